@@ -0,0 +1,509 @@
+﻿#include "bvh.h"
+#include "../log/log.h"
+#include "glm/common.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#ifdef ENABLE_BENCHMARKS
+#include "glm/gtc/matrix_transform.hpp"
+#include <random>
+#include <stdexcept>
+#endif
+
+using Utility::Log;
+using std::max;
+using std::min;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+namespace Culling {
+    static const uint32_t NO_NODE = UINT32_MAX;
+    static const uint32_t BINS    = 16;
+    // Leaves this small are never split; up to the larger size they are kept whenever splitting costs more.
+    static const uint32_t MIN_LEAF_OBJECTS = 2;
+    static const uint32_t MAX_LEAF_OBJECTS = 8;
+    // Cost of visiting a node relative to testing an object.
+    static const float    TRAVERSAL_COST = 1.0f;
+    // Below this, threads cost more than they save.
+    static const uint32_t PARALLEL_BUILD_OBJECTS = 4096;
+
+    static float HalfArea(const vec3& min, const vec3& max)
+    {
+        vec3 d = max - min;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    // Entry distance of the ray into the box if it enters within [0, maxDistance].
+    static bool Slab(const vec3& min, const vec3& max, const vec3& origin, const vec3& inverseDirection, float maxDistance, float& distance)
+    {
+        vec3 t0 = (min - origin) * inverseDirection;
+        vec3 t1 = (max - origin) * inverseDirection;
+        vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+        float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exit  = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+        distance = enter;
+        return enter <= exit;
+    }
+
+    void Bvh::Build(const Bounds& bounds)
+    {
+        auto start = steady_clock::now();
+        uint32_t count = static_cast<uint32_t>(bounds.Size());
+        _centers.resize(count);
+        _extents.resize(count);
+        _objects.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            _centers[i] = bounds.Center(i);
+            _extents[i] = bounds.Extent(i);
+            _objects[i] = i;
+        }
+        _nodes.clear();
+        if (count > 0) {
+            _nodes.reserve(2 * count);
+            _nodes.push_back({});
+            vector<Subtree> deferred;
+            bool parallel = _threads && _threads->ThreadCount() > 1 && count >= PARALLEL_BUILD_OBJECTS;
+            // Enough subtrees for every thread to have a few, as they are seldom balanced.
+            uint32_t splitDepth = 0;
+            while (parallel && (1u << splitDepth) < 4 * _threads->ThreadCount()) {
+                splitDepth++;
+            }
+            Split(_nodes, 0, 0, count, 0, parallel ? &deferred : nullptr, splitDepth);
+            if (!deferred.empty()) {
+                vector<vector<Node>> subtrees(deferred.size());
+                _threads->Run(static_cast<uint32_t>(deferred.size()), [this, &deferred, &subtrees](uint32_t task, uint32_t) {
+                    const Subtree& subtree = deferred[task];
+                    subtrees[task].push_back({});
+                    Split(subtrees[task], 0, subtree.begin, subtree.end, subtree.depth, nullptr, 0);
+                });
+                // Each subtree's root replaces its placeholder, the rest is appended.
+                for (size_t i = 0; i < deferred.size(); i++) {
+                    uint32_t offset = static_cast<uint32_t>(_nodes.size()) - 1;
+                    for (size_t n = 0; n < subtrees[i].size(); n++) {
+                        Node node = subtrees[i][n];
+                        if (node.count == 0) {
+                            node.first += offset;
+                        }
+                        if (n == 0) {
+                            _nodes[deferred[i].node] = node;
+                        } else {
+                            _nodes.push_back(node);
+                        }
+                    }
+                }
+            }
+        }
+        Link();
+        _statistics.buildMilliseconds = duration<float, std::milli>(steady_clock::now() - start).count();
+    }
+
+    Bvh::Box Bvh::Enclose(uint32_t begin, uint32_t end) const
+    {
+        Box box = { vec3(FLT_MAX), vec3(-FLT_MAX) };
+        for (uint32_t i = begin; i < end; i++) {
+            uint32_t object = _objects[i];
+            box.min = glm::min(box.min, _centers[object] - _extents[object]);
+            box.max = glm::max(box.max, _centers[object] + _extents[object]);
+        }
+        return box;
+    }
+
+    void Bvh::Split(vector<Node>& nodes, uint32_t node, uint32_t begin, uint32_t end, uint32_t depth, vector<Subtree>* deferred, uint32_t splitDepth)
+    {
+        uint32_t count = end - begin;
+        nodes[node] = { Enclose(begin, end), begin, count };
+        if (count <= MIN_LEAF_OBJECTS) {
+            return;
+        }
+        if (deferred && depth == splitDepth) {
+            deferred->push_back({ node, begin, end, depth });
+            return;
+        }
+
+        // Bin the centroids along each axis and sweep the bins for the split with the lowest expected cost.
+        vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for (uint32_t i = begin; i < end; i++) {
+            centroidMin = glm::min(centroidMin, _centers[_objects[i]]);
+            centroidMax = glm::max(centroidMax, _centers[_objects[i]]);
+        }
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        uint32_t bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            float span = centroidMax[axis] - centroidMin[axis];
+            if (span <= 0.0f) {
+                continue;
+            }
+            float scale = BINS / span;
+            Box binBoxes[BINS];
+            uint32_t binCounts[BINS] = {};
+            for (Box& box : binBoxes) {
+                box = { vec3(FLT_MAX), vec3(-FLT_MAX) };
+            }
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t object = _objects[i];
+                uint32_t bin = min(BINS - 1, static_cast<uint32_t>((_centers[object][axis] - centroidMin[axis]) * scale));
+                binCounts[bin]++;
+                binBoxes[bin].min = glm::min(binBoxes[bin].min, _centers[object] - _extents[object]);
+                binBoxes[bin].max = glm::max(binBoxes[bin].max, _centers[object] + _extents[object]);
+            }
+            // rightCosts[i] covers bins i + 1 and up.
+            float rightCosts[BINS];
+            Box right = { vec3(FLT_MAX), vec3(-FLT_MAX) };
+            uint32_t rightCount = 0;
+            for (uint32_t i = BINS - 1; i > 0; i--) {
+                right.min = glm::min(right.min, binBoxes[i].min);
+                right.max = glm::max(right.max, binBoxes[i].max);
+                rightCount += binCounts[i];
+                rightCosts[i - 1] = rightCount ? HalfArea(right.min, right.max) * rightCount : 0.0f;
+            }
+            Box left = { vec3(FLT_MAX), vec3(-FLT_MAX) };
+            uint32_t leftCount = 0;
+            for (uint32_t i = 0; i + 1 < BINS; i++) {
+                left.min = glm::min(left.min, binBoxes[i].min);
+                left.max = glm::max(left.max, binBoxes[i].max);
+                leftCount += binCounts[i];
+                if (leftCount == 0 || leftCount == count) {
+                    continue;
+                }
+                float cost = HalfArea(left.min, left.max) * leftCount + rightCosts[i];
+                if (cost < bestCost) {
+                    bestCost = cost, bestAxis = axis, bestSplit = i + 1;
+                }
+            }
+        }
+
+        const Box& box = nodes[node].box;
+        float area = HalfArea(box.min, box.max);
+        bestCost = area > 0.0f ? TRAVERSAL_COST + bestCost / area : FLT_MAX;
+        uint32_t middle;
+        if (bestAxis >= 0 && (bestCost < count || count > MAX_LEAF_OBJECTS)) {
+            float scale = BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+            float axisMin = centroidMin[bestAxis];
+            middle = static_cast<uint32_t>(std::partition(_objects.begin() + begin, _objects.begin() + end, [&](uint32_t object) {
+                return min(BINS - 1, static_cast<uint32_t>((_centers[object][bestAxis] - axisMin) * scale)) < bestSplit;
+            }) - _objects.begin());
+        } else if (count > MAX_LEAF_OBJECTS) {
+            // Every centroid in the same spot: halve the list.
+            middle = begin + count / 2;
+        } else {
+            return;
+        }
+
+        uint32_t children = static_cast<uint32_t>(nodes.size());
+        nodes.resize(nodes.size() + 2);
+        nodes[node].first = children;
+        nodes[node].count = 0;
+        Split(nodes, children, begin, middle, depth + 1, deferred, splitDepth);
+        Split(nodes, children + 1, middle, end, depth + 1, deferred, splitDepth);
+    }
+
+    void Bvh::Link()
+    {
+        _parents.assign(_nodes.size(), NO_NODE);
+        _leaves.assign(_centers.size(), NO_NODE);
+        _dirty.assign(_nodes.size(), 0);
+        _dirtyLeaves.clear();
+        vector<uint32_t> depths(_nodes.size(), 1);
+        _statistics.nodes  = static_cast<uint32_t>(_nodes.size());
+        _statistics.leaves = 0;
+        _statistics.depth  = 0;
+        for (uint32_t i = 0; i < _nodes.size(); i++) {
+            const Node& node = _nodes[i];
+            _statistics.depth = max(_statistics.depth, depths[i]);
+            if (node.count == 0) {
+                _parents[node.first] = _parents[node.first + 1] = i;
+                depths[node.first] = depths[node.first + 1] = depths[i] + 1;
+            } else {
+                _statistics.leaves++;
+                for (uint32_t o = node.first; o < node.first + node.count; o++) {
+                    _leaves[_objects[o]] = i;
+                }
+            }
+        }
+    }
+
+    void Bvh::Update(uint32_t object, const vec3& min, const vec3& max)
+    {
+        _centers[object] = (min + max) * 0.5f;
+        _extents[object] = (max - min) * 0.5f;
+        uint32_t leaf = _leaves[object];
+        if (!_dirty[leaf]) {
+            _dirty[leaf] = 1;
+            _dirtyLeaves.push_back(leaf);
+        }
+    }
+
+    void Bvh::RefitNode(uint32_t node)
+    {
+        Node& n = _nodes[node];
+        if (n.count > 0) {
+            n.box = Enclose(n.first, n.first + n.count);
+        } else {
+            n.box.min = glm::min(_nodes[n.first].box.min, _nodes[n.first + 1].box.min);
+            n.box.max = glm::max(_nodes[n.first].box.max, _nodes[n.first + 1].box.max);
+        }
+    }
+
+    void Bvh::Refit()
+    {
+        auto start = steady_clock::now();
+        if (_dirtyLeaves.size() * 4 > _nodes.size()) {
+            // Most of the tree moved; children come after their parents, so one backward sweep refits everything.
+            for (uint32_t node = static_cast<uint32_t>(_nodes.size()); node-- > 0;) {
+                RefitNode(node);
+            }
+        } else {
+            // Walk up from each moved leaf until a node keeps its box.
+            for (uint32_t leaf : _dirtyLeaves) {
+                for (uint32_t node = leaf; node != NO_NODE; node = _parents[node]) {
+                    Box before = _nodes[node].box;
+                    RefitNode(node);
+                    const Box& after = _nodes[node].box;
+                    if (node != leaf && before.min == after.min && before.max == after.max) {
+                        break;
+                    }
+                }
+            }
+        }
+        for (uint32_t leaf : _dirtyLeaves) {
+            _dirty[leaf] = 0;
+        }
+        _dirtyLeaves.clear();
+        _statistics.refitMilliseconds = duration<float, std::milli>(steady_clock::now() - start).count();
+    }
+
+    bool Bvh::Visible(const Frustum& frustum, uint32_t planes, uint32_t object) const
+    {
+        const vec3& c = _centers[object];
+        const vec3& e = _extents[object];
+        for (int p = 0; p < 6; p++) {
+            if (!(planes & (1u << p))) {
+                continue;
+            }
+            const vec4& plane = frustum.planes[p];
+            float distance = plane.x * c.x + (plane.y * c.y + (plane.z * c.z + plane.w));
+            distance = std::fabs(plane.x) * e.x + (std::fabs(plane.y) * e.y + (std::fabs(plane.z) * e.z + distance));
+            if (distance < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Bvh::MarkVisible(uint32_t node, vector<uint8_t>& visible) const
+    {
+        const Node& n = _nodes[node];
+        if (n.count > 0) {
+            for (uint32_t o = n.first; o < n.first + n.count; o++) {
+                visible[_objects[o]] = 1;
+            }
+        } else {
+            MarkVisible(n.first, visible);
+            MarkVisible(n.first + 1, visible);
+        }
+    }
+
+    size_t Bvh::Cull(const Frustum& frustum, vector<uint8_t>& visible) const
+    {
+        visible.assign(_centers.size(), 0);
+        if (_nodes.empty()) {
+            return 0;
+        }
+        // Planes a node lies entirely inside of are not tested again below it.
+        vector<std::pair<uint32_t, uint32_t>> stack;
+        stack.reserve(64);
+        stack.emplace_back(0, 0x3F);
+        while (!stack.empty()) {
+            uint32_t node = stack.back().first, planes = stack.back().second;
+            stack.pop_back();
+            const Node& n = _nodes[node];
+            vec3 center = (n.box.min + n.box.max) * 0.5f;
+            vec3 extent = (n.box.max - n.box.min) * 0.5f;
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; p++) {
+                if (!(planes & (1u << p))) {
+                    continue;
+                }
+                const vec4& plane = frustum.planes[p];
+                float distance = glm::dot(vec3(plane), center) + plane.w;
+                float radius = glm::dot(glm::abs(vec3(plane)), extent);
+                if (distance + radius < 0.0f) {
+                    outside = true;
+                } else if (distance - radius >= 0.0f) {
+                    planes &= ~(1u << p);
+                }
+            }
+            if (outside) {
+                continue;
+            }
+            if (planes == 0) {
+                MarkVisible(node, visible);
+            } else if (n.count > 0) {
+                for (uint32_t o = n.first; o < n.first + n.count; o++) {
+                    visible[_objects[o]] = Visible(frustum, planes, _objects[o]);
+                }
+            } else {
+                stack.emplace_back(n.first, planes);
+                stack.emplace_back(n.first + 1, planes);
+            }
+        }
+        return static_cast<size_t>(std::count(visible.begin(), visible.end(), 1));
+    }
+
+    bool Bvh::Raycast(const vec3& origin, const vec3& direction, float maxDistance, Hit& hit) const
+    {
+        float entry;
+        vec3 inverseDirection = 1.0f / direction;
+        if (_nodes.empty() || !Slab(_nodes[0].box.min, _nodes[0].box.max, origin, inverseDirection, maxDistance, entry)) {
+            return false;
+        }
+        float nearest = maxDistance;
+        bool found = false;
+        vector<std::pair<uint32_t, float>> stack;
+        stack.reserve(64);
+        stack.emplace_back(0, entry);
+        while (!stack.empty()) {
+            uint32_t node = stack.back().first;
+            float nodeEntry = stack.back().second;
+            stack.pop_back();
+            if (nodeEntry > nearest) {
+                continue;
+            }
+            const Node& n = _nodes[node];
+            if (n.count > 0) {
+                for (uint32_t o = n.first; o < n.first + n.count; o++) {
+                    uint32_t object = _objects[o];
+                    if (Slab(_centers[object] - _extents[object], _centers[object] + _extents[object], origin, inverseDirection, nearest, entry)) {
+                        nearest = entry, found = true;
+                        hit = { object, entry };
+                    }
+                }
+                continue;
+            }
+            // The nearer child goes on top so its hits prune the farther one.
+            float entries[2];
+            bool entered[2];
+            for (uint32_t c = 0; c < 2; c++) {
+                const Box& box = _nodes[n.first + c].box;
+                entered[c] = Slab(box.min, box.max, origin, inverseDirection, nearest, entries[c]);
+            }
+            uint32_t nearer = entered[0] && entered[1] ? (entries[1] < entries[0] ? 1 : 0) : (entered[0] ? 0 : 1);
+            if (entered[1 - nearer]) {
+                stack.emplace_back(n.first + 1 - nearer, entries[1 - nearer]);
+            }
+            if (entered[nearer]) {
+                stack.emplace_back(n.first + nearer, entries[nearer]);
+            }
+        }
+        return found;
+    }
+
+#ifdef ENABLE_BENCHMARKS
+    // Average milliseconds of one call, repeated until the timing is well above the clock's resolution.
+    template <typename F>
+    static float Milliseconds(const F& f)
+    {
+        uint32_t runs = 0;
+        auto start = steady_clock::now();
+        duration<float, std::milli> elapsed(0.0f);
+        do {
+            f();
+            runs++;
+            elapsed = steady_clock::now() - start;
+        } while (elapsed.count() < 20.0f);
+        return elapsed.count() / runs;
+    }
+
+    void RunBvhBenchmark(ThreadPool* threads)
+    {
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> size(0.25f, 1.0f);
+        for (uint32_t count : { 1000, 10000, 100000 }) {
+            // The same density at every count.
+            float side = 8.0f * std::cbrt(static_cast<float>(count));
+            Bounds bounds;
+            for (uint32_t i = 0; i < count; i++) {
+                vec3 center = vec3(unit(random), unit(random), unit(random)) * side;
+                vec3 extent(size(random), size(random), size(random));
+                bounds.Add(center - extent, center + extent);
+            }
+            Bvh serial, bvh(threads);
+            float serialBuild = Milliseconds([&]() { serial.Build(bounds); });
+            float build = Milliseconds([&]() { bvh.Build(bounds); });
+
+            // A tenth of the objects moves back and forth.
+            float offset = 0.5f;
+            float refit = Milliseconds([&]() {
+                for (uint32_t i = 0; i < count; i += 10) {
+                    vec3 center = bounds.Center(i) + vec3(offset, 0.0f, 0.0f), extent = bounds.Extent(i);
+                    bvh.Update(i, center - extent, center + extent);
+                }
+                bvh.Refit();
+                offset = -offset;
+            });
+            bvh.Build(bounds);
+
+            mat4 view = glm::lookAt(vec3(0.0f), vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+            Frustum frustum = FrustumFromMatrix(glm::perspective(glm::radians(90.0f), 1.0f, 0.125f, side) * view);
+            vector<uint8_t> visible, reference;
+            size_t visibleCount = bvh.Cull(frustum, visible);
+            CullBoxesScalar(frustum, bounds, reference);
+            if (visible != reference) {
+                Log::Error("BVH: frustum culling differs from the flat list.");
+                throw std::runtime_error("BVH frustum culling differs from the flat list");
+            }
+            float cull = Milliseconds([&]() { bvh.Cull(frustum, visible); });
+            float flatCull = Milliseconds([&]() { CullBoxes(frustum, bounds, reference); });
+
+            vector<vec3> origins, directions;
+            for (int i = 0; i < 256; i++) {
+                origins.push_back(vec3(unit(random), unit(random), unit(random)) * side);
+                directions.push_back(glm::normalize(vec3(unit(random), unit(random), unit(random))));
+            }
+            int hits = 0, mismatches = 0;
+            for (size_t r = 0; r < origins.size(); r++) {
+                Bvh::Hit hit, flatHit = { 0, side };
+                bool found = bvh.Raycast(origins[r], directions[r], side, hit);
+                bool flatFound = false;
+                float entry;
+                for (uint32_t i = 0; i < count; i++) {
+                    if (Slab(bounds.Center(i) - bounds.Extent(i), bounds.Center(i) + bounds.Extent(i), origins[r], 1.0f / directions[r], flatHit.distance, entry)) {
+                        flatHit = { i, entry }, flatFound = true;
+                    }
+                }
+                hits += found;
+                mismatches += found != flatFound || (found && hit.distance != flatHit.distance);
+            }
+            if (mismatches > 0) {
+                Log::Error("BVH: %d of %d rays hit differently than against the flat list.", mismatches, static_cast<int>(origins.size()));
+                throw std::runtime_error("BVH raycasts differ from the flat list");
+            }
+            float rays = Milliseconds([&]() {
+                Bvh::Hit hit;
+                for (size_t r = 0; r < origins.size(); r++) {
+                    bvh.Raycast(origins[r], directions[r], side, hit);
+                }
+            });
+            float flatRays = Milliseconds([&]() {
+                float entry;
+                for (size_t r = 0; r < origins.size(); r++) {
+                    float nearest = side;
+                    vec3 inverseDirection = 1.0f / directions[r];
+                    for (uint32_t i = 0; i < count; i++) {
+                        if (Slab(bounds.Center(i) - bounds.Extent(i), bounds.Center(i) + bounds.Extent(i), origins[r], inverseDirection, nearest, entry)) {
+                            nearest = entry;
+                        }
+                    }
+                }
+            });
+            Log::Info("BVH over %d objects: %d nodes, depth %d. Build %.2f ms (%.2f ms on one thread), refit of a tenth %.3f ms.",
+                      count, bvh.Stats().nodes, bvh.Stats().depth, build, serialBuild, refit);
+            Log::Info("BVH over %d objects: frustum with %d visible %.3f ms (flat %.3f ms), %d rays with %d hits %.3f ms (flat %.3f ms).",
+                      count, static_cast<int>(visibleCount), cull, flatCull, static_cast<int>(origins.size()), hits, rays, flatRays);
+        }
+    }
+#endif
+}
@@ -0,0 +1,98 @@
+﻿#ifndef CULLING_BVH_H
+#define CULLING_BVH_H
+
+#include "frustum_culling.h"
+#include "../thread/thread_pool.h"
+
+using Utility::ThreadPool;
+
+namespace Culling {
+    // Bounding volume hierarchy over world space boxes. Build() splits by the surface area heuristic over binned
+    // centroids, with the subtrees below the first few splits built on threads. Moving objects are refit with Update()
+    // and Refit(), which keeps the topology; rebuild once they have moved far enough for it to go stale.
+    class Bvh
+    {
+    public:
+        typedef struct Hit {
+            uint32_t object;
+            float    distance;
+        } Hit;
+
+        typedef struct Statistics {
+            uint32_t nodes;
+            uint32_t leaves;
+            uint32_t depth;
+            float    buildMilliseconds;
+            float    refitMilliseconds;
+        } Statistics;
+
+        explicit Bvh(ThreadPool* threads = nullptr) : _threads(threads) {}
+
+        // Object i is bounds[i].
+        void Build(const Bounds& bounds);
+        void Update(uint32_t object, const vec3& min, const vec3& max);
+        // Grows and shrinks the nodes above the objects updated since the last refit.
+        void Refit();
+
+        // Set visible[i] to 1 if object i may intersect the frustum and to 0 otherwise, like CullBoxes(), and return
+        // the number of visible objects.
+        size_t Cull(const Frustum& frustum, vector<uint8_t>& visible) const;
+        // The nearest object whose box the ray enters within maxDistance. direction needs not be normalized; the
+        // distance is in multiples of it.
+        bool Raycast(const vec3& origin, const vec3& direction, float maxDistance, Hit& hit) const;
+        bool IntersectSegment(const vec3& from, const vec3& to, Hit& hit) const { return Raycast(from, to - from, 1.0f, hit); }
+
+        size_t Size() const { return _centers.size(); }
+        const Statistics& Stats() const { return _statistics; }
+
+    private:
+        // Nodes are boxes; objects keep center and extent like Bounds, so they are tested exactly like CullBoxes().
+        typedef struct Box {
+            vec3 min;
+            vec3 max;
+        } Box;
+
+        bool Visible(const Frustum& frustum, uint32_t planes, uint32_t object) const;
+        void MarkVisible(uint32_t node, vector<uint8_t>& visible) const;
+
+        // Leaves hold count objects from _objects[first]; inner nodes have count 0 and their children at first and
+        // first + 1. Children always come after their parent.
+        typedef struct Node {
+            Box      box;
+            uint32_t first;
+            uint32_t count;
+        } Node;
+
+        typedef struct Subtree {
+            uint32_t node;
+            uint32_t begin, end;
+            uint32_t depth;
+        } Subtree;
+
+        // Splits nodes[node] over _objects[begin, end). Subtrees at splitDepth are appended to deferred instead of
+        // being split further, if deferred is given.
+        void Split(vector<Node>& nodes, uint32_t node, uint32_t begin, uint32_t end, uint32_t depth, vector<Subtree>* deferred, uint32_t splitDepth);
+        Box Enclose(uint32_t begin, uint32_t end) const;
+        void RefitNode(uint32_t node);
+        void Link();
+
+        ThreadPool*      _threads;
+        vector<vec3>     _centers, _extents;
+        vector<uint32_t> _objects;
+        vector<Node>     _nodes;
+        vector<uint32_t> _parents;
+        // The leaf holding each object.
+        vector<uint32_t> _leaves;
+        vector<uint32_t> _dirtyLeaves;
+        vector<uint8_t>  _dirty;
+        Statistics       _statistics = {};
+    };
+
+#ifdef ENABLE_BENCHMARKS
+    // Logs build, refit, frustum and ray query times against the flat list for increasing object counts and checks
+    // that both give the same answers.
+    void RunBvhBenchmark(ThreadPool* threads);
+#endif
+}
+
+#endif // CULLING_BVH_H
@@ -0,0 +1,293 @@
+﻿#include "frustum_culling.h"
+#include "simd.h"
+#include "../log/log.h"
+#include "glm/common.hpp"
+#include "glm/vec2.hpp"
+#include "glm/matrix.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#ifdef ENABLE_BENCHMARKS
+#include "glm/gtc/matrix_transform.hpp"
+#include <chrono>
+#include <random>
+#endif
+
+using Utility::Log;
+using glm::vec2;
+using std::max;
+using std::min;
+
+namespace Culling {
+    uint32_t Bounds::Add(const vec3& min, const vec3& max)
+    {
+        vec3 center = (min + max) * 0.5f;
+        vec3 extent = (max - min) * 0.5f;
+        if (_count == centerX.size()) {
+            size_t size = _count + PADDING;
+            for (vector<float>* v : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius }) {
+                v->resize(size, 0.0f);
+            }
+        }
+        centerX[_count] = center.x, centerY[_count] = center.y, centerZ[_count] = center.z;
+        extentX[_count] = extent.x, extentY[_count] = extent.y, extentZ[_count] = extent.z;
+        radius[_count]  = glm::length(extent);
+        return static_cast<uint32_t>(_count++);
+    }
+
+    void Bounds::Clear()
+    {
+        for (vector<float>* v : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius }) {
+            v->clear();
+        }
+        _count = 0;
+    }
+
+    static vec4 Normalize(const vec4& plane)
+    {
+        return plane / glm::length(vec3(plane));
+    }
+
+    Frustum FrustumFromMatrix(const mat4& m)
+    {
+        vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        Frustum frustum;
+        frustum.planes[0] = Normalize(row3 + row0);
+        frustum.planes[1] = Normalize(row3 - row0);
+        frustum.planes[2] = Normalize(row3 + row1);
+        frustum.planes[3] = Normalize(row3 - row1);
+        frustum.planes[4] = Normalize(row2);
+        frustum.planes[5] = Normalize(row3 - row2);
+        return frustum;
+    }
+
+    Frustum CombinedStereoFrustum(const mat4& lView, const mat4& lProjection, const mat4& rView, const mat4& rProjection)
+    {
+        // Gather the corners of both frusta in the left eye's view space, where either one spans the same depths.
+        float nearDepth = FLT_MAX, farDepth = 0.0f;
+        vec2 nearMin(FLT_MAX), nearMax(-FLT_MAX), farMin(FLT_MAX), farMax(-FLT_MAX);
+        mat4 toLeft[2] = { glm::inverse(lProjection), lView * glm::inverse(rProjection * rView) };
+        for (const mat4& m : toLeft) {
+            for (int corner = 0; corner < 8; corner++) {
+                vec4 p = m * vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : 0.0f, 1.0f);
+                p /= p.w;
+                float depth = -p.z;
+                bool nearCorner = (corner & 4) == 0;
+                vec2& lo = nearCorner ? nearMin : farMin;
+                vec2& hi = nearCorner ? nearMax : farMax;
+                lo = glm::min(lo, vec2(p));
+                hi = glm::max(hi, vec2(p));
+                if (nearCorner) {
+                    nearDepth = min(nearDepth, depth);
+                } else {
+                    farDepth = max(farDepth, depth);
+                }
+            }
+        }
+        // Each side of the union bends inwards along depth, so the plane through its near and far extremes encloses
+        // it. A point at depth d = -z is inside a side if it lies beyond the line between both extremes.
+        Frustum frustum;
+        float span = farDepth - nearDepth;
+        for (int axis = 0; axis < 2; axis++) {
+            float lowSlope  = (farMin[axis] - nearMin[axis]) / span;
+            float highSlope = (farMax[axis] - nearMax[axis]) / span;
+            vec4 low(0.0f), high(0.0f);
+            low[axis]  = 1.0f;
+            low.z      = lowSlope;
+            low.w      = lowSlope * nearDepth - nearMin[axis];
+            high[axis] = -1.0f;
+            high.z     = -highSlope;
+            high.w     = nearMax[axis] - highSlope * nearDepth;
+            frustum.planes[2 * axis]     = low;
+            frustum.planes[2 * axis + 1] = high;
+        }
+        frustum.planes[4] = vec4(0.0f, 0.0f, -1.0f, -nearDepth);
+        frustum.planes[5] = vec4(0.0f, 0.0f, 1.0f, farDepth);
+        // Planes transform with the transpose of the point transform's inverse, here from view to world space.
+        mat4 viewTranspose = glm::transpose(lView);
+        for (vec4& plane : frustum.planes) {
+            plane = Normalize(viewTranspose * plane);
+        }
+        return frustum;
+    }
+
+    Frustum ToModelSpace(const Frustum& frustum, const mat4& model)
+    {
+        Frustum result;
+        mat4 modelTranspose = glm::transpose(model);
+        for (int i = 0; i < 6; i++) {
+            result.planes[i] = Normalize(modelTranspose * frustum.planes[i]);
+        }
+        return result;
+    }
+
+    size_t CullBoxesScalar(const Frustum& frustum, const Bounds& bounds, vector<uint8_t>& visible)
+    {
+        size_t count = bounds.Size(), visibleCount = 0;
+        visible.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++) {
+                const vec4& plane = frustum.planes[p];
+                float distance = plane.x * bounds.centerX[i] + (plane.y * bounds.centerY[i] + (plane.z * bounds.centerZ[i] + plane.w));
+                distance = std::fabs(plane.x) * bounds.extentX[i] + (std::fabs(plane.y) * bounds.extentY[i] + (std::fabs(plane.z) * bounds.extentZ[i] + distance));
+                inside = distance >= 0.0f;
+            }
+            visible[i] = inside;
+            visibleCount += inside;
+        }
+        return visibleCount;
+    }
+
+    size_t CullSpheresScalar(const Frustum& frustum, const Bounds& bounds, vector<uint8_t>& visible)
+    {
+        size_t count = bounds.Size(), visibleCount = 0;
+        visible.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++) {
+                const vec4& plane = frustum.planes[p];
+                float distance = plane.x * bounds.centerX[i] + (plane.y * bounds.centerY[i] + (plane.z * bounds.centerZ[i] + plane.w));
+                inside = bounds.radius[i] + distance >= 0.0f;
+            }
+            visible[i] = inside;
+            visibleCount += inside;
+        }
+        return visibleCount;
+    }
+
+    // ==== Vector kernels ==== //
+    // Lanes::WIDTH objects per iteration. Multiplies and adds stay separate and in the scalar loops' order, so both
+    // agree bit for bit.
+#ifdef CULLING_VECTORIZED
+    // Writes the lanes of one batch that are within bounds and returns how many of them are visible.
+    static size_t Store(uint32_t bits, size_t first, size_t count, vector<uint8_t>& visible)
+    {
+        size_t end = min(first + Lanes::WIDTH, count), visibleCount = 0;
+        for (size_t i = first; i < end; i++) {
+            uint8_t inside = (bits >> (i - first)) & 1;
+            visible[i] = inside;
+            visibleCount += inside;
+        }
+        return visibleCount;
+    }
+
+    template <bool Boxes>
+    static size_t CullVectorized(const Frustum& frustum, const Bounds& bounds, vector<uint8_t>& visible)
+    {
+        size_t count = bounds.Size(), visibleCount = 0;
+        visible.resize(count);
+        Lanes::Value nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+        for (int p = 0; p < 6; p++) {
+            const vec4& plane = frustum.planes[p];
+            nx[p] = Lanes::Splat(plane.x), ny[p] = Lanes::Splat(plane.y), nz[p] = Lanes::Splat(plane.z), nw[p] = Lanes::Splat(plane.w);
+            ax[p] = Lanes::Splat(std::fabs(plane.x)), ay[p] = Lanes::Splat(std::fabs(plane.y)), az[p] = Lanes::Splat(std::fabs(plane.z));
+        }
+        // The arrays are padded, so the last batch reads whole vectors too.
+        for (size_t i = 0; i < count; i += Lanes::WIDTH) {
+            Lanes::Value cx = Lanes::Load(&bounds.centerX[i]);
+            Lanes::Value cy = Lanes::Load(&bounds.centerY[i]);
+            Lanes::Value cz = Lanes::Load(&bounds.centerZ[i]);
+            Lanes::Value ex = Lanes::Splat(0.0f), ey = ex, ez = ex, r = ex;
+            if (Boxes) {
+                ex = Lanes::Load(&bounds.extentX[i]), ey = Lanes::Load(&bounds.extentY[i]), ez = Lanes::Load(&bounds.extentZ[i]);
+            } else {
+                r = Lanes::Load(&bounds.radius[i]);
+            }
+            Lanes::Mask inside = Lanes::All();
+            for (int p = 0; p < 6; p++) {
+                Lanes::Value distance = Lanes::MulAdd(nx[p], cx, Lanes::MulAdd(ny[p], cy, Lanes::MulAdd(nz[p], cz, nw[p])));
+                if (Boxes) {
+                    distance = Lanes::MulAdd(ax[p], ex, Lanes::MulAdd(ay[p], ey, Lanes::MulAdd(az[p], ez, distance)));
+                } else {
+                    distance = Lanes::Add(r, distance);
+                }
+                inside = Lanes::And(inside, Lanes::NotNegative(distance));
+            }
+            visibleCount += Store(Lanes::Bits(inside), i, count, visible);
+        }
+        return visibleCount;
+    }
+#endif
+
+    size_t CullBoxes(const Frustum& frustum, const Bounds& bounds, vector<uint8_t>& visible)
+    {
+#ifdef CULLING_VECTORIZED
+        return CullVectorized<true>(frustum, bounds, visible);
+#else
+        return CullBoxesScalar(frustum, bounds, visible);
+#endif
+    }
+
+    size_t CullSpheres(const Frustum& frustum, const Bounds& bounds, vector<uint8_t>& visible)
+    {
+#ifdef CULLING_VECTORIZED
+        return CullVectorized<false>(frustum, bounds, visible);
+#else
+        return CullSpheresScalar(frustum, bounds, visible);
+#endif
+    }
+
+    const char* InstructionSet()
+    {
+        return InstructionSetName();
+    }
+
+#ifdef ENABLE_BENCHMARKS
+    typedef size_t (*CullFunction)(const Frustum&, const Bounds&, vector<uint8_t>&);
+
+    static float ObjectsPerMillisecond(CullFunction cull, const Frustum& frustum, const Bounds& bounds, vector<uint8_t>& visible)
+    {
+        using namespace std::chrono;
+        // Repeat until the timing is well above the clock's resolution.
+        uint32_t runs = 0;
+        auto start = steady_clock::now();
+        duration<float, std::milli> elapsed(0.0f);
+        do {
+            cull(frustum, bounds, visible);
+            runs++;
+            elapsed = steady_clock::now() - start;
+        } while (elapsed.count() < 50.0f);
+        return bounds.Size() * runs / elapsed.count();
+    }
+
+    void RunBenchmark()
+    {
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> size(0.1f, 4.0f);
+        mat4 view = glm::lookAt(vec3(0.0f), vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum = FrustumFromMatrix(glm::perspective(glm::radians(90.0f), 1.0f, 0.125f, 128.0f) * view);
+        for (size_t count : { 10000, 100000 }) {
+            Bounds bounds;
+            for (size_t i = 0; i < count; i++) {
+                vec3 center(position(random), position(random), position(random));
+                vec3 extent(size(random), size(random), size(random));
+                bounds.Add(center - extent, center + extent);
+            }
+            vector<uint8_t> visible, reference;
+            size_t boxes = CullBoxes(frustum, bounds, visible);
+            CullBoxesScalar(frustum, bounds, reference);
+            if (visible != reference) {
+                // Only expected where the compiler fuses the scalar loop's multiplies and adds, for objects touching a plane.
+                Log::Warn("Culling: %s box results differ from the scalar ones.", InstructionSet());
+            }
+            size_t spheres = CullSpheres(frustum, bounds, visible);
+            CullSpheresScalar(frustum, bounds, reference);
+            if (visible != reference) {
+                // Only expected where the compiler fuses the scalar loop's multiplies and adds, for objects touching a plane.
+                Log::Warn("Culling: %s sphere results differ from the scalar ones.", InstructionSet());
+            }
+            Log::Info("Culling %d objects, %d boxes and %d spheres visible. Objects per ms: boxes %.0f (%s) / %.0f (scalar), spheres %.0f (%s) / %.0f (scalar).",
+                      static_cast<int>(count), static_cast<int>(boxes), static_cast<int>(spheres),
+                      ObjectsPerMillisecond(CullBoxes, frustum, bounds, visible), InstructionSet(),
+                      ObjectsPerMillisecond(CullBoxesScalar, frustum, bounds, visible),
+                      ObjectsPerMillisecond(CullSpheres, frustum, bounds, visible), InstructionSet(),
+                      ObjectsPerMillisecond(CullSpheresScalar, frustum, bounds, visible));
+        }
+    }
+#endif
+}
@@ -0,0 +1,68 @@
+﻿#ifndef CULLING_FRUSTUM_CULLING_H
+#define CULLING_FRUSTUM_CULLING_H
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+#include <cstdint>
+#include <vector>
+
+using glm::vec3;
+using glm::vec4;
+using glm::mat4;
+using std::vector;
+
+namespace Culling {
+    // Axis aligned boxes as center and half extent plus their bounding spheres, one array per coordinate so the
+    // kernels load several objects per instruction. Arrays are padded to a multiple of PADDING.
+    class Bounds
+    {
+    public:
+        static const size_t PADDING = 8;
+
+        uint32_t Add(const vec3& min, const vec3& max);
+        void Clear();
+        size_t Size() const { return _count; }
+
+        vec3 Center(size_t i) const { return vec3(centerX[i], centerY[i], centerZ[i]); }
+        vec3 Extent(size_t i) const { return vec3(extentX[i], extentY[i], extentZ[i]); }
+
+        vector<float> centerX, centerY, centerZ;
+        vector<float> extentX, extentY, extentZ;
+        vector<float> radius;
+
+    private:
+        size_t _count = 0;
+    };
+
+    // Planes with inward unit normals: a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all of them.
+    typedef struct Frustum {
+        vec4 planes[6];
+    } Frustum;
+
+    // The frustum of a projection * view matrix with depth in [0, 1].
+    Frustum FrustumFromMatrix(const mat4& viewProjection);
+    // A frustum containing both eyes' frusta, so a stereo pair is culled once. Both views have to share their
+    // orientation, as parallel stereo cameras do; the projections may be off axis.
+    Frustum CombinedStereoFrustum(const mat4& lView, const mat4& lProjection, const mat4& rView, const mat4& rProjection);
+    // The same frustum in the space of a model with the given transform, which may rotate, translate and scale
+    // uniformly, so bounds can be tested without transforming them.
+    Frustum ToModelSpace(const Frustum& frustum, const mat4& model);
+
+    // Set visible[i] to 1 if object i may intersect the frustum and to 0 if it certainly doesn't, and return the
+    // number of visible objects. Both use the widest vector instructions compiled in: AVX2 for eight objects at a
+    // time, SSE or NEON for four, and a scalar loop otherwise.
+    size_t CullBoxes(const Frustum& frustum, const Bounds& bounds, vector<uint8_t>& visible);
+    size_t CullSpheres(const Frustum& frustum, const Bounds& bounds, vector<uint8_t>& visible);
+    // Scalar references of the above.
+    size_t CullBoxesScalar(const Frustum& frustum, const Bounds& bounds, vector<uint8_t>& visible);
+    size_t CullSpheresScalar(const Frustum& frustum, const Bounds& bounds, vector<uint8_t>& visible);
+    const char* InstructionSet();
+
+#ifdef ENABLE_BENCHMARKS
+    // Logs objects culled per millisecond for 10k and 100k random objects, vectorized and scalar.
+    void RunBenchmark();
+#endif
+}
+
+#endif // CULLING_FRUSTUM_CULLING_H
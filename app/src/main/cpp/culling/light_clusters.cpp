@@ -0,0 +1,306 @@
+﻿#include "light_clusters.h"
+#include "simd.h"
+#include "../log/log.h"
+#include "glm/common.hpp"
+#include "glm/matrix.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#ifdef ENABLE_BENCHMARKS
+#include "glm/gtc/matrix_transform.hpp"
+#include <random>
+#include <stdexcept>
+#endif
+
+using Utility::Log;
+using std::max;
+using std::min;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+namespace Culling {
+    // Lights per task; tasks set different words of the cluster bits, so they need no synchronization.
+    static const uint32_t LIGHT_GROUP = 32;
+    static const uint32_t SLICE_CLUSTERS = LightClusters::TILES_X * LightClusters::TILES_Y;
+
+    vec4 LightBoundingSphere(const Light& light)
+    {
+        vec3 position = vec3(light.positionRange);
+        float range = light.positionRange.w, cosine = light.directionCosine.w;
+        // Cones of 90 degrees and more, point lights included.
+        if (cosine <= 0.0f) {
+            return vec4(position, range);
+        }
+        vec3 direction = vec3(light.directionCosine);
+        // Narrow cones: the sphere through the apex and the rim of the cap. Wide ones: the sphere around the cap's rim,
+        // which still reaches past its top.
+        if (cosine >= 0.70710678f) {
+            float radius = range / (2.0f * cosine);
+            return vec4(position + direction * radius, radius);
+        }
+        return vec4(position + direction * (range * cosine), range * std::sqrt(1.0f - cosine * cosine));
+    }
+
+    // Whether the sphere reaches into the box, as the kernel below and the shader test it.
+    static inline bool Touches(float minX, float minY, float minZ, float maxX, float maxY, float maxZ,
+                               float centerX, float centerY, float centerZ, float radius)
+    {
+        float dx = max(max(minX - centerX, 0.0f), centerX - maxX);
+        float dy = max(max(minY - centerY, 0.0f), centerY - maxY);
+        float dz = max(max(minZ - centerZ, 0.0f), centerZ - maxZ);
+        // Separate statements, so the compiler doesn't fuse them where the vector kernel rounds twice.
+        float distance = dx * dx, y2 = dy * dy, z2 = dz * dz;
+        distance += y2;
+        distance += z2;
+        return distance < radius * radius;
+    }
+
+    void LightClusters::SetProjection(const mat4& projection, float zNear, float zFar)
+    {
+        if (projection == _projection && zNear == _zNear && zFar == _zFar) {
+            return;
+        }
+        _projection = projection, _zNear = zNear, _zFar = zFar;
+        _depthScale = SLICES / std::log(zFar / zNear);
+
+        // Directions through the tile corners, scaled to a view space depth of 1.
+        mat4 inverse = glm::inverse(projection);
+        vector<vec3> corners((TILES_X + 1) * (TILES_Y + 1));
+        for (uint32_t y = 0; y <= TILES_Y; y++) {
+            for (uint32_t x = 0; x <= TILES_X; x++) {
+                vec4 p = inverse * vec4(-1.0f + 2.0f * x / TILES_X, -1.0f + 2.0f * y / TILES_Y, 0.5f, 1.0f);
+                corners[y * (TILES_X + 1) + x] = vec3(p) / -p.z;
+            }
+        }
+
+        for (auto* v : { &_minX, &_minY, &_minZ, &_maxX, &_maxY, &_maxZ }) {
+            v->resize(CLUSTERS);
+        }
+        for (uint32_t z = 0; z < SLICES; z++) {
+            float nearDepth = zNear * std::exp(z / _depthScale), farDepth = zNear * std::exp((z + 1) / _depthScale);
+            for (uint32_t y = 0; y < TILES_Y; y++) {
+                for (uint32_t x = 0; x < TILES_X; x++) {
+                    vec3 low(FLT_MAX), high(-FLT_MAX);
+                    for (uint32_t c = 0; c < 4; c++) {
+                        const vec3& corner = corners[(y + c / 2) * (TILES_X + 1) + x + c % 2];
+                        low  = glm::min(low, glm::min(corner * nearDepth, corner * farDepth));
+                        high = glm::max(high, glm::max(corner * nearDepth, corner * farDepth));
+                    }
+                    uint32_t i = (z * TILES_Y + y) * TILES_X + x;
+                    _minX[i] = low.x, _minY[i] = low.y, _minZ[i] = low.z;
+                    _maxX[i] = high.x, _maxY[i] = high.y, _maxZ[i] = high.z;
+                }
+            }
+        }
+    }
+
+    void LightClusters::TransformLights(const vector<Light>& lights, const mat4& view)
+    {
+        size_t count = lights.size();
+        for (auto* v : { &_centerX, &_centerY, &_centerZ, &_radius }) {
+            v->resize(count);
+        }
+        _firstSlice.resize(count);
+        _endSlice.resize(count);
+        float logNear = std::log(_zNear);
+        for (size_t i = 0; i < count; i++) {
+            vec4 sphere = LightBoundingSphere(lights[i]);
+            vec4 center = view * vec4(vec3(sphere), 1.0f);
+            _centerX[i] = center.x, _centerY[i] = center.y, _centerZ[i] = center.z, _radius[i] = sphere.w;
+            // One slice of margin on either side, so that rounding never drops a slice the box test accepts.
+            float nearest = max(-center.z - sphere.w, _zNear), farthest = max(-center.z + sphere.w, _zNear);
+            int first = static_cast<int>((std::log(nearest) - logNear) * _depthScale) - 1;
+            int last  = static_cast<int>(min((std::log(farthest) - logNear) * _depthScale, static_cast<float>(SLICES))) + 1;
+            _firstSlice[i] = static_cast<uint32_t>(max(first, 0));
+            _endSlice[i]   = static_cast<uint32_t>(min(last + 1, static_cast<int>(SLICES)));
+        }
+    }
+
+    void LightClusters::Assign(const vector<Light>& lights, const mat4& view)
+    {
+        auto start = steady_clock::now();
+        TransformLights(lights, view);
+        uint32_t count = static_cast<uint32_t>(lights.size());
+        _words = (count + 31) / 32;
+        _bits.assign(CLUSTERS * _words, 0);
+
+        uint32_t groups = (count + LIGHT_GROUP - 1) / LIGHT_GROUP;
+        auto assign = [this, count](uint32_t group, uint32_t) {
+            AssignLights(group * LIGHT_GROUP, min(count, (group + 1) * LIGHT_GROUP));
+        };
+        if (_threads && groups > 1) {
+            _threads->Run(groups, assign);
+        } else {
+            for (uint32_t group = 0; group < groups; group++) {
+                assign(group, 0);
+            }
+        }
+        Compact();
+        _statistics.lights             = count;
+        _statistics.assignMilliseconds = duration<float, std::milli>(steady_clock::now() - start).count();
+    }
+
+    void LightClusters::AssignLights(uint32_t firstLight, uint32_t endLight)
+    {
+        for (uint32_t l = firstLight; l < endLight; l++) {
+            uint32_t word = l / 32, bit = 1u << (l % 32);
+            float cx = _centerX[l], cy = _centerY[l], cz = _centerZ[l], r = _radius[l];
+            uint32_t first = _firstSlice[l] * SLICE_CLUSTERS, end = _endSlice[l] * SLICE_CLUSTERS;
+#ifdef CULLING_VECTORIZED
+            // Slices hold a multiple of the vector width.
+            Lanes::Value centerX = Lanes::Splat(cx), centerY = Lanes::Splat(cy), centerZ = Lanes::Splat(cz);
+            Lanes::Value radius2 = Lanes::Splat(r * r), zero = Lanes::Splat(0.0f);
+            for (uint32_t c = first; c < end; c += Lanes::WIDTH) {
+                Lanes::Value dx = Lanes::Max(Lanes::Max(Lanes::Sub(Lanes::Load(&_minX[c]), centerX), zero), Lanes::Sub(centerX, Lanes::Load(&_maxX[c])));
+                Lanes::Value dy = Lanes::Max(Lanes::Max(Lanes::Sub(Lanes::Load(&_minY[c]), centerY), zero), Lanes::Sub(centerY, Lanes::Load(&_maxY[c])));
+                Lanes::Value dz = Lanes::Max(Lanes::Max(Lanes::Sub(Lanes::Load(&_minZ[c]), centerZ), zero), Lanes::Sub(centerZ, Lanes::Load(&_maxZ[c])));
+                Lanes::Value distance = Lanes::Mul(dx, dx);
+                distance = Lanes::MulAdd(dy, dy, distance);
+                distance = Lanes::MulAdd(dz, dz, distance);
+                uint32_t touched = Lanes::Bits(Lanes::Less(distance, radius2));
+                while (touched) {
+                    uint32_t lane = __builtin_ctz(touched);
+                    _bits[(c + lane) * _words + word] |= bit;
+                    touched &= touched - 1;
+                }
+            }
+#else
+            for (uint32_t c = first; c < end; c++) {
+                if (Touches(_minX[c], _minY[c], _minZ[c], _maxX[c], _maxY[c], _maxZ[c], cx, cy, cz, r)) {
+                    _bits[c * _words + word] |= bit;
+                }
+            }
+#endif
+        }
+    }
+
+    void LightClusters::Compact()
+    {
+        _ranges.resize(2 * CLUSTERS);
+        uint32_t offset = 0, busiest = 0;
+        for (uint32_t c = 0; c < CLUSTERS; c++) {
+            uint32_t count = 0;
+            for (uint32_t w = 0; w < _words; w++) {
+                count += __builtin_popcount(_bits[c * _words + w]);
+            }
+            _ranges[2 * c]     = offset;
+            _ranges[2 * c + 1] = count;
+            offset += count;
+            busiest = max(busiest, count);
+        }
+        _indices.resize(offset);
+        for (uint32_t c = 0; c < CLUSTERS; c++) {
+            uint32_t* indices = _indices.data() + _ranges[2 * c];
+            for (uint32_t w = 0; w < _words; w++) {
+                for (uint32_t bits = _bits[c * _words + w]; bits; bits &= bits - 1) {
+                    *indices++ = w * 32 + __builtin_ctz(bits);
+                }
+            }
+        }
+        _statistics.indices        = offset;
+        _statistics.busiestCluster = busiest;
+    }
+
+    void LightClusters::AssignBruteForce(const vector<Light>& lights, const mat4& view)
+    {
+        auto start = steady_clock::now();
+        TransformLights(lights, view);
+        uint32_t count = static_cast<uint32_t>(lights.size()), busiest = 0;
+        _ranges.resize(2 * CLUSTERS);
+        _indices.clear();
+        for (uint32_t c = 0; c < CLUSTERS; c++) {
+            _ranges[2 * c] = static_cast<uint32_t>(_indices.size());
+            for (uint32_t l = 0; l < count; l++) {
+                if (Touches(_minX[c], _minY[c], _minZ[c], _maxX[c], _maxY[c], _maxZ[c], _centerX[l], _centerY[l], _centerZ[l], _radius[l])) {
+                    _indices.push_back(l);
+                }
+            }
+            _ranges[2 * c + 1] = static_cast<uint32_t>(_indices.size()) - _ranges[2 * c];
+            busiest = max(busiest, _ranges[2 * c + 1]);
+        }
+        _statistics.lights             = count;
+        _statistics.indices            = static_cast<uint32_t>(_indices.size());
+        _statistics.busiestCluster     = busiest;
+        _statistics.assignMilliseconds = duration<float, std::milli>(steady_clock::now() - start).count();
+    }
+
+#ifdef ENABLE_BENCHMARKS
+    // The cluster a view space point falls into, as the fragment shader finds it.
+    static uint32_t ClusterOf(const mat4& projection, const vec3& position, float zNear, float depthScale)
+    {
+        vec4 clip = projection * vec4(position, 1.0f);
+        int x = static_cast<int>((clip.x / clip.w * 0.5f + 0.5f) * LightClusters::TILES_X);
+        int y = static_cast<int>((clip.y / clip.w * 0.5f + 0.5f) * LightClusters::TILES_Y);
+        int z = static_cast<int>(std::log(-position.z / zNear) * depthScale);
+        x = glm::clamp(x, 0, static_cast<int>(LightClusters::TILES_X) - 1);
+        y = glm::clamp(y, 0, static_cast<int>(LightClusters::TILES_Y) - 1);
+        z = glm::clamp(z, 0, static_cast<int>(LightClusters::SLICES) - 1);
+        return (z * LightClusters::TILES_Y + y) * LightClusters::TILES_X + x;
+    }
+
+    void RunLightClusterBenchmark(ThreadPool* threads)
+    {
+        // An off axis eye as the stereo scene sets it up, looking down -z along a street of lights.
+        float zNear = 0.125f, zFar = 128.0f;
+        mat4 projection = glm::frustum(-0.075f, 0.05f, -0.0518f, 0.0518f, zNear, zFar);
+        projection[1][1] *= -1;
+        mat4 view = glm::lookAt(vec3(0.0f, 1.7f, 0.0f), vec3(0.0f, 1.7f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> across(-24.0f, 24.0f), height(0.0f, 6.0f), along(-120.0f, 4.0f);
+        std::uniform_real_distribution<float> range(1.0f, 8.0f), unit(-1.0f, 1.0f), cone(0.5f, 0.97f);
+        vector<Light> all(1024);
+        for (size_t i = 0; i < all.size(); i++) {
+            Light& light = all[i];
+            light.positionRange = vec4(across(random), height(random), along(random), range(random));
+            vec3 direction = glm::normalize(vec3(unit(random), unit(random) - 1.5f, unit(random)));
+            // Every other light a spot light.
+            light.directionCosine = vec4(direction, i % 2 ? cone(random) : -2.0f);
+            light.color = vec4(1.0f);
+        }
+
+        LightClusters clusters(threads), reference;
+        clusters.SetProjection(projection, zNear, zFar);
+        reference.SetProjection(projection, zNear, zFar);
+        for (uint32_t count = 1; count <= all.size(); count *= 4) {
+            vector<Light> lights(all.begin(), all.begin() + count);
+            const int runs = 16;
+            float milliseconds = 0.0f;
+            for (int run = 0; run < runs; run++) {
+                clusters.Assign(lights, view);
+                milliseconds += clusters.Stats().assignMilliseconds;
+            }
+            reference.AssignBruteForce(lights, view);
+            bool equal = clusters.Ranges() == reference.Ranges() && clusters.Indices() == reference.Indices();
+            Log::Info("Light clusters: %4d lights, %6d indices, at most %3d per cluster, in %.3f ms (%s, %d threads) against %.3f ms brute force%s.",
+                      count, clusters.Stats().indices, clusters.Stats().busiestCluster, milliseconds / runs, InstructionSetName(),
+                      threads ? threads->ThreadCount() : 0, reference.Stats().assignMilliseconds, equal ? ", equal" : "");
+            // A wrong assignment drops lights from the shading, so the benchmark build does not go on with one.
+            if (!equal) {
+                Log::Error("Light clusters: %d lights assigned differently from the brute force assignment.", count);
+                throw std::runtime_error("light cluster assignment differs from the brute force assignment");
+            }
+        }
+
+        // The cluster a light's center shades from lists the light, for the lights in the frustum.
+        clusters.Assign(all, view);
+        uint32_t missing = 0;
+        for (uint32_t i = 0; i < all.size(); i++) {
+            vec3 center = vec3(view * vec4(vec3(all[i].positionRange), 1.0f));
+            vec4 clip = projection * vec4(center, 1.0f);
+            if (-center.z < zNear || -center.z > zFar || std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w) {
+                continue;
+            }
+            uint32_t cluster = ClusterOf(projection, center, zNear, clusters.DepthScale());
+            const uint32_t* first = clusters.Indices().data() + clusters.Ranges()[2 * cluster];
+            const uint32_t* end = first + clusters.Ranges()[2 * cluster + 1];
+            missing += std::find(first, end, i) == end;
+        }
+        if (missing) {
+            Log::Error("Light clusters: %d lights missing from the cluster of their own center.", missing);
+            throw std::runtime_error("lights missing from the cluster of their own center");
+        }
+    }
+#endif
+}
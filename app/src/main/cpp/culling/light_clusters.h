@@ -0,0 +1,88 @@
+﻿#ifndef CULLING_LIGHT_CLUSTERS_H
+#define CULLING_LIGHT_CLUSTERS_H
+
+#include "frustum_culling.h"
+#include "../thread/thread_pool.h"
+
+using Utility::ThreadPool;
+
+namespace Culling {
+    // A point or spot light as the shaders read it (std430). Point lights have a cone cosine of -2, below any angle.
+    typedef struct Light {
+        vec4 positionRange;   // world space position, range in w
+        vec4 directionCosine; // spot direction, normalized, and the cosine of the cone's half angle in w
+        vec4 color;           // premultiplied by intensity; w unused
+    } Light;
+
+    // The sphere enclosing what a light reaches: its range for point lights, the cone's bounds for spot lights.
+    vec4 LightBoundingSphere(const Light& light);
+
+    // Clustered light culling: the view frustum is split into TILES_X x TILES_Y screen tiles and SLICES depth slices,
+    // exponentially spaced between the near and far planes, and every light is assigned to the clusters its bounding
+    // sphere touches. Per cluster the result is a range of Indices(), in light order.
+    //
+    // Cluster i is tile x, y of slice z with i = (z * TILES_Y + y) * TILES_X + x; tiles count from the lowest normalized
+    // device coordinates. A fragment at view space depth d lies in slice floor(log(d / near) * DepthScale()).
+    class LightClusters
+    {
+    public:
+        static const uint32_t TILES_X  = 16;
+        static const uint32_t TILES_Y  = 8;
+        static const uint32_t SLICES   = 24;
+        static const uint32_t CLUSTERS = TILES_X * TILES_Y * SLICES;
+
+        typedef struct Statistics {
+            uint32_t lights;
+            uint32_t indices;
+            uint32_t busiestCluster;
+            float    assignMilliseconds;
+        } Statistics;
+
+        // Lights are split between the threads in groups of 32, or assigned inline without them.
+        explicit LightClusters(ThreadPool* threads = nullptr) : _threads(threads) {}
+
+        // Recomputes the view space cluster bounds if the projection or depth range changed. The projection is any
+        // perspective one, off axis included.
+        void SetProjection(const mat4& projection, float zNear, float zFar);
+        // Assigns world space lights seen through view, testing each against the clusters of the slices it spans
+        // several at a time with the widest vector instructions compiled in.
+        void Assign(const vector<Light>& lights, const mat4& view);
+        // Reference: every cluster against every light, one at a time.
+        void AssignBruteForce(const vector<Light>& lights, const mat4& view);
+
+        // Offset into Indices() and count, two per cluster.
+        const vector<uint32_t>& Ranges() const { return _ranges; }
+        const vector<uint32_t>& Indices() const { return _indices; }
+        float DepthScale() const { return _depthScale; }
+        const Statistics& Stats() const { return _statistics; }
+
+    private:
+        // View space spheres of the lights, one array per coordinate.
+        void TransformLights(const vector<Light>& lights, const mat4& view);
+        void AssignLights(uint32_t firstLight, uint32_t endLight);
+        // Ranges and indices from the light bits of every cluster.
+        void Compact();
+
+        ThreadPool* _threads;
+        mat4        _projection = mat4(0.0f);
+        float       _zNear = 0.0f, _zFar = 0.0f, _depthScale = 0.0f;
+        // View space boxes of the clusters, one array per coordinate in cluster order.
+        vector<float> _minX, _minY, _minZ, _maxX, _maxY, _maxZ;
+        // View space light spheres and the slices they span.
+        vector<float>    _centerX, _centerY, _centerZ, _radius;
+        vector<uint32_t> _firstSlice, _endSlice;
+        // One bit per light for every cluster, _words per cluster.
+        vector<uint32_t> _bits;
+        uint32_t         _words = 0;
+        vector<uint32_t> _ranges;
+        vector<uint32_t> _indices;
+        Statistics       _statistics = {};
+    };
+
+#ifdef ENABLE_BENCHMARKS
+    // Checks the assignment against the brute force one and logs both times for 1 to 1024 lights.
+    void RunLightClusterBenchmark(ThreadPool* threads);
+#endif
+}
+
+#endif // CULLING_LIGHT_CLUSTERS_H
@@ -0,0 +1,411 @@
+﻿#include "occlusion_culler.h"
+#include "simd.h"
+#include "../log/log.h"
+#include "glm/common.hpp"
+#include "glm/vec2.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#ifdef ENABLE_BENCHMARKS
+#include "glm/gtc/matrix_transform.hpp"
+#include <random>
+#include <stdexcept>
+#endif
+
+using glm::vec2;
+using Utility::Log;
+using std::max;
+using std::min;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+namespace Culling {
+    // Rows rasterized per task; bands write disjoint rows, so they need no synchronization.
+    static const uint32_t BAND_ROWS = 16;
+    // The hierarchy test starts this many levels above the one where the bounds cover at most 2x2 texels.
+    static const uint32_t COARSE_LEVELS = 2;
+
+#ifdef CULLING_VECTORIZED
+    static const uint32_t ROW_ALIGNMENT = Lanes::WIDTH;
+#else
+    static const uint32_t ROW_ALIGNMENT = 1;
+#endif
+
+    OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height, ThreadPool* threads)
+        : _width((width + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT), _height(max(height, 1u)), _threads(threads)
+    {
+        uint32_t w = _width, h = _height;
+        while (true) {
+            _levels.push_back({ w, h, vector<float>(w * h, 1.0f), vector<float>(w * h, 1.0f) });
+            if (w == 1 && h == 1) {
+                break;
+            }
+            w = (w + 1) / 2, h = (h + 1) / 2;
+        }
+    }
+
+    void OcclusionCuller::Begin(const mat4& viewProjection)
+    {
+        _viewProjection = viewProjection;
+        _triangles.clear();
+        _statistics = {};
+    }
+
+    void OcclusionCuller::AddOccluder(const float* positions, size_t stride, const uint32_t* indices, size_t indexCount, const mat4& model)
+    {
+        mat4 modelViewProjection = _viewProjection * model;
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            vec4 clip[3];
+            for (int v = 0; v < 3; v++) {
+                const float* p = positions + indices[i + v] * stride;
+                clip[v] = modelViewProjection * vec4(p[0], p[1], p[2], 1.0f);
+            }
+            ClipAndSetup(clip);
+        }
+    }
+
+    void OcclusionCuller::ClipAndSetup(const vec4 clip[3])
+    {
+        // Entirely outside one side of the frustum.
+        for (int axis = 0; axis < 3; axis++) {
+            if (clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w) {
+                return;
+            }
+            if (axis < 2 && clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w) {
+                return;
+            }
+        }
+        // Only the near plane, z >= 0, is clipped; the bounding box clamps everything else to the screen.
+        vec4 polygon[4];
+        int count = 0;
+        for (int v = 0; v < 3; v++) {
+            const vec4& a = clip[v];
+            const vec4& b = clip[(v + 1) % 3];
+            if (a.z >= 0.0f) {
+                polygon[count++] = a;
+            }
+            if ((a.z >= 0.0f) != (b.z >= 0.0f)) {
+                polygon[count++] = a + (b - a) * (a.z / (a.z - b.z));
+            }
+        }
+        for (int v = 1; v + 1 < count; v++) {
+            Setup(polygon[0], polygon[v], polygon[v + 1]);
+        }
+    }
+
+    void OcclusionCuller::Setup(const vec4& a, const vec4& b, const vec4& c)
+    {
+        Triangle triangle;
+        const vec4* clip[3] = { &a, &b, &c };
+        for (int v = 0; v < 3; v++) {
+            const vec4& p = *clip[v];
+            if (p.w <= 0.0f) {
+                return;
+            }
+            vec3 ndc = vec3(p) / p.w;
+            triangle.v[v] = vec3((ndc.x * 0.5f + 0.5f) * _width, (ndc.y * 0.5f + 0.5f) * _height, ndc.z);
+        }
+        const vec3* v = triangle.v;
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+        if (std::fabs(area) < 1e-6f) {
+            return;
+        }
+        _triangles.push_back(triangle);
+    }
+
+    void OcclusionCuller::RasterizeBand(uint32_t firstRow, uint32_t endRow)
+    {
+        vector<float>& depth = _levels[0].farthest;
+        for (const Triangle& triangle : _triangles) {
+            const vec3* v = triangle.v;
+            float minX = min(v[0].x, min(v[1].x, v[2].x)), maxX = max(v[0].x, max(v[1].x, v[2].x));
+            float minY = min(v[0].y, min(v[1].y, v[2].y)), maxY = max(v[0].y, max(v[1].y, v[2].y));
+            // Pixels whose centers may be covered.
+            int32_t x0 = max(0, static_cast<int32_t>(std::ceil(minX - 0.5f)));
+            int32_t x1 = min(static_cast<int32_t>(_width) - 1, static_cast<int32_t>(std::floor(maxX - 0.5f)));
+            int32_t y0 = max(static_cast<int32_t>(firstRow), static_cast<int32_t>(std::ceil(minY - 0.5f)));
+            int32_t y1 = min(static_cast<int32_t>(endRow) - 1, static_cast<int32_t>(std::floor(maxY - 0.5f)));
+            if (x0 > x1 || y0 > y1) {
+                continue;
+            }
+            // Edge i is opposite vertex i and positive inside, whichever way the triangle winds.
+            float edgeA[3], edgeB[3], edgeC[3];
+            for (int e = 0; e < 3; e++) {
+                const vec3& p = v[(e + 1) % 3];
+                const vec3& q = v[(e + 2) % 3];
+                edgeA[e] = p.y - q.y;
+                edgeB[e] = q.x - p.x;
+                edgeC[e] = p.x * q.y - p.y * q.x;
+            }
+            float area = edgeA[0] * v[0].x + edgeB[0] * v[0].y + edgeC[0];
+            if (area < 0.0f) {
+                for (int e = 0; e < 3; e++) {
+                    edgeA[e] = -edgeA[e], edgeB[e] = -edgeB[e], edgeC[e] = -edgeC[e];
+                }
+                area = -area;
+            }
+            // Depth is affine in screen space: the vertex depths weighted by the normalized edge functions.
+            float depthA = (edgeA[0] * v[0].z + edgeA[1] * v[1].z + edgeA[2] * v[2].z) / area;
+            float depthB = (edgeB[0] * v[0].z + edgeB[1] * v[1].z + edgeB[2] * v[2].z) / area;
+            float depthC = (edgeC[0] * v[0].z + edgeC[1] * v[1].z + edgeC[2] * v[2].z) / area;
+
+#ifdef CULLING_VECTORIZED
+            Lanes::Value a0 = Lanes::Splat(edgeA[0]), a1 = Lanes::Splat(edgeA[1]), a2 = Lanes::Splat(edgeA[2]);
+            Lanes::Value za = Lanes::Splat(depthA);
+            int32_t alignedX0 = x0 / static_cast<int32_t>(Lanes::WIDTH) * static_cast<int32_t>(Lanes::WIDTH);
+            for (int32_t y = y0; y <= y1; y++) {
+                float py = y + 0.5f;
+                Lanes::Value c0 = Lanes::Splat(edgeB[0] * py + edgeC[0]);
+                Lanes::Value c1 = Lanes::Splat(edgeB[1] * py + edgeC[1]);
+                Lanes::Value c2 = Lanes::Splat(edgeB[2] * py + edgeC[2]);
+                Lanes::Value zc = Lanes::Splat(depthB * py + depthC);
+                float* row = &depth[y * _width];
+                for (int32_t x = alignedX0; x <= x1; x += Lanes::WIDTH) {
+                    Lanes::Value px = Lanes::Add(Lanes::Indices(), Lanes::Splat(x + 0.5f));
+                    Lanes::Mask inside = Lanes::And(Lanes::NotNegative(Lanes::MulAdd(a0, px, c0)),
+                                                    Lanes::And(Lanes::NotNegative(Lanes::MulAdd(a1, px, c1)),
+                                                               Lanes::NotNegative(Lanes::MulAdd(a2, px, c2))));
+                    Lanes::Value z = Lanes::MulAdd(za, px, zc);
+                    Lanes::Value stored = Lanes::Load(row + x);
+                    Lanes::Store(row + x, Lanes::Select(Lanes::And(inside, Lanes::Less(z, stored)), z, stored));
+                }
+            }
+#else
+            for (int32_t y = y0; y <= y1; y++) {
+                float py = y + 0.5f;
+                float* row = &depth[y * _width];
+                for (int32_t x = x0; x <= x1; x++) {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < 3; e++) {
+                        inside = inside && edgeA[e] * px + edgeB[e] * py + edgeC[e] >= 0.0f;
+                    }
+                    float z = depthA * px + depthB * py + depthC;
+                    if (inside && z < row[x]) {
+                        row[x] = z;
+                    }
+                }
+            }
+#endif
+        }
+    }
+
+    void OcclusionCuller::Finish()
+    {
+        auto start = steady_clock::now();
+        std::fill(_levels[0].farthest.begin(), _levels[0].farthest.end(), 1.0f);
+        uint32_t bands = (_height + BAND_ROWS - 1) / BAND_ROWS;
+        auto rasterize = [this](uint32_t band, uint32_t) {
+            RasterizeBand(band * BAND_ROWS, min(_height, (band + 1) * BAND_ROWS));
+        };
+        if (_threads) {
+            _threads->Run(bands, rasterize);
+        } else {
+            for (uint32_t band = 0; band < bands; band++) {
+                rasterize(band, 0);
+            }
+        }
+        BuildHierarchy();
+        _statistics.triangles          = static_cast<uint32_t>(_triangles.size());
+        _statistics.rasterMilliseconds = duration<float, std::milli>(steady_clock::now() - start).count();
+    }
+
+    void OcclusionCuller::BuildHierarchy()
+    {
+        _levels[0].nearest = _levels[0].farthest;
+        for (size_t l = 1; l < _levels.size(); l++) {
+            const Level& fine = _levels[l - 1];
+            Level& coarse = _levels[l];
+            for (uint32_t y = 0; y < coarse.height; y++) {
+                uint32_t fy[2] = { 2 * y, min(2 * y + 1, fine.height - 1) };
+                for (uint32_t x = 0; x < coarse.width; x++) {
+                    uint32_t fx[2] = { 2 * x, min(2 * x + 1, fine.width - 1) };
+                    float nearest = 1.0f, farthest = 0.0f;
+                    for (uint32_t j = 0; j < 2; j++) {
+                        for (uint32_t i = 0; i < 2; i++) {
+                            nearest  = min(nearest, fine.nearest[fy[j] * fine.width + fx[i]]);
+                            farthest = max(farthest, fine.farthest[fy[j] * fine.width + fx[i]]);
+                        }
+                    }
+                    coarse.nearest[y * coarse.width + x]  = nearest;
+                    coarse.farthest[y * coarse.width + x] = farthest;
+                }
+            }
+        }
+    }
+
+    float OcclusionCuller::FarthestDepth(uint32_t level, uint32_t x, uint32_t y) const
+    {
+        const Level& l = _levels[level];
+        return l.farthest[y * l.width + x];
+    }
+
+    bool OcclusionCuller::IsOccluded(const vec3& min, const vec3& max, const mat4& model)
+    {
+        mat4 modelViewProjection = _viewProjection * model;
+        return Occluded(min, max, modelViewProjection);
+    }
+
+    size_t OcclusionCuller::Test(const Bounds& bounds, const mat4& model, vector<uint8_t>& visible)
+    {
+        mat4 modelViewProjection = _viewProjection * model;
+        size_t occluded = 0;
+        for (size_t i = 0; i < bounds.Size() && i < visible.size(); i++) {
+            if (!visible[i]) {
+                continue;
+            }
+            _statistics.tested++;
+            vec3 center = bounds.Center(i), extent = bounds.Extent(i);
+            if (Occluded(center - extent, center + extent, modelViewProjection)) {
+                visible[i] = 0;
+                occluded++;
+            }
+        }
+        _statistics.occluded += static_cast<uint32_t>(occluded);
+        return occluded;
+    }
+
+    bool OcclusionCuller::Occluded(const vec3& min, const vec3& max, const mat4& modelViewProjection) const
+    {
+        vec2 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+        float nearest = FLT_MAX, farthest = -FLT_MAX;
+        // The corners are the minimum corner plus any combination of the three transformed edges.
+        vec4 origin = modelViewProjection * vec4(min, 1.0f);
+        vec4 edges[3] = { modelViewProjection[0] * (max.x - min.x), modelViewProjection[1] * (max.y - min.y), modelViewProjection[2] * (max.z - min.z) };
+        for (int corner = 0; corner < 8; corner++) {
+            vec4 p = origin;
+            for (int axis = 0; axis < 3; axis++) {
+                if (corner & (1 << axis)) {
+                    p += edges[axis];
+                }
+            }
+            // Bounds reaching past the near plane are never culled.
+            if (p.z < 0.0f || p.w <= 0.0f) {
+                return false;
+            }
+            vec3 ndc = vec3(p) / p.w;
+            vec2 screen((ndc.x * 0.5f + 0.5f) * _width, (ndc.y * 0.5f + 0.5f) * _height);
+            screenMin = glm::min(screenMin, screen);
+            screenMax = glm::max(screenMax, screen);
+            nearest  = std::min(nearest, ndc.z);
+            farthest = std::max(farthest, ndc.z);
+        }
+        if (screenMax.x < 0.0f || screenMax.y < 0.0f || screenMin.x >= _width || screenMin.y >= _height) {
+            return false;
+        }
+        int32_t x0 = std::max(0, static_cast<int32_t>(std::floor(screenMin.x)));
+        int32_t y0 = std::max(0, static_cast<int32_t>(std::floor(screenMin.y)));
+        int32_t x1 = std::min(static_cast<int32_t>(_width) - 1, static_cast<int32_t>(std::floor(screenMax.x)));
+        int32_t y1 = std::min(static_cast<int32_t>(_height) - 1, static_cast<int32_t>(std::floor(screenMax.y)));
+        // The finest level where the rectangle covers at most 2x2 texels.
+        uint32_t span = static_cast<uint32_t>(std::max(x1 - x0, y1 - y0)) + 1;
+        uint32_t finest = 0;
+        while ((1u << finest) < span) {
+            finest++;
+        }
+        uint32_t top = static_cast<uint32_t>(_levels.size()) - 1;
+        finest = std::min(finest, top);
+        // Coarse texels are cheap to read and often decide already: behind their farthest depth is hidden, in front
+        // of their nearest depth is visible. Only what lies in between goes down a level.
+        for (int32_t l = static_cast<int32_t>(std::min(finest + COARSE_LEVELS, top)); l >= static_cast<int32_t>(finest); l--) {
+            const Level& level = _levels[l];
+            float levelNearest = 1.0f, levelFarthest = 0.0f;
+            for (int32_t y = y0 >> l; y <= y1 >> l; y++) {
+                for (int32_t x = x0 >> l; x <= x1 >> l; x++) {
+                    levelNearest  = std::min(levelNearest, level.nearest[y * level.width + x]);
+                    levelFarthest = std::max(levelFarthest, level.farthest[y * level.width + x]);
+                }
+            }
+            if (nearest > levelFarthest) {
+                return true;
+            }
+            if (farthest < levelNearest) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+#ifdef ENABLE_BENCHMARKS
+    // A box as eight corners and twelve triangles.
+    static void BoxMesh(const vec3& min, const vec3& max, vector<float>& positions, vector<uint32_t>& indices)
+    {
+        uint32_t base = static_cast<uint32_t>(positions.size() / 3);
+        for (int corner = 0; corner < 8; corner++) {
+            positions.push_back(corner & 1 ? max.x : min.x);
+            positions.push_back(corner & 2 ? max.y : min.y);
+            positions.push_back(corner & 4 ? max.z : min.z);
+        }
+        static const uint32_t faces[36] = { 0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+                                            2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+        for (uint32_t index : faces) {
+            indices.push_back(base + index);
+        }
+    }
+
+    void RunOcclusionBenchmark(ThreadPool* threads)
+    {
+        mat4 identity(1.0f);
+        mat4 projection = glm::perspective(glm::radians(60.0f), 2.0f, 0.125f, 256.0f);
+        OcclusionCuller culler(256, 128, threads);
+
+        // Known answers: a wall ten units ahead hides what is right behind it, but not what is before or beside it.
+        vector<float> positions;
+        vector<uint32_t> indices;
+        BoxMesh(vec3(-5.0f, -2.0f, -10.5f), vec3(5.0f, 2.0f, -10.0f), positions, indices);
+        culler.Begin(projection * glm::lookAt(vec3(0.0f), vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f)));
+        culler.AddOccluder(positions.data(), 3, indices.data(), indices.size(), identity);
+        culler.Finish();
+        bool hidden  = culler.IsOccluded(vec3(-0.5f, -0.5f, -20.5f), vec3(0.5f, 0.5f, -19.5f), identity);
+        bool before  = culler.IsOccluded(vec3(-0.5f, -0.5f, -5.5f), vec3(0.5f, 0.5f, -4.5f), identity);
+        bool beside  = culler.IsOccluded(vec3(7.5f, -0.5f, -20.5f), vec3(8.5f, 0.5f, -19.5f), identity);
+        bool through = culler.IsOccluded(vec3(-0.5f, -0.5f, -15.0f), vec3(0.5f, 0.5f, -5.0f), identity);
+        if (!hidden || before || beside || through) {
+            Log::Error("Occlusion culling: wrong answers, hidden %d, before %d, beside %d, through %d.", hidden, before, beside, through);
+            throw std::runtime_error("occlusion culling gives wrong answers");
+        }
+
+        // A town of walls on a grid and boxes scattered between them.
+        positions.clear(), indices.clear();
+        for (int x = -8; x < 8; x++) {
+            for (int z = -8; z < 8; z++) {
+                vec3 corner(x * 16.0f, 0.0f, z * 16.0f);
+                if ((x + z) & 1) {
+                    BoxMesh(corner, corner + vec3(12.0f, 6.0f, 0.5f), positions, indices);
+                } else {
+                    BoxMesh(corner, corner + vec3(0.5f, 6.0f, 12.0f), positions, indices);
+                }
+            }
+        }
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> position(-128.0f, 128.0f);
+        std::uniform_real_distribution<float> height(0.0f, 4.0f);
+        Bounds bounds;
+        for (int i = 0; i < 10000; i++) {
+            vec3 center(position(random), height(random), position(random));
+            bounds.Add(center - vec3(0.5f), center + vec3(0.5f));
+        }
+        const vec3 viewpoints[4][2] = {
+            { vec3(2.0f, 1.7f, 2.0f)    , vec3(40.0f, 1.7f, 30.0f) },
+            { vec3(-100.0f, 1.7f, -90.0f), vec3(0.0f, 1.7f, 0.0f) },
+            { vec3(60.0f, 1.7f, -20.0f) , vec3(-60.0f, 1.7f, -20.0f) },
+            { vec3(0.0f, 40.0f, 120.0f) , vec3(0.0f, 0.0f, 0.0f) }
+        };
+        for (int i = 0; i < 4; i++) {
+            mat4 viewProjection = projection * glm::lookAt(viewpoints[i][0], viewpoints[i][1], vec3(0.0f, 1.0f, 0.0f));
+            vector<uint8_t> visible;
+            size_t inFrustum = CullBoxes(FrustumFromMatrix(viewProjection), bounds, visible);
+            culler.Begin(viewProjection);
+            culler.AddOccluder(positions.data(), 3, indices.data(), indices.size(), identity);
+            culler.Finish();
+            auto start = steady_clock::now();
+            size_t occluded = culler.Test(bounds, identity, visible);
+            float testMilliseconds = duration<float, std::milli>(steady_clock::now() - start).count();
+            Log::Info("Occlusion viewpoint %d: %d triangles rasterized in %.3f ms (%s, %d threads); %d of %d objects in the frustum occluded, %.0f tested per ms.",
+                      i, culler.Stats().triangles, culler.Stats().rasterMilliseconds, InstructionSetName(), threads ? threads->ThreadCount() : 0,
+                      static_cast<int>(occluded), static_cast<int>(inFrustum), inFrustum / max(testMilliseconds, 0.001f));
+        }
+    }
+#endif
+}
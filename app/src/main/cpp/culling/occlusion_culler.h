@@ -0,0 +1,81 @@
+﻿#ifndef CULLING_OCCLUSION_CULLER_H
+#define CULLING_OCCLUSION_CULLER_H
+
+#include "frustum_culling.h"
+#include "../thread/thread_pool.h"
+
+using Utility::ThreadPool;
+
+namespace Culling {
+    // Software occlusion culling: a few designated occluders are rasterized into a small depth buffer on the CPU, the
+    // buffer is reduced into a hierarchy of nearest and farthest depths, and bounds whose nearest point lies behind
+    // the farthest occluder depth over their screen rectangle are culled. Depth is in [0, 1] with 1 far.
+    //
+    // Per frame: Begin(), AddOccluder() for each occluder, Finish(), then Test() as often as needed.
+    class OcclusionCuller
+    {
+    public:
+        typedef struct Statistics {
+            uint32_t triangles;
+            float    rasterMilliseconds;
+            uint32_t tested;
+            uint32_t occluded;
+        } Statistics;
+
+        // width is rounded up to a multiple of the vector width. Rasterization is split into bands of rows run on
+        // threads, or inline without them.
+        OcclusionCuller(uint32_t width = 256, uint32_t height = 128, ThreadPool* threads = nullptr);
+
+        void Begin(const mat4& viewProjection);
+        // positions points at the first position, stride is the distance between two of them in floats.
+        void AddOccluder(const float* positions, size_t stride, const uint32_t* indices, size_t indexCount, const mat4& model);
+        // Rasterizes the occluders and builds the hierarchy.
+        void Finish();
+
+        // Clears visible[i] for objects hidden behind the occluders; objects already invisible are skipped. Returns the
+        // number of objects culled.
+        size_t Test(const Bounds& bounds, const mat4& model, vector<uint8_t>& visible);
+        bool IsOccluded(const vec3& min, const vec3& max, const mat4& model);
+
+        // Since Begin().
+        const Statistics& Stats() const { return _statistics; }
+        uint32_t Width() const { return _width; }
+        uint32_t Height() const { return _height; }
+        // Level 0 is the rasterized depth; each further level halves both sides.
+        float FarthestDepth(uint32_t level, uint32_t x, uint32_t y) const;
+        uint32_t Levels() const { return static_cast<uint32_t>(_levels.size()); }
+
+    private:
+        typedef struct Triangle {
+            // Screen space x, y in pixels and depth.
+            vec3 v[3];
+        } Triangle;
+
+        typedef struct Level {
+            uint32_t      width, height;
+            vector<float> nearest, farthest;
+        } Level;
+
+        void ClipAndSetup(const vec4 clip[3]);
+        void Setup(const vec4& a, const vec4& b, const vec4& c);
+        void RasterizeBand(uint32_t firstRow, uint32_t endRow);
+        void BuildHierarchy();
+        bool Occluded(const vec3& min, const vec3& max, const mat4& modelViewProjection) const;
+
+        uint32_t         _width, _height;
+        ThreadPool*      _threads;
+        mat4             _viewProjection;
+        vector<Triangle> _triangles;
+        // _levels[0] holds the rasterized depth in both arrays.
+        vector<Level>    _levels;
+        Statistics       _statistics = {};
+    };
+
+#ifdef ENABLE_BENCHMARKS
+    // Logs rasterization time and cull rate for a field of walls and boxes seen from a few viewpoints, and checks a
+    // few cases with known answers.
+    void RunOcclusionBenchmark(ThreadPool* threads);
+#endif
+}
+
+#endif // CULLING_OCCLUSION_CULLER_H
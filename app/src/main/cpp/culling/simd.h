@@ -0,0 +1,117 @@
+﻿#ifndef CULLING_SIMD_H
+#define CULLING_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CULLING_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CULLING_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CULLING_NEON
+#endif
+
+#if defined(CULLING_AVX2) || defined(CULLING_SSE) || defined(CULLING_NEON)
+#define CULLING_VECTORIZED
+#endif
+
+namespace Culling {
+    // The handful of vector operations the culling kernels are written against, so each kernel exists once for AVX2
+    // with eight lanes and SSE or NEON with four. Only included by the kernels' translation units.
+#if defined(CULLING_AVX2)
+    struct Lanes {
+        static const size_t WIDTH = 8;
+        typedef __m256 Value;
+        typedef __m256 Mask;
+        static Value Splat(float f) { return _mm256_set1_ps(f); }
+        static Value Load(const float* p) { return _mm256_loadu_ps(p); }
+        static void Store(float* p, Value a) { _mm256_storeu_ps(p, a); }
+        static Value Indices() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+        static Value Add(Value a, Value b) { return _mm256_add_ps(a, b); }
+        static Value Sub(Value a, Value b) { return _mm256_sub_ps(a, b); }
+        static Value Mul(Value a, Value b) { return _mm256_mul_ps(a, b); }
+        static Value MulAdd(Value a, Value b, Value c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+        static Value Min(Value a, Value b) { return _mm256_min_ps(a, b); }
+        static Value Max(Value a, Value b) { return _mm256_max_ps(a, b); }
+        static Mask NotNegative(Value a) { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GE_OQ); }
+        static Mask Less(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static Mask And(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+        static Mask All() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+        static Value Select(Mask m, Value a, Value b) { return _mm256_blendv_ps(b, a, m); }
+        static uint32_t Bits(Mask m) { return static_cast<uint32_t>(_mm256_movemask_ps(m)); }
+    };
+#elif defined(CULLING_SSE)
+    struct Lanes {
+        static const size_t WIDTH = 4;
+        typedef __m128 Value;
+        typedef __m128 Mask;
+        static Value Splat(float f) { return _mm_set1_ps(f); }
+        static Value Load(const float* p) { return _mm_loadu_ps(p); }
+        static void Store(float* p, Value a) { _mm_storeu_ps(p, a); }
+        static Value Indices() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+        static Value Add(Value a, Value b) { return _mm_add_ps(a, b); }
+        static Value Sub(Value a, Value b) { return _mm_sub_ps(a, b); }
+        static Value Mul(Value a, Value b) { return _mm_mul_ps(a, b); }
+        static Value MulAdd(Value a, Value b, Value c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        static Value Min(Value a, Value b) { return _mm_min_ps(a, b); }
+        static Value Max(Value a, Value b) { return _mm_max_ps(a, b); }
+        static Mask NotNegative(Value a) { return _mm_cmpge_ps(a, _mm_setzero_ps()); }
+        static Mask Less(Value a, Value b) { return _mm_cmplt_ps(a, b); }
+        static Mask And(Mask a, Mask b) { return _mm_and_ps(a, b); }
+        static Mask All() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+        static Value Select(Mask m, Value a, Value b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+        static uint32_t Bits(Mask m) { return static_cast<uint32_t>(_mm_movemask_ps(m)); }
+    };
+#elif defined(CULLING_NEON)
+    struct Lanes {
+        static const size_t WIDTH = 4;
+        typedef float32x4_t Value;
+        typedef uint32x4_t  Mask;
+        static Value Splat(float f) { return vdupq_n_f32(f); }
+        static Value Load(const float* p) { return vld1q_f32(p); }
+        static void Store(float* p, Value a) { vst1q_f32(p, a); }
+        static Value Indices()
+        {
+            static const float indices[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+            return vld1q_f32(indices);
+        }
+        static Value Add(Value a, Value b) { return vaddq_f32(a, b); }
+        static Value Sub(Value a, Value b) { return vsubq_f32(a, b); }
+        static Value Mul(Value a, Value b) { return vmulq_f32(a, b); }
+        static Value MulAdd(Value a, Value b, Value c) { return vaddq_f32(vmulq_f32(a, b), c); }
+        static Value Min(Value a, Value b) { return vminq_f32(a, b); }
+        static Value Max(Value a, Value b) { return vmaxq_f32(a, b); }
+        static Mask NotNegative(Value a) { return vcgeq_f32(a, vdupq_n_f32(0.0f)); }
+        static Mask Less(Value a, Value b) { return vcltq_f32(a, b); }
+        static Mask And(Mask a, Mask b) { return vandq_u32(a, b); }
+        static Mask All() { return vdupq_n_u32(0xffffffff); }
+        static Value Select(Mask m, Value a, Value b) { return vbslq_f32(m, a, b); }
+        static uint32_t Bits(Mask m)
+        {
+            static const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+            uint32x4_t bits = vandq_u32(m, vld1q_u32(laneBits));
+            uint32x2_t pairs = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+            return vget_lane_u32(vpadd_u32(pairs, pairs), 0);
+        }
+    };
+#endif
+
+    inline const char* InstructionSetName()
+    {
+#if defined(CULLING_AVX2)
+        return "AVX2";
+#elif defined(CULLING_SSE)
+        return "SSE";
+#elif defined(CULLING_NEON)
+        return "NEON";
+#else
+        return "scalar";
+#endif
+    }
+}
+
+#endif // CULLING_SIMD_H
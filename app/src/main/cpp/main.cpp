@@ -197,5 +197,9 @@ using Utility::Log;
 void android_main(struct android_app* state)
 {
     Log::Tag = "vulkan";
+#ifdef STRESS_INSTANCES
+    StereoViewingScene stereoViewingScene((void*)state, STRESS_INSTANCES);
+#else
     StereoViewingScene stereoViewingScene((void*)state);
+#endif
 }
\ No newline at end of file
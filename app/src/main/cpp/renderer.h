@@ -10,10 +10,12 @@
 #include "vulkan/framebuffer.h"
 #include "vulkan/command.h"
 #include "vulkan/buffer.h"
+#include <string>
 #include <vector>
 #include <stdexcept>
 
 using std::runtime_error;
+using std::string;
 
 class Renderer
 {
@@ -23,6 +25,8 @@ public:
     void Render()
     {
         RenderImpl();
+        device->Memory().LogIfDue();
+        device->Pipelines().SaveIfDue();
     }
 
     void SetScreenSize(uint32_t width, uint32_t height) { screenSize.width = width, screenSize.height = height; }
@@ -40,6 +44,8 @@ protected:
     ANativeWindow* window;
 #endif
     Extent2D screenSize = { 0, 0 };
+    // Where the device's pipeline cache is kept between launches.
+    string pipelineCachePath;
 
     // ==== Vulkan ==== //
     static void SysInitVulkan()
@@ -50,6 +50,7 @@ EarthSceneRenderer::EarthSceneRenderer(void* application, uint32_t screenWidth,
     device = new Device(SelectPhysicalDevice(*instance, *surface, requestedExtNames, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, requestedFeatures));
     VkPhysicalDeviceFeatures featuresRequested = { .samplerAnisotropy = VK_TRUE };
     device->BuildDevice(featuresRequested, requestedExtNames);
+    device->Pipelines().Open(pipelineCachePath);
 
     swapchain = new Swapchain(*surface, *device);
     swapchain->getScreenExtent = [&]() -> Extent2D { return screenSize; };
@@ -82,9 +83,9 @@ EarthSceneRenderer::EarthSceneRenderer(void* application, uint32_t screenWidth,
     imageAvailableSemaphores.resize(concurrentFramesCount);
     commandsCompleteSemaphores.resize(concurrentFramesCount);
     for (int i = 0; i < concurrentFramesCount; i++) {
-        multiFrameFences[i]           = CreateFence(d);
-        imageAvailableSemaphores[i]   = CreateSemaphore(d);
-        commandsCompleteSemaphores[i] = CreateSemaphore(d);
+        multiFrameFences[i]           = device->Sync().AcquireFence(VK_FENCE_CREATE_SIGNALED_BIT);
+        imageAvailableSemaphores[i]   = device->Sync().AcquireSemaphore();
+        commandsCompleteSemaphores[i] = device->Sync().AcquireSemaphore();
     }
 
 
@@ -96,6 +97,8 @@ EarthSceneRenderer::EarthSceneRenderer(void* application, uint32_t screenWidth,
     string filePath = string(app->activity->externalDataPath) + string("/earth/");
     Texture::TextureAttribs textureAttribs;
     ModelCreateInfo modelCreateInfo = { 0.001953125f, 1.0f, true, false };
+    // Loading blocks anyway, so the uploads are waited on right away.
+    Vulkan::UploadContext uploadContext(*device);
     if (model.ReadFile(filePath, string("earth.obj"), Model::DEFAULT_READ_FILE_FLAGS, &modelCreateInfo)) {
         for (const auto& n : model.Materials()) {
             for (const auto& it: n.textures) {
@@ -110,13 +113,15 @@ EarthSceneRenderer::EarthSceneRenderer(void* application, uint32_t screenWidth,
                     textureAttribs.sRGB = true;
                     textureAttribs.mipmapLevels = (uint32_t)(floor(log2(max(textureAttribs.width, textureAttribs.height)))) + 1;
                     _modelTextures.emplace_back(*device);
-                    _modelTextures[_modelTextures.size() - 1].BuildTexture2D(textureAttribs, imageData, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *command);
+                    _modelTextures[_modelTextures.size() - 1].name = str;
+                    _modelTextures[_modelTextures.size() - 1].BuildTexture2D(textureAttribs, imageData, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, uploadContext);
                 }
             }
         }
         _modelResources.emplace_back(*device);
-        _modelResources[_modelResources.size() - 1].UploadToGPU(model, *command);
+        _modelResources[_modelResources.size() - 1].UploadToGPU(model, uploadContext);
     }
+    uploadContext.Wait(uploadContext.Flush());
 
 
     // Prepare MVP & lighting buffer.
@@ -172,12 +177,12 @@ EarthSceneRenderer::~EarthSceneRenderer()
 
     vkDestroyImageView(d, _depthView, nullptr), _depthView = VK_NULL_HANDLE;
     vkDestroyImage(d, _depthImage, nullptr), _depthImage = VK_NULL_HANDLE;
-    vkFreeMemory(d, _depthImageMemory, nullptr), _depthImageMemory = VK_NULL_HANDLE;
+    device->Memory().Free(_depthImageMemory), _depthImageMemory = VK_NULL_HANDLE;
 
     for (int i = 0; i < swapchain->ConcurrentFramesCount(); i++) {
-        vkDestroyFence(d, multiFrameFences[i], nullptr), multiFrameFences[i] = VK_NULL_HANDLE;
-        vkDestroySemaphore(d, imageAvailableSemaphores[i], nullptr), imageAvailableSemaphores[i] = VK_NULL_HANDLE;
-        vkDestroySemaphore(d, commandsCompleteSemaphores[i], nullptr), commandsCompleteSemaphores[i] = VK_NULL_HANDLE;
+        device->Sync().ReleaseFence(multiFrameFences[i]), multiFrameFences[i] = VK_NULL_HANDLE;
+        device->Sync().ReleaseSemaphore(imageAvailableSemaphores[i]), imageAvailableSemaphores[i] = VK_NULL_HANDLE;
+        device->Sync().ReleaseSemaphore(commandsCompleteSemaphores[i]), commandsCompleteSemaphores[i] = VK_NULL_HANDLE;
     }
 
     delete command, command = nullptr;
@@ -226,7 +231,7 @@ void EarthSceneRenderer::BuildDepthImage(RenderPass* swapchainRenderPass, VkSamp
                                                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                                                                  *device, memoryRequirements,
                                                                  memoryTypeIndex);
-    VK_CHECK_RESULT(vkAllocateMemory(d, &memoryAllocateInfo, nullptr, &_depthImageMemory));
+    VK_CHECK_RESULT(device->Memory().Allocate(memoryAllocateInfo, Vulkan::MEMORY_CATEGORY_RENDER_TARGET, "depth", &_depthImageMemory));
     VK_CHECK_RESULT(vkBindImageMemory(d, _depthImage, _depthImageMemory, 0));
 
     VkImageViewCreateInfo imageViewInfo = ImageViewCreateInfo(_depthImage, depthFormat, { depthImageAspectFlags, 0, 1, 0, 1 });
@@ -453,7 +458,7 @@ void EarthSceneRenderer::BuildGraphicsPipeline(void* application, VkSampleCountF
                                                                                _pipelineLayout,
                                                                                (*renderPasses[0]).GetRenderPass(),
                                                                                &parameters);
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(d, VK_NULL_HANDLE, 1, &graphicsPipeline, nullptr, &_pipeline));
+    _pipeline = device->Pipelines().CreateGraphicsPipeline(graphicsPipeline, "earth");
 
     vkDestroyShaderModule(d, vertexShader, nullptr);
     vkDestroyShaderModule(d, fragmentShader, nullptr);
@@ -516,7 +521,7 @@ void EarthSceneRenderer::RenderImpl()
     }
 
     uint32_t imageIndex;
-    vkAcquireNextImageKHR(d, swapchain->GetSwapchain(), UINT64_MAX, imageAvailableSemaphores[currentFrameIndex], VK_NULL_HANDLE, &imageIndex);
+    swapchain->AcquireNextImage(imageAvailableSemaphores[currentFrameIndex], &imageIndex);
     if (imageIndexToCurrentFrame.count(imageIndex) > 0) {
         vkWaitForFences(d, 1, &multiFrameFences[imageIndexToCurrentFrame[imageIndex]], true, UINT64_MAX);
         vkResetFences(d, 1, &multiFrameFences[imageIndexToCurrentFrame[imageIndex]]);
@@ -545,7 +550,7 @@ void EarthSceneRenderer::RenderImpl()
     submitInfo.pSignalSemaphores = &commandsCompleteSemaphores[currentFrameIndex];
     VK_CHECK_RESULT(vkQueueSubmit(device->FamilyQueues().graphics.queue, 1, &submitInfo, multiFrameFences[currentFrameIndex]));
 
-    QueuePresent(&swapchain->GetSwapchain(), &imageIndex, *device, 1, &commandsCompleteSemaphores[currentFrameIndex]);
+    swapchain->Present(imageIndex, commandsCompleteSemaphores[currentFrameIndex]);
 
     currentFrameIndex = (currentFrameIndex + 1) % swapchain->ConcurrentFramesCount();
 }
@@ -561,7 +566,7 @@ void EarthSceneRenderer::RebuildSwapchain()
     // Delete out-dated data.
     vkDestroyImageView(d, _depthView, nullptr), _depthView = VK_NULL_HANDLE;
     vkDestroyImage(d, _depthImage, nullptr), _depthImage = VK_NULL_HANDLE;
-    vkFreeMemory(d, _depthImageMemory, nullptr), _depthImageMemory = VK_NULL_HANDLE;
+    device->Memory().Free(_depthImageMemory), _depthImageMemory = VK_NULL_HANDLE;
 
     vkDestroyPipeline(d, _pipeline, nullptr), _pipeline = VK_NULL_HANDLE;
 
@@ -34,6 +34,7 @@ EmptySceneRenderer::EmptySceneRenderer(void* app, uint32_t screenWidth, uint32_t
     device = new Device(SelectPhysicalDevice(*instance, *surface, requestedExtNames));
     VkPhysicalDeviceFeatures featuresRequested = {};
     device->BuildDevice(featuresRequested, requestedExtNames);
+    device->Pipelines().Open(pipelineCachePath);
 
     swapchain = new Swapchain(*surface, *device);
     swapchain->getScreenExtent = [&]() -> Extent2D { return screenSize; };
@@ -63,9 +64,9 @@ EmptySceneRenderer::EmptySceneRenderer(void* app, uint32_t screenWidth, uint32_t
     imageAvailableSemaphores.resize(concurrentFramesCount);
     commandsCompleteSemaphores.resize(concurrentFramesCount);
     for (int i = 0; i < concurrentFramesCount; i++) {
-        multiFrameFences[i]           = CreateFence(d);
-        imageAvailableSemaphores[i]   = CreateSemaphore(d);
-        commandsCompleteSemaphores[i] = CreateSemaphore(d);
+        multiFrameFences[i]           = device->Sync().AcquireFence(VK_FENCE_CREATE_SIGNALED_BIT);
+        imageAvailableSemaphores[i]   = device->Sync().AcquireSemaphore();
+        commandsCompleteSemaphores[i] = device->Sync().AcquireSemaphore();
     }
 
 //    Vulkan::Texture::defaultTransitionImageLayout = [=](VkPipelineStageFlags sourceStage,
@@ -93,9 +94,9 @@ EmptySceneRenderer::~EmptySceneRenderer()
     vkDeviceWaitIdle(d);
 
     for (int i = 0; i < swapchain->ConcurrentFramesCount(); i++) {
-        vkDestroyFence(d, multiFrameFences[i], nullptr);
-        vkDestroySemaphore(d, imageAvailableSemaphores[i], nullptr);
-        vkDestroySemaphore(d, commandsCompleteSemaphores[i], nullptr);
+        device->Sync().ReleaseFence(multiFrameFences[i]);
+        device->Sync().ReleaseSemaphore(imageAvailableSemaphores[i]);
+        device->Sync().ReleaseSemaphore(commandsCompleteSemaphores[i]);
     }
 
     delete command, command = nullptr;
@@ -200,7 +201,7 @@ void EmptySceneRenderer::RenderImpl()
     }
 
     uint32_t imageIndex;
-    vkAcquireNextImageKHR(d, swapchain->GetSwapchain(), UINT64_MAX, imageAvailableSemaphores[currentFrameIndex], VK_NULL_HANDLE, &imageIndex);
+    swapchain->AcquireNextImage(imageAvailableSemaphores[currentFrameIndex], &imageIndex);
     if (imageIndexToCurrentFrame.count(imageIndex) > 0) {
         vkWaitForFences(d, 1, &multiFrameFences[imageIndexToCurrentFrame[imageIndex]], true, UINT64_MAX);
         vkResetFences(d, 1, &multiFrameFences[imageIndexToCurrentFrame[imageIndex]]);
@@ -229,7 +230,7 @@ void EmptySceneRenderer::RenderImpl()
     submitInfo.pSignalSemaphores = &commandsCompleteSemaphores[currentFrameIndex];
     VK_CHECK_RESULT(vkQueueSubmit(device->FamilyQueues().graphics.queue, 1, &submitInfo, multiFrameFences[currentFrameIndex]));
 
-    QueuePresent(&swapchain->GetSwapchain(), &imageIndex, *device, 1, &commandsCompleteSemaphores[currentFrameIndex]);
+    swapchain->Present(imageIndex, commandsCompleteSemaphores[currentFrameIndex]);
 
     currentFrameIndex = (currentFrameIndex + 1) % swapchain->ConcurrentFramesCount();
 }
@@ -11,20 +11,24 @@ Scene::Scene(void* state) : eventLoop((android_app*)state)
 bool Scene::Update()
 {
     static int frames = 0;
+    static float cpuTime = 0.0f;
     frames++;
 
     auto now = high_resolution_clock::now();
     float elapsedTime = duration<float, seconds::period>(now - intervalBaseTime).count();
     if (elapsedTime >= 2.0f) {
-        Log::Info("%d", frames / 2);
+        Log::Info("%d fps, cpu frame time %.2f ms", (int)(frames / elapsedTime), cpuTime * 1000.0f / frames);
         frames = 0;
+        cpuTime = 0.0f;
         intervalBaseTime = now;
     }
 
     deltaTime = duration<float, seconds::period>(now - currentTime).count();
     currentTime = now;
 
+    // Time spent on the CPU for update and command submission, excluding the event loop.
     bool result = UpdateImpl();
     renderer->Render();
+    cpuTime += duration<float, seconds::period>(high_resolution_clock::now() - now).count();
     return result;
 }
\ No newline at end of file
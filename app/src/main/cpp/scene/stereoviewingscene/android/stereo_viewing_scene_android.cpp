@@ -5,8 +5,12 @@
 #include <android_native_app_glue.h>
 #include "../../../log/log.h"
 #include "glm/matrix.hpp"
+#include "glm/gtc/constants.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
+#include <algorithm>
+#include <functional>
+#include <random>
 
 using Vulkan::ModelCreateInfo;
 using std::chrono::duration;
@@ -14,6 +18,9 @@ using std::chrono::seconds;
 
 using std::max;
 
+// Lights the eye passes shade with, clustered per eye.
+static const uint32_t LIGHT_COUNT = 128;
+
 static bool OnActivate();
 static void OnDeactivate();
 
@@ -31,12 +38,13 @@ static void OnLostFocus(void);
 static void OnSaveInstanceState(void**, size_t*);
 static void OnLowMemory(void);
 
-StereoViewingScene::StereoViewingScene(void* state) : Scene(state),
-                                                      _worldSpaceCameraPos(0.0f, 0.0f, 2.0f),
-                                                      _fov(45.0f),
-                                                      _zNear(0.125f), _zFar(128.0f),
-                                                      _focalLength(0.5f),
-                                                      _eyeSeparation(0.08f)
+StereoViewingScene::StereoViewingScene(void* state, uint32_t instances) : Scene(state),
+                                                                          _worldSpaceCameraPos(0.0f, 0.0f, 2.0f),
+                                                                          _fov(45.0f),
+                                                                          _zNear(0.125f), _zFar(128.0f),
+                                                                          _focalLength(0.5f),
+                                                                          _eyeSeparation(0.08f),
+                                                                          _instances(max(instances, 1u))
 {
     eventLoop.onActivate = OnActivate;
     eventLoop.onDeactivate = OnDeactivate;
@@ -56,6 +64,10 @@ StereoViewingScene::StereoViewingScene(void* state) : Scene(state),
         renderer = new StereoViewingSceneRenderer(app, w, h);
 
         StereoViewingSceneRenderer* concreteRenderer = (StereoViewingSceneRenderer*)renderer;
+        concreteRenderer->SetInstanceCount(_instances);
+#ifdef DEPTH_PREPASS
+        concreteRenderer->SetDepthPrePass(true);
+#endif
         concreteRenderer->UploadModels(_models);
         concreteRenderer->BuildTextureSamplers();
         concreteRenderer->BuildMSAAImage(concreteRenderer->SampleCount(), 0);
@@ -66,16 +78,20 @@ StereoViewingScene::StereoViewingScene(void* state) : Scene(state),
         concreteRenderer->BuildMSAADepthImage(concreteRenderer->RenderPasses()[0],
                                               concreteRenderer->SampleCount(),
                                               1);
+        concreteRenderer->BuildRenderTargets();
         concreteRenderer->BuildMSAAResolvedImages(0);
         concreteRenderer->BuildMSAAResolvedImages(1);
+        concreteRenderer->BuildFramebuffers();
         concreteRenderer->BuildMSAAResolvedResultSampler();
         concreteRenderer->BuildMSAADescriptorSetLayout();
         concreteRenderer->BuildMultiviewDescriptorSetLayout();
-        concreteRenderer->BuildDescriptorPool();
         concreteRenderer->BuildMSAADescriptorSet();
         concreteRenderer->BuildMultiViewDescriptorSet(0);
         concreteRenderer->BuildMultiViewDescriptorSet(1);
         concreteRenderer->BuildMSAAPipeline(app, _models[0].VertexLayouts()[0], concreteRenderer->SampleCount());
+        concreteRenderer->BuildGpuCulling(app);
+        concreteRenderer->BuildClusteredLighting(app);
+        concreteRenderer->BuildInstanceBuffer();
         VertexLayout vertexLayout;
         vertexLayout.offsets.push_back(0);
         vertexLayout.components.push_back(Vulkan::VertexComponent::VERTEX_COMPONENT_POSITION);
@@ -175,6 +191,61 @@ StereoViewingScene::StereoViewingScene(void* state) : Scene(state),
     vertexLayouts[0].offsets.push_back(0);
     _models.emplace_back(Model(std::move(subMeshes), std::move(vertexLayouts), dimension, {}, {}));
 
+    _cullingThreads = new ThreadPool(ThreadPool::DefaultThreadCount(2));
+    for (int eye = 0; eye < 2; eye++) {
+        _occlusionCullers[eye] = new Culling::OcclusionCuller(256, 128, _cullingThreads);
+    }
+    ChooseOccluders();
+    _submeshBvh = new Culling::Bvh(_cullingThreads);
+    _submeshBvh->Build(_models[0].SubmeshBounds());
+    Log::Info("Submesh BVH: %d nodes, depth %d, built in %.2f ms.", _submeshBvh->Stats().nodes, _submeshBvh->Stats().depth, _submeshBvh->Stats().buildMilliseconds);
+
+    if (_instances > 1 && !_models.empty()) {
+        // A square grid on the floor, one model size plus a quarter apart.
+        uint32_t side = static_cast<uint32_t>(ceil(sqrt(static_cast<float>(_instances))));
+        vec3 spacing = _models[0].Dimensions().size * 1.25f;
+        for (uint32_t i = 0; i < _instances; i++) {
+            float column = i % side - 0.5f * (side - 1), row = i / side - 0.5f * (side - 1);
+            _instanceOffsets.push_back(vec3(column * spacing.x, 0.0f, row * spacing.z));
+        }
+        _instanceTransforms.resize(_instances);
+        Log::Info("Stress scene: %d copies of %d submeshes on a %dx%d grid.", _instances, static_cast<int>(_models[0].Submeshes().size()), side, side);
+    }
+
+    if (!_models.empty()) {
+        const Model::Dimension& dimension = _models[0].Dimensions();
+        vec3 extent = dimension.size * 0.5f;
+        for (const vec3& offset : _instanceOffsets) {
+            extent = glm::max(extent, glm::abs(offset) + dimension.size * 0.5f);
+        }
+        _lightCenter = (dimension.min + dimension.max) * 0.5f;
+        float reach = max(extent.x, extent.z);
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        _lights.resize(LIGHT_COUNT);
+        _lightOrbits.resize(LIGHT_COUNT);
+        for (uint32_t i = 0; i < LIGHT_COUNT; i++) {
+            // Radius, height, phase and angular velocity, alternating in direction.
+            _lightOrbits[i] = vec4(reach * (0.1f + 0.9f * unit(random)), extent.y * (2.0f * unit(random) - 1.0f),
+                                   glm::two_pi<float>() * unit(random), (0.2f + 0.3f * unit(random)) * (i % 2 ? 1.0f : -1.0f));
+            float range = reach * (0.1f + 0.15f * unit(random));
+            vec3 color = glm::normalize(vec3(unit(random), unit(random), unit(random)) + 0.25f);
+            _lights[i].positionRange   = vec4(_lightCenter, range);
+            _lights[i].directionCosine = vec4(0.0f, -1.0f, 0.0f, i % 2 ? cos(glm::radians(20.0f + 25.0f * unit(random))) : -2.0f);
+            // Scaled by the range squared, which the falloff divides by.
+            _lights[i].color           = vec4(color * (0.5f * range * range), 0.0f);
+        }
+    }
+
+#ifdef ENABLE_BENCHMARKS
+    Culling::RunBenchmark();
+    Culling::RunOcclusionBenchmark(_cullingThreads);
+    Culling::RunBvhBenchmark(_cullingThreads);
+    Culling::RunLightClusterBenchmark(_cullingThreads);
+    Vulkan::RunDrawListBenchmark();
+    Vulkan::RunRenderGraphCheck();
+#endif
+
     eventLoop.Run();
 }
 
@@ -185,6 +256,40 @@ StereoViewingScene::~StereoViewingScene()
     _modelTransforms.clear();
     delete renderer;
     renderer = nullptr;
+    for (int eye = 0; eye < 2; eye++) {
+        delete _occlusionCullers[eye];
+        _occlusionCullers[eye] = nullptr;
+    }
+    delete _submeshBvh;
+    _submeshBvh = nullptr;
+    delete _cullingThreads;
+    _cullingThreads = nullptr;
+}
+
+void StereoViewingScene::ChooseOccluders()
+{
+    // Large bounds cover much of the screen; the triangle limit keeps rasterizing them cheap.
+    static const size_t MAX_OCCLUDERS          = 8;
+    static const size_t MAX_OCCLUDER_TRIANGLES = 4096;
+    _occluders.clear();
+    if (_models.empty()) {
+        return;
+    }
+    const Culling::Bounds& bounds = _models[0].SubmeshBounds();
+    const vector<Model::Mesh>& submeshes = _models[0].Submeshes();
+    vector<std::pair<float, uint32_t>> candidates;
+    for (uint32_t i = 0; i < bounds.Size(); i++) {
+        if (submeshes[i].indexBuffer.size() / 3 > MAX_OCCLUDER_TRIANGLES) {
+            continue;
+        }
+        vec3 e = bounds.Extent(i);
+        candidates.emplace_back(e.x * e.y + e.y * e.z + e.z * e.x, i);
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<float, uint32_t>>());
+    for (size_t i = 0; i < candidates.size() && i < MAX_OCCLUDERS; i++) {
+        _occluders.push_back(candidates[i].second);
+    }
+    Log::Info("%d of %d submeshes chosen as occluders.", static_cast<int>(_occluders.size()), static_cast<int>(bounds.Size()));
 }
 
 bool StereoViewingScene::UpdateImpl()
@@ -230,6 +335,62 @@ bool StereoViewingScene::UpdateImpl()
     _rViewProjTransform.projection = glm::frustum(left, right, bottom, top, _zNear, _zFar);
     _rViewProjTransform.projection[1][1] *= -1;
 
+    if (_instances > 1) {
+        UpdateInstances(elapsedTime);
+        concreteRenderer->UpdateInstanceTransforms(_instanceTransforms);
+        _stressSeconds += deltaTime;
+        _stressFrames++;
+        if (_stressSeconds >= 2.0f) {
+            Log::Info("Stress scene: %d instances, %.2f ms per frame, %.2f ms of GPU time per eye pass at scale %.3f.",
+                      _instances, _stressSeconds * 1000.0f / _stressFrames, concreteRenderer->Resolution().FilteredMilliseconds(),
+                      concreteRenderer->Resolution().Scale());
+            _stressSeconds = 0.0f;
+            _stressFrames  = 0;
+        }
+    } else {
+        // One test per submesh for both eyes.
+        Culling::Frustum frustum = Culling::CombinedStereoFrustum(_lViewProjTransform.view, _lViewProjTransform.projection,
+                                                                  _rViewProjTransform.view, _rViewProjTransform.projection);
+        Culling::CullBoxes(Culling::ToModelSpace(frustum, _modelTransforms[0]), _models[0].SubmeshBounds(), _visibleSubmeshes);
+
+        // Gaze picking: straight ahead from between the eyes. The ray goes into model space rather than the BVH into
+        // world space, so it never needs a refit; distances stay in multiples of the world space direction.
+        mat4 lCamera = glm::inverse(_lViewProjTransform.view), rCamera = glm::inverse(_rViewProjTransform.view);
+        mat4 toModel = glm::inverse(_modelTransforms[0]);
+        vec3 gazeOrigin = vec3(toModel * ((lCamera[3] + rCamera[3]) * 0.5f));
+        vec3 gazeDirection = vec3(toModel * -lCamera[2]);
+        Culling::Bvh::Hit gaze;
+        uint32_t gazed = _submeshBvh->Raycast(gazeOrigin, gazeDirection, _zFar, gaze) ? gaze.object : UINT32_MAX;
+        if (gazed != _gazedSubmesh) {
+            _gazedSubmesh = gazed;
+            DebugLog("Gazing at submesh %d.", static_cast<int>(gazed));
+        }
+
+        // Then what the occluders hide from both eyes.
+        const ViewProjectionTransform* eyes[2] = { &_lViewProjTransform, &_rViewProjTransform };
+        for (int eye = 0; eye < 2; eye++) {
+            Culling::OcclusionCuller& culler = *_occlusionCullers[eye];
+            culler.Begin(eyes[eye]->projection * eyes[eye]->view);
+            for (uint32_t occluder : _occluders) {
+                size_t offset;
+                size_t stride = _models[0].PositionStride(occluder, offset);
+                const Model::Mesh& mesh = _models[0].Submeshes()[occluder];
+                culler.AddOccluder(mesh.vertexBuffer.data() + offset, stride, mesh.indexBuffer.data(), mesh.indexBuffer.size(), _modelTransforms[0]);
+            }
+            culler.Finish();
+            _eyeVisibleSubmeshes[eye] = _visibleSubmeshes;
+            culler.Test(_models[0].SubmeshBounds(), _modelTransforms[0], _eyeVisibleSubmeshes[eye]);
+        }
+        for (size_t i = 0; i < _visibleSubmeshes.size(); i++) {
+            _visibleSubmeshes[i] = _eyeVisibleSubmeshes[0][i] | _eyeVisibleSubmeshes[1][i];
+        }
+        concreteRenderer->SetSubmeshVisibility(_visibleSubmeshes);
+        concreteRenderer->SetCullingFrustum(Culling::ToModelSpace(frustum, _modelTransforms[0]));
+    }
+
+    MoveLights(elapsedTime);
+    concreteRenderer->UpdateLights(_lights, _zNear, _zFar);
+
     vector<int> modelTransformSizes = { sizeof(mat4) };
     concreteRenderer->UpdateUniformBuffers(_modelTransforms, modelTransformSizes, _lViewProjTransform, _rViewProjTransform, sizeof(ViewProjectionTransform));
 
@@ -239,6 +400,28 @@ bool StereoViewingScene::UpdateImpl()
     return true;
 }
 
+void StereoViewingScene::UpdateInstances(float elapsedTime)
+{
+    for (uint32_t i = 0; i < _instances; i++) {
+        // Neighbours turn at slightly different rates, so no two frames stream the same transforms.
+        float angle = elapsedTime * (0.25f + 0.01f * (i % 16));
+        _instanceTransforms[i] = glm::rotate(glm::translate(mat4(1.0f), _instanceOffsets[i]), angle, vec3(0.0f, 1.0f, 0.0f));
+    }
+}
+
+void StereoViewingScene::MoveLights(float elapsedTime)
+{
+    for (size_t i = 0; i < _lights.size(); i++) {
+        const vec4& orbit = _lightOrbits[i];
+        float angle = orbit.z + orbit.w * elapsedTime;
+        vec3 outwards = vec3(cos(angle), 0.0f, sin(angle));
+        _lights[i].positionRange = vec4(_lightCenter + outwards * orbit.x + vec3(0.0f, orbit.y, 0.0f), _lights[i].positionRange.w);
+        if (_lights[i].directionCosine.w > -1.0f) {
+            _lights[i].directionCosine = vec4(glm::normalize(vec3(0.0f, -2.0f, 0.0f) - outwards), _lights[i].directionCosine.w);
+        }
+    }
+}
+
 void StereoViewingScene::UpdateDeviceOrientation(const float rotationMatrix[], bool columnMajorInput)
 {
     cameraRotationMatrix.resize(16);
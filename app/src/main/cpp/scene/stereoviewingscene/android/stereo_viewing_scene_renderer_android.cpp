@@ -3,10 +3,16 @@
 #include "../stereo_viewing_scene_renderer.h"
 #include "../../../vulkan/renderpass/msaa_shader_read_renderpass.h"
 #include "../../../vulkan/renderpass/color_dst_renderpass.h"
+#include "../../../vulkan/renderpass/msaa_swapchain_renderpass.h"
 #include "../../../androidutility/assetmanager/io_asset.hpp"
 #include "../../../vulkan/model/model.h"
 #include "../../../vulkan/vulkan_utility.h"
+#include "glm/mat3x3.hpp"
+#include "glm/matrix.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <unordered_map>
 
 using Vulkan::Instance;
@@ -16,32 +22,116 @@ using Vulkan::Swapchain;
 using Vulkan::RenderPass;
 using Vulkan::MSAAShaderReadRenderPass;
 using Vulkan::ColorDestinationRenderPass;
+using Vulkan::MSAASwapchainRenderPass;
 using Vulkan::VertexComponent;
 using Vulkan::VertexLayout;
 using Vulkan::Model;
+using Vulkan::PipelineBuilder;
 using std::unordered_map;
 using std::max;
+using std::chrono::duration;
+using std::chrono::steady_clock;
 
 static unordered_map<uint32_t, uint32_t> currentFrameToImageindex;
 
+// Upper bound of the bindless texture array; the device limits may lower it.
+static const uint32_t BINDLESS_TEXTURE_CAPACITY = 1024;
+
+// Eye pass frames averaged into each fragment shader invocation count logged.
+static const uint32_t STATISTICS_FRAMES = 120;
+
+// Offscreen images in flight without a window, as many as a FIFO swapchain has.
+static const uint32_t HEADLESS_FRAMES = 2;
+
+// Frames read back between the checksums logged.
+static const uint32_t READBACK_FRAMES = 120;
+
+// The eye shaders' push constants after the texture index.
+typedef struct EyePushConstants {
+    uint32_t eye;
+    // Lens distortion the vertex shaders apply, zero unless the eyes render on chip.
+    float    lensDistortion;
+} EyePushConstants;
+
+static void PackInstance(const mat4& transform, StereoViewingSceneRenderer::InstanceData& instance)
+{
+    mat4 rows = glm::transpose(transform);
+    glm::mat3 normal = glm::transpose(glm::inverse(glm::mat3(transform)));
+    for (int i = 0; i < 3; i++) {
+        instance.model[i]  = rows[i];
+        instance.normal[i] = vec4(normal[i], 0.0f);
+    }
+}
+
 StereoViewingSceneRenderer::StereoViewingSceneRenderer(void* application, uint32_t screenWidth, uint32_t screenHeight) : Renderer(application, screenWidth, screenHeight)
 {
     SysInitVulkan();
     instance = new Instance();
     layerAndExtension = new LayerAndExtension();
-    if (!BuildInstance(*instance, *layerAndExtension)) {
+#ifdef HEADLESS
+    // Nothing is presented to a window, so neither VK_KHR_surface nor the platform's surface extension is needed.
+    vector<const char*> requestedInstanceExtNames = { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME };
+#else
+    vector<const char*> requestedInstanceExtNames = { VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME };
+#endif
+    if (!BuildInstance(*instance, *layerAndExtension, requestedInstanceExtNames)) {
         throw runtime_error("Essential layers and extension are not available.");
     }
 
-    surface = new Surface(window, instance->GetInstance());
-
+    // Headless too: the render passes still leave their images in the swapchain extension's present layout.
     const vector<const char*> requestedExtNames = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
     VkPhysicalDeviceFeatures requestedFeatures = {};
     requestedFeatures.samplerAnisotropy = VK_TRUE;
     requestedFeatures.sampleRateShading = VK_TRUE;
+#ifdef HEADLESS
+    surface = nullptr;
+    device = new Device(SelectOffscreenPhysicalDevice(*instance, requestedExtNames, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, requestedFeatures));
+#else
+    surface = new Surface(window, instance->GetInstance());
     device = new Device(SelectPhysicalDevice(*instance, *surface, requestedExtNames, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, requestedFeatures));
+#endif
     VkPhysicalDeviceFeatures featuresRequested = { .samplerAnisotropy = VK_TRUE, .sampleRateShading = VK_TRUE };
+    // For GPU culled indirect draws; without them the eye draws are culled and recorded on the CPU.
+    featuresRequested.multiDrawIndirect         = device->FeaturesSupported().multiDrawIndirect;
+    featuresRequested.drawIndirectFirstInstance = device->FeaturesSupported().drawIndirectFirstInstance;
+    // Counts the eye passes' fragment shader invocations, which the depth pre-pass is meant to save.
+    featuresRequested.pipelineStatisticsQuery   = device->FeaturesSupported().pipelineStatisticsQuery;
+    featuresRequested.inheritedQueries          = device->FeaturesSupported().inheritedQueries;
+    bool memoryBudget = layerAndExtension->IsInstanceExtensionEnabled(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    if (memoryBudget) {
+        device->EnableOptionalDeviceExtensions({ VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME,
+                                                 VK_KHR_MULTIVIEW_EXTENSION_NAME, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME });
+        memoryBudget = device->IsDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+    // Descriptor indexing is queried through the same instance extension as the memory budget.
+    if (layerAndExtension->IsInstanceExtensionEnabled(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+        _bindlessTextures = device->EnableDescriptorIndexing(instance->GetInstance());
+    }
     device->BuildDevice(featuresRequested, requestedExtNames);
+    device->Pipelines().Open(pipelineCachePath);
+#ifdef ON_CHIP_EYES
+    _passStructure = STEREO_ON_CHIP;
+#endif
+    // On chip the eyes resolve into the swapchain image, which has no layer per eye.
+    _multiview = _passStructure == STEREO_RESOLVE_AND_SAMPLE && device->IsDeviceExtensionEnabled(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+    Log::Info("Stereo rendering: %s.", _passStructure == STEREO_ON_CHIP ? "both eyes on chip, resolved into the swapchain image" :
+                                       _multiview ? "single pass multiview" : "one pass per eye");
+    if (_passStructure == STEREO_ON_CHIP) {
+        Log::Warn("On chip eyes are lens distorted per vertex, which only approximates the distortion pass: edges stay "
+                  "straight, texture coordinates and lighting are interpolated undistorted, and vertices behind the eye "
+                  "are left undistorted.");
+    }
+    _gpuTimestamps = device->PhysicalDeviceProperties().limits.timestampComputeAndGraphics;
+    if (!_gpuTimestamps) {
+        Log::Warn("No timestamps on the graphics queue, eye buffers stay at full resolution.");
+    }
+    if (memoryBudget) {
+        device->Memory().EnableBudgetQuery(instance->GetInstance());
+    }
+    device->Memory().AddBudgetCallback([](uint32_t heapIndex, const Vulkan::MemoryTracker::HeapStatistics& heap) {
+        Log::Warn("Heap %d is running out of memory: %.2f MiB of %.2f MiB budget in use.",
+                  heapIndex, heap.usage / (1024.0f * 1024.0f), heap.budget / (1024.0f * 1024.0f));
+    });
     _sampleCount = VK_SAMPLE_COUNT_4_BIT;
     device->RequestSampleCount(_sampleCount);
 
@@ -59,39 +149,47 @@ StereoViewingSceneRenderer::StereoViewingSceneRenderer(void* application, uint32
                                                                 VK_COMMAND_BUFFER_LEVEL_PRIMARY,
                                                                 size,
                                                                 d);
+    _uploadContext = new UploadContext(*device);
+    _pipelineRegistry = new PipelineRegistry(*device);
+    _descriptorAllocator = new DescriptorAllocator(d, device->DescriptorLayouts());
+    _threadPool = new ThreadPool(ThreadPool::DefaultThreadCount());
+    command->BuildThreadCommandPools(_threadPool->ThreadCount(), size, *device);
 
     size_t concurrentFramesCount = swapchain->ConcurrentFramesCount();
-    msaaFences.resize(concurrentFramesCount);
+    _eyesCompleteSemaphores.resize(concurrentFramesCount);
     multiFrameFences.resize(concurrentFramesCount);
     imageAvailableSemaphores.resize(concurrentFramesCount);
     commandsCompleteSemaphores.resize(concurrentFramesCount);
     for (int i = 0; i < concurrentFramesCount; i++) {
-        imageAvailableSemaphores[i]   = CreateSemaphore(d);
-        msaaFences[i]                 = CreateFence(d, 0);
-        commandsCompleteSemaphores[i] = CreateSemaphore(d);
-        multiFrameFences[i]           = CreateFence(d, 0);
+        imageAvailableSemaphores[i]   = device->Sync().AcquireSemaphore();
+        _eyesCompleteSemaphores[i]    = device->Sync().AcquireSemaphore();
+        commandsCompleteSemaphores[i] = device->Sync().AcquireSemaphore();
+        multiFrameFences[i]           = device->Sync().AcquireFence();
     }
 
-    // Uniform Buffers: Model and Dynamic View and Projection Transform
-    VkDeviceSize modelTransformSize = sizeof(mat4);
-    _buffers.emplace_back(*device);
-    Buffer& modelTransform = _buffers[0];
-    modelTransform.BuildDefaultBuffer(modelTransformSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    modelTransform.Map();
-
+    // Uniform Buffers: Dynamic Model and View and Projection Transform, one slot per swapchain image
     VkDeviceSize minUboAlignment = device->PhysicalDeviceProperties().limits.minUniformBufferOffsetAlignment;
+    _modelSlotSize = sizeof(mat4);
     _dynamicBufferAlignment = sizeof(ViewProjectionTransform);
     if (minUboAlignment > 0) {
+        _modelSlotSize = (_modelSlotSize + minUboAlignment - 1) / minUboAlignment * minUboAlignment;
         _dynamicBufferAlignment = (_dynamicBufferAlignment + minUboAlignment - 1) / minUboAlignment * minUboAlignment;
     }
     _dynamicBufferSize = _dynamicBufferAlignment * 2;
+    _buffers.emplace_back(*device);
+    Buffer& modelTransform = _buffers[0];
+    modelTransform.name = "model transform";
+    modelTransform.BuildDefaultBuffer(size * _modelSlotSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    modelTransform.Map();
+
     //posix_memalign((void**)&dynamicVP, bufferSize, dynamicAlignment);
     DebugLog("minUniformBufferOffsetAlignment: %d\n", minUboAlignment);
     DebugLog("dynamic vp buffer alignment: %d\n", _dynamicBufferAlignment);
     _buffers.emplace_back(*device);
     Buffer& vpTransform = _buffers[1];
+    vpTransform.name = "view projection transform";
     VkMemoryRequirements memoryRequirements;
-    vpTransform.BuildDefaultBuffer(_dynamicBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &memoryRequirements);
+    vpTransform.BuildDefaultBuffer(size * _dynamicBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &memoryRequirements);
     vpTransform.Map(memoryRequirements.size);
     DebugLog("dynamic vp buffer memory size: %d\n", memoryRequirements.size);
 
@@ -118,23 +216,24 @@ StereoViewingSceneRenderer::~StereoViewingSceneRenderer()
         vkDestroySampler(d, ts, nullptr), ts = VK_NULL_HANDLE;
     }
     _textureSamplers.clear();
+    delete _uploadContext, _uploadContext = nullptr;
     _buffers.clear();
     _modelTextures.clear();
     _modelResources.clear();
     _textureAttribsGroup.clear();
 
     for (int i = 0; i < concurrentFramesCount; i++) {
-        vkDestroyFence(d, msaaFences[i], nullptr), msaaFences[i] = VK_NULL_HANDLE;
-        vkDestroyFence(d, multiFrameFences[i], nullptr), multiFrameFences[i] = VK_NULL_HANDLE;
-        vkDestroySemaphore(d, imageAvailableSemaphores[i], nullptr), imageAvailableSemaphores[i] = VK_NULL_HANDLE;
-        vkDestroySemaphore(d, commandsCompleteSemaphores[i], nullptr), commandsCompleteSemaphores[i] = VK_NULL_HANDLE;
+        device->Sync().ReleaseSemaphore(_eyesCompleteSemaphores[i]), _eyesCompleteSemaphores[i] = VK_NULL_HANDLE;
+        device->Sync().ReleaseFence(multiFrameFences[i]), multiFrameFences[i] = VK_NULL_HANDLE;
+        device->Sync().ReleaseSemaphore(imageAvailableSemaphores[i]), imageAvailableSemaphores[i] = VK_NULL_HANDLE;
+        device->Sync().ReleaseSemaphore(commandsCompleteSemaphores[i]), commandsCompleteSemaphores[i] = VK_NULL_HANDLE;
     }
 
+    delete _threadPool, _threadPool = nullptr;
     delete command, command = nullptr;
+    delete _pipelineRegistry, _pipelineRegistry = nullptr;
 
-    vkDestroyDescriptorSetLayout(d, _msaaDescriptorSetLayout, nullptr), _msaaDescriptorSetLayout = VK_NULL_HANDLE;
-    vkDestroyDescriptorSetLayout(d, _multiviewDescriptorSetLayout, nullptr), _multiviewDescriptorSetLayout = VK_NULL_HANDLE;
-    vkDestroyDescriptorPool(d, _descriptorPool, nullptr), _descriptorPool = VK_NULL_HANDLE;
+    delete _descriptorAllocator, _descriptorAllocator = nullptr;
     vkDestroyPipelineLayout(d, _msaaPipelineLayout, nullptr), _msaaPipelineLayout = VK_NULL_HANDLE;
     vkDestroyPipelineLayout(d, _multiviewPipelineLayout, nullptr), _multiviewPipelineLayout = VK_NULL_HANDLE;
 
@@ -146,22 +245,54 @@ StereoViewingSceneRenderer::~StereoViewingSceneRenderer()
 
 void StereoViewingSceneRenderer::BuildSwapchainWithDependencies()
 {
+#if defined(HEADLESS_READBACK)
+    swapchain = new Swapchain(*device, HEADLESS_FRAMES, VK_FORMAT_R8G8B8A8_UNORM, true);
+    swapchain->onFrameRead = [this](uint32_t imageIndex, const uint8_t* pixels) { OnFrameRead(pixels); };
+#elif defined(HEADLESS)
+    swapchain = new Swapchain(*device, HEADLESS_FRAMES);
+#else
     swapchain = new Swapchain(*surface, *device);
+#endif
     swapchain->getScreenExtent = [&]() -> Extent2D { return screenSize; };
     BuildSwapchain(*swapchain);
 
-    RenderPass* msaaRenderPass;
-    msaaRenderPass = new MSAAShaderReadRenderPass(*device);
-    msaaRenderPass->getFormat = [this]() -> VkFormat { return swapchain->Format(); };
-    msaaRenderPass->getSampleCount = [this]() -> VkSampleCountFlagBits { return _sampleCount; };
-    msaaRenderPass->CreateRenderPass();
-    renderPasses.push_back(msaaRenderPass);
-    RenderPass* swapchainRenderPass;
-    swapchainRenderPass = new ColorDestinationRenderPass(*device);
-    swapchainRenderPass->getFormat = [this]() -> VkFormat { return swapchain->Format(); };
-    swapchainRenderPass->getSampleCount = [this]() -> VkSampleCountFlagBits { return _sampleCount; };
-    swapchainRenderPass->CreateRenderPass();
-    renderPasses.push_back(swapchainRenderPass);
+    const VkExtent2D& extent = swapchain->Extent();
+    // On chip there are no eye buffers; the layout still sizes them for the traffic estimate.
+    _foveation = FoveationLayout(_foveationLevel, extent, { extent.width / 2, extent.height });
+    if (_passStructure == STEREO_ON_CHIP) {
+        Log::Info("Eyes rendered at the screen's density, no foveation.");
+    } else {
+        Log::Info("Foveation %s: %dx%d eye buffers in %d regions shade %.1f%% of the pixels of full size ones.",
+                  FoveationLayout::Name(_foveationLevel), _foveation.EyeExtent().width, _foveation.EyeExtent().height,
+                  static_cast<int>(_foveation.Regions().size()), _foveation.ShadedPixelRatio() * 100.0f);
+    }
+
+    _frameGraph       = new RenderGraph();
+    _renderTargetPool = new RenderTargetPool(*device);
+
+    if (_passStructure == STEREO_ON_CHIP) {
+        // A single render pass: the eyes are resolved into the swapchain image with nothing left to distort.
+        RenderPass* eyesRenderPass;
+        eyesRenderPass = new MSAASwapchainRenderPass(*device);
+        eyesRenderPass->getFormat = [this]() -> VkFormat { return swapchain->Format(); };
+        eyesRenderPass->getSampleCount = [this]() -> VkSampleCountFlagBits { return _sampleCount; };
+        eyesRenderPass->CreateRenderPass();
+        renderPasses.push_back(eyesRenderPass);
+    } else {
+        MSAAShaderReadRenderPass* msaaRenderPass;
+        msaaRenderPass = new MSAAShaderReadRenderPass(*device);
+        msaaRenderPass->getFormat = [this]() -> VkFormat { return swapchain->Format(); };
+        msaaRenderPass->getSampleCount = [this]() -> VkSampleCountFlagBits { return _sampleCount; };
+        msaaRenderPass->viewMask = _multiview ? 0b11 : 0;
+        msaaRenderPass->CreateRenderPass();
+        renderPasses.push_back(msaaRenderPass);
+        RenderPass* swapchainRenderPass;
+        swapchainRenderPass = new ColorDestinationRenderPass(*device);
+        swapchainRenderPass->getFormat = [this]() -> VkFormat { return swapchain->Format(); };
+        swapchainRenderPass->getSampleCount = [this]() -> VkSampleCountFlagBits { return _sampleCount; };
+        swapchainRenderPass->CreateRenderPass();
+        renderPasses.push_back(swapchainRenderPass);
+    }
 
     uint32_t size = swapchain->ImageViews().size();
     for (int i = 0 ; i < size; i++) {
@@ -170,12 +301,14 @@ void StereoViewingSceneRenderer::BuildSwapchainWithDependencies()
 
     // BuildMSAAImage
     // BuildMSAADepthImage
+    // BuildRenderTargets
     _lMsaaResolvedImages.resize(size, VK_NULL_HANDLE);
     _lMsaaResolvedMemories.resize(size, VK_NULL_HANDLE);
     _lMsaaResolvedViews.resize(size, VK_NULL_HANDLE);
     _rMsaaResolvedImages.resize(size, VK_NULL_HANDLE);
     _rMsaaResolvedMemories.resize(size, VK_NULL_HANDLE);
     _rMsaaResolvedViews.resize(size, VK_NULL_HANDLE);
+    _stereoResolvedViews.resize(size, VK_NULL_HANDLE);
     // BuildMSAAResolvedImages
     for (int i = 0; i < size; i++) {
         _lMsaaFramebuffers.push_back(*device);
@@ -184,11 +317,35 @@ void StereoViewingSceneRenderer::BuildSwapchainWithDependencies()
 
     // BuildMSAAResolvedResultSampler
 
+    // BuildFramebuffers
+
     _lDescriptorSets.resize(size, VK_NULL_HANDLE);
     _rDescriptorSets.resize(size, VK_NULL_HANDLE);
+
+    _commandBuffersDirty.assign(size, true);
+    _imageFences.assign(size, VK_NULL_HANDLE);
+    // The begin and end of the eye pass of each swapchain image.
+    if (_gpuTimestamps) {
+        VkQueryPoolCreateInfo queryPoolInfo = {};
+        queryPoolInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 2 * size;
+        VK_CHECK_RESULT(vkCreateQueryPool(device->LogicalDevice(), &queryPoolInfo, nullptr, &_timestampPool));
+    }
+    _timestampsWritten.assign(size, false);
+    // The eye draws are recorded into secondaries, which inherit the query.
+    if (device->FeaturesEnabled().pipelineStatisticsQuery && device->FeaturesEnabled().inheritedQueries) {
+        VkQueryPoolCreateInfo queryPoolInfo = {};
+        queryPoolInfo.sType              = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType          = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        queryPoolInfo.queryCount         = size;
+        queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        VK_CHECK_RESULT(vkCreateQueryPool(device->LogicalDevice(), &queryPoolInfo, nullptr, &_statisticsPool));
+    }
+    _statisticsWritten.assign(size, false);
+    _statisticsPrePass.assign(size, false);
     // BuildMSAADescriptorSetLayout
     // BuildMultiviewDescriptorSetLayout
-    // BuildDescriptorPool
     // BuildMSAADescriptorSet
     // BuildMultiViewDescriptorSet
     // BuildMSAAPipeline
@@ -201,18 +358,18 @@ void StereoViewingSceneRenderer::DeleteSwapchainWithDependencies()
 
     vkDeviceWaitIdle(d);
 
-    vkDestroyImageView(d, _lMsaaView, nullptr), _lMsaaView = VK_NULL_HANDLE;
-    vkDestroyImage(d, _lMsaaImage, nullptr), _lMsaaImage = VK_NULL_HANDLE;
-    vkFreeMemory(d, _lMsaaImageMemory, nullptr), _lMsaaImageMemory = VK_NULL_HANDLE;
-    vkDestroyImageView(d, _lDepthView, nullptr), _lDepthView = VK_NULL_HANDLE;
-    vkDestroyImage(d, _lDepthImage, nullptr), _lDepthImage = VK_NULL_HANDLE;
-    vkFreeMemory(d, _lDepthImageMemory, nullptr), _lDepthImageMemory = VK_NULL_HANDLE;
-    vkDestroyImageView(d, _rMsaaView, nullptr), _rMsaaView = VK_NULL_HANDLE;
-    vkDestroyImage(d, _rMsaaImage, nullptr), _rMsaaImage = VK_NULL_HANDLE;
-    vkFreeMemory(d, _rMsaaImageMemory, nullptr), _rMsaaImageMemory = VK_NULL_HANDLE;
-    vkDestroyImageView(d, _rDepthView, nullptr), _rDepthView = VK_NULL_HANDLE;
-    vkDestroyImage(d, _rDepthImage, nullptr), _rDepthImage = VK_NULL_HANDLE;
-    vkFreeMemory(d, _rDepthImageMemory, nullptr), _rDepthImageMemory = VK_NULL_HANDLE;
+    vkDestroyQueryPool(d, _timestampPool, nullptr), _timestampPool = VK_NULL_HANDLE;
+    _timestampsWritten.clear();
+    vkDestroyQueryPool(d, _statisticsPool, nullptr), _statisticsPool = VK_NULL_HANDLE;
+    _statisticsWritten.clear();
+    _statisticsPrePass.clear();
+
+    delete _gpuCuller        , _gpuCuller         = nullptr;
+    delete _clusteredLighting, _clusteredLighting = nullptr;
+    delete _instanceBuffer   , _instanceBuffer    = nullptr;
+
+    delete _renderTargetPool, _renderTargetPool = nullptr;
+    delete _frameGraph      , _frameGraph       = nullptr;
 
     for (auto& view : _lMsaaResolvedViews) {
         vkDestroyImageView(d, view, nullptr), view = VK_NULL_HANDLE;
@@ -223,7 +380,7 @@ void StereoViewingSceneRenderer::DeleteSwapchainWithDependencies()
     }
     _lMsaaResolvedImages.clear();
     for (auto& mem : _lMsaaResolvedMemories) {
-        vkFreeMemory(d, mem, nullptr), mem = VK_NULL_HANDLE;
+        device->Memory().Free(mem), mem = VK_NULL_HANDLE;
     }
     _lMsaaResolvedMemories.clear();
 
@@ -231,30 +388,34 @@ void StereoViewingSceneRenderer::DeleteSwapchainWithDependencies()
         vkDestroyImageView(d, view, nullptr), view = VK_NULL_HANDLE;
     }
     _rMsaaResolvedViews.clear();
+    for (auto& view : _stereoResolvedViews) {
+        vkDestroyImageView(d, view, nullptr), view = VK_NULL_HANDLE;
+    }
+    _stereoResolvedViews.clear();
     for (auto& image : _rMsaaResolvedImages) {
         vkDestroyImage(d, image, nullptr), image = VK_NULL_HANDLE;
     }
     _rMsaaResolvedImages.clear();
     for (auto& mem : _rMsaaResolvedMemories) {
-        vkFreeMemory(d, mem, nullptr), mem = VK_NULL_HANDLE;
+        device->Memory().Free(mem), mem = VK_NULL_HANDLE;
     }
     _rMsaaResolvedMemories.clear();
 
     _lMsaaFramebuffers.clear();
     _rMsaaFramebuffers.clear();
 
-    vkFreeDescriptorSets(d, _descriptorPool, 1, &_msaaDescriptorSet);
-    for (auto& ds : _lDescriptorSets) {
-        vkFreeDescriptorSets(d, _descriptorPool, 1, &ds);
-    }
+    _descriptorAllocator->Reset();
+    _msaaDescriptorSet = VK_NULL_HANDLE;
+    _textureDescriptorSet = VK_NULL_HANDLE;
+    _materialDescriptorSets.clear();
     _lDescriptorSets.clear();
-    for (auto& ds : _rDescriptorSets) {
-        vkFreeDescriptorSets(d, _descriptorPool, 1, &ds);
-    }
     _rDescriptorSets.clear();
 
-    vkDestroyPipeline(d, _msaaPipeline, nullptr), _msaaPipeline = VK_NULL_HANDLE;
-    vkDestroyPipeline(d, _multiviewPipeline, nullptr), _multiviewPipeline = VK_NULL_HANDLE;
+    _pipelineRegistry->WaitIdle();
+    _pipelineRegistry->Release(_msaaPipeline), _msaaPipeline = PipelineRegistry::INVALID_ID;
+    _pipelineRegistry->Release(_multiviewPipeline), _multiviewPipeline = PipelineRegistry::INVALID_ID;
+    _pipelineRegistry->Release(_depthPrePassPipeline), _depthPrePassPipeline = PipelineRegistry::INVALID_ID;
+    _pipelineRegistry->Release(_prePassShadingPipeline), _prePassShadingPipeline = PipelineRegistry::INVALID_ID;
 
     framebuffers.clear();
 
@@ -284,51 +445,104 @@ void StereoViewingSceneRenderer::RenderImpl()
     if (currentFrameToImageindex.count(currentFrameIndex) > 0) {
         VkFence fences[] = { multiFrameFences[currentFrameIndex] };
         VK_CHECK_RESULT(vkWaitForFences(d, 1, fences, true, UINT64_MAX));
+        // Before the reset: uploads whose semaphore this frame's previous submission waited on have the fence as their
+        // consumer fence, and are only released while it reads signaled.
+        _uploadContext->Collect();
         VK_CHECK_RESULT(vkResetFences(d, 1, fences));
-        framebuffers[currentFrameToImageindex[currentFrameIndex]].ReleaseFramebuffer();
         currentFrameToImageindex.erase(currentFrameIndex);
     }
 
     uint32_t imageIndex;
-    vkAcquireNextImageKHR(d, swapchain->GetSwapchain(), UINT64_MAX, imageAvailableSemaphores[currentFrameIndex], VK_NULL_HANDLE, &imageIndex);
+    swapchain->AcquireNextImage(imageAvailableSemaphores[currentFrameIndex], &imageIndex);
 
-    vector<VkImageView> attachments = { _lMsaaView, _lDepthView, _lMsaaResolvedViews[imageIndex] };
-    const VkExtent2D& e = swapchain->Extent();
-    _lMsaaFramebuffers[imageIndex].CreateSwapchainFramebuffer(renderPasses[0]->GetRenderPass(), attachments, e);
-    attachments = { _rMsaaView, _rDepthView, _rMsaaResolvedViews[imageIndex] };
-    _rMsaaFramebuffers[imageIndex].CreateSwapchainFramebuffer(renderPasses[0]->GetRenderPass(), attachments, e);
-    attachments = { swapchain->ImageViews()[imageIndex] };
-    framebuffers[imageIndex].CreateSwapchainFramebuffer(renderPasses[1]->GetRenderPass(), attachments, e);
-
-    BuildCommandBuffers(imageIndex);
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &_msaaCommandBuffers.buffers[imageIndex];
-    VK_CHECK_RESULT(vkQueueSubmit(device->FamilyQueues().graphics.queue, 1, &submitInfo, msaaFences[currentFrameIndex]));
-
-    VK_CHECK_RESULT(vkWaitForFences(d, 1, &msaaFences[currentFrameIndex], true, UINT64_MAX));
-    VK_CHECK_RESULT(vkResetFences(d, 1, &msaaFences[currentFrameIndex]));
-    _lMsaaFramebuffers[imageIndex].ReleaseFramebuffer();
-    _rMsaaFramebuffers[imageIndex].ReleaseFramebuffer();
-
-    submitInfo.waitSemaphoreCount = 1;
-    VkSemaphore multiviewWaitSemaphores[] = { imageAvailableSemaphores[currentFrameIndex] };
-    submitInfo.pWaitSemaphores = multiviewWaitSemaphores;
-    VkPipelineStageFlags multiviewWaitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submitInfo.pWaitDstStageMask = multiviewWaitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &_commandBuffers.buffers[imageIndex];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &commandsCompleteSemaphores[currentFrameIndex];
-    VK_CHECK_RESULT(vkQueueSubmit(device->FamilyQueues().graphics.queue, 1, &submitInfo, multiFrameFences[currentFrameIndex]));
+    // Images may be acquired out of order, so the image's command buffers can still be in flight from another frame.
+    VkFence imageFence = _imageFences[imageIndex];
+    if (imageFence != VK_NULL_HANDLE && imageFence != multiFrameFences[currentFrameIndex]) {
+        VK_CHECK_RESULT(vkWaitForFences(d, 1, &imageFence, true, UINT64_MAX));
+    }
+    _imageFences[imageIndex] = multiFrameFences[currentFrameIndex];
+
+    if (_gpuCuller) {
+        _gpuCuller->Update(imageIndex, _cullingFrustum, _submeshVisibility);
+    }
+    _clusteredLighting->Update(imageIndex, _lights, _eyeTransforms, _lightNear, _lightFar, lighting);
+    memcpy(static_cast<uint8_t*>(_instanceBuffer->mapped) + imageIndex * _instanceSlotSize, _instances.data(), _instances.size() * sizeof(InstanceData));
+    WriteUniformBuffers(imageIndex);
+
+    // The image's previous frame is complete, so are its timestamps. On chip the eyes are not scaled.
+    if (_timestampsWritten[imageIndex] && _passStructure == STEREO_RESOLVE_AND_SAMPLE) {
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(d, _timestampPool, 2 * imageIndex, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            float milliseconds = (timestamps[1] - timestamps[0]) * device->PhysicalDeviceProperties().limits.timestampPeriod / 1000000.0f;
+            if (_dynamicResolution.Update(milliseconds)) {
+                Log::Info("Eye resolution scale %.3f at %.2f ms of GPU time per eye pass.",
+                          _dynamicResolution.Scale(), _dynamicResolution.FilteredMilliseconds());
+                MarkCommandBuffersDirty();
+            }
+        }
+    }
+    if (_statisticsWritten[imageIndex]) {
+        ReadPipelineStatistics(imageIndex);
+    }
+
+    if (_commandBuffersDirty[imageIndex]) {
+        BuildCommandBuffers(imageIndex);
+        _commandBuffersDirty[imageIndex] = false;
+    }
+
+    // The first frame after UploadModels() also waits for the uploads before touching vertices, indices or textures.
+    VkSemaphore uploadComplete = _uploadContext->TakeSemaphore(_uploadTicket, multiFrameFences[currentFrameIndex]);
+    VkPipelineStageFlags uploadWaitStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    if (_passStructure == STEREO_ON_CHIP) {
+        // The eyes resolve into the acquired image, so their single submit waits for it.
+        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrameIndex], uploadComplete };
+        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, uploadWaitStage };
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount   = uploadComplete != VK_NULL_HANDLE ? 2 : 1;
+        submitInfo.pWaitSemaphores      = waitSemaphores;
+        submitInfo.pWaitDstStageMask    = waitStages;
+        submitInfo.commandBufferCount   = 1;
+        submitInfo.pCommandBuffers      = &_msaaCommandBuffers.buffers[imageIndex];
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores    = &commandsCompleteSemaphores[currentFrameIndex];
+        VK_CHECK_RESULT(vkQueueSubmit(device->FamilyQueues().graphics.queue, 1, &submitInfo, multiFrameFences[currentFrameIndex]));
+    } else {
+        // The eye pass doesn't touch the swapchain image, so it starts right away. The distortion pass waits for both
+        // the eyes and the acquired image on the GPU; the CPU only waits on the frame fence, frames later.
+        VkSubmitInfo submitInfos[2] = {};
+        submitInfos[0].sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfos[0].waitSemaphoreCount   = uploadComplete != VK_NULL_HANDLE ? 1 : 0;
+        submitInfos[0].pWaitSemaphores      = &uploadComplete;
+        submitInfos[0].pWaitDstStageMask    = &uploadWaitStage;
+        submitInfos[0].commandBufferCount   = 1;
+        submitInfos[0].pCommandBuffers      = &_msaaCommandBuffers.buffers[imageIndex];
+        submitInfos[0].signalSemaphoreCount = 1;
+        submitInfos[0].pSignalSemaphores    = &_eyesCompleteSemaphores[currentFrameIndex];
+
+        VkSemaphore multiviewWaitSemaphores[] = { imageAvailableSemaphores[currentFrameIndex], _eyesCompleteSemaphores[currentFrameIndex] };
+        VkPipelineStageFlags multiviewWaitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT };
+        submitInfos[1].sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfos[1].waitSemaphoreCount   = 2;
+        submitInfos[1].pWaitSemaphores      = multiviewWaitSemaphores;
+        submitInfos[1].pWaitDstStageMask    = multiviewWaitStages;
+        submitInfos[1].commandBufferCount   = 1;
+        submitInfos[1].pCommandBuffers      = &_commandBuffers.buffers[imageIndex];
+        submitInfos[1].signalSemaphoreCount = 1;
+        submitInfos[1].pSignalSemaphores    = &commandsCompleteSemaphores[currentFrameIndex];
+        VK_CHECK_RESULT(vkQueueSubmit(device->FamilyQueues().graphics.queue, 2, submitInfos, multiFrameFences[currentFrameIndex]));
+    }
 
     currentFrameToImageindex[currentFrameIndex] = imageIndex;
+    _timestampsWritten[imageIndex] = _timestampPool != VK_NULL_HANDLE;
+    _statisticsWritten[imageIndex] = _statisticsPool != VK_NULL_HANDLE;
 
-    QueuePresent(&swapchain->GetSwapchain(), &imageIndex, *device, 1, &commandsCompleteSemaphores[currentFrameIndex]);
+    swapchain->Present(imageIndex, commandsCompleteSemaphores[currentFrameIndex]);
 
     currentFrameIndex = (currentFrameIndex + 1) % swapchain->ConcurrentFramesCount();
+
+    _descriptorAllocator->EndFrame();
+    _descriptorAllocator->LogIfDue("Stereo viewing");
 }
 
 void StereoViewingSceneRenderer::UpdateUniformBuffers(const vector<mat4>& modelTransforms,
@@ -336,17 +550,25 @@ void StereoViewingSceneRenderer::UpdateUniformBuffers(const vector<mat4>& modelT
                                                       const ViewProjectionTransform& lViewProj,
                                                       const ViewProjectionTransform& rViewProj,
                                                       int viewProjSize)
+{
+    // Kept until RenderImpl() knows which image's slot is free to write.
+    std::copy((uint8_t*)&modelTransforms[0], (uint8_t*)&modelTransforms[0] + modelTransformSizes[0], (uint8_t*)&_modelTransform);
+    _depthSortTransform = lViewProj.projection * lViewProj.view * modelTransforms[0];
+    _eyeTransforms[0] = lViewProj;
+    _eyeTransforms[1] = rViewProj;
+}
+
+void StereoViewingSceneRenderer::WriteUniformBuffers(uint32_t imageIndex)
 {
     Buffer& modelTransform = _buffers[0];
-    std::copy((uint8_t*)&modelTransforms[0], (uint8_t*)&modelTransforms[0] + modelTransformSizes[0], (uint8_t*)modelTransform.mapped);
+    memcpy(static_cast<uint8_t*>(modelTransform.mapped) + imageIndex * _modelSlotSize, &_modelTransform, sizeof(mat4));
 
+    // Multiview reads both eyes as one array, the two pass path each eye at its dynamic offset within the slot.
     Buffer& vpTransform = _buffers[1];
-    ViewProjectionTransform* base = (ViewProjectionTransform*)vpTransform.mapped;
-    std::copy((uint8_t*)&lViewProj, (uint8_t*)&lViewProj + viewProjSize, (uint8_t*)base);
-
-    base++;
-
-    std::copy((uint8_t*)&rViewProj, (uint8_t*)&rViewProj + viewProjSize, (uint8_t*)base);
+    uint8_t* base = static_cast<uint8_t*>(vpTransform.mapped) + imageIndex * _dynamicBufferSize;
+    memcpy(base, &_eyeTransforms[0], sizeof(ViewProjectionTransform));
+    base += _multiview ? sizeof(ViewProjectionTransform) : _dynamicBufferAlignment;
+    memcpy(base, &_eyeTransforms[1], sizeof(ViewProjectionTransform));
 }
 
 void StereoViewingSceneRenderer::UploadModels(const vector<Model>& models)
@@ -355,11 +577,17 @@ void StereoViewingSceneRenderer::UploadModels(const vector<Model>& models)
     string filePath = string(app->activity->externalDataPath) + string("/the-upper-vestibule/");
     Texture::TextureAttribs textureAttribs;
     for (const auto& m : models) {
+        // Only the first model is drawn textured.
+        bool textured = (&m == &models.front());
         for (const auto& n : m.Materials()) {
+            int diffuseTexture = -1;
             for (const auto& it: n.textures) {
                 aiTextureType type = (aiTextureType)it.first;
                 DebugLog("Texture Type: %d", type);
                 for (const auto& str : it.second) {
+                    if (type == aiTextureType_DIFFUSE && diffuseTexture < 0) {
+                        diffuseTexture = static_cast<int>(_modelTextures.size());
+                    }
                     uint8_t* imageData = stbi_load((string(filePath) + str).c_str(),
                                                    (int*)&textureAttribs.width,
                                                    (int*)&textureAttribs.height,
@@ -369,14 +597,35 @@ void StereoViewingSceneRenderer::UploadModels(const vector<Model>& models)
                     textureAttribs.mipmapLevels = (uint32_t)(floor(log2(max(textureAttribs.width, textureAttribs.height)))) + 1;
                     _textureAttribsGroup.emplace_back(textureAttribs);
                     _modelTextures.emplace_back(*device);
-                    _modelTextures[_modelTextures.size() - 1].BuildTexture2D(textureAttribs, imageData, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *command);
+                    _modelTextures[_modelTextures.size() - 1].name = str;
+                    _modelTextures[_modelTextures.size() - 1].BuildTexture2D(textureAttribs, imageData, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *_uploadContext);
                     _textureSamplers.push_back(VK_NULL_HANDLE);
                 }
             }
+            if (textured) {
+                _materialTextures.push_back(diffuseTexture < 0 ? 0 : static_cast<uint32_t>(diffuseTexture));
+            }
         }
         _modelResources.emplace_back(*device);
-        _modelResources[_modelResources.size() - 1].UploadToGPU(m, *command);
+        _modelResources[_modelResources.size() - 1].UploadToGPU(m, *_uploadContext);
+    }
+
+    const Culling::Bounds& bounds = models[0].SubmeshBounds();
+    const vector<ModelResource::Mesh>& submeshes = _modelResources[0].Submeshes();
+    _gpuSubmeshes.resize(submeshes.size());
+    for (size_t i = 0; i < submeshes.size(); i++) {
+        GpuCuller::Submesh& submesh = _gpuSubmeshes[i];
+        vec3 center = bounds.Center(i), extent = bounds.Extent(i);
+        std::copy(&center[0], &center[0] + 3, submesh.center);
+        std::copy(&extent[0], &extent[0] + 3, submesh.extent);
+        submesh.center[3] = submesh.extent[3] = 0.0f;
+        submesh.indexCount   = submeshes[i].indexCount;
+        submesh.firstIndex   = submeshes[i].indexBase;
+        submesh.vertexOffset = static_cast<int32_t>(submeshes[i].vertexBase);
+        submesh.textureIndex = MaterialTexture(submeshes[i].materialIndex);
     }
+    _uploadTicket = _uploadContext->Flush();
+    MarkCommandBuffersDirty();
 }
 
 void StereoViewingSceneRenderer::BuildTextureSamplers()
@@ -397,84 +646,174 @@ void StereoViewingSceneRenderer::BuildTextureSamplers()
 
 void StereoViewingSceneRenderer::BuildMSAAImage(VkSampleCountFlagBits sampleCount, int eye)
 {
-    VkFormat colorFormat = swapchain->Format();
-    VkExtent2D extent = swapchain->Extent();
-    VkImageCreateInfo imageInfo = ImageCreateInfo(colorFormat,
-                                                  { extent.width, extent.height, 1},
-                                                  1,
-                                                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
-                                                  VK_IMAGE_TILING_OPTIMAL,
-                                                  VK_IMAGE_LAYOUT_UNDEFINED,
-                                                  sampleCount);
-    VkDevice d = device->LogicalDevice();
-    bool leftEye = (eye == 0);
-    VkImage &image = leftEye ? _lMsaaImage : _rMsaaImage;
-    VkDeviceMemory &memory = leftEye ? _lMsaaImageMemory : _rMsaaImageMemory;
-    VkImageView &imageView = leftEye ? _lMsaaView : _rMsaaView;
-    VK_CHECK_RESULT(vkCreateImage(d, &imageInfo, nullptr, &image));
-
-    VkMemoryRequirements memoryRequirements;
-    uint32_t memoryTypeIndex;
-    VkMemoryAllocateInfo memoryAllocateInfo = MemoryAllocateInfo(image,
-                                                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                                 *device,
-                                                                 memoryRequirements,
-                                                                 memoryTypeIndex);
-    VK_CHECK_RESULT(vkAllocateMemory(d, &memoryAllocateInfo, nullptr, &memory));
-    VK_CHECK_RESULT(vkBindImageMemory(d, image, memory, 0));
-
-    VkImageViewCreateInfo imageViewInfo = ImageViewCreateInfo(image, colorFormat,
-                                                              {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1,
-                                                               0, 1});
-    VK_CHECK_RESULT(vkCreateImageView(d, &imageViewInfo, nullptr, &imageView));
+    // With multiview both eyes are layers of the left eye's attachment, on chip its halves.
+    bool onChip = _passStructure == STEREO_ON_CHIP;
+    if ((_multiview || onChip) && eye == 1) {
+        _msaaResources[1] = _msaaResources[0];
+        return;
+    }
+    RenderTargetPool::AttachmentInfo attachmentInfo = EyeTargetInfo(_passStructure, false);
+    attachmentInfo.samples = sampleCount;
+    _msaaResources[eye] = _frameGraph->CreateTransient(_multiview ? "stereo msaa color" : onChip ? "side by side msaa color" :
+                                                       eye == 0 ? "left msaa color" : "right msaa color", attachmentInfo);
 }
 
 void StereoViewingSceneRenderer::BuildMSAADepthImage(RenderPass *msaaRenderPass, VkSampleCountFlagBits sampleCount, int eye)
 {
-    VkFormat depthFormat = ((MSAAShaderReadRenderPass*)msaaRenderPass)->DepthFormat();
-    VkImageAspectFlags depthImageAspectFlags = VK_IMAGE_ASPECT_DEPTH_BIT;
-    if (depthFormat == VK_FORMAT_D16_UNORM_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT || depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT) {
-        depthImageAspectFlags |= VK_IMAGE_ASPECT_STENCIL_BIT;
-    }
-    VkExtent2D extent2D = swapchain->Extent();
-    VkImageCreateInfo imageInfo = ImageCreateInfo(depthFormat,
-                                                  { extent2D.width, extent2D.height, 1 },
-                                                  1,
-                                                  VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                                                  VK_IMAGE_TILING_OPTIMAL,
-                                                  VK_IMAGE_LAYOUT_UNDEFINED,
-                                                  sampleCount);
-    VkDevice d = device->LogicalDevice();
-    bool leftEye = (eye == 0);
-    VkImage &image = leftEye ? _lDepthImage : _rDepthImage;
-    VkDeviceMemory &memory = leftEye ? _lDepthImageMemory : _rDepthImageMemory;
-    VkImageView &view = leftEye ? _lDepthView : _rDepthView;
-    VK_CHECK_RESULT(vkCreateImage(d, &imageInfo, nullptr, &image));
+    bool onChip = _passStructure == STEREO_ON_CHIP;
+    if ((_multiview || onChip) && eye == 1) {
+        _depthResources[1] = _depthResources[0];
+        return;
+    }
+    _depthFormat = onChip ? ((MSAASwapchainRenderPass*)msaaRenderPass)->DepthFormat() : ((MSAAShaderReadRenderPass*)msaaRenderPass)->DepthFormat();
+    RenderTargetPool::AttachmentInfo attachmentInfo = EyeTargetInfo(_passStructure, true);
+    attachmentInfo.samples = sampleCount;
+    _depthResources[eye] = _frameGraph->CreateTransient(_multiview ? "stereo depth" : onChip ? "side by side depth" :
+                                                        eye == 0 ? "left depth" : "right depth", attachmentInfo);
+}
 
-    VkMemoryRequirements memoryRequirements;
-    uint32_t memoryTypeIndex;
-    VkMemoryAllocateInfo memoryAllocateInfo = MemoryAllocateInfo(image,
-                                                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                                 *device,
-                                                                 memoryRequirements,
-                                                                 memoryTypeIndex);
-    VK_CHECK_RESULT(vkAllocateMemory(d, &memoryAllocateInfo, nullptr, &memory));
-    VK_CHECK_RESULT(vkBindImageMemory(d, image, memory, 0));
-
-    VkImageViewCreateInfo imageViewInfo = ImageViewCreateInfo(image, depthFormat,
-                                                              {depthImageAspectFlags, 0, 1, 0,
-                                                               1});
-    VK_CHECK_RESULT(vkCreateImageView(d, &imageViewInfo, nullptr, &view));
+RenderGraph::ImageInfo StereoViewingSceneRenderer::EyeTargetInfo(StereoPassStructure structure, bool depth) const
+{
+    RenderGraph::ImageInfo info = {};
+    info.format      = swapchain->Format();
+    info.extent      = structure == STEREO_ON_CHIP ? swapchain->Extent() : _foveation.EyeExtent();
+    info.usage       = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    info.samples     = _sampleCount;
+    info.aspect      = VK_IMAGE_ASPECT_COLOR_BIT;
+    info.arrayLayers = _multiview && structure == STEREO_RESOLVE_AND_SAMPLE ? 2 : 1;
+    if (depth) {
+        // Depth is cleared on load and never stored, so it is as transient as the MSAA color.
+        info.format = _depthFormat;
+        info.usage  = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        info.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        if (_depthFormat == VK_FORMAT_D16_UNORM_S8_UINT || _depthFormat == VK_FORMAT_D24_UNORM_S8_UINT || _depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT) {
+            info.aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+    }
+    return info;
+}
+
+void StereoViewingSceneRenderer::BuildRenderTargets()
+{
+    // The frame as a graph: both eyes render into MSAA targets resolved into per-image textures the distortion pass
+    // samples into the swapchain image, or on chip straight into it. The render passes still come from
+    // MSAAShaderReadRenderPass and ColorDestinationRenderPass, or MSAASwapchainRenderPass; the graph decides which
+    // transients alias and logs the barriers it would place.
+    DeclarePasses(*_frameGraph, _passStructure, _msaaResources, _depthResources);
+    _frameGraph->Compile();
+    _frameGraph->LogPlan();
+    LogTraffic();
+
+    _frameGraph->DeclareTransients(*_renderTargetPool);
+    for (int eye = 0; eye < 2; eye++) {
+        _msaaTargets[eye]  = _frameGraph->Attachment(_msaaResources[eye]);
+        _depthTargets[eye] = _frameGraph->Attachment(_depthResources[eye]);
+    }
+    _renderTargetPool->Build();
+}
+
+void StereoViewingSceneRenderer::DeclarePasses(RenderGraph& graph, StereoPassStructure structure, const uint32_t msaa[2], const uint32_t depth[2]) const
+{
+    RenderGraph::ImageInfo swapchainInfo = {};
+    swapchainInfo.format      = swapchain->Format();
+    swapchainInfo.extent      = swapchain->Extent();
+    swapchainInfo.usage       = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    swapchainInfo.samples     = VK_SAMPLE_COUNT_1_BIT;
+    swapchainInfo.aspect      = VK_IMAGE_ASPECT_COLOR_BIT;
+    swapchainInfo.arrayLayers = 1;
+    uint32_t swapchainImage = graph.Import("swapchain", swapchainInfo, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    if (structure == STEREO_ON_CHIP) {
+        uint32_t pass = graph.AddPass("both eyes side by side");
+        graph.Write(pass, msaa[0], Vulkan::RESOURCE_USAGE_COLOR_ATTACHMENT);
+        graph.Write(pass, depth[0], Vulkan::RESOURCE_USAGE_DEPTH_ATTACHMENT);
+        graph.Write(pass, swapchainImage, Vulkan::RESOURCE_USAGE_RESOLVE_ATTACHMENT);
+        return;
+    }
+
+    RenderGraph::ImageInfo resolvedInfo = swapchainInfo;
+    resolvedInfo.extent = _foveation.EyeExtent();
+    resolvedInfo.usage  = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    uint32_t resolved[2];
+    if (_multiview) {
+        resolvedInfo.arrayLayers = 2;
+        resolved[0] = resolved[1] = graph.Import("stereo resolved", resolvedInfo, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED);
+    } else {
+        resolved[0] = graph.Import("left resolved", resolvedInfo, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED);
+        resolved[1] = graph.Import("right resolved", resolvedInfo, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED);
+    }
+    int eyePasses = _multiview ? 1 : 2;
+    for (int eye = 0; eye < eyePasses; eye++) {
+        uint32_t pass = graph.AddPass(_multiview ? "both eyes" : eye == 0 ? "left eye" : "right eye");
+        graph.Write(pass, msaa[eye], Vulkan::RESOURCE_USAGE_COLOR_ATTACHMENT);
+        graph.Write(pass, depth[eye], Vulkan::RESOURCE_USAGE_DEPTH_ATTACHMENT);
+        graph.Write(pass, resolved[eye], Vulkan::RESOURCE_USAGE_RESOLVE_ATTACHMENT);
+    }
+    uint32_t distortion = graph.AddPass("distortion");
+    for (int eye = 0; eye < eyePasses; eye++) {
+        graph.Read(distortion, resolved[eye], Vulkan::RESOURCE_USAGE_SAMPLED);
+    }
+    graph.Write(distortion, swapchainImage, Vulkan::RESOURCE_USAGE_COLOR_ATTACHMENT);
+}
+
+void StereoViewingSceneRenderer::LogTraffic() const
+{
+    // Both structures are declared again in graphs of their own, only compiled for the estimate.
+    static const char* names[] = { "resolve and sample", "on chip, lens distorted per vertex" };
+    // Per-vertex distortion only matches the resampled eyes at the vertices, so the second figure is cheaper for a
+    // visibly different image, not for the same one.
+    static const char* notes[] = { "", " (not an equal-quality comparison: distortion is interpolated between vertices)" };
+    for (int s = STEREO_RESOLVE_AND_SAMPLE; s <= STEREO_ON_CHIP; s++) {
+        StereoPassStructure structure = static_cast<StereoPassStructure>(s);
+        bool shared = _multiview || structure == STEREO_ON_CHIP;
+        RenderGraph graph;
+        uint32_t msaa[2], depth[2];
+        for (int eye = 0; eye < 2; eye++) {
+            msaa[eye]  = shared && eye == 1 ? msaa[0]  : graph.CreateTransient("msaa color", EyeTargetInfo(structure, false));
+            depth[eye] = shared && eye == 1 ? depth[0] : graph.CreateTransient("depth", EyeTargetInfo(structure, true));
+        }
+        DeclarePasses(graph, structure, msaa, depth);
+        graph.Compile();
+        RenderGraph::Traffic traffic = graph.EstimateTraffic();
+        Log::Info("Eyes %s: %.2f MiB stored and %.2f MiB loaded per frame%s%s.", names[s],
+                  traffic.storedBytes / (1024.0f * 1024.0f), traffic.loadedBytes / (1024.0f * 1024.0f),
+                  structure == _passStructure ? ", in use" : "", notes[s]);
+    }
+}
+
+void StereoViewingSceneRenderer::OnFrameRead(const uint8_t* pixels)
+{
+    if (++_framesRead % READBACK_FRAMES != 0) {
+        return;
+    }
+    // FNV-1a over the whole frame; runs on the same device and build should log the same values.
+    const VkExtent2D& extent = swapchain->Extent();
+    size_t size = static_cast<size_t>(extent.width) * extent.height * 4;
+    uint32_t checksum = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        checksum = (checksum ^ pixels[i]) * 16777619u;
+    }
+    Log::Info("Frame %u read back: %ux%u, checksum %08x.", _framesRead, extent.width, extent.height, checksum);
 }
 
 void StereoViewingSceneRenderer::BuildMSAAResolvedImages(int eye)
 {
+    // With multiview the left eye's images hold both eyes as layers; each eye samples its own layer. On chip there is
+    // nothing to resolve into but the swapchain image.
+    if ((_multiview && eye == 1) || _passStructure == STEREO_ON_CHIP) {
+        return;
+    }
+    uint32_t layers = _multiview ? 2 : 1;
     VkFormat colorFormat = swapchain->Format();
-    VkExtent2D extent = swapchain->Extent();
+    VkExtent2D extent = _foveation.EyeExtent();
     VkImageCreateInfo imageInfo = ImageCreateInfo(colorFormat,
                                                   { extent.width, extent.height, 1},
                                                   1,
-                                                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+                                                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                  VK_IMAGE_TILING_OPTIMAL,
+                                                  VK_IMAGE_LAYOUT_UNDEFINED,
+                                                  VK_SAMPLE_COUNT_1_BIT,
+                                                  layers);
 
     bool leftEye = (eye == 0);
     vector<VkImage>& resolvedImages = leftEye ? _lMsaaResolvedImages : _rMsaaResolvedImages;
@@ -493,13 +832,47 @@ void StereoViewingSceneRenderer::BuildMSAAResolvedImages(int eye)
                                                                      *device,
                                                                      memoryRequirements,
                                                                      memoryTypeIndex);
-        VK_CHECK_RESULT(vkAllocateMemory(d, &memoryAllocateInfo, nullptr, &memories[i]));
+        VK_CHECK_RESULT(device->Memory().Allocate(memoryAllocateInfo, Vulkan::MEMORY_CATEGORY_RENDER_TARGET, "msaa resolved", &memories[i]));
         VK_CHECK_RESULT(vkBindImageMemory(d, resolvedImages[i], memories[i], 0));
 
         VkImageViewCreateInfo imageViewInfo = ImageViewCreateInfo(resolvedImages[i], colorFormat,
                                                                   {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1,
                                                                    0, 1});
         VK_CHECK_RESULT(vkCreateImageView(d, &imageViewInfo, nullptr, &views[i]));
+        if (_multiview) {
+            imageViewInfo.subresourceRange.baseArrayLayer = 1;
+            VK_CHECK_RESULT(vkCreateImageView(d, &imageViewInfo, nullptr, &_rMsaaResolvedViews[i]));
+            imageViewInfo.subresourceRange.baseArrayLayer = 0;
+            imageViewInfo.subresourceRange.layerCount     = 2;
+            imageViewInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+            VK_CHECK_RESULT(vkCreateImageView(d, &imageViewInfo, nullptr, &_stereoResolvedViews[i]));
+        }
+    }
+}
+
+void StereoViewingSceneRenderer::BuildFramebuffers()
+{
+    const VkExtent2D& e = swapchain->Extent();
+    const VkExtent2D& eyeExtent = _foveation.EyeExtent();
+    for (uint32_t i = 0; i < framebuffers.size(); i++) {
+        if (_passStructure == STEREO_ON_CHIP) {
+            vector<VkImageView> attachments = { _renderTargetPool->View(_msaaTargets[0]), _renderTargetPool->View(_depthTargets[0]), swapchain->ImageViews()[i] };
+            framebuffers[i].CreateSwapchainFramebuffer(renderPasses[0]->GetRenderPass(), attachments, e);
+            continue;
+        }
+        if (_multiview) {
+            vector<VkImageView> attachments = { _renderTargetPool->View(_msaaTargets[0]), _renderTargetPool->View(_depthTargets[0]), _stereoResolvedViews[i] };
+            _lMsaaFramebuffers[i].CreateSwapchainFramebuffer(renderPasses[0]->GetRenderPass(), attachments, eyeExtent);
+            attachments = { swapchain->ImageViews()[i] };
+            framebuffers[i].CreateSwapchainFramebuffer(renderPasses[1]->GetRenderPass(), attachments, e);
+            continue;
+        }
+        vector<VkImageView> attachments = { _renderTargetPool->View(_msaaTargets[0]), _renderTargetPool->View(_depthTargets[0]), _lMsaaResolvedViews[i] };
+        _lMsaaFramebuffers[i].CreateSwapchainFramebuffer(renderPasses[0]->GetRenderPass(), attachments, eyeExtent);
+        attachments = { _renderTargetPool->View(_msaaTargets[1]), _renderTargetPool->View(_depthTargets[1]), _rMsaaResolvedViews[i] };
+        _rMsaaFramebuffers[i].CreateSwapchainFramebuffer(renderPasses[0]->GetRenderPass(), attachments, eyeExtent);
+        attachments = { swapchain->ImageViews()[i] };
+        framebuffers[i].CreateSwapchainFramebuffer(renderPasses[1]->GetRenderPass(), attachments, e);
     }
 }
 
@@ -518,7 +891,7 @@ void StereoViewingSceneRenderer::BuildMSAADescriptorSetLayout()
 {
     VkDescriptorSetLayoutBinding modelTransformBinding = {};
     modelTransformBinding.binding            = 0;
-    modelTransformBinding.descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    modelTransformBinding.descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     modelTransformBinding.descriptorCount    = 1;
     modelTransformBinding.stageFlags         = VK_SHADER_STAGE_VERTEX_BIT;
     modelTransformBinding.pImmutableSamplers = nullptr;
@@ -544,19 +917,49 @@ void StereoViewingSceneRenderer::BuildMSAADescriptorSetLayout()
 //    normalSamplerBinding.stageFlags         = VK_SHADER_STAGE_FRAGMENT_BIT;
 //    normalSamplerBinding.pImmutableSamplers = nullptr;
 
-    VkDescriptorSetLayoutBinding bindings[] = { modelTransformBinding, viewProjTransformBinding, textureSamplerBinding };//, normalSamplerBinding };
-    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 3;
-    layoutInfo.pBindings = bindings;
-    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->LogicalDevice(), &layoutInfo, nullptr, &_msaaDescriptorSetLayout));
+    // The clustered lights in the set after the textures, and per draw the texture index for bindless textures, the
+    // eye, which the two pass vertex shader hands on to the lights' lookup, and the lens distortion of on-chip eyes.
+    VkDescriptorSetLayout lightingLayout = ClusteredLighting::Layout(*device).layout;
+    VkPushConstantRange drawRange = {};
+    drawRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    drawRange.offset     = 0;
+    drawRange.size       = sizeof(uint32_t) + sizeof(EyePushConstants);
+
+    const VkPhysicalDeviceLimits& limits = device->PhysicalDeviceProperties().limits;
+    uint32_t textureCapacity = std::min(BINDLESS_TEXTURE_CAPACITY, std::min(limits.maxPerStageDescriptorSampledImages, limits.maxPerStageDescriptorSamplers));
+    if (_bindlessTextures && _modelTextures.size() > textureCapacity) {
+        Log::Warn("%d textures exceed the bindless capacity of %d, falling back to a descriptor set per material.",
+                  static_cast<int>(_modelTextures.size()), textureCapacity);
+        _bindlessTextures = false;
+    }
+    if (_bindlessTextures) {
+        _msaaDescriptorSetLayout = &device->DescriptorLayouts().Layout({ modelTransformBinding, viewProjTransformBinding });
+
+        VkDescriptorSetLayoutBinding texturesBinding = {};
+        texturesBinding.binding            = 0;
+        texturesBinding.descriptorType     = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        texturesBinding.descriptorCount    = textureCapacity;
+        texturesBinding.stageFlags         = VK_SHADER_STAGE_FRAGMENT_BIT;
+        texturesBinding.pImmutableSamplers = nullptr;
+        // The capacity only bounds the array; each set is allocated with as many descriptors as there are textures.
+        _textureDescriptorSetLayout = &device->DescriptorLayouts().Layout({ texturesBinding },
+                                                                          { VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+                                                                            VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT });
+
+        VkDescriptorSetLayout setLayouts[] = { _msaaDescriptorSetLayout->layout, _textureDescriptorSetLayout->layout, lightingLayout };
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = PipelineLayoutCreateInfo(3, setLayouts, 1, &drawRange);
+        VK_CHECK_RESULT(vkCreatePipelineLayout(device->LogicalDevice(), &pipelineLayoutInfo, nullptr, &_msaaPipelineLayout));
+        return;
+    }
+    _msaaDescriptorSetLayout = &device->DescriptorLayouts().Layout({ modelTransformBinding, viewProjTransformBinding, textureSamplerBinding });//, normalSamplerBinding });
 
     // Prepare pipeline layout.
 //    VkPushConstantRange pushConstantRange = {};
 //    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 //    pushConstantRange.size = sizeof(BlinnPhongLighting);
-//    VkPipelineLayoutCreateInfo pipelineLayoutInfo = PipelineLayoutCreateInfo(1, &_msaaDescriptorSetLayout, 1, &pushConstantRange);
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = PipelineLayoutCreateInfo(1, &_msaaDescriptorSetLayout, 0, nullptr);
+//    VkPipelineLayoutCreateInfo pipelineLayoutInfo = PipelineLayoutCreateInfo(1, &_msaaDescriptorSetLayout->layout, 1, &pushConstantRange);
+    VkDescriptorSetLayout setLayouts[] = { _msaaDescriptorSetLayout->layout, lightingLayout };
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = PipelineLayoutCreateInfo(2, setLayouts, 1, &drawRange);
     VK_CHECK_RESULT(vkCreatePipelineLayout(device->LogicalDevice(), &pipelineLayoutInfo, nullptr, &_msaaPipelineLayout));
 }
 
@@ -568,318 +971,207 @@ void StereoViewingSceneRenderer::BuildMultiviewDescriptorSetLayout()
     textureSamplerBinding.descriptorCount    = 1;
     textureSamplerBinding.stageFlags         = VK_SHADER_STAGE_FRAGMENT_BIT;
     textureSamplerBinding.pImmutableSamplers = nullptr;
-    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings = &textureSamplerBinding;
-    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->LogicalDevice(), &layoutInfo, nullptr, &_multiviewDescriptorSetLayout));
-
-    // Prepare pipeline layout.
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = PipelineLayoutCreateInfo(1, &_multiviewDescriptorSetLayout, 0, nullptr);
+    _multiviewDescriptorSetLayout = &device->DescriptorLayouts().Layout({ textureSamplerBinding });
+
+    // The lens distortion for the vertex stage, the foveation layout to undo and the part of the eye buffers in use for
+    // the fragment stage.
+    VkPushConstantRange distortionRange = {};
+    distortionRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    distortionRange.offset     = 0;
+    distortionRange.size       = 6 * sizeof(float);
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = PipelineLayoutCreateInfo(1, &_multiviewDescriptorSetLayout->layout, 1, &distortionRange);
     VK_CHECK_RESULT(vkCreatePipelineLayout(device->LogicalDevice(), &pipelineLayoutInfo, nullptr, &_multiviewPipelineLayout));
 }
 
-void StereoViewingSceneRenderer::BuildDescriptorPool()
+void StereoViewingSceneRenderer::BuildMSAADescriptorSet()
 {
-    uint32_t numOfImageViews = swapchain->ImageViews().size();
-    VkDescriptorPoolSize poolSizes[] = { {}, {}, {} };
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = 1;
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-    poolSizes[1].descriptorCount = 1 * 2; // per eye
-    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[2].descriptorCount = 1 + 1 + numOfImageViews * 2; // 1(model texture) + 1(normal texture) + numOfImageViews(temporary rendering results) * 2(per eye)
-    VkDescriptorPoolCreateInfo descriptorPool = {};
-    descriptorPool.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    descriptorPool.poolSizeCount = 3;
-    descriptorPool.pPoolSizes = poolSizes;
-    descriptorPool.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    descriptorPool.maxSets = 1 + numOfImageViews * 2; // 1(temporary rendering) + numOfImageViews(frames of displaying temporary rendering results) * 2(per eye)
-    VK_CHECK_RESULT(vkCreateDescriptorPool(device->LogicalDevice(), &descriptorPool, nullptr, &_descriptorPool));
+    // The descriptors cover one image's slot, the dynamic offsets move them to the slot being drawn.
+    VkDeviceSize viewProjRange = _multiview ? 2 * sizeof(ViewProjectionTransform) : sizeof(ViewProjectionTransform);
+    if (_bindlessTextures) {
+        _msaaDescriptorSet = _descriptorAllocator->Write(*_msaaDescriptorSetLayout, {
+            DescriptorBuffer(_buffers[0].GetBuffer(), 0, sizeof(mat4)),
+            DescriptorBuffer(_buffers[1].GetBuffer(), 0, viewProjRange)
+        });
+        // Sized to the texture count rounded up to a power of two, within the capacity. Value-initialized entries are
+        // null and stay unwritten.
+        uint32_t textureCount = 1;
+        while (textureCount < _modelTextures.size()) {
+            textureCount *= 2;
+        }
+        textureCount = std::min(textureCount, _textureDescriptorSetLayout->descriptorCount);
+        vector<DescriptorInfo> textures(textureCount, DescriptorInfo());
+        for (size_t i = 0; i < _modelTextures.size(); i++) {
+            textures[i] = DescriptorImage(_textureSamplers[i], _modelTextures[i].ImageView());
+        }
+        _textureDescriptorSet = _descriptorAllocator->Write(*_textureDescriptorSetLayout, textures);
+        return;
+    }
+    _materialDescriptorSets.resize(_modelTextures.size());
+    for (size_t i = 0; i < _modelTextures.size(); i++) {
+        _materialDescriptorSets[i] = _descriptorAllocator->Write(*_msaaDescriptorSetLayout, {
+            DescriptorBuffer(_buffers[0].GetBuffer(), 0, sizeof(mat4)),
+            DescriptorBuffer(_buffers[1].GetBuffer(), 0, viewProjRange),
+            DescriptorImage(_textureSamplers[i], _modelTextures[i].ImageView())
+        });
+    }
 }
 
-void StereoViewingSceneRenderer::BuildMSAADescriptorSet()
+uint32_t StereoViewingSceneRenderer::MaterialTexture(uint32_t materialIndex) const
 {
-    VkDescriptorSetAllocateInfo descriptorSet = {};
-    descriptorSet.sType                       = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    descriptorSet.descriptorPool              = _descriptorPool;
-    descriptorSet.descriptorSetCount          = 1;
-    descriptorSet.pSetLayouts                 = &_msaaDescriptorSetLayout;
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(device->LogicalDevice(), &descriptorSet, &_msaaDescriptorSet));
-
-    VkDescriptorBufferInfo modelTransform = {};
-    modelTransform.buffer = _buffers[0].GetBuffer();
-    modelTransform.offset = 0;
-    modelTransform.range = VK_WHOLE_SIZE;
-
-    VkDescriptorBufferInfo viewProjTransform = {};
-    viewProjTransform.buffer = _buffers[1].GetBuffer();
-    viewProjTransform.offset = 0;
-    viewProjTransform.range = VK_WHOLE_SIZE;
-
-    VkDescriptorImageInfo diffuseImage = {};
-    diffuseImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    diffuseImage.imageView = _modelTextures[0].ImageView();
-    diffuseImage.sampler = _textureSamplers[0];
-
-//    VkDescriptorImageInfo normalImage = {};
-//    normalImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-//    normalImage.imageView = _modelTextures[0].ImageView();
-//    normalImage.sampler = _textureSamplers[0];
-
-    VkWriteDescriptorSet descriptorWrites[] = { {}, {}, {}, {} };
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = _msaaDescriptorSet;
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo = &modelTransform;
-
-    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = _msaaDescriptorSet;
-    descriptorWrites[1].dstBinding = 1;
-    descriptorWrites[1].dstArrayElement = 0;
-    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-    descriptorWrites[1].descriptorCount = 1;
-    descriptorWrites[1].pBufferInfo = &viewProjTransform;
-
-    descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[2].dstSet = _msaaDescriptorSet;
-    descriptorWrites[2].dstBinding = 2;
-    descriptorWrites[2].dstArrayElement = 0;
-    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[2].descriptorCount = 1;
-    descriptorWrites[2].pImageInfo = &diffuseImage;
-
-//    descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-//    descriptorWrites[3].dstSet = _msaaDescriptorSet;
-//    descriptorWrites[3].dstBinding = 3;
-//    descriptorWrites[3].dstArrayElement = 0;
-//    descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-//    descriptorWrites[3].descriptorCount = 1;
-//    descriptorWrites[3].pImageInfo = &normalImage;
-
-    vkUpdateDescriptorSets(device->LogicalDevice(), 3, descriptorWrites, 0, nullptr);
+    return materialIndex < _materialTextures.size() ? _materialTextures[materialIndex] : 0;
 }
 
 void StereoViewingSceneRenderer::BuildMultiViewDescriptorSet(int eye)
 {
-    VkDescriptorSetAllocateInfo descriptorSet = {};
-    descriptorSet.sType                       = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    descriptorSet.descriptorPool              = _descriptorPool;
-    descriptorSet.descriptorSetCount          = 1;
-    descriptorSet.pSetLayouts                 = &_multiviewDescriptorSetLayout;
-
-    VkDescriptorImageInfo msaaResolvedResult = {};
-    msaaResolvedResult.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    msaaResolvedResult.sampler = _msaaResolvedResultSampler;
-
+    if (_passStructure == STEREO_ON_CHIP) {
+        return;
+    }
     int size = swapchain->ImageViews().size();
     bool leftEye = (eye == 0);
     vector<VkDescriptorSet>& descriptorSets = leftEye ? _lDescriptorSets : _rDescriptorSets;
     vector<VkImageView>& views = leftEye ? _lMsaaResolvedViews : _rMsaaResolvedViews;
     for (int i = 0; i < size; i++) {
-        VK_CHECK_RESULT(vkAllocateDescriptorSets(device->LogicalDevice(), &descriptorSet, &descriptorSets[i]));
-
-        VkWriteDescriptorSet descriptorWrites[] = { {} };
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = descriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[0].descriptorCount = 1;
-        msaaResolvedResult.imageView = views[i];
-        descriptorWrites[0].pImageInfo = &msaaResolvedResult;
-
-        vkUpdateDescriptorSets(device->LogicalDevice(), 1, descriptorWrites, 0, nullptr);
+        descriptorSets[i] = _descriptorAllocator->Write(*_multiviewDescriptorSetLayout, { DescriptorImage(_msaaResolvedResultSampler, views[i]) });
     }
 }
 
 void StereoViewingSceneRenderer::BuildMSAAPipeline(void* application, const VertexLayout& vertexLayout, VkSampleCountFlagBits sampleCount)
 {
     android_app* app = (android_app*)application;
-    vector<char*> vertFile, fragFile;
-    AndroidNative::Open<char*>("shaders/vr/texture.vert.spv", app, vertFile);
-    AndroidNative::Open<char*>("shaders/vr/texture.frag.spv", app, fragFile);
-    VkShaderModuleCreateInfo vertModule = ShaderModuleCreateInfo(vertFile);
-    VkShaderModuleCreateInfo fragModule = ShaderModuleCreateInfo(fragFile);
-    VkShaderModule vertexShader;
-    VkDevice d = device->LogicalDevice();
-    VK_CHECK_RESULT(vkCreateShaderModule(d, &vertModule, nullptr, &vertexShader));
-    VkShaderModule fragmentShader;
-    VK_CHECK_RESULT(vkCreateShaderModule(d, &fragModule, nullptr, &fragmentShader));
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {
-        PipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, vertexShader),
-        PipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader)
-    };
+    vector<char> vertFile, fragFile, depthFile;
+    AndroidNative::Open<char>(_multiview ? "shaders/vr/texture_multiview.vert.spv" : "shaders/vr/texture.vert.spv", app, vertFile);
+    AndroidNative::Open<char>(_multiview ? "shaders/vr/depth_prepass_multiview.vert.spv" : "shaders/vr/depth_prepass.vert.spv", app, depthFile);
+    // The indirect draws carry the texture index as their first instance, which needs the textures bindless and
+    // leaves no room for instances.
+    _gpuDriven = _bindlessTextures && _instanceCount == 1 && GpuCuller::Supported(*device, _gpuSubmeshes.size());
+    const char* fragPath = _gpuDriven ? "shaders/vr/texture_indirect.frag.spv" :
+                           _bindlessTextures ? "shaders/vr/texture_bindless.frag.spv" : "shaders/vr/texture.frag.spv";
+    AndroidNative::Open<char>(fragPath, app, fragFile);
+
+    // Positions come from their own stream, the only one the depth pre-pass reads. All eye pipelines bind the same
+    // buffers: positions at 0, the interleaved vertices at 1 and the instances at 2.
+    uint32_t instanceStride = _gpuDriven ? 0 : sizeof(InstanceData);
+    uint32_t instanceVectors = sizeof(InstanceData) / sizeof(vec4);
+    PipelineBuilder builder;
+    builder.Shader(VK_SHADER_STAGE_VERTEX_BIT, vertFile.data(), vertFile.size())
+           .Shader(VK_SHADER_STAGE_FRAGMENT_BIT, fragFile.data(), fragFile.size())
+           .VertexInput(vertexLayout.WithPositionStream())
+           .InstanceInput(instanceStride, INSTANCE_LOCATION, instanceVectors)
+           .Multisample(sampleCount)
+           .Layout(_msaaPipelineLayout)
+           .RenderPass(renderPasses[0]->GetRenderPass());
+    _msaaPipeline = _pipelineRegistry->Request(builder, "eye");
+    // Both variants are built up front, so switching the pre-pass only re-records.
+    builder.Depth(true, false, VK_COMPARE_OP_EQUAL);
+    _prePassShadingPipeline = _pipelineRegistry->Request(builder, "eye after depth pre-pass");
+
+    VkPipelineColorBlendAttachmentState noColor = {};
+    PipelineBuilder depthBuilder;
+    depthBuilder.Shader(VK_SHADER_STAGE_VERTEX_BIT, depthFile.data(), depthFile.size())
+                .VertexInput(vertexLayout.WithPositionStream(true))
+                .InstanceInput(instanceStride, INSTANCE_LOCATION, instanceVectors)
+                .Multisample(sampleCount, false)
+                .ColorAttachments({ noColor })
+                .Layout(_msaaPipelineLayout)
+                .RenderPass(renderPasses[0]->GetRenderPass());
+    _depthPrePassPipeline = _pipelineRegistry->Request(depthBuilder, "eye depth pre-pass");
+}
 
-    VkVertexInputBindingDescription vertexInputBinding = {};
-    vertexInputBinding.binding                         = 0;
-    vertexInputBinding.stride                          = vertexLayout.Stride();
-    vertexInputBinding.inputRate                       = VK_VERTEX_INPUT_RATE_VERTEX;
-    vector<VkVertexInputAttributeDescription> vertexAttributes;
-    VkFormat format;
-    for (uint32_t i = 0; i < vertexLayout.components.size(); i++) {
-        vertexAttributes.emplace_back();
-        vertexAttributes[i].location = i;
-        vertexAttributes[i].binding  = 0;
-        if (vertexLayout.components[i] != VertexComponent::VERTEX_COMPONENT_UV) {
-            format = VK_FORMAT_R32G32B32_SFLOAT;
-        } else {
-            format = VK_FORMAT_R32G32_SFLOAT;
-        }
-        vertexAttributes[i].format = format;
-        vertexAttributes[i].offset = vertexLayout.offsets[i];
+void StereoViewingSceneRenderer::BuildMultiviewPipeline(void* application, const VertexLayout& vertexLayout)
+{
+    // On chip the eye pipelines distort.
+    if (_passStructure == STEREO_ON_CHIP) {
+        return;
     }
-    VkPipelineVertexInputStateCreateInfo pipelineVertexInput = PipelineVertexInputStateCreateInfo(1, &vertexInputBinding, vertexAttributes.size(), vertexAttributes.data());
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-    inputAssembly.sType                                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology                               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable                 = VK_FALSE;
-
-    // pTessellationState  ignored.
-
-    VkExtent2D extent2D = swapchain->Extent();
-    VkViewport viewport = Viewport(extent2D.width, extent2D.height);
-    VkRect2D scissor = {};
-    scissor.offset = { 0, 0 };
-    scissor.extent = extent2D;
-    VkPipelineViewportStateCreateInfo viewportState = PipelineViewport(&viewport, &scissor);
-
-    VkPipelineRasterizationStateCreateInfo rasterization = Rasterization(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-
-    VkPipelineMultisampleStateCreateInfo multisample = {};
-    multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisample.rasterizationSamples = sampleCount;
-    multisample.sampleShadingEnable = (sampleCount == VK_SAMPLE_COUNT_1_BIT) ? VK_FALSE : VK_TRUE;
-
-    VkPipelineDepthStencilStateCreateInfo depthStencil = DepthStencil();
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-    colorBlendAttachment.colorWriteMask                      = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable                         = VK_FALSE;
-    float blendConstants[] = { VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_ZERO };
-    VkPipelineColorBlendStateCreateInfo colorBlend = ColorBlend(VK_FALSE, VK_LOGIC_OP_NO_OP, 1, &colorBlendAttachment, blendConstants);
-
-    // pDynamicState ignored.
-
-    GraphicsPipelineInfoParameters parameters = GraphicsPipelineInfoParameters();
-    parameters.pMultisampleState  = &multisample;
-    parameters.pDepthStencilState = &depthStencil;
-    VkGraphicsPipelineCreateInfo graphicsPipeline = GraphicsPipelineCreateInfo(2,
-                                                                               shaderStages,
-                                                                               &pipelineVertexInput,
-                                                                               &inputAssembly,
-                                                                               &viewportState,
-                                                                               &rasterization,
-                                                                               &colorBlend,
-                                                                               _msaaPipelineLayout,
-                                                                               (*renderPasses[0]).GetRenderPass(),
-                                                                               &parameters);
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(d, VK_NULL_HANDLE, 1, &graphicsPipeline, nullptr, &_msaaPipeline));
-
-    vkDestroyShaderModule(d, vertexShader, nullptr);
-    vkDestroyShaderModule(d, fragmentShader, nullptr);
+    android_app* app = (android_app*)application;
+    vector<char> vertFile, fragFile;
+    AndroidNative::Open<char>("shaders/vr/multiview.vert.spv", app, vertFile);
+    AndroidNative::Open<char>("shaders/vr/multiview.frag.spv", app, fragFile);
+
+    // Viewport and scissor are dynamic: each eye is drawn into its own half of the swapchain image.
+    PipelineBuilder builder;
+    builder.Shader(VK_SHADER_STAGE_VERTEX_BIT, vertFile.data(), vertFile.size())
+           .Shader(VK_SHADER_STAGE_FRAGMENT_BIT, fragFile.data(), fragFile.size())
+           .VertexInput(vertexLayout)
+           .Depth(false, false)
+           .Layout(_multiviewPipelineLayout)
+           .RenderPass(renderPasses[1]->GetRenderPass());
+    _multiviewPipeline = _pipelineRegistry->Request(builder, "distortion");
 }
 
-void StereoViewingSceneRenderer::BuildMultiviewPipeline(void* application, const VertexLayout& vertexLayout)
+void StereoViewingSceneRenderer::BuildGpuCulling(void* application)
 {
+    if (!_gpuDriven) {
+        Log::Info("Eye draws culled on the CPU.");
+        return;
+    }
     android_app* app = (android_app*)application;
-    vector<char*> vertFile, fragFile;
-    AndroidNative::Open<char*>("shaders/vr/multiview.vert.spv", app, vertFile);
-    AndroidNative::Open<char*>("shaders/vr/multiview.frag.spv", app, fragFile);
-    VkShaderModuleCreateInfo vertModule = ShaderModuleCreateInfo(vertFile);
-    VkShaderModuleCreateInfo fragModule = ShaderModuleCreateInfo(fragFile);
-    VkShaderModule vertexShader;
-    VkDevice d = device->LogicalDevice();
-    VK_CHECK_RESULT(vkCreateShaderModule(d, &vertModule, nullptr, &vertexShader));
-    VkShaderModule fragmentShader;
-    VK_CHECK_RESULT(vkCreateShaderModule(d, &fragModule, nullptr, &fragmentShader));
+    vector<char> compFile;
+    AndroidNative::Open<char>("shaders/vr/cull_submeshes.comp.spv", app, compFile);
+    _gpuCuller = new GpuCuller(*device, *_descriptorAllocator, compFile, _gpuSubmeshes, static_cast<uint32_t>(swapchain->ImageViews().size()));
+}
 
-    VkPipelineShaderStageCreateInfo shaderStages[] = {
-            PipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, vertexShader),
-            PipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader)
-    };
+void StereoViewingSceneRenderer::BuildClusteredLighting(void* application)
+{
+    vector<char> compFile;
+#ifdef GPU_LIGHT_CLUSTERS
+    android_app* app = (android_app*)application;
+    AndroidNative::Open<char>("shaders/vr/cluster_lights.comp.spv", app, compFile);
+#endif
+    _clusteredLighting = new ClusteredLighting(*device, *_descriptorAllocator, compFile, _threadPool, static_cast<uint32_t>(swapchain->ImageViews().size()));
+}
 
-    VkVertexInputBindingDescription vertexInputBinding = {};
-    vertexInputBinding.binding                         = 0;
-    vertexInputBinding.stride                          = vertexLayout.Stride();
-    vertexInputBinding.inputRate                       = VK_VERTEX_INPUT_RATE_VERTEX;
-    vector<VkVertexInputAttributeDescription> vertexAttributes;
-    VkFormat format;
-    for (uint32_t i = 0; i < vertexLayout.components.size(); i++) {
-        vertexAttributes.emplace_back();
-        vertexAttributes[i].location = i;
-        vertexAttributes[i].binding  = 0;
-        if (vertexLayout.components[i] != VertexComponent::VERTEX_COMPONENT_UV) {
-            format = VK_FORMAT_R32G32B32_SFLOAT;
-        } else {
-            format = VK_FORMAT_R32G32_SFLOAT;
-        }
-        vertexAttributes[i].format = format;
-        vertexAttributes[i].offset = vertexLayout.offsets[i];
-    }
-    VkPipelineVertexInputStateCreateInfo pipelineVertexInput = PipelineVertexInputStateCreateInfo(1, &vertexInputBinding, vertexAttributes.size(), vertexAttributes.data());
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-    inputAssembly.sType                                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology                               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable                 = VK_FALSE;
-
-    // pTessellationState ignored.
-
-    VkPipelineViewportStateCreateInfo viewportState = PipelineViewport(nullptr, nullptr);
-
-    VkPipelineRasterizationStateCreateInfo rasterization = Rasterization(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-
-    VkPipelineMultisampleStateCreateInfo multisample = {};
-    multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisample.sampleShadingEnable = VK_FALSE;
-
-    VkPipelineDepthStencilStateCreateInfo depthStencil = DepthStencil(VK_FALSE, VK_FALSE);
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-    colorBlendAttachment.colorWriteMask                      = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable                         = VK_FALSE;
-    float blendConstants[] = { VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_ZERO };
-    VkPipelineColorBlendStateCreateInfo colorBlend = ColorBlend(VK_FALSE, VK_LOGIC_OP_NO_OP, 1, &colorBlendAttachment, blendConstants);
-
-    VkDynamicState dynamicStateEnables[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-    VkPipelineDynamicStateCreateInfo dynamicState = {};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = 2;
-    dynamicState.pDynamicStates = dynamicStateEnables;
-
-    GraphicsPipelineInfoParameters parameters = GraphicsPipelineInfoParameters();
-    parameters.pDepthStencilState = &depthStencil;
-    parameters.pMultisampleState  = &multisample;
-    parameters.pDynamicState      = &dynamicState;
-    VkGraphicsPipelineCreateInfo graphicsPipeline = GraphicsPipelineCreateInfo(2,
-                                                                               shaderStages,
-                                                                               &pipelineVertexInput,
-                                                                               &inputAssembly,
-                                                                               &viewportState,
-                                                                               &rasterization,
-                                                                               &colorBlend,
-                                                                               _multiviewPipelineLayout,
-                                                                               (*renderPasses[1]).GetRenderPass(),
-                                                                               &parameters);
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(d, VK_NULL_HANDLE, 1, &graphicsPipeline, nullptr, &_multiviewPipeline));
-
-    vkDestroyShaderModule(d, vertexShader, nullptr);
-    vkDestroyShaderModule(d, fragmentShader, nullptr);
+void StereoViewingSceneRenderer::BuildInstanceBuffer()
+{
+    if (_instances.size() != _instanceCount) {
+        SetInstanceCount(_instanceCount);
+    }
+    size_t slots = swapchain->ImageViews().size();
+    _instanceSlotSize = _instanceCount * sizeof(InstanceData);
+    _instanceBuffer = new Buffer(*device);
+    _instanceBuffer->name = "instances";
+    _instanceBuffer->BuildDefaultBuffer(slots * _instanceSlotSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    _instanceBuffer->Map();
+    for (size_t slot = 0; slot < slots; slot++) {
+        memcpy(static_cast<uint8_t*>(_instanceBuffer->mapped) + slot * _instanceSlotSize, _instances.data(), _instanceSlotSize);
+    }
 }
 
 void StereoViewingSceneRenderer::BuildCommandBuffers(int index)
 {
     RenderPass* msaaRenderPass = renderPasses[0];
     const VkExtent2D& extent = swapchain->Extent();
+    // The eye buffers are allocated at full scale; the dynamic resolution scale picks how much of them is used. On chip
+    // each eye fills its half of the swapchain image as it is.
+    bool onChip = _passStructure == STEREO_ON_CHIP;
+    float scale = onChip ? 1.0f : _dynamicResolution.Scale();
+    vector<FoveationLayout::Region> eyeRegions[2];
+    if (onChip) {
+        VkExtent2D half = { extent.width / 2, extent.height };
+        eyeRegions[0] = eyeRegions[1] = FoveationLayout(FOVEATION_NONE, half, half).Regions();
+        for (FoveationLayout::Region& region : eyeRegions[1]) {
+            region.viewport.x       += half.width;
+            region.scissor.offset.x += half.width;
+        }
+    } else {
+        eyeRegions[0] = eyeRegions[1] = _foveation.ScaledRegions(scale);
+    }
 
-    Command::BeginCommandBuffer(_msaaCommandBuffers.buffers[index], VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    Command::BeginCommandBuffer(_msaaCommandBuffers.buffers[index], 0);
+    if (_timestampPool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(_msaaCommandBuffers.buffers[index], _timestampPool, 2 * index, 2);
+        vkCmdWriteTimestamp(_msaaCommandBuffers.buffers[index], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _timestampPool, 2 * index);
+    }
+    if (_gpuCuller) {
+        _gpuCuller->RecordCull(_msaaCommandBuffers.buffers[index], index);
+    }
+    _clusteredLighting->RecordAssignment(_msaaCommandBuffers.buffers[index], index);
+    if (_statisticsPool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(_msaaCommandBuffers.buffers[index], _statisticsPool, index, 1);
+        vkCmdBeginQuery(_msaaCommandBuffers.buffers[index], _statisticsPool, index, 0);
+        _statisticsPrePass[index] = _depthPrePass;
+    }
 
 //    vkCmdPushConstants(_msaaCommandBuffers.buffers[index],
 //                       _msaaPipelineLayout,
@@ -889,47 +1181,181 @@ void StereoViewingSceneRenderer::BuildCommandBuffers(int index)
 //                       &lighting);
 
     // msaa
-    VkDeviceSize offsets[] = { 0 };
-    vkCmdBindVertexBuffers(_msaaCommandBuffers.buffers[index], 0, 1, &_modelResources[0].VertexBuffer().GetBuffer(), offsets);
-    vkCmdBindIndexBuffer(_msaaCommandBuffers.buffers[index], _modelResources[0].IndexBuffer().GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
-
-    // left eye
+    auto recordStart = steady_clock::now();
+    // The draws of each eye are recorded into secondary command buffers on the worker threads. All secondaries of
+    // this swapchain image come from its own pools, which are reset here as a whole.
+    command->ResetThreadCommandPools(index);
+    const vector<ModelResource::Mesh>& submeshes = _modelResources[0].Submeshes();
+    // Pipelines compile in the background; recording is the first point that needs them.
+    // Indexed by the packets' pipeline: the eye shading and the depth pre-pass.
+    VkPipeline eyePipelines[2] = { _pipelineRegistry->Wait(_depthPrePass ? _prePassShadingPipeline : _msaaPipeline),
+                                   _pipelineRegistry->Wait(_depthPrePass ? _depthPrePassPipeline : _msaaPipeline) };
+    // Visible submeshes as draw packets, sorted by texture and then front to back as the left eye sees them. The depth
+    // pre-pass draws them all first as an earlier pass, with a single material since it samples nothing.
+    _drawList.Clear();
+    if (!_gpuCuller) {
+        for (uint32_t i = 0; i < submeshes.size(); i++) {
+            if (i < _submeshVisibility.size() && !_submeshVisibility[i]) {
+                continue;
+            }
+            const GpuCuller::Submesh& bounds = _gpuSubmeshes[i];
+            vec4 clip = _depthSortTransform * vec4(bounds.center[0], bounds.center[1], bounds.center[2], 1.0f);
+            DrawList::Packet packet = {};
+            packet.pipeline      = 0;
+            packet.material      = MaterialTexture(submeshes[i].materialIndex);
+            packet.geometry      = 0;
+            float depth = clip.w > 0.0f ? clip.z / clip.w : 0.0f;
+            packet.key           = DrawList::Key(1, packet.pipeline, packet.material, depth);
+            packet.indexCount    = submeshes[i].indexCount;
+            packet.instanceCount = _instanceCount;
+            packet.firstIndex    = submeshes[i].indexBase;
+            packet.vertexOffset  = static_cast<int32_t>(submeshes[i].vertexBase);
+            _drawList.Push(packet);
+            if (_depthPrePass) {
+                packet.pipeline = 1;
+                packet.material = 0;
+                packet.key      = DrawList::Key(0, packet.pipeline, packet.material, depth);
+                _drawList.Push(packet);
+            }
+        }
+        _drawList.Sort();
+    }
+    auto recordEye = [this, &eyeRegions, &eyePipelines, index](uint32_t eye) -> Command::RecordRange {
+        return [this, &eyeRegions, &eyePipelines, index, eye](VkCommandBuffer commandBuffer, uint32_t first, uint32_t end) {
+            // The image's transform slots; multiview reads both eyes' transforms as one array at the start of its slot.
+            uint32_t dynamicOffsets[] = {
+                static_cast<uint32_t>(index * _modelSlotSize),
+                static_cast<uint32_t>(index * _dynamicBufferSize + (eye && !_multiview ? _dynamicBufferAlignment : 0))
+            };
+            uint32_t dynamicOffsetCount = 2;
+            DrawList::Binder binder;
+            VkShaderStageFlags drawStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+            EyePushConstants eyeConstants = { eye, _passStructure == STEREO_ON_CHIP ? LENS_DISTORTION_K1 : 0.0f };
+            VkDescriptorSet lightingSet = _clusteredLighting->DescriptorSet(index);
+            binder.pipeline = [&](VkCommandBuffer commandBuffer, uint32_t pipeline) {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, eyePipelines[pipeline]);
+                vkCmdPushConstants(commandBuffer, _msaaPipelineLayout, drawStages, sizeof(uint32_t), sizeof(eyeConstants), &eyeConstants);
+                if (_bindlessTextures) {
+                    VkDescriptorSet descriptorSets[] = { _msaaDescriptorSet, _textureDescriptorSet, lightingSet };
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _msaaPipelineLayout, 0, 3, descriptorSets, dynamicOffsetCount, dynamicOffsets);
+                } else {
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _msaaPipelineLayout, 1, 1, &lightingSet, 0, nullptr);
+                }
+            };
+            binder.material = [&](VkCommandBuffer commandBuffer, uint32_t texture) {
+                if (_bindlessTextures) {
+                    vkCmdPushConstants(commandBuffer, _msaaPipelineLayout, drawStages, 0, sizeof(uint32_t), &texture);
+                } else {
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _msaaPipelineLayout, 0, 1, &_materialDescriptorSets[texture], dynamicOffsetCount, dynamicOffsets);
+                }
+            };
+            binder.geometry = [&](VkCommandBuffer commandBuffer, uint32_t) {
+                VkBuffer vertexBuffers[] = { _modelResources[0].PositionBuffer().GetBuffer(), _modelResources[0].VertexBuffer().GetBuffer(),
+                                             _instanceBuffer->GetBuffer() };
+                VkDeviceSize offsets[] = { 0, 0, index * _instanceSlotSize };
+                vkCmdBindVertexBuffers(commandBuffer, 0, 3, vertexBuffers, offsets);
+                vkCmdBindIndexBuffer(commandBuffer, _modelResources[0].IndexBuffer().GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+            };
+            if (_gpuCuller) {
+                binder.geometry(commandBuffer, 0);
+                for (const FoveationLayout::Region& region : eyeRegions[eye]) {
+                    vkCmdSetViewport(commandBuffer, 0, 1, &region.viewport);
+                    vkCmdSetScissor(commandBuffer, 0, 1, &region.scissor);
+                    if (_depthPrePass) {
+                        binder.pipeline(commandBuffer, 1);
+                        _gpuCuller->RecordDraws(commandBuffer, index);
+                    }
+                    binder.pipeline(commandBuffer, 0);
+                    _gpuCuller->RecordDraws(commandBuffer, index);
+                }
+                return;
+            }
+            // Every foveation region gets all draws; its scissor keeps what falls into it.
+            for (const FoveationLayout::Region& region : eyeRegions[eye]) {
+                vkCmdSetViewport(commandBuffer, 0, 1, &region.viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &region.scissor);
+                _drawList.Emit(commandBuffer, first, end, binder);
+            }
+        };
+    };
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType      = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = msaaRenderPass->GetRenderPass();
+    inheritanceInfo.subpass    = 0;
+    if (_statisticsPool != VK_NULL_HANDLE) {
+        inheritanceInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    }
+    // The indirect draws take a single secondary.
+    uint32_t eyeTasks = _gpuCuller ? 1 : static_cast<uint32_t>(_drawList.Size());
+
+    // left eye, and on chip the right one beside it in the same render pass
+    VkFramebuffer eyeFramebuffer = onChip ? framebuffers[index].GetFramebuffer() : _lMsaaFramebuffers[index].GetFramebuffer();
+    inheritanceInfo.framebuffer = eyeFramebuffer;
+    vector<VkCommandBuffer> secondaries = command->RecordSecondaryCommandBuffers(*_threadPool, index, inheritanceInfo, eyeTasks, recordEye(0));
+    if (onChip) {
+        vector<VkCommandBuffer> right = command->RecordSecondaryCommandBuffers(*_threadPool, index, inheritanceInfo, eyeTasks, recordEye(1));
+        secondaries.insert(secondaries.end(), right.begin(), right.end());
+    }
+    _renderTargetPool->AliasBarrier(_msaaCommandBuffers.buffers[index], { _msaaTargets[0], _depthTargets[0] });
     VkRenderPassBeginInfo lRenderPassBegin = {};
     lRenderPassBegin.sType                 = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     lRenderPassBegin.renderPass            = msaaRenderPass->GetRenderPass();
-    lRenderPassBegin.framebuffer           = _lMsaaFramebuffers[index].GetFramebuffer();
+    lRenderPassBegin.framebuffer           = eyeFramebuffer;
     lRenderPassBegin.renderArea.offset     = { 0, 0 };
-    lRenderPassBegin.renderArea.extent     = extent;
+    lRenderPassBegin.renderArea.extent     = onChip ? extent : _foveation.ScaledExtent(scale);
     lRenderPassBegin.clearValueCount       = 2;
     vector<VkClearValue> msaaClearValues = { { 0.03125f, 0.0625f, 1.0f, 0.0f }, { 1.0f, 0 } };
     lRenderPassBegin.pClearValues = msaaClearValues.data();
-    vkCmdBeginRenderPass(_msaaCommandBuffers.buffers[index], &lRenderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(_msaaCommandBuffers.buffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, _msaaPipeline);
-    uint32_t dynamicOffsets = 0;
-    vkCmdBindDescriptorSets(_msaaCommandBuffers.buffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, _msaaPipelineLayout, 0, 1, &_msaaDescriptorSet, 1, &dynamicOffsets);
-    vkCmdDrawIndexed(_msaaCommandBuffers.buffers[index], _modelResources[0].IndicesCount(), 1, 0, 0, 0);
-
+    vkCmdBeginRenderPass(_msaaCommandBuffers.buffers[index], &lRenderPassBegin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(_msaaCommandBuffers.buffers[index], static_cast<uint32_t>(secondaries.size()), secondaries.data());
     vkCmdEndRenderPass(_msaaCommandBuffers.buffers[index]);
 
-    // right eye
-    VkRenderPassBeginInfo rRenderPassBegin = lRenderPassBegin;
-    rRenderPassBegin.framebuffer = _rMsaaFramebuffers[index].GetFramebuffer();
-    vkCmdBeginRenderPass(_msaaCommandBuffers.buffers[index], &rRenderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(_msaaCommandBuffers.buffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, _msaaPipeline);
-    dynamicOffsets = _dynamicBufferAlignment;
-    vkCmdBindDescriptorSets(_msaaCommandBuffers.buffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, _msaaPipelineLayout, 0, 1, &_msaaDescriptorSet, 1, &dynamicOffsets);
-    vkCmdDrawIndexed(_msaaCommandBuffers.buffers[index], _modelResources[0].IndicesCount(), 1, 0, 0, 0);
-
-    vkCmdEndRenderPass(_msaaCommandBuffers.buffers[index]);
+    // right eye, drawn by the pass above with multiview and on chip
+    if (!_multiview && !onChip) {
+        inheritanceInfo.framebuffer = _rMsaaFramebuffers[index].GetFramebuffer();
+        secondaries = command->RecordSecondaryCommandBuffers(*_threadPool, index, inheritanceInfo, eyeTasks, recordEye(1));
+        _renderTargetPool->AliasBarrier(_msaaCommandBuffers.buffers[index], { _msaaTargets[1], _depthTargets[1] });
+        VkRenderPassBeginInfo rRenderPassBegin = lRenderPassBegin;
+        rRenderPassBegin.framebuffer = _rMsaaFramebuffers[index].GetFramebuffer();
+        vkCmdBeginRenderPass(_msaaCommandBuffers.buffers[index], &rRenderPassBegin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(_msaaCommandBuffers.buffers[index], static_cast<uint32_t>(secondaries.size()), secondaries.data());
+        vkCmdEndRenderPass(_msaaCommandBuffers.buffers[index]);
+    }
 
+    if (_statisticsPool != VK_NULL_HANDLE) {
+        vkCmdEndQuery(_msaaCommandBuffers.buffers[index], _statisticsPool, index);
+    }
+    if (_timestampPool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(_msaaCommandBuffers.buffers[index], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _timestampPool, 2 * index + 1);
+    }
     VK_CHECK_RESULT(vkEndCommandBuffer(_msaaCommandBuffers.buffers[index]));
+    int eyePasses = _multiview || onChip ? 1 : 2;
+    // The eye draws are recorded once for both eyes with multiview only.
+    int eyeRecordings = _multiview ? 1 : 2;
+    if (_gpuCuller) {
+        Log::Info("Image %d: eyes recorded in %.3f ms with %d render passes and %d indirect draws of %d submeshes, %d drawn last (%s).",
+                  index, duration<float, std::milli>(steady_clock::now() - recordStart).count(), eyePasses,
+                  eyeRecordings * static_cast<int>(eyeRegions[0].size()) * (_depthPrePass ? 2 : 1), static_cast<int>(submeshes.size()), _gpuCuller->LastDrawCount(index),
+                  _gpuCuller->CompactsDraws() ? "draw count" : "a draw per submesh");
+    } else {
+        DrawList::Statistics draws = _drawList.Stats();
+        Log::Info("Image %d: eyes recorded in %.3f ms with %d render passes and %d draw calls of %d instances for %d of %d submeshes (%s).",
+                  index, duration<float, std::milli>(steady_clock::now() - recordStart).count(), eyePasses,
+                  draws.draws, _instanceCount, draws.packets, static_cast<int>(submeshes.size()),
+                  _multiview ? "multiview" : onChip ? "both eyes on chip" : "one pass per eye");
+        Log::Info("Image %d: %d pipeline, %d material and %d geometry binds after sorting in %.3f ms.",
+                  index, draws.pipelineBinds, draws.materialBinds, draws.geometryBinds, draws.sortMilliseconds);
+    }
+
 
 
 
+    // On chip the eyes are already distorted and presentable.
+    if (onChip) {
+        return;
+    }
 
-    Command::BeginCommandBuffer(_commandBuffers.buffers[index], VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    Command::BeginCommandBuffer(_commandBuffers.buffers[index], 0);
 
     // multiview
     vector<VkClearValue> multiviewClearValues = { { 0.0f, 0.0f, 0.0f, .0f } };
@@ -951,8 +1377,12 @@ void StereoViewingSceneRenderer::BuildCommandBuffers(int index)
     multiviewRenderPassBegin.pClearValues          = multiviewClearValues.data();
     vkCmdBeginRenderPass(_commandBuffers.buffers[index], &multiviewRenderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdBindPipeline(_commandBuffers.buffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, _multiviewPipeline);
+    vkCmdBindPipeline(_commandBuffers.buffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineRegistry->Wait(_multiviewPipeline));
+    float distortion[6] = { _foveation.Remap()[0], _foveation.Remap()[1], _foveation.Remap()[2], _foveation.Remap()[3], LENS_DISTORTION_K1, scale };
+    vkCmdPushConstants(_commandBuffers.buffers[index], _multiviewPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                       0, sizeof(distortion), distortion);
 
+    VkDeviceSize offsets[] = { 0 };
     vkCmdBindVertexBuffers(_commandBuffers.buffers[index], 0, 1, &_modelResources[1].VertexBuffer().GetBuffer(), offsets);
     vkCmdBindIndexBuffer(_commandBuffers.buffers[index], _modelResources[1].IndexBuffer().GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
 
@@ -991,12 +1421,96 @@ void StereoViewingSceneRenderer::BuildCommandBuffers(int index)
     VK_CHECK_RESULT(vkEndCommandBuffer(_commandBuffers.buffers[index]));
 }
 
+void StereoViewingSceneRenderer::MarkCommandBuffersDirty()
+{
+    _commandBuffersDirty.assign(_commandBuffersDirty.size(), true);
+}
+
+void StereoViewingSceneRenderer::SetSubmeshVisibility(const vector<uint8_t>& visible)
+{
+    if (visible != _submeshVisibility) {
+        _submeshVisibility = visible;
+        // The GPU reads it every frame.
+        if (!_gpuCuller) {
+            MarkCommandBuffersDirty();
+        }
+    }
+}
+
+void StereoViewingSceneRenderer::SetInstanceCount(uint32_t count)
+{
+    _instanceCount = max(count, 1u);
+    InstanceData identity;
+    PackInstance(mat4(1.0f), identity);
+    _instances.assign(_instanceCount, identity);
+}
+
+void StereoViewingSceneRenderer::UpdateInstanceTransforms(const vector<mat4>& transforms)
+{
+    for (size_t i = 0; i < transforms.size() && i < _instances.size(); i++) {
+        PackInstance(transforms[i], _instances[i]);
+    }
+}
+
+void StereoViewingSceneRenderer::UpdateLights(const vector<Culling::Light>& lights, float zNear, float zFar)
+{
+    _lights    = lights;
+    _lightNear = zNear;
+    _lightFar  = zFar;
+}
+
+void StereoViewingSceneRenderer::SetDepthPrePass(bool enabled)
+{
+    if (enabled != _depthPrePass) {
+        _depthPrePass = enabled;
+        Log::Info("Depth pre-pass %s.", enabled ? "on" : "off");
+        MarkCommandBuffersDirty();
+    }
+}
+
+void StereoViewingSceneRenderer::ReadPipelineStatistics(uint32_t imageIndex)
+{
+    uint64_t invocations;
+    if (vkGetQueryPoolResults(device->LogicalDevice(), _statisticsPool, imageIndex, 1, sizeof(invocations), &invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+    int mode = _statisticsPrePass[imageIndex] ? 1 : 0;
+    _fragmentInvocations[mode] += invocations;
+    if (++_statisticsFrames[mode] < STATISTICS_FRAMES) {
+        return;
+    }
+    _averageInvocations[mode] = static_cast<double>(_fragmentInvocations[mode]) / _statisticsFrames[mode];
+    _fragmentInvocations[mode] = 0;
+    _statisticsFrames[mode] = 0;
+    Log::Info("Eye passes: %.0f fragment shader invocations per frame %s the depth pre-pass.", _averageInvocations[mode], mode ? "with" : "without");
+    if (_averageInvocations[0] > 0.0 && _averageInvocations[1] > 0.0) {
+        Log::Info("Depth pre-pass saves %.1f%% of the fragment shader invocations.", 100.0 * (1.0 - _averageInvocations[1] / _averageInvocations[0]));
+    }
+#ifdef ENABLE_BENCHMARKS
+    // Alternates the modes to compare them under the same scene.
+    SetDepthPrePass(mode == 0);
+#endif
+}
+
+void StereoViewingSceneRenderer::SetFoveationLevel(FoveationLevel level)
+{
+    if (level == _foveationLevel) {
+        return;
+    }
+    _foveationLevel = level;
+    // Until the pipelines are requested nothing is built at the old size yet.
+    if (_msaaPipeline != PipelineRegistry::INVALID_ID) {
+        RebuildSwapchain();
+    }
+}
+
 void StereoViewingSceneRenderer::RebuildSwapchain()
 {
     VkDevice d = device->LogicalDevice();
     vkDeviceWaitIdle(d);
     uint32_t concurrentFramesCount = swapchain->ConcurrentFramesCount();
     vkWaitForFences(d, concurrentFramesCount, multiFrameFences.data(), true, UINT64_MAX);
+    _uploadContext->Collect();
     vkResetFences(d, concurrentFramesCount, multiFrameFences.data());
 
     currentFrameIndex = 0;
@@ -1010,8 +1524,10 @@ void StereoViewingSceneRenderer::RebuildSwapchain()
     BuildMSAAImage(_sampleCount, 1);
     BuildMSAADepthImage(renderPasses[0], _sampleCount, 0);
     BuildMSAADepthImage(renderPasses[0], _sampleCount, 1);
+    BuildRenderTargets();
     BuildMSAAResolvedImages(0);
     BuildMSAAResolvedImages(1);
+    BuildFramebuffers();
 
     BuildMSAADescriptorSet();
     BuildMultiViewDescriptorSet(0);
@@ -1019,6 +1535,9 @@ void StereoViewingSceneRenderer::RebuildSwapchain()
 
     android_app* app = (android_app*)_application;
     BuildMSAAPipeline(app, _vertexLayouts[0], _sampleCount);
+    BuildGpuCulling(app);
+    BuildClusteredLighting(app);
+    BuildInstanceBuffer();
     BuildMultiviewPipeline(app, _vertexLayouts[1]);
 }
 
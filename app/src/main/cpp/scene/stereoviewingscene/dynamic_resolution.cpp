@@ -0,0 +1,56 @@
+﻿#include "dynamic_resolution.h"
+#include <algorithm>
+#include <cmath>
+
+using std::max;
+using std::min;
+
+// Weight of a new measurement in the smoothed GPU time.
+static const float SMOOTHING = 0.125f;
+// Scales are multiples of this.
+static const float SCALE_STEP = 1.0f / 32.0f;
+// Frames between two changes, giving the smoothed time a chance to settle at the new scale.
+static const uint32_t SETTLE_FRAMES = 16;
+// Below this share of the budget there is room to scale up; the scale aims at the middle of both.
+static const float HEADROOM = 0.8f;
+
+DynamicResolution::DynamicResolution(float budgetMilliseconds, float minScale, float maxScale, size_t historySize)
+    : _budget(budgetMilliseconds), _minScale(minScale), _maxScale(maxScale), _scale(maxScale), _history(max<size_t>(historySize, 1))
+{
+}
+
+bool DynamicResolution::Update(float gpuMilliseconds)
+{
+    _filtered = _filtered == 0.0f ? gpuMilliseconds : _filtered + SMOOTHING * (gpuMilliseconds - _filtered);
+    _history[_next] = { gpuMilliseconds, _scale };
+    _next = (_next + 1) % _history.size();
+    _full = _full || _next == 0;
+
+    if (++_framesUnchanged < SETTLE_FRAMES || _filtered <= 0.0f) {
+        return false;
+    }
+    if (_filtered <= _budget && _filtered >= _budget * HEADROOM) {
+        return false;
+    }
+    // Time follows the area, i.e. the square of the scale.
+    float target = _budget * (1.0f + HEADROOM) * 0.5f;
+    float scale = _scale * std::sqrt(target / _filtered);
+    scale = std::round(scale / SCALE_STEP) * SCALE_STEP;
+    scale = min(_maxScale, max(_minScale, scale));
+    if (scale == _scale) {
+        return false;
+    }
+    _scale = scale;
+    _framesUnchanged = 0;
+    return true;
+}
+
+vector<DynamicResolution::Sample> DynamicResolution::History() const
+{
+    if (!_full) {
+        return vector<Sample>(_history.begin(), _history.begin() + _next);
+    }
+    vector<Sample> history(_history.begin() + _next, _history.end());
+    history.insert(history.end(), _history.begin(), _history.begin() + _next);
+    return history;
+}
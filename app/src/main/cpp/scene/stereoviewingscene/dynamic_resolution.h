@@ -0,0 +1,41 @@
+﻿#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+// Picks the scale of the eye render area from measured GPU time. Each measurement is smoothed and the scale is moved
+// so that the shaded area tracks the budget, on the assumption that GPU time grows with the area. Scales are
+// quantized and changes spaced apart, since every change re-records the command buffers.
+class DynamicResolution
+{
+public:
+    typedef struct Sample {
+        float gpuMilliseconds;
+        float scale;
+    } Sample;
+
+    DynamicResolution(float budgetMilliseconds = 13.0f, float minScale = 0.5f, float maxScale = 1.0f, size_t historySize = 256);
+
+    // Returns true when Scale() changed.
+    bool Update(float gpuMilliseconds);
+    float Scale() const { return _scale; }
+    float FilteredMilliseconds() const { return _filtered; }
+    // Oldest first, at most historySize samples.
+    vector<Sample> History() const;
+
+private:
+    float          _budget;
+    float          _minScale, _maxScale;
+    float          _scale;
+    float          _filtered        = 0.0f;
+    uint32_t       _framesUnchanged = 0;
+    vector<Sample> _history;
+    size_t         _next            = 0;
+    bool           _full            = false;
+};
+
+#endif // DYNAMIC_RESOLUTION_H
@@ -0,0 +1,99 @@
+﻿#include "foveation.h"
+#include <algorithm>
+#include <cmath>
+
+using std::max;
+
+FoveationLayout::FoveationLayout(FoveationLevel level, VkExtent2D swapchainExtent, VkExtent2D displayExtent) : _level(level)
+{
+    VkExtent2D fullDensity = swapchainExtent;
+    float center  = 1.0f;
+    float density = 1.0f;
+    if (level != FOVEATION_NONE) {
+        // The distortion scales eye space by 1 + k1 * r^2 tangentially and 1 + 3 * k1 * r^2 radially, so the eye buffer
+        // needs the screen's density times the largest of both anywhere up to the corners at r^2 = 2.
+        float magnification = max(1.0f, 1.0f + 3.0f * LENS_DISTORTION_K1 * 2.0f);
+        fullDensity.width  = static_cast<uint32_t>(std::ceil(displayExtent.width * magnification));
+        fullDensity.height = static_cast<uint32_t>(std::ceil(displayExtent.height * magnification));
+    }
+    if (level == FOVEATION_MEDIUM) {
+        center  = 0.5f;
+        density = 0.5f;
+    } else if (level == FOVEATION_HIGH) {
+        center  = 0.375f;
+        density = 0.25f;
+    }
+
+    vector<Segment> columns = Split(fullDensity.width, center, density, _eyeExtent.width, _remap[1]);
+    vector<Segment> rows    = Split(fullDensity.height, center, density, _eyeExtent.height, _remap[3]);
+    _remap[0] = _remap[2] = center;
+    for (const Segment& row : rows) {
+        for (const Segment& column : columns) {
+            // The viewport maps eye space [-1, 1] to a span whose [ndcMin, ndcMax] part covers the segment exactly.
+            Region region = {};
+            region.viewport.width    = column.size * 2.0f / (column.ndcMax - column.ndcMin);
+            region.viewport.height   = row.size * 2.0f / (row.ndcMax - row.ndcMin);
+            region.viewport.x        = column.offset - (column.ndcMin + 1.0f) * 0.5f * region.viewport.width;
+            region.viewport.y        = row.offset - (row.ndcMin + 1.0f) * 0.5f * region.viewport.height;
+            region.viewport.minDepth = 0.0f;
+            region.viewport.maxDepth = 1.0f;
+            region.scissor.offset    = { static_cast<int32_t>(column.offset), static_cast<int32_t>(row.offset) };
+            region.scissor.extent    = { column.size, row.size };
+            _regions.push_back(region);
+        }
+    }
+    _shadedPixelRatio = static_cast<float>(_eyeExtent.width) * _eyeExtent.height / (static_cast<float>(swapchainExtent.width) * swapchainExtent.height);
+}
+
+vector<FoveationLayout::Segment> FoveationLayout::Split(uint32_t fullDensity, float center, float density, uint32_t& total, float& band)
+{
+    if (center >= 1.0f) {
+        total = fullDensity;
+        band  = 0.0f;
+        return { { -1.0f, 1.0f, 0, fullDensity } };
+    }
+    uint32_t outer  = max(1u, static_cast<uint32_t>(std::lround((1.0f - center) * 0.5f * fullDensity * density)));
+    uint32_t middle = max(1u, static_cast<uint32_t>(std::lround(center * fullDensity)));
+    total = 2 * outer + middle;
+    band  = static_cast<float>(outer) / total;
+    return {
+        { -1.0f  , -center, 0             , outer  },
+        { -center, center , outer         , middle },
+        { center , 1.0f   , outer + middle, outer  }
+    };
+}
+
+VkExtent2D FoveationLayout::ScaledExtent(float scale) const
+{
+    return { static_cast<uint32_t>(std::lround(_eyeExtent.width * scale)), static_cast<uint32_t>(std::lround(_eyeExtent.height * scale)) };
+}
+
+vector<FoveationLayout::Region> FoveationLayout::ScaledRegions(float scale) const
+{
+    vector<Region> regions = _regions;
+    for (Region& region : regions) {
+        region.viewport.x      *= scale;
+        region.viewport.y      *= scale;
+        region.viewport.width  *= scale;
+        region.viewport.height *= scale;
+        // Edges are rounded rather than sizes, so neighbouring scissors still meet.
+        VkRect2D& scissor = region.scissor;
+        int32_t right  = static_cast<int32_t>(std::lround((scissor.offset.x + scissor.extent.width) * scale));
+        int32_t bottom = static_cast<int32_t>(std::lround((scissor.offset.y + scissor.extent.height) * scale));
+        scissor.offset.x = static_cast<int32_t>(std::lround(scissor.offset.x * scale));
+        scissor.offset.y = static_cast<int32_t>(std::lround(scissor.offset.y * scale));
+        scissor.extent   = { static_cast<uint32_t>(right - scissor.offset.x), static_cast<uint32_t>(bottom - scissor.offset.y) };
+    }
+    return regions;
+}
+
+const char* FoveationLayout::Name(FoveationLevel level)
+{
+    switch (level) {
+        case FOVEATION_NONE:   return "none";
+        case FOVEATION_LOW:    return "low";
+        case FOVEATION_MEDIUM: return "medium";
+        case FOVEATION_HIGH:   return "high";
+    }
+    return "unknown";
+}
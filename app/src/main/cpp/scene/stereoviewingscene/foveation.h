@@ -0,0 +1,72 @@
+﻿#ifndef FOVEATION_H
+#define FOVEATION_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include <vector>
+
+using std::vector;
+
+// Radial distortion coefficient of the lens, applied by the distortion pass: a point p of the eye image lands at
+// p * (1 + k1 * |p|^2) on screen.
+static const float LENS_DISTORTION_K1 = -0.046875f;
+
+typedef enum FoveationLevel {
+    // Every eye buffer as large as the whole swapchain image.
+    FOVEATION_NONE,
+    // Eye buffers as large as their half of the screen times the lens' largest magnification.
+    FOVEATION_LOW,
+    // Lens matched, with the periphery rendered at half density.
+    FOVEATION_MEDIUM,
+    // Lens matched, with a smaller center and the periphery at a quarter of the density.
+    FOVEATION_HIGH
+} FoveationLevel;
+
+// Lays out an eye buffer as a 3x3 grid of regions: the center at full density and the bands around it at reduced
+// density. Each region is drawn with a viewport that stretches the whole eye projection over it, so the scene is
+// drawn once per region with unchanged transforms and the scissor keeps the part that belongs there. The distortion
+// pass undoes the layout with Remap() before sampling.
+class FoveationLayout
+{
+public:
+    typedef struct Region {
+        VkViewport viewport;
+        VkRect2D   scissor;
+    } Region;
+
+    FoveationLayout() = default;
+    // displayExtent is the part of the screen a single eye is shown on.
+    FoveationLayout(FoveationLevel level, VkExtent2D swapchainExtent, VkExtent2D displayExtent);
+
+    FoveationLevel Level() const { return _level; }
+    VkExtent2D EyeExtent() const { return _eyeExtent; }
+    const vector<Region>& Regions() const { return _regions; }
+    // The layout shrunk towards the buffer's origin, for rendering into part of the eye buffer.
+    VkExtent2D ScaledExtent(float scale) const;
+    vector<Region> ScaledRegions(float scale) const;
+    // Per axis, the eye space coordinate where the center region ends and the fraction of the buffer each outer band
+    // takes: (x center, x band, y center, y band).
+    const float* Remap() const { return _remap; }
+    // Pixels shaded per eye relative to FOVEATION_NONE.
+    float ShadedPixelRatio() const { return _shadedPixelRatio; }
+
+    static const char* Name(FoveationLevel level);
+
+private:
+    typedef struct Segment {
+        float    ndcMin, ndcMax;
+        uint32_t offset, size;
+    } Segment;
+
+    // Splits one axis of fullDensity pixels into the outer bands and the center.
+    static vector<Segment> Split(uint32_t fullDensity, float center, float density, uint32_t& total, float& band);
+
+    FoveationLevel _level            = FOVEATION_NONE;
+    VkExtent2D     _eyeExtent        = {};
+    vector<Region> _regions;
+    float          _remap[4]         = { 1.0f, 0.0f, 1.0f, 0.0f };
+    float          _shadedPixelRatio = 1.0f;
+};
+
+#endif // FOVEATION_H
@@ -4,6 +4,9 @@
 #include "../scene.h"
 #include "../../vulkan/model/model.h"
 #include "../../vulkan/texture/texture.h"
+#include "../../culling/occlusion_culler.h"
+#include "../../culling/bvh.h"
+#include "../../culling/light_clusters.h"
 #include "transformation.hpp"
 #include <glm/ext/quaternion_common.hpp>
 #include <glm/ext/quaternion_float.hpp>
@@ -13,7 +16,8 @@ using Vulkan::Model;
 class StereoViewingScene : public Scene
 {
 public:
-    StereoViewingScene(void* state);
+    // More than one instance turns it into a stress scene: that many copies of the model on a grid, drawn instanced.
+    StereoViewingScene(void* state, uint32_t instances = 1);
     ~StereoViewingScene();
 
     bool UpdateImpl() override;
@@ -45,7 +49,16 @@ public:
     }
 
     const vector<Model>& Models() const { return _models; };
+    // The submesh of the first model straight ahead of the viewer, or UINT32_MAX.
+    uint32_t GazedSubmesh() const { return _gazedSubmesh; }
 private:
+    // Picks the submeshes of the first model with the largest bounds as occluders.
+    void ChooseOccluders();
+    // Spins every copy of the stress scene about its own vertical axis.
+    void UpdateInstances(float elapsedTime);
+    // Moves every light along its orbit about the model, spot lights facing inwards and down.
+    void MoveLights(float elapsedTime);
+
     uint32_t _screenWidth, _screenHeight;
 
     vec3 _worldSpaceCameraPos;
@@ -59,6 +72,30 @@ private:
     // ==== Vulkan ==== //
     vector<Model> _models;
     vector<mat4>  _modelTransforms;
+    // Submeshes of the first model inside the frustum enclosing both eyes.
+    vector<uint8_t> _visibleSubmeshes;
+    // Each eye rasterizes the occluders into its own depth buffer and tests the submeshes left by the frustum, which
+    // stay visible if either eye sees them.
+    ThreadPool*                _cullingThreads = nullptr;
+    Culling::OcclusionCuller*  _occlusionCullers[2] = { nullptr, nullptr };
+    vector<uint32_t>           _occluders;
+    vector<uint8_t>            _eyeVisibleSubmeshes[2];
+    // Model space submesh bounds of the first model, for gaze picking only; the flat SIMD test is faster for the
+    // frustum. The second model is the distortion plane and not part of the world.
+    Culling::Bvh*              _submeshBvh = nullptr;
+    uint32_t                   _gazedSubmesh = UINT32_MAX;
+    // Stress scene: grid positions of the copies, their transforms of this frame and the frame times since the
+    // last report. Culling is per submesh of a single copy, so it is skipped.
+    uint32_t                   _instances;
+    vector<vec3>               _instanceOffsets;
+    vector<mat4>               _instanceTransforms;
+    float                      _stressSeconds = 0.0f;
+    uint32_t                   _stressFrames  = 0;
+    // Point and spot lights, every other one a spot light, each circling the middle of the model, or of the stress
+    // scene's grid, at its own radius, height, phase and rate.
+    vector<Culling::Light>     _lights;
+    vector<vec4>               _lightOrbits;
+    vec3                       _lightCenter;
     ViewProjectionTransform _lViewProjTransform;
     ViewProjectionTransform _rViewProjTransform;
 };
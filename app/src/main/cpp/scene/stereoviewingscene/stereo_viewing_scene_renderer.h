@@ -5,6 +5,17 @@
 #include "../../vulkan/model/model.h"
 #include "../../vulkan/model/model_resource.h"
 #include "../../vulkan/texture/texture.h"
+#include "../../vulkan/render_target_pool.h"
+#include "../../vulkan/render_graph.h"
+#include "../../vulkan/upload_context.h"
+#include "../../vulkan/pipeline_registry.h"
+#include "../../vulkan/descriptor_allocator.h"
+#include "../../vulkan/gpu_culler.h"
+#include "../../vulkan/clustered_lighting.h"
+#include "../../vulkan/draw_list.h"
+#include "../../thread/thread_pool.h"
+#include "foveation.h"
+#include "dynamic_resolution.h"
 #include <vector>
 
 using Vulkan::Command;
@@ -12,11 +23,38 @@ using Vulkan::VertexLayout;
 using Vulkan::ModelResource;
 using Vulkan::Texture;
 using Vulkan::Texture2D;
+using Vulkan::RenderTargetPool;
+using Vulkan::RenderGraph;
+using Vulkan::UploadContext;
+using Vulkan::PipelineRegistry;
+using Vulkan::GpuCuller;
+using Vulkan::ClusteredLighting;
+using Vulkan::DrawList;
+using Utility::ThreadPool;
 using std::vector;
 
+// How the eyes reach the swapchain image.
+typedef enum StereoPassStructure {
+    // Each eye is resolved into a texture, stored, and sampled back by the distortion pass. Eye buffers can be
+    // foveated and scaled at the cost of that round trip.
+    STEREO_RESOLVE_AND_SAMPLE,
+    // Both eyes render side by side into one transient MSAA target that is resolved straight into the swapchain image,
+    // their vertices lens distorted, so eye color never leaves tile memory. Draws one pass per eye at full density.
+    STEREO_ON_CHIP
+} StereoPassStructure;
+
 class StereoViewingSceneRenderer : public Renderer
 {
 public:
+    // One instance of the first model as the eye shaders read it from the per-instance vertex binding: the rows of
+    // the 3x4 model matrix, then the columns of the normal matrix.
+    typedef struct InstanceData {
+        vec4 model[3];
+        vec4 normal[3];
+    } InstanceData;
+    // Above any vertex layout's attributes.
+    static const uint32_t INSTANCE_LOCATION = 8;
+
     StereoViewingSceneRenderer(void* application, uint32_t screenWidth, uint32_t screenHeight);
     ~StereoViewingSceneRenderer() override;
 
@@ -28,23 +66,54 @@ public:
                               const ViewProjectionTransform& rViewProj,
                               int viewProjSize);
 
+    // Returns once the uploads are submitted; the first frame drawing them waits for them on the GPU.
     void UploadModels(const vector<Vulkan::Model>& models);
     void BuildTextureSamplers();
 
     void BuildMSAAImage(VkSampleCountFlagBits sampleCount, int eye);
     void BuildMSAADepthImage(RenderPass* msaaRenderPass, VkSampleCountFlagBits sampleCount, int eye);
+    void BuildRenderTargets();
     void BuildMSAAResolvedImages(int eye);
+    void BuildFramebuffers();
     void BuildMSAAResolvedResultSampler();
 
     void BuildMSAADescriptorSetLayout();
     void BuildMultiviewDescriptorSetLayout();
-    void BuildDescriptorPool();
     void BuildMSAADescriptorSet();
     void BuildMultiViewDescriptorSet(int eye);
     void BuildMSAAPipeline(void* application, const VertexLayout& vertexLayout, VkSampleCountFlagBits sampleCount);
     void BuildMultiviewPipeline(void* application, const VertexLayout& vertexLayout);
+    // After BuildMSAAPipeline(), which decides whether the eye draws are culled on the GPU.
+    void BuildGpuCulling(void* application);
+    // The eye shaders' clustered lights, assigned on the GPU when built with GPU_LIGHT_CLUSTERS and on the CPU
+    // otherwise.
+    void BuildClusteredLighting(void* application);
+    void BuildInstanceBuffer();
 
     void BuildCommandBuffers(int index);
+    // Command buffers are recorded once per swapchain image and resubmitted as is. Call this whenever what is drawn
+    // changes; only uniform contents may change without it.
+    void MarkCommandBuffersDirty();
+    // One flag per submesh of the first model; only visible ones are drawn. Changes re-record the command buffers.
+    void SetSubmeshVisibility(const vector<uint8_t>& visible);
+    // In the first model's space; the GPU culls against it every frame, without re-recording.
+    void SetCullingFrustum(const Culling::Frustum& frustum) { _cullingFrustum = frustum; }
+    // Copies of the first model each eye draw makes, set before the pipelines are built. The indirect draws use the
+    // first instance for the texture index, so more than one keeps the draws on the CPU.
+    void SetInstanceCount(uint32_t count);
+    // One transform per instance, relative to the first model's; streamed to the GPU with the next frame.
+    void UpdateInstanceTransforms(const vector<mat4>& transforms);
+    // World space point and spot lights, assigned to clusters between zNear and zFar of both eyes with the next frame.
+    void UpdateLights(const vector<Culling::Light>& lights, float zNear, float zFar);
+    // Draws the eye passes' depth first from positions alone, then shades with an EQUAL depth test and depth writes
+    // off, so that hidden samples are never shaded. Re-records the command buffers.
+    void SetDepthPrePass(bool enabled);
+    // Rebuilds the eye buffers for the new level once they exist; before that it picks the level they are built with.
+    void SetFoveationLevel(FoveationLevel level);
+    // Chosen with ON_CHIP_EYES at build time; the descriptor layouts depend on it through multiview.
+    StereoPassStructure PassStructure() const { return _passStructure; }
+    // Scale of the eye render area and its history, for telemetry.
+    const DynamicResolution& Resolution() const { return _dynamicResolution; }
 
     VkSampleCountFlagBits SampleCount() { return _sampleCount; }
 
@@ -74,49 +143,148 @@ private:
     void BuildSwapchainWithDependencies();
     void DeleteSwapchainWithDependencies();
     void RebuildSwapchain();
+    // The frame of structure in graph after its eye targets: the eye passes and, when they do not resolve into the
+    // swapchain image, the distortion pass.
+    void DeclarePasses(RenderGraph& graph, StereoPassStructure structure, const uint32_t msaa[2], const uint32_t depth[2]) const;
+    // The MSAA color or depth target of the left eye, or of both eyes for multiview and on-chip rendering.
+    RenderGraph::ImageInfo EyeTargetInfo(StereoPassStructure structure, bool depth) const;
+    // Bytes stored to and loaded from memory per frame by each structure, from the attachments' load and store
+    // operations and the distortion pass' reads.
+    void LogTraffic() const;
+    // Receives the frames an offscreen swapchain reads back and logs a checksum of one every so often.
+    void OnFrameRead(const uint8_t* pixels);
+    // Index into _modelTextures; the first texture stands in for materials without a diffuse one.
+    uint32_t MaterialTexture(uint32_t materialIndex) const;
+    // Adds the fragment shader invocations of the image's last eye passes to the average of the mode they were
+    // recorded with, and logs both averages every so often.
+    void ReadPipelineStatistics(uint32_t imageIndex);
+    void WriteUniformBuffers(uint32_t imageIndex);
 
     void* _application;
 
-    vector<VkFence> msaaFences;
+    // Frames read back from the offscreen swapchain so far.
+    uint32_t _framesRead = 0;
+
+    // Signaled by the eye pass, waited on by the distortion pass of the same frame.
+    vector<VkSemaphore> _eyesCompleteSemaphores;
+
+    UploadContext*        _uploadContext = nullptr;
+    UploadContext::Ticket _uploadTicket  = UploadContext::NO_TICKET;
 
     vector<ModelResource>           _modelResources;
     vector<Texture2D>               _modelTextures;
     vector<Texture::TextureAttribs> _textureAttribsGroup;
     vector<VkSampler>               _textureSamplers;
+    // The diffuse texture of each material of the first model.
+    vector<uint32_t>                _materialTextures;
+    // Empty until the scene culls, which draws everything.
+    vector<uint8_t>                 _submeshVisibility;
+    // With bindless textures and multi draw indirect, the eye passes draw the first model with indirect draws that a
+    // compute pass culls against _cullingFrustum and _submeshVisibility. Recorded once, they follow both without
+    // re-recording.
+    bool                            _gpuDriven = false;
+    vector<GpuCuller::Submesh>      _gpuSubmeshes;
+    GpuCuller*                      _gpuCuller = nullptr;
+    Culling::Frustum                _cullingFrustum = {};
+    // One slot of _instanceCount InstanceData per swapchain image, refilled from _instances once the image's previous
+    // frame has completed.
+    uint32_t                        _instanceCount = 1;
+    vector<InstanceData>            _instances;
+    Buffer*                         _instanceBuffer = nullptr;
+    VkDeviceSize                    _instanceSlotSize = 0;
+    bool                            _depthPrePass = false;
+    // Lights of the next frame, clustered through the eye transforms of the last UpdateUniformBuffers().
+    ClusteredLighting*              _clusteredLighting = nullptr;
+    vector<Culling::Light>          _lights;
+    float                           _lightNear = 0.125f, _lightFar = 128.0f;
+    ViewProjectionTransform         _eyeTransforms[2] = {};
+    mat4                            _modelTransform = mat4(1.0f);
 
+    // Model and view projection transforms keep one slot per swapchain image, picked by dynamic offsets and written
+    // once the image's previous frame has completed. A view projection slot holds both eyes.
     vector<Buffer> _buffers;
+    size_t         _modelSlotSize;
     size_t         _dynamicBufferAlignment;
     size_t         _dynamicBufferSize;
 
     VkSampleCountFlagBits _sampleCount = VK_SAMPLE_COUNT_1_BIT;
 
-    VkImage        _lMsaaImage        = VK_NULL_HANDLE, _rMsaaImage        = VK_NULL_HANDLE;
-    VkImageView    _lMsaaView         = VK_NULL_HANDLE, _rMsaaView         = VK_NULL_HANDLE;
-    VkDeviceMemory _lMsaaImageMemory  = VK_NULL_HANDLE, _rMsaaImageMemory  = VK_NULL_HANDLE;
-    VkImage        _lDepthImage       = VK_NULL_HANDLE, _rDepthImage       = VK_NULL_HANDLE;
-    VkImageView    _lDepthView        = VK_NULL_HANDLE, _rDepthView        = VK_NULL_HANDLE;
-    VkDeviceMemory _lDepthImageMemory = VK_NULL_HANDLE, _rDepthImageMemory = VK_NULL_HANDLE;
+    StereoPassStructure _passStructure = STEREO_RESOLVE_AND_SAMPLE;
+
+    // MSAA color and depth of both eyes are transients of the frame graph, which puts the left and right attachments
+    // in the same alias slots since the eyes are rendered one after another.
+    RenderGraph*      _frameGraph       = nullptr;
+    uint32_t          _msaaResources[2];
+    uint32_t          _depthResources[2];
+    RenderTargetPool* _renderTargetPool = nullptr;
+    VkFormat          _depthFormat      = VK_FORMAT_UNDEFINED;
+    uint32_t          _msaaTargets[2];
+    uint32_t          _depthTargets[2];
     vector<VkImage>        _lMsaaResolvedImages  , _rMsaaResolvedImages;
     vector<VkDeviceMemory> _lMsaaResolvedMemories, _rMsaaResolvedMemories;
     vector<VkImageView>    _lMsaaResolvedViews   , _rMsaaResolvedViews;
+    // Single pass stereo through VK_KHR_multiview: the MSAA attachments and the left eye's resolved images have a
+    // layer per eye, rendered into through these array views, and the right eye's images stay empty.
+    bool                   _multiview = false;
+    vector<VkImageView>    _stereoResolvedViews;
     vector<Framebuffer>    _lMsaaFramebuffers    , _rMsaaFramebuffers;
+    // Size and region layout of the eye buffers, recomputed with the swapchain.
+    FoveationLevel         _foveationLevel = FOVEATION_MEDIUM;
+    FoveationLayout        _foveation;
+    // Scales the eye render area by the GPU time of the eye pass, measured with a pair of timestamps per swapchain
+    // image and read back once the image comes around again.
+    DynamicResolution      _dynamicResolution;
+    bool                   _gpuTimestamps = false;
+    VkQueryPool            _timestampPool = VK_NULL_HANDLE;
+    vector<bool>           _timestampsWritten;
+    // Fragment shader invocations of the eye passes, one query per swapchain image, and whether the image was
+    // recorded with the depth pre-pass. Averaged per mode, [0] without and [1] with it.
+    VkQueryPool            _statisticsPool = VK_NULL_HANDLE;
+    vector<bool>           _statisticsWritten;
+    vector<bool>           _statisticsPrePass;
+    uint64_t               _fragmentInvocations[2] = {};
+    uint32_t               _statisticsFrames[2] = {};
+    double                 _averageInvocations[2] = {};
     VkSampler _msaaResolvedResultSampler = VK_NULL_HANDLE;
 
-    VkDescriptorSetLayout   _msaaDescriptorSetLayout      = VK_NULL_HANDLE;
-    VkDescriptorSetLayout   _multiviewDescriptorSetLayout = VK_NULL_HANDLE;
-    VkDescriptorPool        _descriptorPool               = VK_NULL_HANDLE;
-    VkDescriptorSet         _msaaDescriptorSet            = VK_NULL_HANDLE;
-    vector<VkDescriptorSet> _lDescriptorSets, _rDescriptorSets;
+    // Layouts are owned by the device's layout cache. The sets are recorded into the command buffers of every
+    // swapchain image, so they live until the swapchain is rebuilt, which resets the allocator.
+    const DescriptorSetLayout* _msaaDescriptorSetLayout      = nullptr;
+    const DescriptorSetLayout* _multiviewDescriptorSetLayout = nullptr;
+    DescriptorAllocator*       _descriptorAllocator          = nullptr;
+    VkDescriptorSet            _msaaDescriptorSet            = VK_NULL_HANDLE;
+    // With descriptor indexing, every texture sits in one partially bound array in set 1 and each draw pushes the
+    // index of its material's texture. Without it, set 0 includes the texture and each material gets its own copy,
+    // bound per draw.
+    bool                       _bindlessTextures             = false;
+    const DescriptorSetLayout* _textureDescriptorSetLayout   = nullptr;
+    VkDescriptorSet            _textureDescriptorSet         = VK_NULL_HANDLE;
+    vector<VkDescriptorSet>    _materialDescriptorSets;
+    vector<VkDescriptorSet>    _lDescriptorSets, _rDescriptorSets;
 
     vector<VertexLayout> _vertexLayouts;
 
     VkPipelineLayout _msaaPipelineLayout      = VK_NULL_HANDLE;
     VkPipelineLayout _multiviewPipelineLayout = VK_NULL_HANDLE;
-    VkPipeline       _msaaPipeline            = VK_NULL_HANDLE;
-    VkPipeline       _multiviewPipeline       = VK_NULL_HANDLE;
+    // Requested when the swapchain is built and compiled on the registry's threads.
+    PipelineRegistry*            _pipelineRegistry  = nullptr;
+    PipelineRegistry::PipelineId _msaaPipeline      = PipelineRegistry::INVALID_ID;
+    PipelineRegistry::PipelineId _multiviewPipeline = PipelineRegistry::INVALID_ID;
+    // The depth pre-pass and the eye shading after it.
+    PipelineRegistry::PipelineId _depthPrePassPipeline   = PipelineRegistry::INVALID_ID;
+    PipelineRegistry::PipelineId _prePassShadingPipeline = PipelineRegistry::INVALID_ID;
 
     Command::CommandBuffers _msaaCommandBuffers;
     Command::CommandBuffers _commandBuffers;
+    vector<bool>            _commandBuffersDirty;
+    // Records the eye passes' draws into secondary command buffers.
+    ThreadPool*             _threadPool = nullptr;
+    // The CPU recorded eye draws, rebuilt with each recording; depth is taken through the left eye's transform as of
+    // the last UpdateUniformBuffers().
+    DrawList                _drawList;
+    mat4                    _depthSortTransform = mat4(1.0f);
+    // Fence of the last frame that rendered to each swapchain image.
+    vector<VkFence>         _imageFences;
 };
 
 #endif // STEREO_VIEWING_SCENE_RENDERER_H
\ No newline at end of file
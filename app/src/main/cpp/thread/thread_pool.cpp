@@ -0,0 +1,74 @@
+﻿#include "thread_pool.h"
+#include <algorithm>
+
+using std::condition_variable;
+using std::mutex;
+using std::unique_lock;
+
+namespace Utility {
+    ThreadPool::ThreadPool(uint32_t threadCount)
+    {
+        threadCount = std::max(threadCount, 1u);
+        for (uint32_t i = 0; i < threadCount; i++) {
+            _workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            unique_lock<mutex> lock(_mutex);
+            _stop = true;
+        }
+        _workAvailable.notify_all();
+        for (auto& w : _workers) {
+            w.join();
+        }
+    }
+
+    void ThreadPool::Run(uint32_t taskCount, const Task& task)
+    {
+        if (!taskCount) {
+            return;
+        }
+        unique_lock<mutex> lock(_mutex);
+        _task        = &task;
+        _taskCount   = taskCount;
+        _nextTask    = 0;
+        _pendingTask = taskCount;
+        _generation++;
+        _workAvailable.notify_all();
+        _workDone.wait(lock, [this]() { return _pendingTask == 0; });
+        _task = nullptr;
+    }
+
+    void ThreadPool::WorkerLoop(uint32_t thread)
+    {
+        uint64_t generation = 0;
+        unique_lock<mutex> lock(_mutex);
+        while (true) {
+            _workAvailable.wait(lock, [&]() { return _stop || (_generation != generation && _nextTask < _taskCount); });
+            if (_stop) {
+                return;
+            }
+            while (_nextTask < _taskCount) {
+                uint32_t t = _nextTask++;
+                const Task* task = _task;
+                lock.unlock();
+                (*task)(t, thread);
+                lock.lock();
+                if (--_pendingTask == 0) {
+                    _workDone.notify_one();
+                }
+            }
+            generation = _generation;
+        }
+    }
+
+    uint32_t ThreadPool::DefaultThreadCount(uint32_t maxThreads)
+    {
+        uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        uint32_t threads = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        return std::min(std::max(threads, 1u), std::max(maxThreads, 1u));
+    }
+}
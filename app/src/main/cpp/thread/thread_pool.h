@@ -0,0 +1,53 @@
+﻿#ifndef UTILITY_THREAD_POOL_H
+#define UTILITY_THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::function;
+using std::vector;
+
+namespace Utility {
+    // Fixed set of worker threads that execute one batch of tasks at a time. Run() hands out task indices to the
+    // workers and returns once every task has finished, so callers can treat it as a parallel for loop.
+    class ThreadPool
+    {
+    public:
+        // Task function: (task index, worker index). The worker index is stable per thread and smaller than
+        // ThreadCount(), so it can select per-thread resources.
+        typedef function<void(uint32_t task, uint32_t thread)> Task;
+
+        explicit ThreadPool(uint32_t threadCount);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void Run(uint32_t taskCount, const Task& task);
+
+        uint32_t ThreadCount() const { return static_cast<uint32_t>(_workers.size()); }
+
+        // Hardware threads minus the one driving the frame, clamped to [1, maxThreads].
+        static uint32_t DefaultThreadCount(uint32_t maxThreads = 4);
+
+    private:
+        void WorkerLoop(uint32_t thread);
+
+        vector<std::thread>     _workers;
+        std::mutex              _mutex;
+        std::condition_variable _workAvailable;
+        std::condition_variable _workDone;
+
+        const Task* _task        = nullptr;
+        uint32_t    _taskCount   = 0;
+        uint32_t    _nextTask    = 0;
+        uint32_t    _pendingTask = 0;
+        uint64_t    _generation  = 0;
+        bool        _stop        = false;
+    };
+}
+
+#endif // UTILITY_THREAD_POOL_H
@@ -9,6 +9,7 @@ Renderer::Renderer(void* app, uint32_t screenWidth, uint32_t screenHeight)
     screenSize.width  = screenWidth;
     screenSize.height = screenHeight;
     currentFrameIndex = 0;
+    pipelineCachePath = string(((android_app*)app)->activity->internalDataPath) + "/pipeline_cache.bin";
 }
 
 #endif
\ No newline at end of file
@@ -9,6 +9,8 @@ namespace Vulkan
         alignment = other.alignment, other.alignment = 0;
         _buffer   = other._buffer  , other._buffer   = VK_NULL_HANDLE;
         _memory   = other._memory  , other._memory   = VK_NULL_HANDLE;
+        _usage    = other._usage   , other._usage    = 0;
+        name      = std::move(other.name);
     }
 
     Buffer::~Buffer()
@@ -36,6 +38,7 @@ namespace Vulkan
         bufferInfo.queueFamilyIndexCount = queueFamilyIndexCount;
         bufferInfo.pQueueFamilyIndices   = pQueueFamilyIndices;
         VK_CHECK_RESULT(vkCreateBuffer(_device.LogicalDevice(), &bufferInfo, nullptr, &_buffer));
+        _usage = usage;
     }
 
     void Buffer::AllocateBuffer(VkMemoryRequirements& memoryRequirements, VkMemoryPropertyFlags preferredProperties, const void* pNext)
@@ -50,7 +53,8 @@ namespace Vulkan
         allocInfo.allocationSize  = memoryRequirements.size;
         uint32_t memoryTypeIndex = MapMemoryTypeToIndex(_device.PhysicalDevice(), memoryRequirements.memoryTypeBits, preferredProperties);
         allocInfo.memoryTypeIndex = memoryTypeIndex;
-        VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &_memory));
+        MemoryCategory category = MemoryTracker::BufferCategory(_usage, preferredProperties);
+        VK_CHECK_RESULT(_device.Memory().Allocate(allocInfo, category, name, &_memory));
     }
 
     void Buffer::BuildDefaultBuffer(VkDeviceSize          size,
@@ -96,7 +100,7 @@ namespace Vulkan
         }
         if (_memory != VK_NULL_HANDLE) {
             DebugLog("Buffer::Free() vkFreeMemory()");
-            vkFreeMemory(device, _memory, nullptr);
+            _device.Memory().Free(_memory);
             _memory = VK_NULL_HANDLE;
         }
     }
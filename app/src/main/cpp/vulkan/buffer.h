@@ -74,9 +74,12 @@ namespace Vulkan {
 
         void*        mapped    = nullptr;
         VkDeviceSize alignment = 0;
+        // Debug name reported by the memory tracker.
+        string       name      = "buffer";
     private:
-        VkBuffer       _buffer = VK_NULL_HANDLE;
-        VkDeviceMemory _memory = VK_NULL_HANDLE;
+        VkBuffer           _buffer = VK_NULL_HANDLE;
+        VkDeviceMemory     _memory = VK_NULL_HANDLE;
+        VkBufferUsageFlags _usage  = 0;
 
         const Device&  _device;
     };
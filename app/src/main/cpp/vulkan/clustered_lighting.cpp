@@ -0,0 +1,182 @@
+﻿#include "clustered_lighting.h"
+#include "vulkan_utility.h"
+#include "glm/matrix.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using Culling::Light;
+using Culling::LightClusters;
+
+namespace Vulkan
+{
+    static const uint32_t WORKGROUP_SIZE = 64;
+
+    const DescriptorSetLayout& ClusteredLighting::Layout(const Device& device)
+    {
+        vector<VkDescriptorSetLayoutBinding> bindings(4);
+        for (uint32_t b = 0; b < 4; b++) {
+            bindings[b].binding         = b;
+            bindings[b].descriptorType  = b == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[b].descriptorCount = 1;
+            bindings[b].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        return device.DescriptorLayouts().Layout(bindings);
+    }
+
+    ClusteredLighting::ClusteredLighting(const Device& device, DescriptorAllocator& descriptorAllocator, const vector<char>& computeShader,
+                                         ThreadPool* threads, uint32_t slotCount)
+        : _device(device), _slotCount(slotCount), _parameterBuffer(device), _lightBuffer(device), _rangeBuffer(device), _indexBuffer(device),
+          _clusters{ LightClusters(threads), LightClusters(threads) }
+    {
+        const VkPhysicalDeviceLimits& limits = device.PhysicalDeviceProperties().limits;
+        _parameterStride = Aligned(sizeof(Parameters), limits.minUniformBufferOffsetAlignment);
+        _lightStride     = Aligned(LIGHT_CAPACITY * sizeof(Light), limits.minStorageBufferOffsetAlignment);
+        _rangeStride     = Aligned(2 * LightClusters::CLUSTERS * 2 * sizeof(uint32_t), limits.minStorageBufferOffsetAlignment);
+        // The index count, then the indices.
+        _indexStride     = Aligned((1 + INDEX_CAPACITY) * sizeof(uint32_t), limits.minStorageBufferOffsetAlignment);
+
+        // The CPU writes the assignment where the shaders read it; the GPU keeps its own in device local memory.
+        bool gpu = !computeShader.empty();
+        VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        VkMemoryPropertyFlags assignmentMemory = gpu ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : hostVisible;
+        _parameterBuffer.name = "lighting parameters";
+        _parameterBuffer.BuildDefaultBuffer(slotCount * _parameterStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hostVisible);
+        _parameterBuffer.Map();
+        _lightBuffer.name = "lights";
+        _lightBuffer.BuildDefaultBuffer(slotCount * _lightStride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+        _lightBuffer.Map();
+        _rangeBuffer.name = "light cluster ranges";
+        _rangeBuffer.BuildDefaultBuffer(slotCount * _rangeStride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, assignmentMemory);
+        _indexBuffer.name = "light cluster indices";
+        _indexBuffer.BuildDefaultBuffer(slotCount * _indexStride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, assignmentMemory);
+        if (!gpu) {
+            _rangeBuffer.Map();
+            _indexBuffer.Map();
+        }
+
+        const DescriptorSetLayout& layout = Layout(device);
+        for (uint32_t slot = 0; slot < slotCount; slot++) {
+            _descriptorSets.push_back(descriptorAllocator.Write(layout, {
+                DescriptorBuffer(_parameterBuffer.GetBuffer(), slot * _parameterStride, sizeof(Parameters)),
+                DescriptorBuffer(_lightBuffer.GetBuffer(), slot * _lightStride, LIGHT_CAPACITY * sizeof(Light)),
+                DescriptorBuffer(_rangeBuffer.GetBuffer(), slot * _rangeStride, 2 * LightClusters::CLUSTERS * 2 * sizeof(uint32_t)),
+                DescriptorBuffer(_indexBuffer.GetBuffer(), slot * _indexStride, (1 + INDEX_CAPACITY) * sizeof(uint32_t))
+            }));
+        }
+
+        if (gpu) {
+            VkDevice d = device.LogicalDevice();
+            VkPipelineLayoutCreateInfo pipelineLayoutInfo = PipelineLayoutCreateInfo(1, &layout.layout, 0, nullptr);
+            VK_CHECK_RESULT(vkCreatePipelineLayout(d, &pipelineLayoutInfo, nullptr, &_pipelineLayout));
+            vector<char> code = computeShader;
+            VkShaderModuleCreateInfo moduleInfo = ShaderModuleCreateInfo(code);
+            VkShaderModule module;
+            VK_CHECK_RESULT(vkCreateShaderModule(d, &moduleInfo, nullptr, &module));
+            VkComputePipelineCreateInfo pipelineInfo = {};
+            pipelineInfo.sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            pipelineInfo.stage  = PipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, module);
+            pipelineInfo.layout = _pipelineLayout;
+            _pipeline = device.Pipelines().CreateComputePipeline(pipelineInfo, "light clusters");
+            vkDestroyShaderModule(d, module, nullptr);
+        }
+        Log::Info("Clustered lighting: %dx%dx%d clusters per eye, lights assigned on the %s.", LightClusters::TILES_X,
+                  LightClusters::TILES_Y, LightClusters::SLICES, gpu ? "GPU" : threads ? "CPU threads" : "CPU");
+    }
+
+    ClusteredLighting::~ClusteredLighting()
+    {
+        VkDevice d = _device.LogicalDevice();
+        vkDestroyPipeline(d, _pipeline, nullptr), _pipeline = VK_NULL_HANDLE;
+        vkDestroyPipelineLayout(d, _pipelineLayout, nullptr), _pipelineLayout = VK_NULL_HANDLE;
+    }
+
+    void ClusteredLighting::Update(uint32_t slot, const vector<Light>& lights, const ViewProjectionTransform eyes[2],
+                                   float zNear, float zFar, const BlinnPhongLighting& lighting)
+    {
+        uint32_t lightCount = static_cast<uint32_t>(std::min<size_t>(lights.size(), LIGHT_CAPACITY));
+        memcpy(static_cast<uint8_t*>(_lightBuffer.mapped) + slot * _lightStride, lights.data(), lightCount * sizeof(Light));
+
+        Parameters parameters = {};
+        for (int eye = 0; eye < 2; eye++) {
+            parameters.eyes[eye].view              = eyes[eye].view;
+            parameters.eyes[eye].projection        = eyes[eye].projection;
+            parameters.eyes[eye].inverseProjection = glm::inverse(eyes[eye].projection);
+            parameters.eyes[eye].camera            = glm::inverse(eyes[eye].view)[3];
+        }
+        parameters.depth    = vec4(zNear, LightClusters::SLICES / std::log(zFar / zNear), zFar, 0.0f);
+        parameters.grid[0]  = LightClusters::TILES_X;
+        parameters.grid[1]  = LightClusters::TILES_Y;
+        parameters.grid[2]  = LightClusters::SLICES;
+        parameters.grid[3]  = lightCount;
+        parameters.ambient  = vec4(lighting.ambientLight, 0.0f);
+        parameters.specular = vec4(lighting.specularLight, lighting.shininess);
+        memcpy(static_cast<uint8_t*>(_parameterBuffer.mapped) + slot * _parameterStride, &parameters, sizeof(parameters));
+
+        if (AssignsOnGpu()) {
+            return;
+        }
+        if (lightCount < lights.size()) {
+            _cappedLights.assign(lights.begin(), lights.begin() + lightCount);
+        }
+        const vector<Light>& assigned = lightCount < lights.size() ? _cappedLights : lights;
+        for (int eye = 0; eye < 2; eye++) {
+            _clusters[eye].SetProjection(eyes[eye].projection, zNear, zFar);
+            _clusters[eye].Assign(assigned, eyes[eye].view);
+        }
+        WriteAssignment(slot);
+    }
+
+    void ClusteredLighting::WriteAssignment(uint32_t slot)
+    {
+        uint32_t* ranges  = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(_rangeBuffer.mapped) + slot * _rangeStride);
+        uint32_t* indices = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(_indexBuffer.mapped) + slot * _indexStride);
+        uint32_t total = 0;
+        for (int eye = 0; eye < 2; eye++) {
+            const vector<uint32_t>& eyeRanges  = _clusters[eye].Ranges();
+            const vector<uint32_t>& eyeIndices = _clusters[eye].Indices();
+            // Each cluster's list stays contiguous; the clusters that don't fit anymore are cut short.
+            uint32_t count = std::min(static_cast<uint32_t>(eyeIndices.size()), INDEX_CAPACITY - total);
+            memcpy(indices + 1 + total, eyeIndices.data(), count * sizeof(uint32_t));
+            for (uint32_t c = 0; c < LightClusters::CLUSTERS; c++) {
+                uint32_t offset = eyeRanges[2 * c];
+                uint32_t* range = ranges + 2 * (eye * LightClusters::CLUSTERS + c);
+                range[0] = total + offset;
+                range[1] = offset < count ? std::min(eyeRanges[2 * c + 1], count - offset) : 0;
+            }
+            if (count < eyeIndices.size() && !_overflowLogged) {
+                Log::Warn("Clustered lighting: %d light indices exceed the capacity of %d.",
+                          static_cast<int>(total + eyeIndices.size()), INDEX_CAPACITY);
+                _overflowLogged = true;
+            }
+            total += count;
+        }
+        indices[0] = total;
+    }
+
+    void ClusteredLighting::RecordAssignment(VkCommandBuffer commandBuffer, uint32_t slot)
+    {
+        if (!AssignsOnGpu()) {
+            return;
+        }
+        vkCmdFillBuffer(commandBuffer, _indexBuffer.GetBuffer(), slot * _indexStride, sizeof(uint32_t), 0);
+        VkMemoryBarrier clearBarrier = {};
+        clearBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &_descriptorSets[slot], 0, nullptr);
+        // One invocation per cluster of each eye.
+        vkCmdDispatch(commandBuffer, (2 * LightClusters::CLUSTERS + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+        VkMemoryBarrier shadeBarrier = {};
+        shadeBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        shadeBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        shadeBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0, 1, &shadeBarrier, 0, nullptr, 0, nullptr);
+    }
+}
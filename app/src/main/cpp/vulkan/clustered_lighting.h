@@ -0,0 +1,95 @@
+﻿#ifndef VULKAN_CLUSTERED_LIGHTING_H
+#define VULKAN_CLUSTERED_LIGHTING_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include "device.h"
+#include "buffer.h"
+#include "descriptor_allocator.h"
+#include "../data_type.h"
+#include "../culling/light_clusters.h"
+#include <vector>
+
+using std::vector;
+
+namespace Vulkan
+{
+    // Point and spot lights for clustered forward shading. Every frame the lights are assigned to the clusters of both
+    // eyes, either on the CPU with Culling::LightClusters or in a compute shader, and the eye fragment shaders light
+    // each fragment with the lights listed for its cluster only.
+    //
+    // The shaders read one descriptor set with Layout(): the parameters, the lights, an offset and count per cluster,
+    // the left eye's clusters first, and the light indices they refer to. Whatever a frame writes lives in one slot per
+    // swapchain image: Update() it after the image's previous frame has completed.
+    class ClusteredLighting {
+    public:
+        static const uint32_t LIGHT_CAPACITY = 1024;
+        // Light indices of both eyes' clusters together; clusters past it go without lights.
+        static const uint32_t INDEX_CAPACITY = 65536;
+
+        // Parameters, lights, cluster ranges and light indices, for the fragment and compute stages.
+        static const DescriptorSetLayout& Layout(const Device& device);
+
+        // With an empty computeShader the lights are assigned on the CPU, split between the threads if there are any.
+        ClusteredLighting(const Device& device, DescriptorAllocator& descriptorAllocator, const vector<char>& computeShader,
+                          ThreadPool* threads, uint32_t slotCount);
+        ~ClusteredLighting();
+
+        ClusteredLighting(const ClusteredLighting&) = delete;
+        ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+        bool AssignsOnGpu() const { return _pipeline != VK_NULL_HANDLE; }
+
+        // World space lights, beyond LIGHT_CAPACITY dropped, seen by both eyes; zNear and zFar bound the slices.
+        // Ambient and specular light come from lighting.
+        void Update(uint32_t slot, const vector<Culling::Light>& lights, const ViewProjectionTransform eyes[2],
+                    float zNear, float zFar, const BlinnPhongLighting& lighting);
+        // Outside a render pass, before the eye passes. Records nothing when the CPU assigns the lights.
+        void RecordAssignment(VkCommandBuffer commandBuffer, uint32_t slot);
+
+        VkDescriptorSet DescriptorSet(uint32_t slot) const { return _descriptorSets[slot]; }
+
+    private:
+        // std140 layout of the shaders' Lighting block.
+        typedef struct Eye {
+            mat4 view;
+            mat4 projection;
+            mat4 inverseProjection;
+            vec4 camera;
+        } Eye;
+        typedef struct Parameters {
+            Eye      eyes[2];
+            vec4     depth;   // near plane, slices per unit of log depth and far plane
+            uint32_t grid[4]; // tiles across and down, slices and the light count
+            vec4     ambient;
+            vec4     specular; // color and shininess in w
+        } Parameters;
+
+        VkDeviceSize Aligned(VkDeviceSize size, VkDeviceSize alignment) const { return (size + alignment - 1) / alignment * alignment; }
+        // Writes both eyes' assignments into the slot's ranges and indices.
+        void WriteAssignment(uint32_t slot);
+
+        const Device& _device;
+        uint32_t      _slotCount;
+
+        // One buffer per kind, each holding every slot at its stride.
+        Buffer       _parameterBuffer;
+        Buffer       _lightBuffer;
+        Buffer       _rangeBuffer;
+        Buffer       _indexBuffer;
+        VkDeviceSize _parameterStride, _lightStride, _rangeStride, _indexStride;
+
+        VkPipelineLayout        _pipelineLayout = VK_NULL_HANDLE;
+        VkPipeline              _pipeline       = VK_NULL_HANDLE;
+        vector<VkDescriptorSet> _descriptorSets;
+
+        // CPU assignment, one per eye since each keeps the cluster bounds of its projection.
+        Culling::LightClusters _clusters[2];
+        // The first LIGHT_CAPACITY lights when there are more.
+        vector<Culling::Light> _cappedLights;
+        bool                   _overflowLogged = false;
+    };
+}
+
+#endif // VULKAN_CLUSTERED_LIGHTING_H
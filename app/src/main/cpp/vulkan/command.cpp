@@ -1,5 +1,6 @@
 ﻿#include "command.h"
 #include "vulkan_utility.h"
+#include <algorithm>
 
 using Vulkan::Command;
 using Vulkan::Device;
@@ -9,6 +10,10 @@ void CreateCommandPoolImpl(VkCommandPoolCreateFlags poolFlags, VkQueueFlags queu
 Command::~Command()
 {
     DebugLog("~Command()");
+    for (auto& p : _threadPools) {
+        vkDestroyCommandPool(_device, p.pool, nullptr), p.pool = VK_NULL_HANDLE;
+    }
+    _threadPools.clear();
     if (_shortLivedPool.graphics != VK_NULL_HANDLE) {
         DebugLog("~Command() vkDestroyCommandPool() _shortLivedPool.graphics");
         vkDestroyCommandPool(_device, _shortLivedPool.graphics, nullptr);
@@ -159,7 +164,7 @@ vector<VkCommandBuffer> Command::CreateAndBeginCommandBuffers(VkCommandPool comm
     return commandBuffer;
 }
 
-void Command::EndAndSubmitCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, VkCommandPool commandPool, VkDevice device, bool free)
+void Command::EndAndSubmitCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, VkCommandPool commandPool, const Device& device, bool free)
 {
     VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
     VkSubmitInfo submitInfo = {};
@@ -167,18 +172,83 @@ void Command::EndAndSubmitCommandBuffer(VkCommandBuffer commandBuffer, VkQueue q
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
 
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    VkFence fence;
-    VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
-
-    VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
-    VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+    SyncPool& sync = device.Sync();
+    VkDevice d = device.LogicalDevice();
+    if (sync.TimelineSemaphoresEnabled()) {
+        SyncPool::TimelineSignal signal;
+        uint64_t value = sync.SignalTimeline(queue, submitInfo, signal);
+        VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+        sync.WaitTimeline(queue, value);
+    } else {
+        VkFence fence = sync.AcquireFence();
+        VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+        VK_CHECK_RESULT(vkWaitForFences(d, 1, &fence, VK_TRUE, UINT64_MAX));
+        sync.ReleaseFence(fence);
+    }
 
-    vkDestroyFence(device, fence, nullptr);
     if (free) {
-        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+        vkFreeCommandBuffers(d, commandPool, 1, &commandBuffer);
     } else {
         VK_CHECK_RESULT(vkResetCommandBuffer(commandBuffer, 0));
     }
-}
\ No newline at end of file
+}
+
+void Command::BuildThreadCommandPools(uint32_t threadCount, uint32_t frameCount, const Device& device)
+{
+    assert(_threadPools.empty());
+    _device      = device.LogicalDevice();
+    _threadCount = threadCount;
+
+    VkCommandPoolCreateInfo createInfo = {};
+    createInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    createInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    createInfo.queueFamilyIndex = device.FamilyQueues().graphics.index;
+    _threadPools.resize(threadCount * frameCount);
+    for (auto& p : _threadPools) {
+        VK_CHECK_RESULT(vkCreateCommandPool(_device, &createInfo, nullptr, &p.pool));
+    }
+}
+
+void Command::ResetThreadCommandPools(uint32_t frame)
+{
+    for (uint32_t t = 0; t < _threadCount; t++) {
+        ThreadCommandPool& p = _threadPools[frame * _threadCount + t];
+        VK_CHECK_RESULT(vkResetCommandPool(_device, p.pool, 0));
+        p.used = 0;
+    }
+}
+
+VkCommandBuffer Command::SecondaryCommandBuffer(uint32_t frame, uint32_t thread)
+{
+    ThreadCommandPool& p = _threadPools[frame * _threadCount + thread];
+    if (p.used == p.secondaries.size()) {
+        p.secondaries.push_back(CreateCommandBuffers(p.pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1, _device)[0]);
+    }
+    return p.secondaries[p.used++];
+}
+
+vector<VkCommandBuffer> Command::RecordSecondaryCommandBuffers(ThreadPool&                           threadPool,
+                                                               uint32_t                              frame,
+                                                               const VkCommandBufferInheritanceInfo& inheritanceInfo,
+                                                               uint32_t                              drawCount,
+                                                               const RecordRange&                    record,
+                                                               uint32_t                              minDrawsPerChunk)
+{
+    assert(threadPool.ThreadCount() <= _threadCount);
+    minDrawsPerChunk = std::max(minDrawsPerChunk, 1u);
+    uint32_t chunkCount = std::min(threadPool.ThreadCount(), (drawCount + minDrawsPerChunk - 1) / minDrawsPerChunk);
+    chunkCount = std::max(chunkCount, 1u);
+    uint32_t drawsPerChunk = (drawCount + chunkCount - 1) / chunkCount;
+
+    vector<VkCommandBuffer> commandBuffers(chunkCount, VK_NULL_HANDLE);
+    threadPool.Run(chunkCount, [&](uint32_t chunk, uint32_t thread) {
+        VkCommandBuffer commandBuffer = SecondaryCommandBuffer(frame, thread);
+        BeginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, &inheritanceInfo);
+        uint32_t first = std::min(chunk * drawsPerChunk, drawCount);
+        uint32_t end   = std::min(first + drawsPerChunk, drawCount);
+        record(commandBuffer, first, end);
+        VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+        commandBuffers[chunk] = commandBuffer;
+    });
+    return commandBuffers;
+}
@@ -5,6 +5,9 @@
 #include "vulkan_wrapper.h"
 #endif
 #include "device.h"
+#include "../thread/thread_pool.h"
+
+using Utility::ThreadPool;
 
 namespace Vulkan
 {
@@ -33,7 +36,8 @@ namespace Vulkan
                                                                     const void *pCreateNext = nullptr,
                                                                     const void *pBeginNext = nullptr);
 
-        static void EndAndSubmitCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, VkCommandPool commandPool, VkDevice device, bool free = true);
+        // Blocks until the command buffer has executed, on the queue's timeline when available or else on a pooled fence.
+        static void EndAndSubmitCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, VkCommandPool commandPool, const Device& device, bool free = true);
 
         typedef struct CommandPools {
             int graphicsQueueIndex      = -1;
@@ -56,6 +60,29 @@ namespace Vulkan
 
         void BuildCommandPools(VkCommandPoolCreateFlags poolFlags, const Vulkan::Device& device);
 
+        // ==== Multithreaded Recording ==== //
+        // One transient graphics pool per (frame, thread). A command pool must only be used from one thread at a time,
+        // so every worker records into its own pool, and a frame's pools are reset as a whole instead of resetting
+        // individual command buffers.
+        void BuildThreadCommandPools(uint32_t threadCount, uint32_t frameCount, const Vulkan::Device& device);
+        void ResetThreadCommandPools(uint32_t frame);
+        // Returns a secondary command buffer owned by the pool of (frame, thread), allocating one if needed. Only valid
+        // until the next ResetThreadCommandPools(frame).
+        VkCommandBuffer SecondaryCommandBuffer(uint32_t frame, uint32_t thread);
+
+        // Records draws [0, drawCount) into secondary command buffers in parallel, splitting the range into chunks of
+        // at least minDrawsPerChunk. record(commandBuffer, first, end) is called on a worker thread for each chunk with
+        // the buffer already begun with RENDER_PASS_CONTINUE and the given inheritance. The returned buffers are in
+        // draw order and ready for vkCmdExecuteCommands() inside a render pass begun with
+        // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+        typedef function<void(VkCommandBuffer commandBuffer, uint32_t first, uint32_t end)> RecordRange;
+        vector<VkCommandBuffer> RecordSecondaryCommandBuffers(ThreadPool&                           threadPool,
+                                                              uint32_t                              frame,
+                                                              const VkCommandBufferInheritanceInfo& inheritanceInfo,
+                                                              uint32_t                              drawCount,
+                                                              const RecordRange&                    record,
+                                                              uint32_t                              minDrawsPerChunk = 64);
+
         VkCommandPool GeneralGraphcisPool() { return _generalPool.graphics; }
         VkCommandPool GeneralComputePool()
         {
@@ -188,6 +215,15 @@ namespace Vulkan
         CommandPools _generalPool;
         CommandPools _shortLivedPool;
 
+        typedef struct ThreadCommandPool {
+            VkCommandPool           pool = VK_NULL_HANDLE;
+            vector<VkCommandBuffer> secondaries;
+            uint32_t                used = 0;
+        } ThreadCommandPool;
+        // Indexed by frame * _threadCount + thread.
+        vector<ThreadCommandPool> _threadPools;
+        uint32_t                  _threadCount = 0;
+
         VkDevice _device;
     };
 }
@@ -0,0 +1,436 @@
+﻿#include "descriptor_allocator.h"
+#include "vulkan_utility.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+using std::chrono::duration;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::mutex;
+
+namespace Vulkan
+{
+    static const uint32_t INITIAL_SETS_PER_POOL = 16;
+    static const uint32_t MAX_SETS_PER_POOL     = 512;
+
+    // Descriptors of each type per set in a new pool.
+    static const struct {
+        VkDescriptorType type;
+        float            ratio;
+    } POOL_RATIOS[] = {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         2.0f },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1.0f },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,          1.0f },
+        { VK_DESCRIPTOR_TYPE_SAMPLER,                0.5f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          0.5f },
+        { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,       0.5f }
+    };
+
+    // Whether sizes hold at least the descriptors of needed, type by type.
+    static bool Covers(const vector<VkDescriptorPoolSize>& sizes, const vector<VkDescriptorPoolSize>& needed)
+    {
+        for (const auto& n : needed) {
+            auto it = std::find_if(sizes.begin(), sizes.end(), [&n](const VkDescriptorPoolSize& s) {
+                return s.type == n.type;
+            });
+            if (it == sizes.end() || it->descriptorCount < n.descriptorCount) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void AddPoolSize(vector<VkDescriptorPoolSize>& sizes, VkDescriptorType type, uint32_t count)
+    {
+        for (auto& s : sizes) {
+            if (s.type == type) {
+                s.descriptorCount += count;
+                return;
+            }
+        }
+        sizes.push_back({ type, count });
+    }
+
+    static void HashBytes(uint64_t& hash, const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+
+    DescriptorInfo DescriptorBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+    {
+        DescriptorInfo info;
+        memset(&info, 0, sizeof(info));
+        info.buffer.buffer = buffer;
+        info.buffer.offset = offset;
+        info.buffer.range  = range;
+        return info;
+    }
+
+    DescriptorInfo DescriptorImage(VkSampler sampler, VkImageView imageView, VkImageLayout imageLayout)
+    {
+        DescriptorInfo info;
+        memset(&info, 0, sizeof(info));
+        info.image.sampler     = sampler;
+        info.image.imageView   = imageView;
+        info.image.imageLayout = imageLayout;
+        return info;
+    }
+
+    // ==== Layout Cache ==== //
+    DescriptorLayoutCache::DescriptorLayoutCache(VkDevice device, bool updateTemplates) : _device(device)
+    {
+        if (updateTemplates) {
+            _createUpdateTemplate  = (PFN_vkCreateDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(device, "vkCreateDescriptorUpdateTemplateKHR");
+            _destroyUpdateTemplate = (PFN_vkDestroyDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(device, "vkDestroyDescriptorUpdateTemplateKHR");
+            _updateWithTemplate    = (PFN_vkUpdateDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(device, "vkUpdateDescriptorSetWithTemplateKHR");
+            if (!_createUpdateTemplate || !_destroyUpdateTemplate || !_updateWithTemplate) {
+                Log::Warn("VK_KHR_descriptor_update_template entry points are unavailable, falling back to vkUpdateDescriptorSets.");
+                _createUpdateTemplate  = nullptr;
+                _destroyUpdateTemplate = nullptr;
+                _updateWithTemplate    = nullptr;
+            }
+        }
+    }
+
+    DescriptorLayoutCache::~DescriptorLayoutCache()
+    {
+        DebugLog("~DescriptorLayoutCache()");
+        for (auto& it : _layouts) {
+            for (auto& l : it.second) {
+                if (l->updateTemplate) {
+                    _destroyUpdateTemplate(_device, l->updateTemplate, nullptr), l->updateTemplate = VK_NULL_HANDLE;
+                }
+                vkDestroyDescriptorSetLayout(_device, l->layout, nullptr), l->layout = VK_NULL_HANDLE;
+                delete l, l = nullptr;
+            }
+        }
+    }
+
+    static bool SameBindings(const vector<VkDescriptorSetLayoutBinding>& a, const vector<VkDescriptorSetLayoutBinding>& b)
+    {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (a[i].binding != b[i].binding || a[i].descriptorType != b[i].descriptorType ||
+                a[i].descriptorCount != b[i].descriptorCount || a[i].stageFlags != b[i].stageFlags) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool IsNullDescriptor(VkDescriptorType type, const DescriptorInfo& info)
+    {
+        switch (type) {
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+                return info.buffer.buffer == VK_NULL_HANDLE;
+            case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+                return info.texelBuffer == VK_NULL_HANDLE;
+            case VK_DESCRIPTOR_TYPE_SAMPLER:
+                return info.image.sampler == VK_NULL_HANDLE;
+            default:
+                return info.image.imageView == VK_NULL_HANDLE;
+        }
+    }
+
+    const DescriptorSetLayout& DescriptorLayoutCache::Layout(vector<VkDescriptorSetLayoutBinding> bindings,
+                                                             vector<VkDescriptorBindingFlagsEXT> bindingFlags)
+    {
+        assert(bindingFlags.empty() || bindingFlags.size() == bindings.size());
+        vector<size_t> order(bindings.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&bindings](size_t a, size_t b) {
+            return bindings[a].binding < bindings[b].binding;
+        });
+        vector<VkDescriptorSetLayoutBinding> sortedBindings;
+        vector<VkDescriptorBindingFlagsEXT>  sortedFlags;
+        for (size_t i : order) {
+            sortedBindings.push_back(bindings[i]);
+            if (!bindingFlags.empty()) {
+                sortedFlags.push_back(bindingFlags[i]);
+            }
+        }
+        bindings     = std::move(sortedBindings);
+        bindingFlags = std::move(sortedFlags);
+
+        uint64_t hash = 14695981039346656037ull;
+        for (const auto& b : bindings) {
+            assert(!b.pImmutableSamplers);
+            HashBytes(hash, &b.binding, sizeof(b.binding));
+            HashBytes(hash, &b.descriptorType, sizeof(b.descriptorType));
+            HashBytes(hash, &b.descriptorCount, sizeof(b.descriptorCount));
+            HashBytes(hash, &b.stageFlags, sizeof(b.stageFlags));
+        }
+        HashBytes(hash, bindingFlags.data(), bindingFlags.size() * sizeof(VkDescriptorBindingFlagsEXT));
+
+        lock_guard<mutex> lock(_mutex);
+        vector<DescriptorSetLayout*>& candidates = _layouts[hash];
+        for (auto l : candidates) {
+            if (SameBindings(l->bindings, bindings) && l->bindingFlags == bindingFlags) {
+                return *l;
+            }
+        }
+
+        DescriptorSetLayout* l = new DescriptorSetLayout();
+        l->bindings        = bindings;
+        l->bindingFlags    = bindingFlags;
+        l->updateTemplate  = VK_NULL_HANDLE;
+        l->descriptorCount = 0;
+        l->variableDescriptorCount = !bindingFlags.empty() && (bindingFlags.back() & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT);
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo = {};
+        flagsInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        flagsInfo.bindingCount  = static_cast<uint32_t>(bindingFlags.size());
+        flagsInfo.pBindingFlags = bindingFlags.data();
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext        = bindingFlags.empty() ? nullptr : &flagsInfo;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings    = bindings.data();
+        VK_CHECK_RESULT(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &l->layout));
+
+        bool partiallyBound = false;
+        vector<VkDescriptorUpdateTemplateEntryKHR> entries;
+        for (size_t i = 0; i < bindings.size(); i++) {
+            const auto& b = bindings[i];
+            VkDescriptorUpdateTemplateEntryKHR entry = {};
+            entry.dstBinding      = b.binding;
+            entry.dstArrayElement = 0;
+            entry.descriptorCount = b.descriptorCount;
+            entry.descriptorType  = b.descriptorType;
+            entry.offset          = l->descriptorCount * sizeof(DescriptorInfo);
+            entry.stride          = sizeof(DescriptorInfo);
+            entries.push_back(entry);
+            l->descriptorCount += b.descriptorCount;
+            AddPoolSize(l->poolSizes, b.descriptorType, b.descriptorCount);
+            if (!bindingFlags.empty() && (bindingFlags[i] & VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT)) {
+                partiallyBound = true;
+            }
+            assert(i + 1 == bindings.size() || bindingFlags.empty() || !(bindingFlags[i] & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT));
+        }
+        // A template writes every descriptor it covers, which partially bound bindings must not have, and it covers
+        // the upper bound of a variable binding.
+        if (_createUpdateTemplate && !partiallyBound && !l->variableDescriptorCount) {
+            VkDescriptorUpdateTemplateCreateInfoKHR templateInfo = {};
+            templateInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+            templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+            templateInfo.pDescriptorUpdateEntries   = entries.data();
+            templateInfo.templateType               = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR;
+            templateInfo.descriptorSetLayout        = l->layout;
+            VK_CHECK_RESULT(_createUpdateTemplate(_device, &templateInfo, nullptr, &l->updateTemplate));
+        }
+        candidates.push_back(l);
+        return *l;
+    }
+
+    void DescriptorLayoutCache::Update(VkDescriptorSet set, const DescriptorSetLayout& layout, const DescriptorInfo* infos, uint32_t infoCount) const
+    {
+        if (layout.updateTemplate) {
+            assert(infoCount == layout.descriptorCount);
+            _updateWithTemplate(_device, set, layout.updateTemplate, infos);
+            return;
+        }
+        // Descriptors are written one by one: the infos are laid out with the union's stride, which
+        // vkUpdateDescriptorSets cannot skip over.
+        vector<VkWriteDescriptorSet> writes;
+        uint32_t first = 0;
+        for (size_t k = 0; k < layout.bindings.size(); k++) {
+            const auto& b = layout.bindings[k];
+            bool partiallyBound = !layout.bindingFlags.empty() && (layout.bindingFlags[k] & VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT);
+            for (uint32_t i = 0; i < b.descriptorCount && first + i < infoCount; i++) {
+                const DescriptorInfo& info = infos[first + i];
+                if (partiallyBound && IsNullDescriptor(b.descriptorType, info)) {
+                    continue;
+                }
+                VkWriteDescriptorSet write = {};
+                write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write.dstSet          = set;
+                write.dstBinding      = b.binding;
+                write.dstArrayElement = i;
+                write.descriptorCount = 1;
+                write.descriptorType  = b.descriptorType;
+                switch (b.descriptorType) {
+                    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+                    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+                    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+                    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+                        write.pBufferInfo = &info.buffer;
+                        break;
+                    case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+                    case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+                        write.pTexelBufferView = &info.texelBuffer;
+                        break;
+                    default:
+                        write.pImageInfo = &info.image;
+                        break;
+                }
+                writes.push_back(write);
+            }
+            first += b.descriptorCount;
+        }
+        vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    // ==== Allocator ==== //
+    DescriptorAllocator::DescriptorAllocator(VkDevice device, DescriptorLayoutCache& layouts) : _device(device),
+                                                                                                _layouts(layouts),
+                                                                                                _setsPerPool(INITIAL_SETS_PER_POOL)
+    {
+        _lastLogTime = steady_clock::now();
+    }
+
+    DescriptorAllocator::~DescriptorAllocator()
+    {
+        for (auto& p : _usedPools) {
+            vkDestroyDescriptorPool(_device, p.pool, nullptr), p.pool = VK_NULL_HANDLE;
+        }
+        for (auto& p : _freePools) {
+            vkDestroyDescriptorPool(_device, p.pool, nullptr), p.pool = VK_NULL_HANDLE;
+        }
+    }
+
+    VkDescriptorPool DescriptorAllocator::CreatePool(const vector<VkDescriptorPoolSize>& needed)
+    {
+        for (auto it = _freePools.rbegin(); it != _freePools.rend(); ++it) {
+            if (Covers(it->sizes, needed)) {
+                _usedPools.push_back(*it);
+                _freePools.erase(std::next(it).base());
+                return _usedPools.back().pool;
+            }
+        }
+        // The ratios size a pool for typical sets; a layout with more descriptors of a type than that, e.g. a
+        // bindless texture array, raises its type so the set fits.
+        vector<VkDescriptorPoolSize> poolSizes;
+        for (const auto& r : POOL_RATIOS) {
+            poolSizes.push_back({ r.type, std::max(1u, static_cast<uint32_t>(r.ratio * _setsPerPool)) });
+        }
+        for (const auto& n : needed) {
+            auto it = std::find_if(poolSizes.begin(), poolSizes.end(), [&n](const VkDescriptorPoolSize& s) {
+                return s.type == n.type;
+            });
+            if (it == poolSizes.end()) {
+                poolSizes.push_back(n);
+            } else {
+                it->descriptorCount = std::max(it->descriptorCount, n.descriptorCount);
+            }
+        }
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets       = _setsPerPool;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes    = poolSizes.data();
+        VkDescriptorPool pool;
+        VK_CHECK_RESULT(vkCreateDescriptorPool(_device, &poolInfo, nullptr, &pool));
+        _setsPerPool = std::min(_setsPerPool * 2, MAX_SETS_PER_POOL);
+        _statistics.pools++;
+        _usedPools.push_back({ pool, poolSizes });
+        return pool;
+    }
+
+    VkDescriptorSet DescriptorAllocator::Allocate(const DescriptorSetLayout& layout, uint32_t variableCount)
+    {
+        // A variable binding takes only the descriptors it is allocated with out of the pool.
+        vector<VkDescriptorPoolSize> needed = layout.poolSizes;
+        VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableInfo = {};
+        if (layout.variableDescriptorCount) {
+            const VkDescriptorSetLayoutBinding& variable = layout.bindings.back();
+            assert(variableCount <= variable.descriptorCount);
+            for (auto& n : needed) {
+                if (n.type == variable.descriptorType) {
+                    n.descriptorCount -= variable.descriptorCount - variableCount;
+                }
+            }
+            variableInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+            variableInfo.descriptorSetCount = 1;
+            variableInfo.pDescriptorCounts  = &variableCount;
+        }
+        if (!_currentPool) {
+            _currentPool = CreatePool(needed);
+        }
+        VkDescriptorSetAllocateInfo allocateInfo = {};
+        allocateInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocateInfo.pNext              = layout.variableDescriptorCount ? &variableInfo : nullptr;
+        allocateInfo.descriptorPool     = _currentPool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts        = &layout.layout;
+        VkDescriptorSet set;
+        _statistics.allocateCalls++;
+        VkResult result = vkAllocateDescriptorSets(_device, &allocateInfo, &set);
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY_KHR || result == VK_ERROR_FRAGMENTED_POOL) {
+            // Pools are only ever reset as a whole, so a full one stays full until then. The next pool is empty and
+            // holds the layout's descriptors, so the set fits there.
+            _currentPool = CreatePool(needed);
+            allocateInfo.descriptorPool = _currentPool;
+            _statistics.allocateCalls++;
+            result = vkAllocateDescriptorSets(_device, &allocateInfo, &set);
+        }
+        VK_CHECK_RESULT(result);
+        return set;
+    }
+
+    VkDescriptorSet DescriptorAllocator::Write(const DescriptorSetLayout& layout, const vector<DescriptorInfo>& infos)
+    {
+        uint32_t variableCount = 0;
+        if (layout.variableDescriptorCount) {
+            uint32_t fixedCount = layout.descriptorCount - layout.bindings.back().descriptorCount;
+            assert(infos.size() >= fixedCount && infos.size() <= layout.descriptorCount);
+            variableCount = static_cast<uint32_t>(infos.size()) - fixedCount;
+        } else {
+            assert(infos.size() == layout.descriptorCount);
+        }
+        uint64_t hash = 14695981039346656037ull;
+        HashBytes(hash, &layout.layout, sizeof(layout.layout));
+        HashBytes(hash, infos.data(), infos.size() * sizeof(DescriptorInfo));
+        vector<CachedSet>& candidates = _cache[hash];
+        for (const auto& c : candidates) {
+            if (c.layout == &layout && c.infos.size() == infos.size() && memcmp(c.infos.data(), infos.data(), infos.size() * sizeof(DescriptorInfo)) == 0) {
+                _statistics.cacheHits++;
+                return c.set;
+            }
+        }
+        VkDescriptorSet set = Allocate(layout, variableCount);
+        _layouts.Update(set, layout, infos.data(), static_cast<uint32_t>(infos.size()));
+        _statistics.updateCalls++;
+        candidates.push_back({ &layout, infos, set });
+        return set;
+    }
+
+    void DescriptorAllocator::Reset()
+    {
+        for (auto& p : _usedPools) {
+            VK_CHECK_RESULT(vkResetDescriptorPool(_device, p.pool, 0));
+            _freePools.push_back(p);
+        }
+        _usedPools.clear();
+        _currentPool = VK_NULL_HANDLE;
+        _cache.clear();
+    }
+
+    void DescriptorAllocator::LogIfDue(const char* name, float intervalSeconds)
+    {
+        auto now = steady_clock::now();
+        if (duration<float, seconds::period>(now - _lastLogTime).count() < intervalSeconds) {
+            return;
+        }
+        _lastLogTime = now;
+        float frames = static_cast<float>(std::max(_statistics.frames, 1u));
+        Log::Info("%s descriptors: %.2f vkAllocateDescriptorSets and %.2f descriptor updates per frame, %d cache hits, %d pools.",
+                  name, _statistics.allocateCalls / frames, _statistics.updateCalls / frames, _statistics.cacheHits, _statistics.pools);
+        uint32_t pools = _statistics.pools;
+        _statistics = {};
+        _statistics.pools = pools;
+    }
+}
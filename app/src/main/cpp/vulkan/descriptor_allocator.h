@@ -0,0 +1,237 @@
+﻿#ifndef VULKAN_DESCRIPTOR_ALLOCATOR_H
+#define VULKAN_DESCRIPTOR_ALLOCATOR_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifndef VK_KHR_descriptor_update_template
+#define VK_KHR_descriptor_update_template 1
+VK_DEFINE_NON_DISPATCHABLE_HANDLE(VkDescriptorUpdateTemplateKHR)
+#define VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_SPEC_VERSION 1
+#define VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME "VK_KHR_descriptor_update_template"
+#define VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR ((VkStructureType)1000085000)
+typedef enum VkDescriptorUpdateTemplateTypeKHR {
+    VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR       = 0,
+    VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR     = 1,
+    VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_MAX_ENUM_KHR             = 0x7FFFFFFF
+} VkDescriptorUpdateTemplateTypeKHR;
+typedef VkFlags VkDescriptorUpdateTemplateCreateFlagsKHR;
+typedef struct VkDescriptorUpdateTemplateEntryKHR {
+    uint32_t         dstBinding;
+    uint32_t         dstArrayElement;
+    uint32_t         descriptorCount;
+    VkDescriptorType descriptorType;
+    size_t           offset;
+    size_t           stride;
+} VkDescriptorUpdateTemplateEntryKHR;
+typedef struct VkDescriptorUpdateTemplateCreateInfoKHR {
+    VkStructureType                           sType;
+    void*                                     pNext;
+    VkDescriptorUpdateTemplateCreateFlagsKHR  flags;
+    uint32_t                                  descriptorUpdateEntryCount;
+    const VkDescriptorUpdateTemplateEntryKHR* pDescriptorUpdateEntries;
+    VkDescriptorUpdateTemplateTypeKHR         templateType;
+    VkDescriptorSetLayout                     descriptorSetLayout;
+    VkPipelineBindPoint                       pipelineBindPoint;
+    VkPipelineLayout                          pipelineLayout;
+    uint32_t                                  set;
+} VkDescriptorUpdateTemplateCreateInfoKHR;
+typedef VkResult (VKAPI_PTR *PFN_vkCreateDescriptorUpdateTemplateKHR)(VkDevice device, const VkDescriptorUpdateTemplateCreateInfoKHR* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDescriptorUpdateTemplateKHR* pDescriptorUpdateTemplate);
+typedef void (VKAPI_PTR *PFN_vkDestroyDescriptorUpdateTemplateKHR)(VkDevice device, VkDescriptorUpdateTemplateKHR descriptorUpdateTemplate, const VkAllocationCallbacks* pAllocator);
+typedef void (VKAPI_PTR *PFN_vkUpdateDescriptorSetWithTemplateKHR)(VkDevice device, VkDescriptorSet descriptorSet, VkDescriptorUpdateTemplateKHR descriptorUpdateTemplate, const void* pData);
+#endif
+
+#ifndef VK_KHR_maintenance3
+#define VK_KHR_maintenance3 1
+#define VK_KHR_MAINTENANCE3_SPEC_VERSION 1
+#define VK_KHR_MAINTENANCE3_EXTENSION_NAME "VK_KHR_maintenance3"
+#endif
+
+#ifndef VK_EXT_descriptor_indexing
+#define VK_EXT_descriptor_indexing 1
+#define VK_EXT_DESCRIPTOR_INDEXING_SPEC_VERSION 2
+#define VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME "VK_EXT_descriptor_indexing"
+#define VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT ((VkStructureType)1000161000)
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT ((VkStructureType)1000161001)
+#define VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT ((VkStructureType)1000161003)
+typedef enum VkDescriptorBindingFlagBitsEXT {
+    VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT           = 0x00000001,
+    VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT = 0x00000002,
+    VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT             = 0x00000004,
+    VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT   = 0x00000008,
+    VK_DESCRIPTOR_BINDING_FLAG_BITS_MAX_ENUM_EXT              = 0x7FFFFFFF
+} VkDescriptorBindingFlagBitsEXT;
+typedef VkFlags VkDescriptorBindingFlagsEXT;
+typedef struct VkDescriptorSetLayoutBindingFlagsCreateInfoEXT {
+    VkStructureType                    sType;
+    const void*                        pNext;
+    uint32_t                           bindingCount;
+    const VkDescriptorBindingFlagsEXT* pBindingFlags;
+} VkDescriptorSetLayoutBindingFlagsCreateInfoEXT;
+typedef struct VkPhysicalDeviceDescriptorIndexingFeaturesEXT {
+    VkStructureType sType;
+    void*           pNext;
+    VkBool32        shaderInputAttachmentArrayDynamicIndexing;
+    VkBool32        shaderUniformTexelBufferArrayDynamicIndexing;
+    VkBool32        shaderStorageTexelBufferArrayDynamicIndexing;
+    VkBool32        shaderUniformBufferArrayNonUniformIndexing;
+    VkBool32        shaderSampledImageArrayNonUniformIndexing;
+    VkBool32        shaderStorageBufferArrayNonUniformIndexing;
+    VkBool32        shaderStorageImageArrayNonUniformIndexing;
+    VkBool32        shaderInputAttachmentArrayNonUniformIndexing;
+    VkBool32        shaderUniformTexelBufferArrayNonUniformIndexing;
+    VkBool32        shaderStorageTexelBufferArrayNonUniformIndexing;
+    VkBool32        descriptorBindingUniformBufferUpdateAfterBind;
+    VkBool32        descriptorBindingSampledImageUpdateAfterBind;
+    VkBool32        descriptorBindingStorageImageUpdateAfterBind;
+    VkBool32        descriptorBindingStorageBufferUpdateAfterBind;
+    VkBool32        descriptorBindingUniformTexelBufferUpdateAfterBind;
+    VkBool32        descriptorBindingStorageTexelBufferUpdateAfterBind;
+    VkBool32        descriptorBindingUpdateUnusedWhilePending;
+    VkBool32        descriptorBindingPartiallyBound;
+    VkBool32        descriptorBindingVariableDescriptorCount;
+    VkBool32        runtimeDescriptorArray;
+} VkPhysicalDeviceDescriptorIndexingFeaturesEXT;
+typedef struct VkDescriptorSetVariableDescriptorCountAllocateInfoEXT {
+    VkStructureType sType;
+    const void*     pNext;
+    uint32_t        descriptorSetCount;
+    const uint32_t* pDescriptorCounts;
+} VkDescriptorSetVariableDescriptorCountAllocateInfoEXT;
+#endif
+
+#ifndef VK_KHR_maintenance1
+#define VK_ERROR_OUT_OF_POOL_MEMORY_KHR ((VkResult)-1000069000)
+#endif
+
+using std::unordered_map;
+using std::vector;
+
+namespace Vulkan
+{
+    // One descriptor as the update templates read it. Build them with DescriptorBuffer() and DescriptorImage(), which
+    // zero the unused bytes so equal descriptors compare and hash equal.
+    typedef union DescriptorInfo {
+        VkDescriptorBufferInfo buffer;
+        VkDescriptorImageInfo  image;
+        VkBufferView           texelBuffer;
+    } DescriptorInfo;
+
+    DescriptorInfo DescriptorBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+    DescriptorInfo DescriptorImage(VkSampler sampler, VkImageView imageView, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    typedef struct DescriptorSetLayout {
+        VkDescriptorSetLayout                layout;
+        // Reads DescriptorInfos ordered by binding and array element; VK_NULL_HANDLE without the extension.
+        VkDescriptorUpdateTemplateKHR        updateTemplate;
+        vector<VkDescriptorSetLayoutBinding> bindings;
+        // Empty unless flags were given; otherwise one per binding, in the same order.
+        vector<VkDescriptorBindingFlagsEXT>  bindingFlags;
+        uint32_t                             descriptorCount;
+        // Descriptors of each type one set takes, which a pool must hold for the set to fit.
+        vector<VkDescriptorPoolSize>         poolSizes;
+        // Set when the last binding has a variable descriptor count: its descriptorCount, and with it the counts
+        // above, is only the upper bound, and each set takes as many as it is allocated with.
+        bool                                 variableDescriptorCount;
+    } DescriptorSetLayout;
+
+    // Descriptor set layouts are created once per distinct set of bindings and live as long as the cache, together
+    // with an update template for each when VK_KHR_descriptor_update_template is enabled. Thread safe.
+    class DescriptorLayoutCache {
+    public:
+        DescriptorLayoutCache(VkDevice device, bool updateTemplates);
+        ~DescriptorLayoutCache();
+
+        // Bindings may come in any order; immutable samplers are not supported. bindingFlags, if given, pairs up with
+        // bindings and needs VK_EXT_descriptor_indexing. Only the highest binding may have a variable descriptor count.
+        const DescriptorSetLayout& Layout(vector<VkDescriptorSetLayoutBinding> bindings,
+                                          vector<VkDescriptorBindingFlagsEXT> bindingFlags = {});
+
+        // One vkUpdateDescriptorSetWithTemplateKHR, or one vkUpdateDescriptorSets without the extension. infos holds
+        // infoCount entries ordered by binding, layout.descriptorCount unless the last binding is variable, which gets
+        // the remainder. Layouts with partially bound or variable bindings have no template: null entries of partially
+        // bound bindings are left unwritten.
+        void Update(VkDescriptorSet set, const DescriptorSetLayout& layout, const DescriptorInfo* infos, uint32_t infoCount) const;
+
+    private:
+        VkDevice _device;
+
+        std::mutex                                         _mutex;
+        unordered_map<uint64_t, vector<DescriptorSetLayout*>> _layouts;
+
+        PFN_vkCreateDescriptorUpdateTemplateKHR  _createUpdateTemplate  = nullptr;
+        PFN_vkDestroyDescriptorUpdateTemplateKHR _destroyUpdateTemplate = nullptr;
+        PFN_vkUpdateDescriptorSetWithTemplateKHR _updateWithTemplate    = nullptr;
+    };
+
+    // Allocates descriptor sets from pools it grows on demand: when a pool runs out, the next one is created with
+    // twice as many sets, and with at least the descriptors of the set that did not fit. Sets are never freed one by
+    // one; Reset() returns every pool at once, so an allocator per frame in flight can be reset when its frame comes
+    // around again, and one per swapchain when it is rebuilt.
+    //
+    // Write() also caches: asking again for the same layout and descriptors returns the set written the first time,
+    // until the next Reset(). Not thread safe; use one allocator per thread.
+    class DescriptorAllocator {
+    public:
+        typedef struct Statistics {
+            uint32_t frames;
+            uint32_t allocateCalls;
+            uint32_t updateCalls;
+            uint32_t cacheHits;
+            uint32_t pools;
+        } Statistics;
+
+        DescriptorAllocator(VkDevice device, DescriptorLayoutCache& layouts);
+        ~DescriptorAllocator();
+
+        DescriptorAllocator(const DescriptorAllocator&) = delete;
+        DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+        // variableCount is the size of the layout's variable binding, if it has one.
+        VkDescriptorSet Allocate(const DescriptorSetLayout& layout, uint32_t variableCount = 0);
+        // For a variable binding infos may be shorter than layout.descriptorCount; the binding takes the rest.
+        VkDescriptorSet Write(const DescriptorSetLayout& layout, const vector<DescriptorInfo>& infos);
+        void Reset();
+
+        // Counts a frame; the logged call counts are averaged over the frames since the last log.
+        void EndFrame() { _statistics.frames++; }
+        void LogIfDue(const char* name, float intervalSeconds = 10.0f);
+        const Statistics& Stats() const { return _statistics; }
+
+    private:
+        typedef struct CachedSet {
+            const DescriptorSetLayout* layout;
+            vector<DescriptorInfo>     infos;
+            VkDescriptorSet            set;
+        } CachedSet;
+
+        typedef struct Pool {
+            VkDescriptorPool             pool;
+            vector<VkDescriptorPoolSize> sizes;
+        } Pool;
+
+        // An empty pool that holds at least the given descriptors: a reset one if any is large enough, otherwise a
+        // new one.
+        VkDescriptorPool CreatePool(const vector<VkDescriptorPoolSize>& needed);
+
+        VkDevice               _device;
+        DescriptorLayoutCache& _layouts;
+
+        vector<Pool>     _usedPools;
+        vector<Pool>     _freePools;
+        VkDescriptorPool _currentPool = VK_NULL_HANDLE;
+        uint32_t         _setsPerPool;
+
+        unordered_map<uint64_t, vector<CachedSet>> _cache;
+
+        Statistics                            _statistics = {};
+        std::chrono::steady_clock::time_point _lastLogTime;
+    };
+}
+
+#endif // VULKAN_DESCRIPTOR_ALLOCATOR_H
@@ -92,6 +92,10 @@ namespace Vulkan {
 
     Device::~Device()
     {
+        delete _descriptorLayouts, _descriptorLayouts = nullptr;
+        delete _pipelineCache, _pipelineCache = nullptr;
+        delete _syncPool, _syncPool = nullptr;
+        delete _memoryTracker, _memoryTracker = nullptr;
         if (_device) {
             DebugLog("~Device() vkDestroyDevice");
             vkDestroyDevice(_device, nullptr);
@@ -155,6 +159,62 @@ namespace Vulkan {
         return res;
     }
 
+    void Device::EnableOptionalDeviceExtensions(const vector<const char*>& extensionNames)
+    {
+        for (auto name : extensionNames) {
+            if (IsDeviceExtensionEnabled(name)) {
+                continue;
+            }
+            if (IsDeviceExtensionSupported(name)) {
+                _enabledDeviceExtensionNames.push_back(name);
+            } else {
+                Log::Info("Optional device extension %s is not supported.", name);
+            }
+        }
+    }
+
+    bool Device::IsDeviceExtensionEnabled(const char* extensionName) const
+    {
+        for (auto& name : _enabledDeviceExtensionNames) {
+            if (!strcmp(name.c_str(), extensionName)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Device::EnableDescriptorIndexing(VkInstance instance)
+    {
+        assert(!_device);
+        if (!IsDeviceExtensionSupported(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) ||
+            !IsDeviceExtensionSupported(VK_KHR_MAINTENANCE3_EXTENSION_NAME)) {
+            Log::Info("Optional device extension %s is not supported.", VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+            return false;
+        }
+        PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+        if (!getFeatures2) {
+            Log::Warn("vkGetPhysicalDeviceFeatures2KHR is unavailable, descriptor indexing stays disabled.");
+            return false;
+        }
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+        descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2KHR features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+        features.pNext = &descriptorIndexingFeatures;
+        getFeatures2(_physicalDevice, &features);
+        if (!features.features.shaderSampledImageArrayDynamicIndexing ||
+            !descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing ||
+            !descriptorIndexingFeatures.descriptorBindingPartiallyBound ||
+            !descriptorIndexingFeatures.descriptorBindingVariableDescriptorCount ||
+            !descriptorIndexingFeatures.runtimeDescriptorArray) {
+            Log::Info("Descriptor indexing lacks the features for sampled image arrays.");
+            return false;
+        }
+        EnableOptionalDeviceExtensions({ VK_KHR_MAINTENANCE3_EXTENSION_NAME, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME });
+        _descriptorIndexing = true;
+        return true;
+    }
+
     bool Device::IsDeviceExtensionSupported(const char* extensionName) const
     {
         for (auto& name : _supportedDeviceExtensionNames) {
@@ -193,8 +253,7 @@ namespace Vulkan {
         uint32_t size = _queueFamilyProperties.size();
         // Save info about whether a queue family of a physical device supports presentation to a given surface to presentables.
         vector<int> presentables;
-        if (queueFlagBit == VK_QUEUE_GRAPHICS_BIT) {
-            assert (surface);
+        if (queueFlagBit == VK_QUEUE_GRAPHICS_BIT && surface != VK_NULL_HANDLE) {
             presentables.resize(size);
             for (uint32_t i = 0; i < size; i++) {
                 VkBool32 support = true;
@@ -208,8 +267,12 @@ namespace Vulkan {
             if ((_queueFamilyProperties[i].queueFlags & queueFlagBit)) {
                 if (queueFlagBit == VK_QUEUE_GRAPHICS_BIT) {
                     _familyQueues.graphics.index = i;
+                    if (surface == VK_NULL_HANDLE) {
+                        _familyQueues.present.index = i;
+                        _sharedGraphicsAndPresentQueueFamily = true;
+                    }
 
-                    for (uint32_t j = 0; j < size; j++) {
+                    for (uint32_t j = 0; j < presentables.size(); j++) {
                         if (presentables[j] != -1) {
                             _familyQueues.present.index = j;
                             // I prefer shared graphics and present queue family.
@@ -295,6 +358,10 @@ namespace Vulkan {
     {
         CreateDevice(requestedFeatures, requestedExtensions);
         GetFamilyQueues();
+        _memoryTracker = new MemoryTracker(_physicalDevice, _device);
+        _syncPool = new SyncPool(_device, IsDeviceExtensionEnabled(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME));
+        _pipelineCache = new PipelineCache(_device, _properties);
+        _descriptorLayouts = new DescriptorLayoutCache(_device, IsDeviceExtensionEnabled(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME));
     }
 
     void Device::CreateDevice(const VkPhysicalDeviceFeatures& requestedFeatures,
@@ -333,9 +400,45 @@ namespace Vulkan {
             queueInfos.emplace_back(queueInfo);
         }
 
+        // The feature is mandatory for devices exposing the extension, so it needs no query.
+        VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+        timelineSemaphoreFeatures.sType             = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+        timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+
+        // Queried in EnableDescriptorIndexing().
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+        descriptorIndexingFeatures.sType                                     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        descriptorIndexingFeatures.descriptorBindingPartiallyBound           = VK_TRUE;
+        descriptorIndexingFeatures.descriptorBindingVariableDescriptorCount  = VK_TRUE;
+        descriptorIndexingFeatures.runtimeDescriptorArray                    = VK_TRUE;
+
+        // Mandatory for devices exposing the extension, like the timeline semaphore feature.
+        VkPhysicalDeviceMultiviewFeaturesKHR multiviewFeatures = {};
+        multiviewFeatures.sType     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES_KHR;
+        multiviewFeatures.multiview = VK_TRUE;
+
+        void* features = nullptr;
+        if (IsDeviceExtensionEnabled(VK_KHR_MULTIVIEW_EXTENSION_NAME)) {
+            multiviewFeatures.pNext = features;
+            features = &multiviewFeatures;
+        }
+        if (_descriptorIndexing) {
+            descriptorIndexingFeatures.pNext = features;
+            features = &descriptorIndexingFeatures;
+        }
+        if (IsDeviceExtensionEnabled(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+            timelineSemaphoreFeatures.pNext = features;
+            features = &timelineSemaphoreFeatures;
+        }
+        VkPhysicalDeviceFeatures enabledFeatures = requestedFeatures;
+        if (_descriptorIndexing) {
+            enabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        }
+
         VkDeviceCreateInfo deviceInfo = {};
         deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        deviceInfo.pNext = nullptr;
+        deviceInfo.pNext = features;
         deviceInfo.flags = 0;
         deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size());
         deviceInfo.pQueueCreateInfos = queueInfos.data();
@@ -344,8 +447,8 @@ namespace Vulkan {
         deviceInfo.enabledExtensionCount = static_cast<uint32_t>(_enabledDeviceExtensionNames.size());
         vector<const char*> enabledDeviceExtensionNames = EnabledDeviceExtensionNames();
         deviceInfo.ppEnabledExtensionNames = enabledDeviceExtensionNames.data();
-        deviceInfo.pEnabledFeatures = &requestedFeatures;
-        _featuresEnabled = requestedFeatures;
+        deviceInfo.pEnabledFeatures = &enabledFeatures;
+        _featuresEnabled = enabledFeatures;
         VK_CHECK_RESULT(vkCreateDevice(_physicalDevice, &deviceInfo, nullptr, &_device));
     }
 
@@ -4,9 +4,38 @@
 #ifdef __ANDROID__
 #include "vulkan_wrapper.h"
 #endif
+#include "memory_tracker.h"
+#include "sync_pool.h"
+#include "pipeline_cache.h"
+#include "descriptor_allocator.h"
 #include <string>
 #include <vector>
 
+#ifndef VK_KHR_multiview
+#define VK_KHR_multiview 1
+#define VK_KHR_MULTIVIEW_SPEC_VERSION 1
+#define VK_KHR_MULTIVIEW_EXTENSION_NAME "VK_KHR_multiview"
+#define VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO_KHR ((VkStructureType)1000053000)
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES_KHR ((VkStructureType)1000053001)
+typedef struct VkRenderPassMultiviewCreateInfoKHR {
+    VkStructureType sType;
+    const void*     pNext;
+    uint32_t        subpassCount;
+    const uint32_t* pViewMasks;
+    uint32_t        dependencyCount;
+    const int32_t*  pViewOffsets;
+    uint32_t        correlationMaskCount;
+    const uint32_t* pCorrelationMasks;
+} VkRenderPassMultiviewCreateInfoKHR;
+typedef struct VkPhysicalDeviceMultiviewFeaturesKHR {
+    VkStructureType sType;
+    void*           pNext;
+    VkBool32        multiview;
+    VkBool32        multiviewGeometryShader;
+    VkBool32        multiviewTessellationShader;
+} VkPhysicalDeviceMultiviewFeaturesKHR;
+#endif
+
 using std::string;
 using std::vector;
 
@@ -31,11 +60,20 @@ namespace Vulkan
         Device(VkPhysicalDevice physicalDevice);
         ~Device();
 
+        // Without a surface the graphics queue family also serves as the present one, for offscreen rendering.
         int GetQueueFamilyIndex(VkQueueFlagBits queueFlagBit, VkSurfaceKHR surface = VK_NULL_HANDLE);
 
         void EnumerateExtensions(const vector<const char*>& instanceLayerNames);
         bool EnableDeviceExtensions(const vector<const char*>& extensionNames);
+        // Unlike EnableDeviceExtensions(), unsupported names are skipped instead of failing the whole request.
+        void EnableOptionalDeviceExtensions(const vector<const char*>& extensionNames);
         bool IsDeviceExtensionSupported(const char* extensionName) const;
+        bool IsDeviceExtensionEnabled(const char* extensionName) const;
+        // Enables VK_EXT_descriptor_indexing with runtime sized, partially bound and non-uniformly indexed sampled
+        // image arrays if the device supports all three. Needs VK_KHR_get_physical_device_properties2 on instance and
+        // has to come before BuildDevice().
+        bool EnableDescriptorIndexing(VkInstance instance);
+        bool DescriptorIndexingEnabled() const { return _descriptorIndexing; }
 
         const VkPhysicalDeviceFeatures& FeaturesSupported() const { return _featuresSupported; }
         const VkPhysicalDeviceFeatures& FeaturesEnabled() const { return _featuresEnabled; }
@@ -66,6 +104,13 @@ namespace Vulkan
         bool SharedGraphicsAndPresentQueueFamily() const { return _sharedGraphicsAndPresentQueueFamily; }
 
         const VkPhysicalDeviceProperties& PhysicalDeviceProperties() const { return  _properties; }
+        const VkPhysicalDeviceMemoryProperties& MemoryProperties() const { return _memoryProperties; }
+
+        // Valid after BuildDevice().
+        MemoryTracker& Memory() const { return *_memoryTracker; }
+        SyncPool& Sync() const { return *_syncPool; }
+        PipelineCache& Pipelines() const { return *_pipelineCache; }
+        DescriptorLayoutCache& DescriptorLayouts() const { return *_descriptorLayouts; }
 
         VkQueueFlags queueFlags;
     private:
@@ -93,11 +138,17 @@ namespace Vulkan
         bool _dedicatedTransferQueueFamily        = false;
         bool _dedicatedSparseBindingQueueFamily   = false;
         bool _sharedGraphicsAndPresentQueueFamily = false;
+        bool _descriptorIndexing                  = false;
 
-        VkDevice _device;
+        VkDevice _device = VK_NULL_HANDLE;
         //vector<VkDevice> _logicalDevices;
         vector<string> _supportedDeviceExtensionNames;
         vector<string> _enabledDeviceExtensionNames;
+
+        MemoryTracker*         _memoryTracker     = nullptr;
+        SyncPool*              _syncPool          = nullptr;
+        PipelineCache*         _pipelineCache     = nullptr;
+        DescriptorLayoutCache* _descriptorLayouts = nullptr;
     };
 }
 
@@ -0,0 +1,195 @@
+﻿#include "draw_list.h"
+#include "../log/log.h"
+#include <algorithm>
+#include <chrono>
+#ifdef ENABLE_BENCHMARKS
+#include <stdexcept>
+#endif
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using Utility::Log;
+
+namespace Vulkan
+{
+    static const uint32_t RADIX_BITS    = 8;
+    static const uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+    static const uint32_t RADIX_PASSES  = 64 / RADIX_BITS;
+
+    uint64_t DrawList::Key(uint32_t pass, uint32_t pipeline, uint32_t material, float depth)
+    {
+        const uint32_t depthMax = (1u << DEPTH_BITS) - 1;
+        uint64_t depthBucket = static_cast<uint64_t>(std::min(std::max(depth, 0.0f), 1.0f) * depthMax);
+        uint64_t key = std::min<uint64_t>(pass, (1u << PASS_BITS) - 1);
+        key = key << PIPELINE_BITS | std::min<uint64_t>(pipeline, (1u << PIPELINE_BITS) - 1);
+        key = key << MATERIAL_BITS | std::min<uint64_t>(material, (1u << MATERIAL_BITS) - 1);
+        return key << DEPTH_BITS | depthBucket;
+    }
+
+    void DrawList::Clear()
+    {
+        _packets.clear();
+        _sortMilliseconds = 0.0f;
+        _draws = _pipelineBinds = _materialBinds = _geometryBinds = 0;
+    }
+
+    void DrawList::Sort()
+    {
+        auto start = steady_clock::now();
+        size_t count = _packets.size();
+        _items.resize(count);
+        _scratch.resize(count);
+        // Every digit's histogram in one read of the keys.
+        vector<uint32_t> histograms(RADIX_PASSES * RADIX_BUCKETS, 0);
+        for (size_t i = 0; i < count; i++) {
+            uint64_t key = _packets[i].key;
+            _items[i] = { key, static_cast<uint32_t>(i) };
+            for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+                histograms[pass * RADIX_BUCKETS + ((key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1))]++;
+            }
+        }
+
+        // Least significant digit first; a digit all keys share leaves the order as it is.
+        for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+            uint32_t* histogram = &histograms[pass * RADIX_BUCKETS];
+            uint32_t shift = pass * RADIX_BITS;
+            if (count == 0 || histogram[(_items[0].key >> shift) & (RADIX_BUCKETS - 1)] == count) {
+                continue;
+            }
+            uint32_t offset = 0;
+            for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+                uint32_t n = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += n;
+            }
+            for (size_t i = 0; i < count; i++) {
+                _scratch[histogram[(_items[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = _items[i];
+            }
+            _items.swap(_scratch);
+        }
+
+        _sortedPackets.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            _sortedPackets[i] = _packets[_items[i].index];
+        }
+        _packets.swap(_sortedPackets);
+        _sortMilliseconds = duration<float, std::milli>(steady_clock::now() - start).count();
+    }
+
+    void DrawList::Emit(VkCommandBuffer commandBuffer, size_t first, size_t end, const Binder& binder)
+    {
+        uint32_t pipelineBinds = 0, materialBinds = 0, geometryBinds = 0;
+        for (size_t i = first; i < end; i++) {
+            const Packet& p = _packets[i];
+            bool start = i == first;
+            if (start || p.pipeline != _packets[i - 1].pipeline) {
+                binder.pipeline(commandBuffer, p.pipeline);
+                pipelineBinds++;
+            }
+            if (start || p.material != _packets[i - 1].material) {
+                binder.material(commandBuffer, p.material);
+                materialBinds++;
+            }
+            if (start || p.geometry != _packets[i - 1].geometry) {
+                binder.geometry(commandBuffer, p.geometry);
+                geometryBinds++;
+            }
+            vkCmdDrawIndexed(commandBuffer, p.indexCount, p.instanceCount, p.firstIndex, p.vertexOffset, p.firstInstance);
+        }
+        _draws += static_cast<uint32_t>(end > first ? end - first : 0);
+        _pipelineBinds += pipelineBinds;
+        _materialBinds += materialBinds;
+        _geometryBinds += geometryBinds;
+    }
+
+    DrawList::Statistics DrawList::Count() const
+    {
+        Statistics statistics = {};
+        statistics.packets = statistics.draws = static_cast<uint32_t>(_packets.size());
+        for (size_t i = 0; i < _packets.size(); i++) {
+            const Packet& p = _packets[i];
+            statistics.pipelineBinds += i == 0 || p.pipeline != _packets[i - 1].pipeline;
+            statistics.materialBinds += i == 0 || p.material != _packets[i - 1].material;
+            statistics.geometryBinds += i == 0 || p.geometry != _packets[i - 1].geometry;
+        }
+        statistics.sortMilliseconds = _sortMilliseconds;
+        return statistics;
+    }
+
+    DrawList::Statistics DrawList::Stats() const
+    {
+        Statistics statistics = {};
+        statistics.packets          = static_cast<uint32_t>(_packets.size());
+        statistics.draws            = _draws;
+        statistics.pipelineBinds    = _pipelineBinds;
+        statistics.materialBinds    = _materialBinds;
+        statistics.geometryBinds    = _geometryBinds;
+        statistics.sortMilliseconds = _sortMilliseconds;
+        return statistics;
+    }
+
+#ifdef ENABLE_BENCHMARKS
+    void RunDrawListBenchmark()
+    {
+        static const uint32_t PACKETS = 100000;
+        static const int      RUNS    = 10;
+
+        // A frame's worth of draws: a few passes and pipelines, many materials and geometries, any depth.
+        uint32_t seed = 12345;
+        auto random = [&seed]() -> uint32_t {
+            seed = seed * 1664525u + 1013904223u;
+            return seed >> 8;
+        };
+        vector<DrawList::Packet> packets(PACKETS);
+        for (uint32_t i = 0; i < PACKETS; i++) {
+            DrawList::Packet& p = packets[i];
+            p = {};
+            p.pipeline      = random() % 8;
+            p.material      = random() % 512;
+            p.geometry      = random() % 64;
+            p.key           = DrawList::Key(random() % 3, p.pipeline, p.material, (random() % 4096) / 4096.0f);
+            p.instanceCount = 1;
+            p.firstInstance = i;
+        }
+
+        DrawList list;
+        float radixMilliseconds = 0.0f;
+        for (int run = 0; run < RUNS; run++) {
+            list.Clear();
+            for (const auto& p : packets) {
+                list.Push(p);
+            }
+            if (run == 0) {
+                DrawList::Statistics unsorted = list.Count();
+                Log::Info("Draw list: %d packets unsorted need %d pipeline, %d material and %d geometry binds.",
+                          unsorted.packets, unsorted.pipelineBinds, unsorted.materialBinds, unsorted.geometryBinds);
+            }
+            list.Sort();
+            radixMilliseconds += list.Count().sortMilliseconds;
+        }
+
+        float stdMilliseconds = 0.0f;
+        vector<DrawList::Packet> reference;
+        for (int run = 0; run < RUNS; run++) {
+            reference = packets;
+            auto start = steady_clock::now();
+            std::stable_sort(reference.begin(), reference.end(), [](const DrawList::Packet& a, const DrawList::Packet& b) {
+                return a.key < b.key;
+            });
+            stdMilliseconds += duration<float, std::milli>(steady_clock::now() - start).count();
+        }
+
+        bool same = list.Size() == reference.size();
+        for (size_t i = 0; same && i < reference.size(); i++) {
+            same = list[i].key == reference[i].key && list[i].firstInstance == reference[i].firstInstance;
+        }
+        if (!same) {
+            Log::Error("Draw list: radix sort disagrees with std::stable_sort.");
+            throw std::runtime_error("draw list radix sort disagrees with std::stable_sort");
+        }
+        DrawList::Statistics sorted = list.Count();
+        Log::Info("Draw list: sorted %d packets in %.3f ms, std::stable_sort %.3f ms; sorted they need %d pipeline, %d material and %d geometry binds.",
+                  sorted.packets, radixMilliseconds / RUNS, stdMilliseconds / RUNS, sorted.pipelineBinds, sorted.materialBinds, sorted.geometryBinds);
+    }
+#endif
+}
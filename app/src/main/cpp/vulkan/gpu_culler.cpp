@@ -0,0 +1,183 @@
+﻿#include "gpu_culler.h"
+#include "vulkan_utility.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace Vulkan
+{
+    static const uint32_t WORKGROUP_SIZE = 64;
+
+    bool GpuCuller::Supported(const Device& device, size_t submeshCount)
+    {
+        const VkPhysicalDeviceFeatures& features = device.FeaturesEnabled();
+        return features.multiDrawIndirect && features.drawIndirectFirstInstance &&
+               submeshCount > 0 && submeshCount <= device.PhysicalDeviceProperties().limits.maxDrawIndirectCount;
+    }
+
+    GpuCuller::GpuCuller(const Device& device, DescriptorAllocator& descriptorAllocator, const vector<char>& shaderCode,
+                         const vector<Submesh>& submeshes, uint32_t slotCount)
+        : _device(device), _submeshes(submeshes), _slotCount(slotCount), _submeshBuffer(device), _parameterBuffer(device),
+          _visibilityBuffer(device), _drawBuffer(device), _countBuffer(device)
+    {
+        VkDevice d = device.LogicalDevice();
+        if (device.IsDeviceExtensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+            _drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(d, "vkCmdDrawIndexedIndirectCountKHR");
+        }
+
+        const VkPhysicalDeviceLimits& limits = device.PhysicalDeviceProperties().limits;
+        VkDeviceSize submeshCount = _submeshes.size();
+        _parameterStride  = Aligned(sizeof(Parameters), limits.minUniformBufferOffsetAlignment);
+        _visibilityStride = Aligned((submeshCount + 31) / 32 * sizeof(uint32_t), limits.minStorageBufferOffsetAlignment);
+        _drawStride       = Aligned(submeshCount * sizeof(VkDrawIndexedIndirectCommand), limits.minStorageBufferOffsetAlignment);
+        _countStride      = Aligned(sizeof(uint32_t), limits.minStorageBufferOffsetAlignment);
+
+        VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        _submeshBuffer.name = "culled submeshes";
+        _submeshBuffer.BuildDefaultBuffer(submeshCount * sizeof(Submesh), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+        _submeshBuffer.Map();
+        memcpy(_submeshBuffer.mapped, _submeshes.data(), _submeshes.size() * sizeof(Submesh));
+        _submeshBuffer.Unmap();
+        _parameterBuffer.name = "culling parameters";
+        _parameterBuffer.BuildDefaultBuffer(slotCount * _parameterStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hostVisible);
+        _parameterBuffer.Map();
+        _visibilityBuffer.name = "submesh visibility";
+        _visibilityBuffer.BuildDefaultBuffer(slotCount * _visibilityStride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+        _visibilityBuffer.Map();
+        _drawBuffer.name = "indirect draws";
+        _drawBuffer.BuildDefaultBuffer(slotCount * _drawStride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        // Host visible to read the counts back.
+        _countBuffer.name = "indirect draw count";
+        _countBuffer.BuildDefaultBuffer(slotCount * _countStride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostVisible);
+        _countBuffer.Map();
+
+        // Submeshes, parameters, visibility, draws and the draw count.
+        vector<VkDescriptorSetLayoutBinding> bindings(5);
+        for (uint32_t b = 0; b < 5; b++) {
+            bindings[b].binding         = b;
+            bindings[b].descriptorType  = b == 1 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[b].descriptorCount = 1;
+            bindings[b].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        const DescriptorSetLayout& layout = device.DescriptorLayouts().Layout(bindings);
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = PipelineLayoutCreateInfo(1, &layout.layout, 0, nullptr);
+        VK_CHECK_RESULT(vkCreatePipelineLayout(d, &pipelineLayoutInfo, nullptr, &_pipelineLayout));
+        for (uint32_t slot = 0; slot < slotCount; slot++) {
+            _descriptorSets.push_back(descriptorAllocator.Write(layout, {
+                DescriptorBuffer(_submeshBuffer.GetBuffer()),
+                DescriptorBuffer(_parameterBuffer.GetBuffer(), slot * _parameterStride, sizeof(Parameters)),
+                DescriptorBuffer(_visibilityBuffer.GetBuffer(), slot * _visibilityStride, _visibilityStride),
+                DescriptorBuffer(_drawBuffer.GetBuffer(), slot * _drawStride, _drawStride),
+                DescriptorBuffer(_countBuffer.GetBuffer(), slot * _countStride, sizeof(uint32_t))
+            }));
+        }
+
+        vector<char> code = shaderCode;
+        VkShaderModuleCreateInfo moduleInfo = ShaderModuleCreateInfo(code);
+        VkShaderModule module;
+        VK_CHECK_RESULT(vkCreateShaderModule(d, &moduleInfo, nullptr, &module));
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage  = PipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, module);
+        pipelineInfo.layout = _pipelineLayout;
+        _pipeline = device.Pipelines().CreateComputePipeline(pipelineInfo, "submesh culling");
+        vkDestroyShaderModule(d, module, nullptr);
+
+        _written.assign(slotCount, false);
+        _lastDrawCounts.assign(slotCount, 0);
+#ifdef ENABLE_BENCHMARKS
+        _expectedDrawCounts.assign(slotCount, 0);
+#endif
+        Log::Info("GPU culling of %d submeshes with %s.", static_cast<int>(submeshCount),
+                  CompactsDraws() ? "compacted draws and a draw count" : "a draw per submesh");
+    }
+
+    GpuCuller::~GpuCuller()
+    {
+        VkDevice d = _device.LogicalDevice();
+        vkDestroyPipeline(d, _pipeline, nullptr), _pipeline = VK_NULL_HANDLE;
+        vkDestroyPipelineLayout(d, _pipelineLayout, nullptr), _pipelineLayout = VK_NULL_HANDLE;
+    }
+
+    void GpuCuller::Update(uint32_t slot, const Culling::Frustum& frustum, const vector<uint8_t>& visible)
+    {
+        if (_written[slot]) {
+            _lastDrawCounts[slot] = *reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(_countBuffer.mapped) + slot * _countStride);
+#ifdef ENABLE_BENCHMARKS
+            if (_lastDrawCounts[slot] != _expectedDrawCounts[slot]) {
+                // Only expected for submeshes touching a plane, where the GPU may round differently.
+                Log::Warn("GPU culling drew %d submeshes where the CPU culls to %d.", _lastDrawCounts[slot], _expectedDrawCounts[slot]);
+            }
+#endif
+        }
+
+        Parameters parameters = {};
+        memcpy(parameters.planes, frustum.planes, sizeof(parameters.planes));
+        parameters.submeshCount = SubmeshCount();
+        parameters.compact      = CompactsDraws();
+        memcpy(static_cast<uint8_t*>(_parameterBuffer.mapped) + slot * _parameterStride, &parameters, sizeof(parameters));
+
+        uint32_t* words = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(_visibilityBuffer.mapped) + slot * _visibilityStride);
+        memset(words, 0, (_submeshes.size() + 31) / 32 * sizeof(uint32_t));
+        for (size_t i = 0; i < _submeshes.size(); i++) {
+            if (i >= visible.size() || visible[i]) {
+                words[i / 32] |= 1u << (i % 32);
+            }
+        }
+        _written[slot] = true;
+
+#ifdef ENABLE_BENCHMARKS
+        // The shader's test, in the same order.
+        uint32_t expected = 0;
+        for (size_t i = 0; i < _submeshes.size(); i++) {
+            const Submesh& s = _submeshes[i];
+            bool inside = i >= visible.size() || visible[i];
+            for (int p = 0; p < 6 && inside; p++) {
+                const vec4& plane = frustum.planes[p];
+                float distance = plane.x * s.center[0] + plane.y * s.center[1] + plane.z * s.center[2] + plane.w;
+                distance += std::fabs(plane.x) * s.extent[0] + std::fabs(plane.y) * s.extent[1] + std::fabs(plane.z) * s.extent[2];
+                inside = distance >= 0.0f;
+            }
+            expected += inside;
+        }
+        _expectedDrawCounts[slot] = expected;
+#endif
+    }
+
+    void GpuCuller::RecordCull(VkCommandBuffer commandBuffer, uint32_t slot)
+    {
+        vkCmdFillBuffer(commandBuffer, _countBuffer.GetBuffer(), slot * _countStride, sizeof(uint32_t), 0);
+        // The count is cleared, and the slot's draws from its previous frame have been read.
+        VkMemoryBarrier clearBarrier = {};
+        clearBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &_descriptorSets[slot], 0, nullptr);
+        vkCmdDispatch(commandBuffer, (SubmeshCount() + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+        // The draws read the commands and the count, and Update() reads the count through the mapping once the slot's
+        // frame has completed.
+        VkMemoryBarrier drawBarrier = {};
+        drawBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                             0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    void GpuCuller::RecordDraws(VkCommandBuffer commandBuffer, uint32_t slot)
+    {
+        if (CompactsDraws()) {
+            _drawIndexedIndirectCount(commandBuffer, _drawBuffer.GetBuffer(), slot * _drawStride, _countBuffer.GetBuffer(), slot * _countStride,
+                                      SubmeshCount(), sizeof(VkDrawIndexedIndirectCommand));
+        } else {
+            vkCmdDrawIndexedIndirect(commandBuffer, _drawBuffer.GetBuffer(), slot * _drawStride, SubmeshCount(), sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+}
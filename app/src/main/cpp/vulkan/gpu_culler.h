@@ -0,0 +1,105 @@
+﻿#ifndef VULKAN_GPU_CULLER_H
+#define VULKAN_GPU_CULLER_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include "device.h"
+#include "buffer.h"
+#include "descriptor_allocator.h"
+#include "../culling/frustum_culling.h"
+#include <vector>
+
+#ifndef VK_KHR_draw_indirect_count
+#define VK_KHR_draw_indirect_count 1
+#define VK_KHR_DRAW_INDIRECT_COUNT_SPEC_VERSION 1
+#define VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME "VK_KHR_draw_indirect_count"
+typedef void (VKAPI_PTR *PFN_vkCmdDrawIndexedIndirectCountKHR)(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+                                                               VkBuffer countBuffer, VkDeviceSize countBufferOffset,
+                                                               uint32_t maxDrawCount, uint32_t stride);
+#endif
+
+using std::vector;
+
+namespace Vulkan
+{
+    // Frustum culls the submeshes of one model in a compute shader, which writes an indexed indirect draw for each
+    // visible one, so recording a pass takes a dispatch and one indirect draw however many submeshes there are. With
+    // VK_KHR_draw_indirect_count the draws are compacted and their count read by the GPU; without it every submesh
+    // keeps its own draw, with no instances if culled.
+    //
+    // The draw's first instance is the submesh's texture index, for bindless materials. Whatever a frame writes lives
+    // in one slot per swapchain image: Update() it after the image's previous frame has completed.
+    class GpuCuller {
+    public:
+        // std430 layout of the shader's Submesh.
+        typedef struct Submesh {
+            float    center[4];
+            float    extent[4];
+            uint32_t indexCount;
+            uint32_t firstIndex;
+            int32_t  vertexOffset;
+            uint32_t textureIndex;
+        } Submesh;
+
+        GpuCuller(const Device& device, DescriptorAllocator& descriptorAllocator, const vector<char>& shaderCode,
+                  const vector<Submesh>& submeshes, uint32_t slotCount);
+        ~GpuCuller();
+
+        GpuCuller(const GpuCuller&) = delete;
+        GpuCuller& operator=(const GpuCuller&) = delete;
+
+        // Multi draw indirect with first instances, and enough draws per call for submeshCount.
+        static bool Supported(const Device& device, size_t submeshCount);
+        bool CompactsDraws() const { return _drawIndexedIndirectCount != nullptr; }
+
+        // frustum is in the model's space; visible, if not empty, further restricts the submeshes drawn, e.g. to those
+        // not occluded.
+        void Update(uint32_t slot, const Culling::Frustum& frustum, const vector<uint8_t>& visible);
+        // Outside a render pass, before the draws.
+        void RecordCull(VkCommandBuffer commandBuffer, uint32_t slot);
+        void RecordDraws(VkCommandBuffer commandBuffer, uint32_t slot);
+
+        // Draws the slot's last completed frame submitted, valid from its second Update().
+        uint32_t LastDrawCount(uint32_t slot) const { return _lastDrawCounts[slot]; }
+        uint32_t SubmeshCount() const { return static_cast<uint32_t>(_submeshes.size()); }
+
+    private:
+        // std140 layout of the shader's Culling block.
+        typedef struct Parameters {
+            float    planes[6][4];
+            uint32_t submeshCount;
+            uint32_t compact;
+            uint32_t padding[2];
+        } Parameters;
+
+        VkDeviceSize Aligned(VkDeviceSize size, VkDeviceSize alignment) const { return (size + alignment - 1) / alignment * alignment; }
+
+        const Device&   _device;
+        vector<Submesh> _submeshes;
+        uint32_t        _slotCount;
+
+        // One buffer per kind, each holding every slot at its stride.
+        Buffer       _submeshBuffer;
+        Buffer       _parameterBuffer;
+        Buffer       _visibilityBuffer;
+        Buffer       _drawBuffer;
+        Buffer       _countBuffer;
+        VkDeviceSize _parameterStride, _visibilityStride, _drawStride, _countStride;
+
+        VkPipelineLayout        _pipelineLayout = VK_NULL_HANDLE;
+        VkPipeline              _pipeline       = VK_NULL_HANDLE;
+        vector<VkDescriptorSet> _descriptorSets;
+
+        PFN_vkCmdDrawIndexedIndirectCountKHR _drawIndexedIndirectCount = nullptr;
+
+        vector<bool>     _written;
+        vector<uint32_t> _lastDrawCounts;
+#ifdef ENABLE_BENCHMARKS
+        // What the CPU makes of each slot's last parameters, to check the GPU's counts against.
+        vector<uint32_t> _expectedDrawCounts;
+#endif
+    };
+}
+
+#endif // VULKAN_GPU_CULLER_H
@@ -245,6 +245,16 @@ const vector<const char*> LayerAndExtension::EnabledInstanceExtensionNames(void)
     return {};
 }
 
+bool LayerAndExtension::IsInstanceExtensionEnabled(const char* extensionName) const
+{
+    for (const auto& name : _instanceExtensionNamesEnabled) {
+        if (!strcmp(name.c_str(), extensionName)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool LayerAndExtension::HookDebugReportExtension(VkInstance instance)
 {
     assert(instance);
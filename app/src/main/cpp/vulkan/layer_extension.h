@@ -40,6 +40,7 @@ public:
     const vector<const char*> EnabledInstanceLayerNames(void) const;
     const vector<string>& EnabledRawInstanceLayerNames(void) const { return _instanceLayerNamesEnabled; }
     const vector<const char*> EnabledInstanceExtensionNames(void) const;
+    bool IsInstanceExtensionEnabled(const char* extensionName) const;
 private:
     VkInstance _instance;
     VkDebugReportCallbackEXT _debugReportCallbackExt;
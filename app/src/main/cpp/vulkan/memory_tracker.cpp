@@ -0,0 +1,268 @@
+﻿#include "memory_tracker.h"
+#include "vulkan_utility.h"
+#include <algorithm>
+
+using std::chrono::duration;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::mutex;
+
+namespace Vulkan
+{
+    // Without VK_EXT_memory_budget the only thing known is the heap size, and the whole heap is never available to a
+    // single process.
+    static const float FALLBACK_BUDGET_RATIO = 0.8f;
+
+    MemoryTracker::MemoryTracker(VkPhysicalDevice physicalDevice, VkDevice device) : _physicalDevice(physicalDevice),
+                                                                                      _device(device)
+    {
+        vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &_memoryProperties);
+        _heaps.resize(_memoryProperties.memoryHeapCount);
+        _liveBytesAtQuery.resize(_memoryProperties.memoryHeapCount, 0);
+        _overBudget.resize(_memoryProperties.memoryHeapCount, false);
+        for (uint32_t i = 0; i < _memoryProperties.memoryHeapCount; i++) {
+            HeapStatistics& heap = _heaps[i];
+            heap.size            = _memoryProperties.memoryHeaps[i].size;
+            heap.budget          = (VkDeviceSize)(heap.size * FALLBACK_BUDGET_RATIO);
+            heap.usage           = 0;
+            heap.liveBytes       = 0;
+            heap.peakBytes       = 0;
+            heap.allocationCount = 0;
+            heap.deviceLocal     = (_memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        }
+        for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+            _categoryBytes[i]       = 0;
+            _categoryAllocations[i] = 0;
+        }
+        _lastLogTime = steady_clock::now();
+    }
+
+    void MemoryTracker::EnableBudgetQuery(VkInstance instance)
+    {
+        _getMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+        if (!_getMemoryProperties2) {
+            Log::Warn("vkGetPhysicalDeviceMemoryProperties2KHR is unavailable, memory budget falls back to heap sizes.");
+            return;
+        }
+        lock_guard<mutex> lock(_mutex);
+        QueryBudget();
+    }
+
+    void MemoryTracker::QueryBudget()
+    {
+        if (!_getMemoryProperties2) {
+            return;
+        }
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        VkPhysicalDeviceMemoryProperties2KHR memoryProperties = {};
+        memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+        memoryProperties.pNext = &budgetProperties;
+        _getMemoryProperties2(_physicalDevice, &memoryProperties);
+        for (uint32_t i = 0; i < _heaps.size(); i++) {
+            _heaps[i].budget     = budgetProperties.heapBudget[i];
+            _heaps[i].usage      = budgetProperties.heapUsage[i];
+            _liveBytesAtQuery[i] = _heaps[i].liveBytes;
+        }
+    }
+
+    VkDeviceSize MemoryTracker::EstimatedUsage(uint32_t heapIndex) const
+    {
+        const HeapStatistics& heap = _heaps[heapIndex];
+        if (!_getMemoryProperties2) {
+            return heap.liveBytes;
+        }
+        // The driver's usage is only as fresh as the last query, so account for what this tracker has seen since.
+        VkDeviceSize base = _liveBytesAtQuery[heapIndex];
+        if (heap.liveBytes >= base) {
+            return heap.usage + (heap.liveBytes - base);
+        }
+        VkDeviceSize released = base - heap.liveBytes;
+        return heap.usage > released ? heap.usage - released : 0;
+    }
+
+    VkResult MemoryTracker::Allocate(const VkMemoryAllocateInfo& allocateInfo, MemoryCategory category, const string& name, VkDeviceMemory* memory)
+    {
+        VkResult result = vkAllocateMemory(_device, &allocateInfo, nullptr, memory);
+        if (result != VK_SUCCESS) {
+            Log::Error("Allocating %llu bytes for %s (%s) failed: %d.",
+                       (unsigned long long)allocateInfo.allocationSize, name.c_str(), CategoryName(category), result);
+            LogSnapshot();
+            return result;
+        }
+
+        vector<uint32_t> crossings;
+        {
+            lock_guard<mutex> lock(_mutex);
+            uint32_t heapIndex = _memoryProperties.memoryTypes[allocateInfo.memoryTypeIndex].heapIndex;
+            Allocation allocation = { allocateInfo.allocationSize, heapIndex, category, name };
+            _allocations[*memory] = allocation;
+
+            HeapStatistics& heap = _heaps[heapIndex];
+            heap.liveBytes += allocateInfo.allocationSize;
+            heap.peakBytes = std::max(heap.peakBytes, heap.liveBytes);
+            heap.allocationCount++;
+            _categoryBytes[category] += allocateInfo.allocationSize;
+            _categoryAllocations[category]++;
+            CollectBudgetCrossings(crossings);
+        }
+        NotifyBudgetCrossings(crossings);
+        return result;
+    }
+
+    void MemoryTracker::Free(VkDeviceMemory memory)
+    {
+        if (memory == VK_NULL_HANDLE) {
+            return;
+        }
+        {
+            lock_guard<mutex> lock(_mutex);
+            auto it = _allocations.find(memory);
+            if (it != _allocations.end()) {
+                const Allocation& allocation = it->second;
+                HeapStatistics& heap = _heaps[allocation.heapIndex];
+                heap.liveBytes -= allocation.size;
+                heap.allocationCount--;
+                _categoryBytes[allocation.category] -= allocation.size;
+                _categoryAllocations[allocation.category]--;
+                _allocations.erase(it);
+            } else {
+                Log::Warn("Freeing untracked device memory.");
+            }
+        }
+        vkFreeMemory(_device, memory, nullptr);
+    }
+
+    void MemoryTracker::CollectBudgetCrossings(vector<uint32_t>& heapIndices)
+    {
+        for (uint32_t i = 0; i < _heaps.size(); i++) {
+            bool over = EstimatedUsage(i) > _heaps[i].budget * budgetWarningRatio;
+            if (over && !_overBudget[i]) {
+                heapIndices.push_back(i);
+            }
+            _overBudget[i] = over;
+        }
+    }
+
+    void MemoryTracker::NotifyBudgetCrossings(const vector<uint32_t>& heapIndices)
+    {
+        if (heapIndices.empty()) {
+            return;
+        }
+        // Callbacks may free memory, so they run without the lock held.
+        vector<BudgetCallback> callbacks;
+        vector<HeapStatistics> heaps;
+        {
+            lock_guard<mutex> lock(_mutex);
+            for (const auto& it : _budgetCallbacks) {
+                callbacks.push_back(it.second);
+            }
+            heaps = _heaps;
+        }
+        for (uint32_t i : heapIndices) {
+            Log::Warn("Memory heap %d is over %d%% of its budget.", i, (int)(budgetWarningRatio * 100));
+            for (auto& callback : callbacks) {
+                callback(i, heaps[i]);
+            }
+        }
+    }
+
+    MemoryTracker::Snapshot MemoryTracker::TakeSnapshot()
+    {
+        vector<uint32_t> crossings;
+        Snapshot snapshot;
+        {
+            lock_guard<mutex> lock(_mutex);
+            QueryBudget();
+            CollectBudgetCrossings(crossings);
+            snapshot.heaps = _heaps;
+            for (uint32_t i = 0; i < snapshot.heaps.size(); i++) {
+                snapshot.heaps[i].usage = EstimatedUsage(i);
+            }
+            for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+                snapshot.categoryBytes[i]       = _categoryBytes[i];
+                snapshot.categoryAllocations[i] = _categoryAllocations[i];
+            }
+            snapshot.driverBudget = (_getMemoryProperties2 != nullptr);
+        }
+        NotifyBudgetCrossings(crossings);
+        return snapshot;
+    }
+
+    void MemoryTracker::LogSnapshot()
+    {
+        const float MiB = 1024.0f * 1024.0f;
+        Snapshot snapshot = TakeSnapshot();
+        for (uint32_t i = 0; i < snapshot.heaps.size(); i++) {
+            const HeapStatistics& heap = snapshot.heaps[i];
+            Log::Info("Memory heap %d%s: %.2f MiB live (peak %.2f MiB) in %d allocations, usage %.2f MiB of %s budget %.2f MiB, heap size %.2f MiB.",
+                      i, heap.deviceLocal ? " (device local)" : "",
+                      heap.liveBytes / MiB, heap.peakBytes / MiB, heap.allocationCount,
+                      heap.usage / MiB, snapshot.driverBudget ? "driver" : "estimated", heap.budget / MiB,
+                      heap.size / MiB);
+        }
+        for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+            if (snapshot.categoryAllocations[i]) {
+                Log::Info("Memory category %s: %.2f MiB in %d allocations.",
+                          CategoryName((MemoryCategory)i), snapshot.categoryBytes[i] / MiB, snapshot.categoryAllocations[i]);
+            }
+        }
+    }
+
+    void MemoryTracker::LogIfDue(float intervalSeconds)
+    {
+        auto now = steady_clock::now();
+        if (duration<float, seconds::period>(now - _lastLogTime).count() < intervalSeconds) {
+            return;
+        }
+        _lastLogTime = now;
+        LogSnapshot();
+    }
+
+    uint32_t MemoryTracker::AddBudgetCallback(BudgetCallback callback)
+    {
+        lock_guard<mutex> lock(_mutex);
+        uint32_t id = _nextCallbackId++;
+        _budgetCallbacks[id] = callback;
+        return id;
+    }
+
+    void MemoryTracker::RemoveBudgetCallback(uint32_t id)
+    {
+        lock_guard<mutex> lock(_mutex);
+        _budgetCallbacks.erase(id);
+    }
+
+    MemoryCategory MemoryTracker::BufferCategory(VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
+    {
+        if (usage & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT)) {
+            return MEMORY_CATEGORY_GEOMETRY;
+        }
+        if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+            return MEMORY_CATEGORY_UNIFORM;
+        }
+        if ((usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) && (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+            return MEMORY_CATEGORY_STAGING;
+        }
+        return MEMORY_CATEGORY_OTHER;
+    }
+
+    const char* MemoryTracker::CategoryName(MemoryCategory category)
+    {
+        switch (category) {
+            case MEMORY_CATEGORY_GEOMETRY:
+                return "geometry";
+            case MEMORY_CATEGORY_TEXTURE:
+                return "texture";
+            case MEMORY_CATEGORY_RENDER_TARGET:
+                return "render target";
+            case MEMORY_CATEGORY_UNIFORM:
+                return "uniform";
+            case MEMORY_CATEGORY_STAGING:
+                return "staging";
+            default:
+                return "other";
+        }
+    }
+}
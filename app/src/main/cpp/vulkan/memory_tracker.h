@@ -0,0 +1,122 @@
+﻿#ifndef VULKAN_MEMORY_TRACKER_H
+#define VULKAN_MEMORY_TRACKER_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef VK_EXT_memory_budget
+#define VK_EXT_memory_budget 1
+#define VK_EXT_MEMORY_BUDGET_SPEC_VERSION 1
+#define VK_EXT_MEMORY_BUDGET_EXTENSION_NAME "VK_EXT_memory_budget"
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT ((VkStructureType)1000237000)
+typedef struct VkPhysicalDeviceMemoryBudgetPropertiesEXT {
+    VkStructureType sType;
+    void*           pNext;
+    VkDeviceSize    heapBudget[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize    heapUsage[VK_MAX_MEMORY_HEAPS];
+} VkPhysicalDeviceMemoryBudgetPropertiesEXT;
+#endif
+
+using std::function;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace Vulkan
+{
+    typedef enum MemoryCategory {
+        MEMORY_CATEGORY_GEOMETRY,
+        MEMORY_CATEGORY_TEXTURE,
+        MEMORY_CATEGORY_RENDER_TARGET,
+        MEMORY_CATEGORY_UNIFORM,
+        MEMORY_CATEGORY_STAGING,
+        MEMORY_CATEGORY_OTHER,
+        MEMORY_CATEGORY_COUNT
+    } MemoryCategory;
+
+    // Central accounting of VkDeviceMemory. Every allocation goes through Allocate()/Free() so that live and peak bytes
+    // are known per heap and per category. When VK_EXT_memory_budget is enabled the driver's budget and process-wide
+    // usage are queried as well; otherwise the budget falls back to a fraction of the heap size.
+    class MemoryTracker {
+    public:
+        typedef struct HeapStatistics {
+            VkDeviceSize size;
+            VkDeviceSize budget;
+            VkDeviceSize usage;
+            VkDeviceSize liveBytes;
+            VkDeviceSize peakBytes;
+            uint32_t     allocationCount;
+            bool         deviceLocal;
+        } HeapStatistics;
+
+        typedef struct Snapshot {
+            vector<HeapStatistics> heaps;
+            VkDeviceSize           categoryBytes[MEMORY_CATEGORY_COUNT];
+            uint32_t               categoryAllocations[MEMORY_CATEGORY_COUNT];
+            bool                   driverBudget;
+        } Snapshot;
+
+        // Invoked once when a heap's usage crosses budgetWarningRatio of its budget.
+        typedef function<void(uint32_t heapIndex, const HeapStatistics& heap)> BudgetCallback;
+
+        MemoryTracker(VkPhysicalDevice physicalDevice, VkDevice device);
+
+        // Requires VK_KHR_get_physical_device_properties2 on the instance and VK_EXT_memory_budget on the device.
+        void EnableBudgetQuery(VkInstance instance);
+        bool BudgetQueryEnabled() const { return _getMemoryProperties2 != nullptr; }
+
+        VkResult Allocate(const VkMemoryAllocateInfo& allocateInfo, MemoryCategory category, const string& name, VkDeviceMemory* memory);
+        void Free(VkDeviceMemory memory);
+
+        Snapshot TakeSnapshot();
+        void LogSnapshot();
+        void LogIfDue(float intervalSeconds = 10.0f);
+
+        uint32_t AddBudgetCallback(BudgetCallback callback);
+        void RemoveBudgetCallback(uint32_t id);
+
+        static MemoryCategory BufferCategory(VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+        static const char* CategoryName(MemoryCategory category);
+
+        float budgetWarningRatio = 0.9f;
+    private:
+        typedef struct Allocation {
+            VkDeviceSize   size;
+            uint32_t       heapIndex;
+            MemoryCategory category;
+            string         name;
+        } Allocation;
+
+        void QueryBudget();
+        VkDeviceSize EstimatedUsage(uint32_t heapIndex) const;
+        void CollectBudgetCrossings(vector<uint32_t>& heapIndices);
+        void NotifyBudgetCrossings(const vector<uint32_t>& heapIndices);
+
+        VkPhysicalDevice                 _physicalDevice;
+        VkDevice                         _device;
+        VkPhysicalDeviceMemoryProperties _memoryProperties;
+
+        PFN_vkGetPhysicalDeviceMemoryProperties2KHR _getMemoryProperties2 = nullptr;
+
+        std::mutex                                  _mutex;
+        unordered_map<VkDeviceMemory, Allocation>   _allocations;
+        vector<HeapStatistics>                      _heaps;
+        vector<VkDeviceSize>                        _liveBytesAtQuery;
+        vector<bool>                                _overBudget;
+        VkDeviceSize                                _categoryBytes[MEMORY_CATEGORY_COUNT];
+        uint32_t                                    _categoryAllocations[MEMORY_CATEGORY_COUNT];
+        unordered_map<uint32_t, BudgetCallback>     _budgetCallbacks;
+        uint32_t                                    _nextCallbackId = 0;
+
+        std::chrono::steady_clock::time_point _lastLogTime;
+    };
+}
+
+#endif // VULKAN_MEMORY_TRACKER_H
@@ -1,5 +1,7 @@
 ﻿#include "model.h"
 #include "../../log/log.h"
+#include "glm/common.hpp"
+#include <algorithm>
 
 using Utility::Log;
 
@@ -177,9 +179,42 @@ namespace Vulkan
             LoadMaterialTextures(material, aiTextureType_LIGHTMAP    , i);
             LoadMaterialTextures(material, aiTextureType_REFLECTION  , i);
         }
+        ComputeSubmeshBounds();
         return true;
     }
 
+    size_t Model::PositionStride(size_t submesh, size_t& offset) const
+    {
+        const VertexLayout& layout = _vertexLayouts[std::min(submesh, _vertexLayouts.size() - 1)];
+        offset = 0;
+        for (size_t c = 0; c < layout.components.size(); c++) {
+            if (layout.components[c] == VERTEX_COMPONENT_POSITION) {
+                offset = layout.offsets[c] / sizeof(float);
+            }
+        }
+        return layout.Stride() / sizeof(float);
+    }
+
+    void Model::ComputeSubmeshBounds()
+    {
+        _submeshBounds.Clear();
+        for (size_t i = 0; i < _subMeshes.size(); i++) {
+            size_t position;
+            size_t stride = PositionStride(i, position);
+            vec3 min(FLT_MAX), max(-FLT_MAX);
+            const vector<float>& vertices = _subMeshes[i].vertexBuffer;
+            for (size_t v = position; v + 2 < vertices.size(); v += stride) {
+                vec3 p(vertices[v], vertices[v + 1], vertices[v + 2]);
+                min = glm::min(min, p);
+                max = glm::max(max, p);
+            }
+            if (min.x > max.x) {
+                min = max = vec3(0.0f);
+            }
+            _submeshBounds.Add(min, max);
+        }
+    }
+
     void Model::LoadMaterialTextures(const aiMaterial* mat, aiTextureType type, int storeIndex)
     {
         int textureCount = mat->GetTextureCount(type);
@@ -2,6 +2,7 @@
 #define VULKAN_MODEL_H
 
 #include "../../log/log.h"
+#include "../../culling/frustum_culling.h"
 #include "glm/vec2.hpp"
 #include "glm/vec3.hpp"
 #include "glm/mat4x4.hpp"
@@ -36,6 +37,10 @@ namespace Vulkan
     public:
         vector<Component> components;
         vector<uint32_t> offsets;
+        // The binding each component is read from and the stride of each binding. Both empty for a single interleaved
+        // binding of Stride(); offsets are within the component's binding.
+        vector<uint32_t> bindings;
+        vector<uint32_t> strides;
 
         VertexLayout() { DebugLog("VertexLayout()"); }
         VertexLayout(const VertexLayout& other)
@@ -43,12 +48,38 @@ namespace Vulkan
             DebugLog("VertexLayout(VertexLayout&)");
             components = other.components;
             offsets = other.offsets;
+            bindings = other.bindings;
+            strides = other.strides;
         }
         VertexLayout(VertexLayout&& other)
         {
             DebugLog("VertexLayout(VertexLayout&&)");
             components = other.components;
             offsets = other.offsets;
+            bindings = other.bindings;
+            strides = other.strides;
+        }
+
+        uint32_t BindingCount() const { return strides.empty() ? 1 : static_cast<uint32_t>(strides.size()); }
+        uint32_t BindingStride(uint32_t binding) const { return strides.empty() ? Stride() : strides[binding]; }
+        uint32_t Binding(size_t component) const { return bindings.empty() ? 0 : bindings[component]; }
+
+        // Positions from ModelResource's tightly packed position stream at binding 0 and the other components from
+        // this interleaved layout at binding 1. positionsOnly leaves out the other components but keeps both bindings,
+        // so that a depth pre-pass binds the same buffers as the pass after it.
+        VertexLayout WithPositionStream(bool positionsOnly = false) const
+        {
+            VertexLayout layout;
+            layout.strides = { 3 * sizeof(float), Stride() };
+            for (size_t i = 0; i < components.size(); i++) {
+                bool position = components[i] == VERTEX_COMPONENT_POSITION;
+                if (position || !positionsOnly) {
+                    layout.components.push_back(components[i]);
+                    layout.offsets.push_back(position ? 0 : offsets[i]);
+                    layout.bindings.push_back(position ? 0 : 1);
+                }
+            }
+            return layout;
         }
 
         uint32_t Stride() const
@@ -137,6 +168,7 @@ namespace Vulkan
             _dimension       = dimension;
             _materialIndices = materialIndices;
             _materials       = std::forward<vector<Material>>(materials);
+            ComputeSubmeshBounds();
         }
         Model(Model&& other)
         {
@@ -147,6 +179,7 @@ namespace Vulkan
             _dimension       = other._dimension;
             _materialIndices = std::move(other._materialIndices);
             _materials       = std::move(other._materials);
+            _submeshBounds   = std::move(other._submeshBounds);
             _mvp             = other._mvp;
         }
         ~Model() { DebugLog("~Model()"); }
@@ -160,7 +193,16 @@ namespace Vulkan
         const vector<VertexLayout>& VertexLayouts() const { return _vertexLayouts; }
 
         const vector<Material>& Materials() const { return _materials; }
+        // One per submesh.
+        const vector<int>& MaterialIndices() const { return _materialIndices; }
+        // Model space bounds of all submeshes together.
+        const Dimension& Dimensions() const { return _dimension; }
+        // Model space bounds of each submesh, in submesh order.
+        const Culling::Bounds& SubmeshBounds() const { return _submeshBounds; }
+        // Distance between two vertices of a submesh in floats; offset receives where the position starts in one.
+        size_t PositionStride(size_t submesh, size_t& offset) const;
     private:
+        void ComputeSubmeshBounds();
         void LoadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
 
         void ProcessNode(aiNode* node, const aiScene* scene);
@@ -174,6 +216,8 @@ namespace Vulkan
         vector<int>      _materialIndices;
         vector<Material> _materials;
 
+        Culling::Bounds _submeshBounds;
+
         MVP _mvp;
     };
 }
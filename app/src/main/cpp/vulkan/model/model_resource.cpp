@@ -1,6 +1,5 @@
 ﻿#include "model_resource.h"
 #include "../../log/log.h"
-#include "../command.h"
 #include "../vulkan_utility.h"
 #include "../../androidutility/assetmanager/io_asset.hpp"
 
@@ -8,7 +7,7 @@ using Utility::Log;
 
 namespace Vulkan
 {
-    ModelResource::ModelResource(const Device& device) : device(device), vertices(device), indices(device)
+    ModelResource::ModelResource(const Device& device) : device(device), vertices(device), positions(device), indices(device)
     {
         DebugLog("ModelResource()");
     }
@@ -16,6 +15,7 @@ namespace Vulkan
     ModelResource::ModelResource(ModelResource&& other) : subMeshes(std::move(other.subMeshes)),
                                                           device(other.device),
                                                           vertices(std::move(other.vertices)),
+                                                          positions(std::move(other.positions)),
                                                           indices(std::move(other.indices)),
                                                           indicesCount(other.indicesCount)
     {
@@ -27,7 +27,7 @@ namespace Vulkan
         DebugLog("~ModelResource()");
     }
 
-    void ModelResource::UploadToGPU(const Model& model, Command& command)
+    void ModelResource::UploadToGPU(const Model& model, UploadContext& uploadContext)
     {
         // Upload model.
         subMeshes.clear();
@@ -36,6 +36,7 @@ namespace Vulkan
         const vector<VertexLayout>& vertexLayouts = model.VertexLayouts();
 
         vector<float> vertexBuffer;
+        vector<float> positionBuffer;
         vector<uint32_t> indexBuffer;
         uint32_t vertexCount = 0;
         uint32_t indexCount  = 0;
@@ -44,6 +45,7 @@ namespace Vulkan
             subMeshes[i] = {};
             subMeshes[i].vertexBase = vertexCount;
             subMeshes[i].indexBase = indexCount;
+            subMeshes[i].materialIndex = i < model.MaterialIndices().size() ? model.MaterialIndices()[i] : 0;
 
             const Model::Mesh& m = model.Submeshes()[i];
             size_t packSize = vertexLayouts[i].Stride() / sizeof(float);
@@ -57,6 +59,10 @@ namespace Vulkan
                 {
                     switch (component) {
                         case VERTEX_COMPONENT_POSITION:
+                            positionBuffer.push_back(m.vertexBuffer[vIndex + indexInsidePack]);
+                            positionBuffer.push_back(m.vertexBuffer[vIndex + indexInsidePack + 1]);
+                            positionBuffer.push_back(m.vertexBuffer[vIndex + indexInsidePack + 2]);
+                            // Interleaved as well.
                         case VERTEX_COMPONENT_NORMAL:
                         case VERTEX_COMPONENT_COLOR:
                         case VERTEX_COMPONENT_TANGENT:
@@ -82,37 +88,18 @@ namespace Vulkan
 
         uint32_t vBufferSize = static_cast<uint32_t>(vertexBuffer.size()) * sizeof(float);
         uint32_t iBufferSize = static_cast<uint32_t>(indexBuffer.size()) * sizeof(uint32_t);
+        uint32_t pBufferSize = static_cast<uint32_t>(positionBuffer.size()) * sizeof(float);
         indicesCount = indexBuffer.size();
 
-        Buffer vertexStaging(device), indexStaging(device);
-        vertexStaging.BuildDefaultBuffer(vBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        indexStaging.BuildDefaultBuffer(iBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        vertices.name  = "vertices";
+        positions.name = "positions";
+        indices.name   = "indices";
         vertices.BuildDefaultBuffer(vBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        positions.BuildDefaultBuffer(pBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
         indices.BuildDefaultBuffer(iBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-        vertexStaging.Map();
-        indexStaging.Map();
-        memcpy(vertexStaging.mapped, vertexBuffer.data(), vBufferSize);
-        memcpy(indexStaging.mapped, indexBuffer.data(), iBufferSize);
-        vertexStaging.Unmap();
-        indexStaging.Unmap();
-
-
-        VkDevice d = device.LogicalDevice();
-        vector<VkCommandBuffer> copyCmds = Command::CreateAndBeginCommandBuffers(command.ShortLivedTransferPool(),
-                                                                                 VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-                                                                                 1,
-                                                                                 VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-                                                                                 d);
-        VkCommandBuffer copyCmd = copyCmds[0];
-        VkBufferCopy copyRegion = {};
-
-        copyRegion.size = vBufferSize;
-        vkCmdCopyBuffer(copyCmd, vertexStaging.GetBuffer(), vertices.GetBuffer(), 1, &copyRegion);
-
-        copyRegion.size = iBufferSize;
-        vkCmdCopyBuffer(copyCmd, indexStaging.GetBuffer(), indices.GetBuffer(), 1, &copyRegion);
-
-        Command::EndAndSubmitCommandBuffer(copyCmd, device.FamilyQueues().transfer.queue, command.ShortLivedTransferPool(), d);
+        uploadContext.UploadBuffer(vertices, vertexBuffer.data(), vBufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        uploadContext.UploadBuffer(positions, positionBuffer.data(), pBufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        uploadContext.UploadBuffer(indices, indexBuffer.data(), iBufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
     }
 }
@@ -3,6 +3,7 @@
 
 #include "../device.h"
 #include "../buffer.h"
+#include "../upload_context.h"
 #include "glm/vec2.hpp"
 #include "glm/vec3.hpp"
 #include "glm/vec4.hpp"
@@ -30,21 +31,29 @@ namespace Vulkan
             uint32_t vertexCount;
             uint32_t indexBase;
             uint32_t indexCount;
+            // Index into the model's materials; 0 for models without any.
+            uint32_t materialIndex;
         };
 
         ModelResource(const Device& device);
         ModelResource(ModelResource&& other);
         virtual ~ModelResource();
 
-        void UploadToGPU(const Model& model, Command& command);
+        // Records the copies into uploadContext; the buffers may be used once its next ticket has completed.
+        void UploadToGPU(const Model& model, UploadContext& uploadContext);
 
         const Buffer& VertexBuffer() const { return vertices; }
+        // The positions of VertexBuffer() alone, tightly packed, for VertexLayout::WithPositionStream().
+        const Buffer& PositionBuffer() const { return positions; }
         const Buffer& IndexBuffer() const { return indices; }
         uint32_t IndicesCount() { return indicesCount; }
+        // Submesh indices are local to the submesh, so each one is drawn with its own index and vertex base.
+        const vector<Mesh>& Submeshes() const { return subMeshes; }
     protected:
         vector<Mesh>  subMeshes;
         const Device& device;
         Buffer        vertices;
+        Buffer        positions;
         Buffer        indices;
         uint32_t      indicesCount;
     };
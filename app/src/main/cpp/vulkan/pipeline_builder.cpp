@@ -0,0 +1,352 @@
+﻿#include "pipeline_builder.h"
+#include "vulkan_utility.h"
+#include "model/model.h"
+#include <cstring>
+
+namespace Vulkan
+{
+    static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+    static const uint64_t FNV_PRIME        = 1099511628211ull;
+
+    static void HashBytes(uint64_t& hash, const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * FNV_PRIME;
+        }
+    }
+
+    template <typename T>
+    static void HashValue(uint64_t& hash, T value)
+    {
+        HashBytes(hash, &value, sizeof(value));
+    }
+
+    PipelineBuilder::PipelineBuilder()
+    {
+        _instanceBinding  = { 0, 0, VK_VERTEX_INPUT_RATE_INSTANCE };
+        _topology         = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        _polygonMode      = VK_POLYGON_MODE_FILL;
+        _cullMode         = VK_CULL_MODE_BACK_BIT;
+        _frontFace        = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        _samples          = VK_SAMPLE_COUNT_1_BIT;
+        _sampleShading    = false;
+        _depthTest        = true;
+        _depthWrite       = true;
+        _depthCompareOp   = VK_COMPARE_OP_LESS;
+        _viewport         = { 0, 0 };
+        _layout           = VK_NULL_HANDLE;
+        _renderPass       = VK_NULL_HANDLE;
+        _subpass          = 0;
+        VkPipelineColorBlendAttachmentState opaque = {};
+        opaque.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        opaque.blendEnable    = VK_FALSE;
+        _colorAttachments     = { opaque };
+    }
+
+    PipelineBuilder& PipelineBuilder::Shader(VkShaderStageFlagBits stage, const void* code, size_t size, const char* entryPoint)
+    {
+        ShaderStage shader = { stage, vector<uint32_t>((size + 3) / 4, 0), entryPoint };
+        memcpy(shader.code.data(), code, size);
+        for (auto& s : _shaders) {
+            if (s.stage == stage) {
+                s = shader;
+                return *this;
+            }
+        }
+        _shaders.push_back(shader);
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::VertexInput(const VertexLayout& vertexLayout)
+    {
+        _bindings.clear();
+        for (uint32_t b = 0; b < vertexLayout.BindingCount(); b++) {
+            _bindings.push_back({ b, vertexLayout.BindingStride(b), VK_VERTEX_INPUT_RATE_VERTEX });
+        }
+        _attributes.clear();
+        for (uint32_t i = 0; i < vertexLayout.components.size(); i++) {
+            VkVertexInputAttributeDescription attribute = {};
+            attribute.location = i;
+            attribute.binding  = vertexLayout.Binding(i);
+            attribute.format   = vertexLayout.components[i] != VertexComponent::VERTEX_COMPONENT_UV ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R32G32_SFLOAT;
+            attribute.offset   = vertexLayout.offsets[i];
+            _attributes.push_back(attribute);
+        }
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::InstanceInput(uint32_t stride, uint32_t firstLocation, uint32_t vec4Count)
+    {
+        _instanceBinding.stride = stride;
+        _instanceAttributes.clear();
+        for (uint32_t i = 0; i < vec4Count; i++) {
+            VkVertexInputAttributeDescription attribute = {};
+            attribute.location = firstLocation + i;
+            // Set to the binding after the vertex ones when built.
+            attribute.binding  = 0;
+            attribute.format   = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attribute.offset   = i * 4 * sizeof(float);
+            _instanceAttributes.push_back(attribute);
+        }
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::Topology(VkPrimitiveTopology topology)
+    {
+        _topology = topology;
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::Rasterization(VkPolygonMode polygonMode, VkCullModeFlags cullMode, VkFrontFace frontFace)
+    {
+        _polygonMode = polygonMode;
+        _cullMode    = cullMode;
+        _frontFace   = frontFace;
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::Multisample(VkSampleCountFlagBits samples, bool sampleShading)
+    {
+        _samples       = samples;
+        _sampleShading = sampleShading && samples != VK_SAMPLE_COUNT_1_BIT;
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::Depth(bool test, bool write, VkCompareOp compareOp)
+    {
+        _depthTest      = test;
+        _depthWrite     = write;
+        _depthCompareOp = compareOp;
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::ColorAttachments(const vector<VkPipelineColorBlendAttachmentState>& attachments)
+    {
+        _colorAttachments = attachments;
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::Viewport(VkExtent2D extent)
+    {
+        _viewport = extent;
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::Layout(VkPipelineLayout layout)
+    {
+        _layout = layout;
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::RenderPass(VkRenderPass renderPass, uint32_t subpass)
+    {
+        _renderPass = renderPass;
+        _subpass    = subpass;
+        return *this;
+    }
+
+    uint64_t PipelineBuilder::Hash() const
+    {
+        // Field by field, so that padding never takes part.
+        uint64_t hash = FNV_OFFSET_BASIS;
+        for (const auto& s : _shaders) {
+            HashValue(hash, s.stage);
+            HashBytes(hash, s.code.data(), s.code.size() * sizeof(uint32_t));
+            HashBytes(hash, s.entryPoint.data(), s.entryPoint.size());
+        }
+        for (const auto& b : _bindings) {
+            HashValue(hash, b.stride);
+        }
+        for (const auto& a : _attributes) {
+            HashValue(hash, a.location);
+            HashValue(hash, a.binding);
+            HashValue(hash, a.format);
+            HashValue(hash, a.offset);
+        }
+        HashValue(hash, _instanceBinding.stride);
+        for (const auto& a : _instanceAttributes) {
+            HashValue(hash, a.location);
+            HashValue(hash, a.offset);
+        }
+        HashValue(hash, _topology);
+        HashValue(hash, _polygonMode);
+        HashValue(hash, _cullMode);
+        HashValue(hash, _frontFace);
+        HashValue(hash, _samples);
+        HashValue(hash, _sampleShading);
+        HashValue(hash, _depthTest);
+        HashValue(hash, _depthWrite);
+        HashValue(hash, _depthCompareOp);
+        for (const auto& c : _colorAttachments) {
+            HashValue(hash, c.blendEnable);
+            HashValue(hash, c.srcColorBlendFactor);
+            HashValue(hash, c.dstColorBlendFactor);
+            HashValue(hash, c.colorBlendOp);
+            HashValue(hash, c.srcAlphaBlendFactor);
+            HashValue(hash, c.dstAlphaBlendFactor);
+            HashValue(hash, c.alphaBlendOp);
+            HashValue(hash, c.colorWriteMask);
+        }
+        HashValue(hash, _viewport.width);
+        HashValue(hash, _viewport.height);
+        HashValue(hash, _layout);
+        HashValue(hash, _renderPass);
+        HashValue(hash, _subpass);
+        return hash;
+    }
+
+    bool PipelineBuilder::operator==(const PipelineBuilder& other) const
+    {
+        if (_shaders.size() != other._shaders.size() || _bindings.size() != other._bindings.size() || _attributes.size() != other._attributes.size() ||
+            _instanceAttributes.size() != other._instanceAttributes.size() || _colorAttachments.size() != other._colorAttachments.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < _shaders.size(); i++) {
+            const ShaderStage& a = _shaders[i];
+            const ShaderStage& b = other._shaders[i];
+            if (a.stage != b.stage || a.code != b.code || a.entryPoint != b.entryPoint) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < _bindings.size(); i++) {
+            if (_bindings[i].stride != other._bindings[i].stride) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < _attributes.size(); i++) {
+            const VkVertexInputAttributeDescription& a = _attributes[i];
+            const VkVertexInputAttributeDescription& b = other._attributes[i];
+            if (a.location != b.location || a.binding != b.binding || a.format != b.format || a.offset != b.offset) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < _instanceAttributes.size(); i++) {
+            if (_instanceAttributes[i].location != other._instanceAttributes[i].location ||
+                _instanceAttributes[i].offset != other._instanceAttributes[i].offset) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < _colorAttachments.size(); i++) {
+            const VkPipelineColorBlendAttachmentState& a = _colorAttachments[i];
+            const VkPipelineColorBlendAttachmentState& b = other._colorAttachments[i];
+            if (a.blendEnable != b.blendEnable || a.srcColorBlendFactor != b.srcColorBlendFactor ||
+                a.dstColorBlendFactor != b.dstColorBlendFactor || a.colorBlendOp != b.colorBlendOp ||
+                a.srcAlphaBlendFactor != b.srcAlphaBlendFactor || a.dstAlphaBlendFactor != b.dstAlphaBlendFactor ||
+                a.alphaBlendOp != b.alphaBlendOp || a.colorWriteMask != b.colorWriteMask) {
+                return false;
+            }
+        }
+        return _instanceBinding.stride == other._instanceBinding.stride &&
+               _topology == other._topology &&
+               _polygonMode == other._polygonMode &&
+               _cullMode == other._cullMode &&
+               _frontFace == other._frontFace &&
+               _samples == other._samples &&
+               _sampleShading == other._sampleShading &&
+               _depthTest == other._depthTest &&
+               _depthWrite == other._depthWrite &&
+               _depthCompareOp == other._depthCompareOp &&
+               _viewport.width == other._viewport.width &&
+               _viewport.height == other._viewport.height &&
+               _layout == other._layout &&
+               _renderPass == other._renderPass &&
+               _subpass == other._subpass;
+    }
+
+    VkPipeline PipelineBuilder::Build(const Device& device, const char* name) const
+    {
+        VkDevice d = device.LogicalDevice();
+        vector<VkShaderModule> modules;
+        vector<VkPipelineShaderStageCreateInfo> shaderStages;
+        for (const auto& s : _shaders) {
+            VkShaderModuleCreateInfo moduleInfo = {};
+            moduleInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+            moduleInfo.codeSize = s.code.size() * sizeof(uint32_t);
+            moduleInfo.pCode    = s.code.data();
+            VkShaderModule module;
+            VK_CHECK_RESULT(vkCreateShaderModule(d, &moduleInfo, nullptr, &module));
+            modules.push_back(module);
+            shaderStages.push_back(PipelineShaderStageCreateInfo(s.stage, modules.back(), s.entryPoint.c_str()));
+        }
+
+        vector<VkVertexInputBindingDescription> bindings;
+        if (!_attributes.empty()) {
+            bindings = _bindings;
+        }
+        vector<VkVertexInputAttributeDescription> attributes = _attributes;
+        if (!_instanceAttributes.empty()) {
+            VkVertexInputBindingDescription instanceBinding = _instanceBinding;
+            instanceBinding.binding = static_cast<uint32_t>(bindings.size());
+            bindings.push_back(instanceBinding);
+            for (auto attribute : _instanceAttributes) {
+                attribute.binding = instanceBinding.binding;
+                attributes.push_back(attribute);
+            }
+        }
+        VkPipelineVertexInputStateCreateInfo vertexInput = PipelineVertexInputStateCreateInfo(bindings.size(),
+                                                                                              bindings.data(),
+                                                                                              attributes.size(),
+                                                                                              attributes.data());
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+        inputAssembly.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology               = _topology;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        bool dynamicViewport = _viewport.width == 0 || _viewport.height == 0;
+        VkViewport viewport = ::Viewport(_viewport.width, _viewport.height);
+        VkRect2D scissor = { { 0, 0 }, _viewport };
+        VkPipelineViewportStateCreateInfo viewportState = dynamicViewport ? PipelineViewport(nullptr, nullptr)
+                                                                          : PipelineViewport(&viewport, &scissor);
+
+        VkPipelineRasterizationStateCreateInfo rasterization = ::Rasterization(_polygonMode, _cullMode, _frontFace);
+
+        VkPipelineMultisampleStateCreateInfo multisample = {};
+        multisample.sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisample.rasterizationSamples = _samples;
+        multisample.sampleShadingEnable  = _sampleShading ? VK_TRUE : VK_FALSE;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil = DepthStencil(_depthTest ? VK_TRUE : VK_FALSE,
+                                                                          _depthWrite ? VK_TRUE : VK_FALSE,
+                                                                          _depthCompareOp);
+
+        float blendConstants[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        VkPipelineColorBlendStateCreateInfo colorBlend = ColorBlend(VK_FALSE, VK_LOGIC_OP_NO_OP, _colorAttachments.size(), _colorAttachments.data(), blendConstants);
+
+        VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        VkPipelineDynamicStateCreateInfo dynamicState = {};
+        dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates    = dynamicStates;
+
+        GraphicsPipelineInfoParameters parameters = GraphicsPipelineInfoParameters();
+        parameters.pMultisampleState  = &multisample;
+        parameters.pDepthStencilState = &depthStencil;
+        parameters.pDynamicState      = dynamicViewport ? &dynamicState : nullptr;
+        parameters.subpass            = _subpass;
+        VkGraphicsPipelineCreateInfo graphicsPipeline = GraphicsPipelineCreateInfo(shaderStages.size(),
+                                                                                   shaderStages.data(),
+                                                                                   &vertexInput,
+                                                                                   &inputAssembly,
+                                                                                   &viewportState,
+                                                                                   &rasterization,
+                                                                                   &colorBlend,
+                                                                                   _layout,
+                                                                                   _renderPass,
+                                                                                   &parameters);
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        try {
+            pipeline = device.Pipelines().CreateGraphicsPipeline(graphicsPipeline, name);
+        } catch (...) {
+            for (auto& m : modules) {
+                vkDestroyShaderModule(d, m, nullptr), m = VK_NULL_HANDLE;
+            }
+            throw;
+        }
+        for (auto& m : modules) {
+            vkDestroyShaderModule(d, m, nullptr), m = VK_NULL_HANDLE;
+        }
+        return pipeline;
+    }
+}
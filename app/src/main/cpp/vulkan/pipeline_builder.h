@@ -0,0 +1,79 @@
+﻿#ifndef VULKAN_PIPELINE_BUILDER_H
+#define VULKAN_PIPELINE_BUILDER_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace Vulkan
+{
+    class Device;
+    struct VertexLayout;
+
+    // The complete state of a graphics pipeline as plain values, shaders included as SPIR-V, so that two builders
+    // describing the same pipeline compare equal and hash the same no matter where they were filled in. Defaults: one
+    // vertex and fragment stage entered at "main", triangle lists, filled back-face culling with counter-clockwise front
+    // faces, one sample, depth test and write with LESS, one opaque color attachment and dynamic viewport and scissor.
+    class PipelineBuilder {
+    public:
+        PipelineBuilder();
+
+        PipelineBuilder& Shader(VkShaderStageFlagBits stage, const void* code, size_t size, const char* entryPoint = "main");
+        // The layout's bindings, one interleaved one unless it says otherwise, and an attribute per component at its
+        // index; positions, normals, colors, tangents and bitangents are vec3, UVs vec2.
+        PipelineBuilder& VertexInput(const VertexLayout& vertexLayout);
+        // A binding after the vertex ones advanced per instance: vec4Count vec4 attributes from firstLocation on, stride
+        // apart. A stride of 0 gives every instance the first element.
+        PipelineBuilder& InstanceInput(uint32_t stride, uint32_t firstLocation, uint32_t vec4Count);
+        PipelineBuilder& Topology(VkPrimitiveTopology topology);
+        PipelineBuilder& Rasterization(VkPolygonMode polygonMode, VkCullModeFlags cullMode, VkFrontFace frontFace);
+        // Sample shading is enabled for every sample count above one unless told otherwise.
+        PipelineBuilder& Multisample(VkSampleCountFlagBits samples, bool sampleShading = true);
+        PipelineBuilder& Depth(bool test, bool write, VkCompareOp compareOp = VK_COMPARE_OP_LESS);
+        PipelineBuilder& ColorAttachments(const vector<VkPipelineColorBlendAttachmentState>& attachments);
+        // A static viewport and scissor covering extent; without it both are dynamic.
+        PipelineBuilder& Viewport(VkExtent2D extent);
+        PipelineBuilder& Layout(VkPipelineLayout layout);
+        PipelineBuilder& RenderPass(VkRenderPass renderPass, uint32_t subpass = 0);
+
+        uint64_t Hash() const;
+        bool operator==(const PipelineBuilder& other) const;
+
+        // Compiles through the device's pipeline cache. Thread safe: shader modules are created and destroyed here.
+        VkPipeline Build(const Device& device, const char* name) const;
+
+    private:
+        typedef struct ShaderStage {
+            VkShaderStageFlagBits stage;
+            vector<uint32_t>      code;
+            string                entryPoint;
+        } ShaderStage;
+
+        vector<ShaderStage>                         _shaders;
+        vector<VkVertexInputBindingDescription>     _bindings;
+        vector<VkVertexInputAttributeDescription>   _attributes;
+        VkVertexInputBindingDescription             _instanceBinding;
+        vector<VkVertexInputAttributeDescription>   _instanceAttributes;
+        VkPrimitiveTopology                         _topology;
+        VkPolygonMode                               _polygonMode;
+        VkCullModeFlags                             _cullMode;
+        VkFrontFace                                 _frontFace;
+        VkSampleCountFlagBits                       _samples;
+        bool                                        _sampleShading;
+        bool                                        _depthTest;
+        bool                                        _depthWrite;
+        VkCompareOp                                 _depthCompareOp;
+        vector<VkPipelineColorBlendAttachmentState> _colorAttachments;
+        VkExtent2D                                  _viewport;
+        VkPipelineLayout                            _layout;
+        VkRenderPass                                _renderPass;
+        uint32_t                                    _subpass;
+    };
+}
+
+#endif // VULKAN_PIPELINE_BUILDER_H
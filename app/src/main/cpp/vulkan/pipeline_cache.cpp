@@ -0,0 +1,215 @@
+﻿#include "pipeline_cache.h"
+#include "vulkan_utility.h"
+#include <cstdio>
+#include <cstring>
+
+using std::chrono::duration;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::mutex;
+
+namespace Vulkan
+{
+    static const uint32_t FILE_MAGIC   = 0x43504B56; // "VKPC"
+    static const uint32_t FILE_VERSION = 1;
+    // VkPipelineCacheHeaderVersionOne: header size, header version, vendor ID, device ID and the cache UUID.
+    static const size_t DRIVER_HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+    static uint32_t Checksum(const uint8_t* data, size_t size)
+    {
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    PipelineCache::PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties) : _device(device),
+                                                                                                   _properties(properties)
+    {
+        VkPipelineCacheCreateInfo cacheInfo = {};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        VK_CHECK_RESULT(vkCreatePipelineCache(_device, &cacheInfo, nullptr, &_cache));
+        _lastSaveTime = steady_clock::now();
+    }
+
+    PipelineCache::~PipelineCache()
+    {
+        DebugLog("~PipelineCache()");
+        LogStatistics();
+        Save();
+        vkDestroyPipelineCache(_device, _cache, nullptr), _cache = VK_NULL_HANDLE;
+    }
+
+    void PipelineCache::Open(const string& path)
+    {
+        _path = path;
+        vector<uint8_t> data;
+        if (!Read(data)) {
+            // Whatever is there is of no use; the next save replaces it.
+            std::remove(_path.c_str());
+            Log::Info("Pipeline cache: starting cold.");
+            return;
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo = {};
+        cacheInfo.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = data.size();
+        cacheInfo.pInitialData    = data.data();
+        VkPipelineCache loaded;
+        if (vkCreatePipelineCache(_device, &cacheInfo, nullptr, &loaded) != VK_SUCCESS) {
+            Log::Warn("Pipeline cache: the driver rejected %s, starting cold.", _path.c_str());
+            std::remove(_path.c_str());
+            return;
+        }
+        VkResult result = vkMergePipelineCaches(_device, _cache, 1, &loaded);
+        vkDestroyPipelineCache(_device, loaded, nullptr);
+        if (result != VK_SUCCESS) {
+            Log::Warn("Pipeline cache: merging %s failed, starting cold.", _path.c_str());
+            return;
+        }
+        lock_guard<mutex> lock(_mutex);
+        _loadedBytes = _savedBytes = data.size();
+        Log::Info("Pipeline cache: loaded %d bytes from %s.", (int)data.size(), _path.c_str());
+    }
+
+    bool PipelineCache::Read(vector<uint8_t>& data) const
+    {
+        FILE* file = fopen(_path.c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        FileHeader header = {};
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                     header.magic == FILE_MAGIC &&
+                     header.version == FILE_VERSION &&
+                     header.dataSize >= DRIVER_HEADER_SIZE &&
+                     header.dataSize < (64u << 20);
+        if (valid) {
+            data.resize(header.dataSize);
+            valid = fread(data.data(), 1, data.size(), file) == data.size() && fgetc(file) == EOF;
+        }
+        fclose(file);
+
+        if (!valid) {
+            Log::Warn("Pipeline cache: %s is truncated or not a pipeline cache.", _path.c_str());
+            return false;
+        }
+        if (Checksum(data.data(), data.size()) != header.checksum) {
+            Log::Warn("Pipeline cache: %s is corrupted.", _path.c_str());
+            return false;
+        }
+        if (!IsCompatible(data)) {
+            Log::Warn("Pipeline cache: %s was written by another device or driver.", _path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool PipelineCache::IsCompatible(const vector<uint8_t>& data) const
+    {
+        uint32_t fields[4];
+        memcpy(fields, data.data(), sizeof(fields));
+        uint32_t headerSize    = fields[0];
+        uint32_t headerVersion = fields[1];
+        uint32_t vendorID      = fields[2];
+        uint32_t deviceID      = fields[3];
+        return headerSize >= DRIVER_HEADER_SIZE && headerSize <= data.size() &&
+               headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               vendorID == _properties.vendorID &&
+               deviceID == _properties.deviceID &&
+               memcmp(data.data() + 16, _properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+
+    bool PipelineCache::Save()
+    {
+        lock_guard<mutex> lock(_mutex);
+        _lastSaveTime = steady_clock::now();
+        if (_path.empty()) {
+            return false;
+        }
+        size_t size = 0;
+        VK_CHECK_RESULT(vkGetPipelineCacheData(_device, _cache, &size, nullptr));
+        // Pipeline caches only grow, so an unchanged size means nothing new to save.
+        if (size == _savedBytes || size < DRIVER_HEADER_SIZE) {
+            return true;
+        }
+        vector<uint8_t> data(size);
+        VK_CHECK_RESULT(vkGetPipelineCacheData(_device, _cache, &size, data.data()));
+        data.resize(size);
+
+        FileHeader header = {};
+        header.magic    = FILE_MAGIC;
+        header.version  = FILE_VERSION;
+        header.dataSize = size;
+        header.checksum = Checksum(data.data(), size);
+
+        // Written next to the file and renamed over it, so being killed halfway leaves the old file intact.
+        string temporaryPath = _path + ".tmp";
+        FILE* file = fopen(temporaryPath.c_str(), "wb");
+        if (!file) {
+            Log::Warn("Pipeline cache: cannot write %s.", temporaryPath.c_str());
+            return false;
+        }
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data.data(), 1, size, file) == size;
+        written = fclose(file) == 0 && written;
+        if (!written || std::rename(temporaryPath.c_str(), _path.c_str()) != 0) {
+            Log::Warn("Pipeline cache: saving %s failed.", _path.c_str());
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+        _savedBytes = size;
+        Log::Info("Pipeline cache: saved %d bytes to %s.", (int)size, _path.c_str());
+        return true;
+    }
+
+    void PipelineCache::SaveIfDue(float intervalSeconds)
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            if (duration<float, seconds::period>(steady_clock::now() - _lastSaveTime).count() < intervalSeconds) {
+                return;
+            }
+        }
+        Save();
+    }
+
+    VkPipeline PipelineCache::CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, const char* name)
+    {
+        VkPipeline pipeline;
+        auto start = steady_clock::now();
+        VK_CHECK_RESULT(vkCreateGraphicsPipelines(_device, _cache, 1, &createInfo, nullptr, &pipeline));
+        double milliseconds = duration<double, std::milli>(steady_clock::now() - start).count();
+        {
+            lock_guard<mutex> lock(_mutex);
+            _pipelinesCreated++;
+            _creationMilliseconds += milliseconds;
+        }
+        Log::Info("Pipeline %s created in %.2f ms with a %s cache.", name, milliseconds, Warm() ? "warm" : "cold");
+        return pipeline;
+    }
+
+    VkPipeline PipelineCache::CreateComputePipeline(const VkComputePipelineCreateInfo& createInfo, const char* name)
+    {
+        VkPipeline pipeline;
+        auto start = steady_clock::now();
+        VK_CHECK_RESULT(vkCreateComputePipelines(_device, _cache, 1, &createInfo, nullptr, &pipeline));
+        double milliseconds = duration<double, std::milli>(steady_clock::now() - start).count();
+        {
+            lock_guard<mutex> lock(_mutex);
+            _pipelinesCreated++;
+            _creationMilliseconds += milliseconds;
+        }
+        Log::Info("Pipeline %s created in %.2f ms with a %s cache.", name, milliseconds, Warm() ? "warm" : "cold");
+        return pipeline;
+    }
+
+    void PipelineCache::LogStatistics()
+    {
+        lock_guard<mutex> lock(_mutex);
+        Log::Info("Pipeline cache: %d pipelines created in %.2f ms with a %s cache of %d bytes.",
+                  _pipelinesCreated, _creationMilliseconds, _loadedBytes > 0 ? "warm" : "cold", (int)_loadedBytes);
+    }
+}
@@ -0,0 +1,68 @@
+﻿#ifndef VULKAN_PIPELINE_CACHE_H
+#define VULKAN_PIPELINE_CACHE_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace Vulkan
+{
+    // The device's VkPipelineCache, kept on disk between launches. The file wraps the driver's cache data in a small
+    // header with its size and checksum; a file that is truncated, corrupted or written by another driver, device or
+    // driver version is discarded and the cache starts out empty.
+    //
+    // Saving is skipped while the cache has not grown since the last save, so it is cheap to call often.
+    class PipelineCache {
+    public:
+        PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties);
+        // Saves to the opened file.
+        ~PipelineCache();
+
+        // Merges what an earlier launch saved at path into the cache and makes path the file to save to.
+        void Open(const string& path);
+        bool Save();
+        void SaveIfDue(float intervalSeconds = 30.0f);
+
+        VkPipelineCache Handle() const { return _cache; }
+        // Whether the cache started out with data from disk.
+        bool Warm() const { return _loadedBytes > 0; }
+
+        // Creates the pipeline through the cache and logs how long it took.
+        VkPipeline CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, const char* name);
+        VkPipeline CreateComputePipeline(const VkComputePipelineCreateInfo& createInfo, const char* name);
+        void LogStatistics();
+
+    private:
+        typedef struct FileHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t dataSize;
+            uint32_t checksum;
+            uint32_t reserved;
+        } FileHeader;
+
+        bool Read(vector<uint8_t>& data) const;
+        bool IsCompatible(const vector<uint8_t>& data) const;
+
+        VkDevice                   _device;
+        VkPhysicalDeviceProperties _properties;
+        VkPipelineCache            _cache = VK_NULL_HANDLE;
+        string                     _path;
+
+        std::mutex _mutex;
+        size_t     _loadedBytes = 0;
+        size_t     _savedBytes  = 0;
+        uint32_t   _pipelinesCreated = 0;
+        double     _creationMilliseconds = 0.0;
+        std::chrono::steady_clock::time_point _lastSaveTime;
+    };
+}
+
+#endif // VULKAN_PIPELINE_CACHE_H
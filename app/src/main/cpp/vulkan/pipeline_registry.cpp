@@ -0,0 +1,181 @@
+﻿#include "pipeline_registry.h"
+#include "vulkan_utility.h"
+#include <algorithm>
+
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+namespace Vulkan
+{
+    const PipelineRegistry::PipelineId PipelineRegistry::INVALID_ID;
+
+    PipelineRegistry::PipelineRegistry(const Device& device, uint32_t threadCount) : _device(device)
+    {
+        for (uint32_t i = 0; i < std::max(threadCount, 1u); i++) {
+            _workers.emplace_back(&PipelineRegistry::WorkerLoop, this);
+        }
+    }
+
+    PipelineRegistry::~PipelineRegistry()
+    {
+        DebugLog("~PipelineRegistry()");
+        {
+            lock_guard<mutex> lock(_mutex);
+            _stop = true;
+            _queue.clear();
+        }
+        _workAvailable.notify_all();
+        for (auto& w : _workers) {
+            w.join();
+        }
+        VkDevice d = _device.LogicalDevice();
+        for (auto& e : _entries) {
+            if (e.pipeline) {
+                vkDestroyPipeline(d, e.pipeline, nullptr), e.pipeline = VK_NULL_HANDLE;
+            }
+        }
+        Log::Info("Pipeline registry: %d requested, %d deduplicated, %d compiled.",
+                  _statistics.requested, _statistics.deduplicated, _statistics.compiled);
+    }
+
+    PipelineRegistry::PipelineId PipelineRegistry::Request(const PipelineBuilder& builder, const string& name)
+    {
+        uint64_t hash = builder.Hash();
+        lock_guard<mutex> lock(_mutex);
+        _statistics.requested++;
+        auto range = _byHash.equal_range(hash);
+        for (auto it = range.first; it != range.second; it++) {
+            Entry& e = _entries[it->second];
+            if (e.builder == builder) {
+                e.references++;
+                _statistics.deduplicated++;
+                return it->second;
+            }
+        }
+
+        PipelineId id;
+        if (!_freeEntries.empty()) {
+            id = _freeEntries.back();
+            _freeEntries.pop_back();
+        } else {
+            id = static_cast<PipelineId>(_entries.size());
+            _entries.emplace_back();
+        }
+        Entry& e = _entries[id];
+        e.builder    = builder;
+        e.hash       = hash;
+        e.name       = name;
+        e.pipeline   = VK_NULL_HANDLE;
+        e.references = 1;
+        e.pending    = true;
+        e.failed     = false;
+        _byHash.insert({ hash, id });
+        _pending++;
+        _queue.push_back(id);
+        _workAvailable.notify_one();
+        return id;
+    }
+
+    void PipelineRegistry::Free(PipelineId id)
+    {
+        Entry& e = _entries[id];
+        if (e.pipeline) {
+            vkDestroyPipeline(_device.LogicalDevice(), e.pipeline, nullptr), e.pipeline = VK_NULL_HANDLE;
+        }
+        auto range = _byHash.equal_range(e.hash);
+        for (auto it = range.first; it != range.second; it++) {
+            if (it->second == id) {
+                _byHash.erase(it);
+                break;
+            }
+        }
+        e.builder = PipelineBuilder();
+        _freeEntries.push_back(id);
+    }
+
+    void PipelineRegistry::Release(PipelineId id)
+    {
+        if (id == INVALID_ID) {
+            return;
+        }
+        lock_guard<mutex> lock(_mutex);
+        Entry& e = _entries[id];
+        assert(e.references > 0);
+        if (--e.references == 0 && !e.pending) {
+            Free(id);
+        }
+    }
+
+    bool PipelineRegistry::IsReady(PipelineId id)
+    {
+        lock_guard<mutex> lock(_mutex);
+        return !_entries[id].pending && !_entries[id].failed;
+    }
+
+    VkPipeline PipelineRegistry::Get(PipelineId id)
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _entries[id].pending ? VK_NULL_HANDLE : _entries[id].pipeline;
+    }
+
+    VkPipeline PipelineRegistry::Wait(PipelineId id)
+    {
+        unique_lock<mutex> lock(_mutex);
+        _compiled.wait(lock, [this, id]() { return !_entries[id].pending; });
+        if (_entries[id].failed) {
+            throw runtime_error("Pipeline " + _entries[id].name + " failed to compile.");
+        }
+        return _entries[id].pipeline;
+    }
+
+    void PipelineRegistry::WaitIdle()
+    {
+        unique_lock<mutex> lock(_mutex);
+        _compiled.wait(lock, [this]() { return _pending == 0; });
+    }
+
+    PipelineRegistry::Statistics PipelineRegistry::Stats()
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _statistics;
+    }
+
+    void PipelineRegistry::WorkerLoop()
+    {
+        unique_lock<mutex> lock(_mutex);
+        while (true) {
+            _workAvailable.wait(lock, [this]() { return _stop || !_queue.empty(); });
+            if (_stop) {
+                return;
+            }
+            PipelineId id = _queue.front();
+            _queue.pop_front();
+            Entry& e = _entries[id];
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            bool failed = false;
+            if (e.references > 0) {
+                // Nothing else touches a pending entry, so it is read without the lock.
+                lock.unlock();
+                try {
+                    pipeline = e.builder.Build(_device, e.name.c_str());
+                } catch (const std::exception& exception) {
+                    Log::Error("Pipeline %s: %s", e.name.c_str(), exception.what());
+                    failed = true;
+                }
+                lock.lock();
+            }
+            e.pipeline = pipeline;
+            e.pending  = false;
+            e.failed   = failed;
+            _pending--;
+            if (pipeline) {
+                _statistics.compiled++;
+            }
+            if (e.references == 0) {
+                Free(id);
+            }
+            _compiled.notify_all();
+        }
+    }
+}
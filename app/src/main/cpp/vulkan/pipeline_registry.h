@@ -0,0 +1,82 @@
+﻿#ifndef VULKAN_PIPELINE_REGISTRY_H
+#define VULKAN_PIPELINE_REGISTRY_H
+
+#include "pipeline_builder.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+using std::deque;
+using std::unordered_multimap;
+
+namespace Vulkan
+{
+    // Owns graphics pipelines by state. Requesting a state that is already registered returns the same pipeline with
+    // one more reference; anything new is compiled on the registry's worker threads, so requests return immediately
+    // and several pipelines compile side by side. Get() never blocks and returns VK_NULL_HANDLE until the pipeline is
+    // ready; Wait() blocks until then. Thread safe.
+    class PipelineRegistry {
+    public:
+        typedef uint32_t PipelineId;
+        static const PipelineId INVALID_ID = UINT32_MAX;
+
+        typedef struct Statistics {
+            uint32_t requested;
+            uint32_t deduplicated;
+            uint32_t compiled;
+        } Statistics;
+
+        explicit PipelineRegistry(const Device& device, uint32_t threadCount = 2);
+        // Waits for compilations in flight and destroys every pipeline.
+        ~PipelineRegistry();
+
+        PipelineRegistry(const PipelineRegistry&) = delete;
+        PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+        PipelineId Request(const PipelineBuilder& builder, const string& name);
+        // The pipeline is destroyed with its last reference, after its compilation if that is still running. The
+        // caller makes sure no pending command buffer uses it.
+        void Release(PipelineId id);
+
+        bool IsReady(PipelineId id);
+        VkPipeline Get(PipelineId id);
+        // Throws if compilation failed.
+        VkPipeline Wait(PipelineId id);
+        // Waits for every compilation in flight, e.g. before destroying render passes or layouts they use.
+        void WaitIdle();
+
+        Statistics Stats();
+
+    private:
+        typedef struct Entry {
+            PipelineBuilder builder;
+            uint64_t        hash;
+            string          name;
+            VkPipeline      pipeline;
+            uint32_t        references;
+            bool            pending;
+            bool            failed;
+        } Entry;
+
+        void WorkerLoop();
+        void Free(PipelineId id);
+
+        const Device& _device;
+
+        std::mutex                              _mutex;
+        std::condition_variable                 _workAvailable;
+        std::condition_variable                 _compiled;
+        deque<Entry>                            _entries;
+        vector<PipelineId>                      _freeEntries;
+        unordered_multimap<uint64_t, PipelineId> _byHash;
+        deque<PipelineId>                       _queue;
+        vector<std::thread>                     _workers;
+        uint32_t                                _pending    = 0;
+        Statistics                              _statistics = {};
+        bool                                    _stop       = false;
+    };
+}
+
+#endif // VULKAN_PIPELINE_REGISTRY_H
@@ -0,0 +1,977 @@
+﻿#include "render_graph.h"
+#include "vulkan_utility.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace Vulkan
+{
+    const uint32_t RenderGraph::NOT_FOUND;
+
+    static const VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                              VK_ACCESS_TRANSFER_WRITE_BIT |
+                                              VK_ACCESS_SHADER_WRITE_BIT;
+
+    typedef struct UsageState {
+        VkPipelineStageFlags stages;
+        VkAccessFlags        access;
+        VkImageLayout        layout;
+    } UsageState;
+
+    static UsageState StateOf(ResourceUsage usage)
+    {
+        switch (usage) {
+            case RESOURCE_USAGE_COLOR_ATTACHMENT:
+                return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+            case RESOURCE_USAGE_DEPTH_ATTACHMENT:
+                return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+            case RESOURCE_USAGE_DEPTH_READ_ONLY:
+                return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+            case RESOURCE_USAGE_RESOLVE_ATTACHMENT:
+                return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+            case RESOURCE_USAGE_INPUT_ATTACHMENT:
+                return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+            case RESOURCE_USAGE_SAMPLED:
+                return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_ACCESS_SHADER_READ_BIT,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+            case RESOURCE_USAGE_TRANSFER_SRC:
+                return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+            case RESOURCE_USAGE_TRANSFER_DST:
+                return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+        }
+        return { 0, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+    }
+
+    static bool IsAttachmentUsage(ResourceUsage usage)
+    {
+        return usage == RESOURCE_USAGE_COLOR_ATTACHMENT ||
+               usage == RESOURCE_USAGE_DEPTH_ATTACHMENT ||
+               usage == RESOURCE_USAGE_DEPTH_READ_ONLY ||
+               usage == RESOURCE_USAGE_RESOLVE_ATTACHMENT ||
+               usage == RESOURCE_USAGE_INPUT_ATTACHMENT;
+    }
+
+    static bool SameImageInfo(const RenderGraph::ImageInfo& a, const RenderGraph::ImageInfo& b)
+    {
+        return a.format == b.format && a.extent.width == b.extent.width && a.extent.height == b.extent.height &&
+               a.usage == b.usage && a.samples == b.samples && a.aspect == b.aspect && a.arrayLayers == b.arrayLayers;
+    }
+
+    // Bytes per texel of the formats render targets use; others count as four.
+    static uint32_t TexelSize(VkFormat format)
+    {
+        switch (format) {
+            case VK_FORMAT_R8_UNORM:
+            case VK_FORMAT_S8_UINT:
+                return 1;
+            case VK_FORMAT_D16_UNORM:
+            case VK_FORMAT_R16_SFLOAT:
+                return 2;
+            case VK_FORMAT_D16_UNORM_S8_UINT:
+                return 3;
+            case VK_FORMAT_D32_SFLOAT_S8_UINT:
+                return 5;
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+            case VK_FORMAT_R32G32_SFLOAT:
+                return 8;
+            case VK_FORMAT_R32G32B32A32_SFLOAT:
+                return 16;
+            default:
+                return 4;
+        }
+    }
+
+    static uint64_t ImageSize(const RenderGraph::ImageInfo& info)
+    {
+        return static_cast<uint64_t>(info.extent.width) * info.extent.height * info.arrayLayers * info.samples * TexelSize(info.format);
+    }
+
+    static const char* LayoutName(VkImageLayout layout)
+    {
+        switch (layout) {
+            case VK_IMAGE_LAYOUT_UNDEFINED:                        return "UNDEFINED";
+            case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:         return "COLOR_ATTACHMENT";
+            case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return "DEPTH_STENCIL_ATTACHMENT";
+            case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:  return "DEPTH_STENCIL_READ_ONLY";
+            case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:         return "SHADER_READ_ONLY";
+            case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:             return "TRANSFER_SRC";
+            case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:             return "TRANSFER_DST";
+            case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:                  return "PRESENT_SRC";
+            default:                                               return "OTHER";
+        }
+    }
+
+    // ==== Declaration ==== //
+    uint32_t RenderGraph::CreateTransient(const string& name, const ImageInfo& info)
+    {
+        Resource resource = { name, info, false, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED, 0 };
+        _resources.push_back(resource);
+        return static_cast<uint32_t>(_resources.size() - 1);
+    }
+
+    uint32_t RenderGraph::Import(const string& name,
+                                 const ImageInfo& info,
+                                 VkImageLayout initialLayout,
+                                 VkImageLayout finalLayout,
+                                 VkPipelineStageFlags initialStageMask)
+    {
+        Resource resource = { name, info, true, initialLayout, finalLayout, initialStageMask };
+        _resources.push_back(resource);
+        return static_cast<uint32_t>(_resources.size() - 1);
+    }
+
+    uint32_t RenderGraph::AddPass(const string& name, RecordPass record)
+    {
+        Pass pass = { name, record, {}, false };
+        _passes.push_back(pass);
+        return static_cast<uint32_t>(_passes.size() - 1);
+    }
+
+    void RenderGraph::Read(uint32_t pass, uint32_t resource, ResourceUsage usage)
+    {
+        if (usage == RESOURCE_USAGE_COLOR_ATTACHMENT || usage == RESOURCE_USAGE_DEPTH_ATTACHMENT ||
+            usage == RESOURCE_USAGE_RESOLVE_ATTACHMENT || usage == RESOURCE_USAGE_TRANSFER_DST) {
+            throw runtime_error("Render graph: " + _passes[pass].name + " reads " + _resources[resource].name + " with a write usage.");
+        }
+        _passes[pass].accesses.push_back({ resource, usage, false, false });
+    }
+
+    void RenderGraph::Write(uint32_t pass, uint32_t resource, ResourceUsage usage, bool preserveContents)
+    {
+        if (usage == RESOURCE_USAGE_DEPTH_READ_ONLY || usage == RESOURCE_USAGE_INPUT_ATTACHMENT ||
+            usage == RESOURCE_USAGE_SAMPLED || usage == RESOURCE_USAGE_TRANSFER_SRC) {
+            throw runtime_error("Render graph: " + _passes[pass].name + " writes " + _resources[resource].name + " with a read usage.");
+        }
+        _passes[pass].accesses.push_back({ resource, usage, true, preserveContents });
+    }
+
+    void RenderGraph::SetSideEffects(uint32_t pass)
+    {
+        _passes[pass].sideEffects = true;
+    }
+
+    uint32_t RenderGraph::FindResource(const string& name) const
+    {
+        for (uint32_t i = 0; i < _resources.size(); i++) {
+            if (_resources[i].name == name) {
+                return i;
+            }
+        }
+        return NOT_FOUND;
+    }
+
+    uint32_t RenderGraph::FindPass(const string& name) const
+    {
+        for (uint32_t i = 0; i < _passes.size(); i++) {
+            if (_passes[i].name == name) {
+                return i;
+            }
+        }
+        return NOT_FOUND;
+    }
+
+    bool RenderGraph::IsCulled(uint32_t pass) const
+    {
+        return std::find(_plan.culledPasses.begin(), _plan.culledPasses.end(), pass) != _plan.culledPasses.end();
+    }
+
+    // ==== Compile ==== //
+    void RenderGraph::Compile()
+    {
+        _plan = Plan();
+        _plan.aliasSlots.assign(_resources.size(), RenderTargetPool::NO_ALIAS);
+        _plan.aliasSlotCount = 0;
+        _attachments.assign(_resources.size(), NOT_FOUND);
+
+        vector<bool> written(_resources.size(), false);
+        for (uint32_t i = 0; i < _resources.size(); i++) {
+            written[i] = _resources[i].imported;
+        }
+        for (const auto& p : _passes) {
+            for (const auto& a : p.accesses) {
+                if ((!a.write || a.preserveContents) && !written[a.resource]) {
+                    throw runtime_error("Render graph: " + p.name + " reads " + _resources[a.resource].name + " before anything writes it.");
+                }
+            }
+            for (const auto& a : p.accesses) {
+                written[a.resource] = written[a.resource] || a.write;
+            }
+        }
+
+        vector<bool> alive;
+        Cull(alive);
+        vector<uint32_t> order;
+        for (uint32_t i = 0; i < _passes.size(); i++) {
+            if (alive[i]) {
+                order.push_back(i);
+            }
+        }
+        BuildGroups(order);
+        AssignAliasSlots(order);
+        PlanBarriers();
+    }
+
+    void RenderGraph::Cull(vector<bool>& alive)
+    {
+        // Walk backwards from the outputs. A pass survives if it has side effects or writes something still needed;
+        // a plain write satisfies the need, a read or a preserving write passes it on to earlier passes.
+        vector<bool> needed(_resources.size(), false);
+        for (uint32_t i = 0; i < _resources.size(); i++) {
+            needed[i] = _resources[i].imported && _resources[i].finalLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+        alive.assign(_passes.size(), false);
+        for (int i = static_cast<int>(_passes.size()) - 1; i >= 0; i--) {
+            const Pass& p = _passes[i];
+            bool keep = p.sideEffects;
+            for (const auto& a : p.accesses) {
+                keep = keep || (a.write && needed[a.resource]);
+            }
+            if (!keep) {
+                _plan.culledPasses.insert(_plan.culledPasses.begin(), i);
+                continue;
+            }
+            alive[i] = true;
+            for (const auto& a : p.accesses) {
+                if (a.write && !a.preserveContents) {
+                    needed[a.resource] = false;
+                }
+            }
+            for (const auto& a : p.accesses) {
+                if (!a.write || a.preserveContents) {
+                    needed[a.resource] = true;
+                }
+            }
+        }
+    }
+
+    bool RenderGraph::HasAttachments(const Pass& pass) const
+    {
+        for (const auto& a : pass.accesses) {
+            if (IsAttachmentUsage(a.usage)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool RenderGraph::CanMerge(const vector<uint32_t>& group, uint32_t pass) const
+    {
+        const Pass& next  = _passes[pass];
+        const Pass& first = _passes[group[0]];
+        if (!HasAttachments(first) || !HasAttachments(next)) {
+            return false;
+        }
+
+        const ImageInfo* area = nullptr;
+        for (const auto& a : first.accesses) {
+            if (IsAttachmentUsage(a.usage)) {
+                area = &_resources[a.resource].info;
+                break;
+            }
+        }
+
+        // Subpasses share the render area, and anything passed between them has to stay an attachment: sampling or
+        // copying what the group wrote needs the render pass to end first.
+        bool shares = false;
+        for (const auto& a : next.accesses) {
+            if (a.usage == RESOURCE_USAGE_TRANSFER_SRC || a.usage == RESOURCE_USAGE_TRANSFER_DST) {
+                return false;
+            }
+            const ImageInfo& info = _resources[a.resource].info;
+            if (IsAttachmentUsage(a.usage) &&
+                (info.extent.width != area->extent.width || info.extent.height != area->extent.height)) {
+                return false;
+            }
+            for (uint32_t g : group) {
+                for (const auto& b : _passes[g].accesses) {
+                    if (b.resource != a.resource) {
+                        continue;
+                    }
+                    if (!IsAttachmentUsage(a.usage) || !IsAttachmentUsage(b.usage)) {
+                        return false;
+                    }
+                    shares = true;
+                }
+            }
+        }
+        return shares;
+    }
+
+    void RenderGraph::BuildGroups(const vector<uint32_t>& order)
+    {
+        vector<uint32_t> current;
+        for (uint32_t i = 0; i < order.size(); i++) {
+            uint32_t p = order[i];
+            if (current.empty() || !CanMerge(current, p)) {
+                Group group = { i, 0, {} };
+                _plan.groups.push_back(group);
+                current.clear();
+            }
+            current.push_back(p);
+            Group& group = _plan.groups.back();
+            CompiledPass compiled = { p, static_cast<uint32_t>(_plan.groups.size() - 1), group.passCount, {} };
+            _plan.passes.push_back(compiled);
+            group.passCount++;
+        }
+    }
+
+    void RenderGraph::AssignAliasSlots(const vector<uint32_t>& order)
+    {
+        vector<uint32_t> firstUse(_resources.size(), NOT_FOUND);
+        vector<uint32_t> lastUse(_resources.size(), NOT_FOUND);
+        for (uint32_t i = 0; i < order.size(); i++) {
+            for (const auto& a : _passes[order[i]].accesses) {
+                if (firstUse[a.resource] == NOT_FOUND) {
+                    firstUse[a.resource] = i;
+                }
+                lastUse[a.resource] = i;
+            }
+        }
+
+        vector<uint32_t> transients;
+        for (uint32_t r = 0; r < _resources.size(); r++) {
+            if (!_resources[r].imported && firstUse[r] != NOT_FOUND) {
+                transients.push_back(r);
+            }
+        }
+        std::stable_sort(transients.begin(), transients.end(), [&firstUse](uint32_t a, uint32_t b) {
+            return firstUse[a] < firstUse[b];
+        });
+
+        // Greedy interval assignment: a slot is reused by the next identical image whose lifetime starts after the
+        // slot's current lifetime ended.
+        vector<uint32_t> slotResource;
+        vector<uint32_t> slotEnd;
+        for (uint32_t r : transients) {
+            uint32_t slot = NOT_FOUND;
+            for (uint32_t s = 0; s < slotResource.size(); s++) {
+                if (slotEnd[s] < firstUse[r] && SameImageInfo(_resources[slotResource[s]].info, _resources[r].info)) {
+                    slot = s;
+                    break;
+                }
+            }
+            if (slot == NOT_FOUND) {
+                slot = static_cast<uint32_t>(slotResource.size());
+                slotResource.push_back(r);
+                slotEnd.push_back(0);
+            }
+            slotResource[slot]    = r;
+            slotEnd[slot]         = lastUse[r];
+            _plan.aliasSlots[r]   = slot;
+        }
+        _plan.aliasSlotCount = static_cast<uint32_t>(slotResource.size());
+    }
+
+    void RenderGraph::PlanBarriers()
+    {
+        typedef struct State {
+            VkImageLayout        layout;
+            VkPipelineStageFlags writeStages;
+            VkAccessFlags        writeAccess;
+            VkPipelineStageFlags readStages;
+            VkPipelineStageFlags visibleStages;
+            VkAccessFlags        visibleAccess;
+            uint32_t             lastPosition;
+            bool                 used;
+        } State;
+
+        vector<State> states(_resources.size());
+        for (uint32_t r = 0; r < _resources.size(); r++) {
+            const Resource& resource = _resources[r];
+            State& st = states[r];
+            st = {};
+            st.layout       = resource.initialLayout;
+            st.writeStages  = resource.imported && resource.initialStageMask != VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT ? resource.initialStageMask : 0;
+            st.lastPosition = NOT_FOUND;
+        }
+        vector<uint32_t> slotOccupant(_plan.aliasSlotCount, NOT_FOUND);
+
+        for (uint32_t i = 0; i < _plan.passes.size(); i++) {
+            CompiledPass& compiled = _plan.passes[i];
+            Group& group = _plan.groups[compiled.group];
+            bool renderPass = HasAttachments(_passes[_plan.passes[group.firstPass].pass]);
+            const Pass& pass = _passes[compiled.pass];
+
+            // Several accesses of one image within a pass are combined into a single use.
+            vector<Access> uses;
+            for (const auto& a : pass.accesses) {
+                auto it = std::find_if(uses.begin(), uses.end(), [&a](const Access& u) { return u.resource == a.resource; });
+                if (it == uses.end()) {
+                    uses.push_back(a);
+                    continue;
+                }
+                if (StateOf(it->usage).layout != StateOf(a.usage).layout) {
+                    throw runtime_error("Render graph: " + pass.name + " uses " + _resources[a.resource].name + " in two layouts.");
+                }
+                // A combined write only discards the old contents if none of its parts needs them.
+                bool needsContents   = !it->write || it->preserveContents || !a.write || a.preserveContents;
+                it->write            = it->write || a.write;
+                it->preserveContents = needsContents;
+            }
+
+            for (const auto& u : uses) {
+                uint32_t r = u.resource;
+                State& st = states[r];
+                UsageState us = StateOf(u.usage);
+                for (const auto& a : pass.accesses) {
+                    if (a.resource == r) {
+                        us.stages |= StateOf(a.usage).stages;
+                        us.access |= StateOf(a.usage).access;
+                    }
+                }
+                bool discard      = u.write && !u.preserveContents;
+                bool layoutChange = st.layout != us.layout;
+
+                VkPipelineStageFlags srcStages = 0;
+                VkAccessFlags        srcAccess = 0;
+                bool                 need      = false;
+                if (layoutChange || u.write) {
+                    srcStages = st.writeStages | st.readStages;
+                    srcAccess = st.writeAccess;
+                    need      = layoutChange || srcStages != 0;
+                } else if (st.writeStages && ((us.stages & ~st.visibleStages) || (us.access & ~st.visibleAccess))) {
+                    srcStages = st.writeStages;
+                    srcAccess = st.writeAccess;
+                    need      = true;
+                }
+
+                bool alias = false;
+                uint32_t slot = _plan.aliasSlots[r];
+                if (!st.used && slot != RenderTargetPool::NO_ALIAS) {
+                    uint32_t previous = slotOccupant[slot];
+                    if (previous != NOT_FOUND) {
+                        srcStages |= states[previous].writeStages | states[previous].readStages;
+                        srcAccess |= states[previous].writeAccess;
+                        alias = true;
+                        need  = true;
+                    }
+                    slotOccupant[slot] = r;
+                }
+
+                bool attachment = renderPass && IsAttachmentUsage(u.usage);
+                bool inGroup    = st.used && st.lastPosition >= group.firstPass;
+                if (need) {
+                    Barrier barrier = {};
+                    barrier.resource          = r;
+                    barrier.srcStageMask      = srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                    barrier.dstStageMask      = us.stages;
+                    barrier.srcAccessMask     = srcAccess;
+                    barrier.dstAccessMask     = us.access;
+                    barrier.oldLayout         = discard ? VK_IMAGE_LAYOUT_UNDEFINED : st.layout;
+                    barrier.newLayout         = us.layout;
+                    // The render pass performs the transitions of its attachments, so everything around them turns
+                    // into subpass dependencies, external ones for what happened before the group.
+                    barrier.subpassDependency = attachment;
+                    barrier.srcSubpass        = inGroup ? _plan.passes[st.lastPosition].subpass : VK_SUBPASS_EXTERNAL;
+                    barrier.alias             = alias;
+                    // Nothing to wait for and nothing to keep: the render pass starts from UNDEFINED on its own.
+                    bool redundant = attachment && !inGroup && barrier.oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && srcStages == 0;
+                    if (!redundant) {
+                        compiled.barriers.push_back(barrier);
+                    }
+                }
+
+                if (attachment) {
+                    auto it = std::find_if(group.attachments.begin(), group.attachments.end(),
+                                           [r](const GroupAttachment& ga) { return ga.resource == r; });
+                    if (it == group.attachments.end()) {
+                        GroupAttachment ga = {};
+                        ga.resource      = r;
+                        ga.loadOp        = u.usage == RESOURCE_USAGE_RESOLVE_ATTACHMENT ? VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                                           : discard ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+                        ga.storeOp       = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                        ga.initialLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : st.layout;
+                        group.attachments.push_back(ga);
+                        it = group.attachments.end() - 1;
+                    }
+                    it->finalLayout = us.layout;
+                }
+
+                if (u.write) {
+                    st.writeStages   = us.stages;
+                    st.writeAccess   = us.access & WRITE_ACCESS;
+                    st.readStages    = 0;
+                    st.visibleStages = us.stages;
+                    st.visibleAccess = us.access;
+                } else if (layoutChange) {
+                    // A layout transition is a write that completes before this use.
+                    st.writeStages   = us.stages;
+                    st.writeAccess   = 0;
+                    st.readStages    = 0;
+                    st.visibleStages = us.stages;
+                    st.visibleAccess = us.access;
+                } else {
+                    st.readStages |= us.stages;
+                    if (need) {
+                        st.visibleStages |= us.stages;
+                        st.visibleAccess |= us.access;
+                    }
+                }
+                st.layout       = us.layout;
+                st.used         = true;
+                st.lastPosition = i;
+            }
+        }
+
+        // Attachments are only stored when used after their render pass or handed out of the frame.
+        for (auto& group : _plan.groups) {
+            uint32_t groupEnd = group.firstPass + group.passCount;
+            for (auto& ga : group.attachments) {
+                const Resource& resource = _resources[ga.resource];
+                bool output = resource.imported && resource.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+                if (output || states[ga.resource].lastPosition >= groupEnd) {
+                    ga.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+                }
+            }
+        }
+
+        // Outputs end up in their final layout, through the last render pass using them when possible.
+        for (uint32_t r = 0; r < _resources.size(); r++) {
+            const Resource& resource = _resources[r];
+            const State& st = states[r];
+            if (!resource.imported || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || st.layout == resource.finalLayout) {
+                continue;
+            }
+            if (st.used) {
+                Group& group = _plan.groups[_plan.passes[st.lastPosition].group];
+                auto it = std::find_if(group.attachments.begin(), group.attachments.end(),
+                                       [r](const GroupAttachment& ga) { return ga.resource == r; });
+                if (it != group.attachments.end()) {
+                    it->finalLayout = resource.finalLayout;
+                    continue;
+                }
+            }
+            Barrier barrier = {};
+            barrier.resource      = r;
+            barrier.srcStageMask  = (st.writeStages | st.readStages) ? (st.writeStages | st.readStages) : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            barrier.dstStageMask  = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+            barrier.srcAccessMask = st.writeAccess;
+            barrier.dstAccessMask = 0;
+            barrier.oldLayout     = st.layout;
+            barrier.newLayout     = resource.finalLayout;
+            barrier.srcSubpass    = VK_SUBPASS_EXTERNAL;
+            _plan.finalBarriers.push_back(barrier);
+        }
+    }
+
+    // ==== Inspection ==== //
+    string RenderGraph::Describe() const
+    {
+        char line[512];
+        string text;
+        snprintf(line, sizeof(line), "Render graph: %d passes in %d render passes, %d culled, %d alias slots.\n",
+                 (int)_plan.passes.size(), (int)_plan.groups.size(), (int)_plan.culledPasses.size(), _plan.aliasSlotCount);
+        text += line;
+        for (uint32_t p : _plan.culledPasses) {
+            text += "  culled " + _passes[p].name + "\n";
+        }
+        auto describeBarrier = [this, &line, &text](const Barrier& b) {
+            snprintf(line, sizeof(line), "    %s %s: %s -> %s, stages 0x%x -> 0x%x, access 0x%x -> 0x%x%s\n",
+                     b.subpassDependency ? "dependency" : "barrier",
+                     _resources[b.resource].name.c_str(), LayoutName(b.oldLayout), LayoutName(b.newLayout),
+                     b.srcStageMask, b.dstStageMask, b.srcAccessMask, b.dstAccessMask, b.alias ? " (alias)" : "");
+            text += line;
+        };
+        for (uint32_t g = 0; g < _plan.groups.size(); g++) {
+            const Group& group = _plan.groups[g];
+            snprintf(line, sizeof(line), "  render pass %d:\n", g);
+            text += line;
+            for (const auto& ga : group.attachments) {
+                snprintf(line, sizeof(line), "    attachment %s: %s -> %s, load %d, store %d\n",
+                         _resources[ga.resource].name.c_str(), LayoutName(ga.initialLayout), LayoutName(ga.finalLayout),
+                         ga.loadOp, ga.storeOp);
+                text += line;
+            }
+            for (uint32_t i = group.firstPass; i < group.firstPass + group.passCount; i++) {
+                const CompiledPass& compiled = _plan.passes[i];
+                snprintf(line, sizeof(line), "   subpass %d: %s\n", compiled.subpass, _passes[compiled.pass].name.c_str());
+                text += line;
+                for (const auto& b : compiled.barriers) {
+                    describeBarrier(b);
+                }
+            }
+        }
+        for (const auto& b : _plan.finalBarriers) {
+            describeBarrier(b);
+        }
+        for (uint32_t r = 0; r < _resources.size(); r++) {
+            if (_plan.aliasSlots[r] != RenderTargetPool::NO_ALIAS) {
+                snprintf(line, sizeof(line), "  %s in alias slot %d\n", _resources[r].name.c_str(), _plan.aliasSlots[r]);
+                text += line;
+            }
+        }
+        return text;
+    }
+
+    void RenderGraph::LogPlan() const
+    {
+        string text = Describe();
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find('\n', start);
+            Log::Info("%s", text.substr(start, end - start).c_str());
+            start = end + 1;
+        }
+    }
+
+    RenderGraph::Traffic RenderGraph::EstimateTraffic() const
+    {
+        Traffic traffic = {};
+        for (const auto& group : _plan.groups) {
+            for (const auto& ga : group.attachments) {
+                uint64_t size = ImageSize(_resources[ga.resource].info);
+                if (ga.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+                    traffic.loadedBytes += size;
+                }
+                if (ga.storeOp == VK_ATTACHMENT_STORE_OP_STORE) {
+                    traffic.storedBytes += size;
+                }
+            }
+        }
+        for (const auto& compiled : _plan.passes) {
+            for (const auto& access : _passes[compiled.pass].accesses) {
+                if (IsAttachmentUsage(access.usage)) {
+                    continue;
+                }
+                uint64_t size = ImageSize(_resources[access.resource].info);
+                if (access.write) {
+                    traffic.storedBytes += size;
+                } else {
+                    traffic.loadedBytes += size;
+                }
+            }
+        }
+        return traffic;
+    }
+
+    // ==== Realization ==== //
+    void RenderGraph::DeclareTransients(RenderTargetPool& pool)
+    {
+        for (uint32_t r = 0; r < _resources.size(); r++) {
+            if (_plan.aliasSlots[r] != RenderTargetPool::NO_ALIAS) {
+                _attachments[r] = pool.DeclareAttachment(_resources[r].info, _plan.aliasSlots[r]);
+            }
+        }
+    }
+
+    VkRenderPass RenderGraph::CreateRenderPass(const Device& device, uint32_t group) const
+    {
+        const Group& g = _plan.groups[group];
+        if (g.attachments.empty()) {
+            throw runtime_error("Render graph: render pass " + std::to_string(group) + " has no attachments.");
+        }
+
+        vector<VkAttachmentDescription> descriptions;
+        for (const auto& ga : g.attachments) {
+            const ImageInfo& info = _resources[ga.resource].info;
+            bool stencil = (info.aspect & VK_IMAGE_ASPECT_STENCIL_BIT) != 0;
+            VkAttachmentDescription description = {};
+            description.format         = info.format;
+            description.samples        = info.samples;
+            description.loadOp         = ga.loadOp;
+            description.storeOp        = ga.storeOp;
+            description.stencilLoadOp  = stencil ? ga.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            description.stencilStoreOp = stencil ? ga.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            description.initialLayout  = ga.initialLayout;
+            description.finalLayout    = ga.finalLayout;
+            descriptions.push_back(description);
+        }
+        auto indexOf = [&g](uint32_t resource) -> uint32_t {
+            for (uint32_t i = 0; i < g.attachments.size(); i++) {
+                if (g.attachments[i].resource == resource) {
+                    return i;
+                }
+            }
+            return VK_ATTACHMENT_UNUSED;
+        };
+
+        vector<vector<VkAttachmentReference>> colors(g.passCount), resolves(g.passCount), inputs(g.passCount);
+        vector<VkAttachmentReference> depths(g.passCount);
+        vector<VkSubpassDescription> subpasses(g.passCount);
+        vector<VkSubpassDependency> dependencies;
+        for (uint32_t k = 0; k < g.passCount; k++) {
+            const CompiledPass& compiled = _plan.passes[g.firstPass + k];
+            VkSubpassDescription& subpass = subpasses[k];
+            subpass = {};
+            subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            depths[k] = { VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED };
+            for (const auto& a : _passes[compiled.pass].accesses) {
+                VkAttachmentReference reference = { indexOf(a.resource), StateOf(a.usage).layout };
+                switch (a.usage) {
+                    case RESOURCE_USAGE_COLOR_ATTACHMENT:
+                        colors[k].push_back(reference);
+                        break;
+                    case RESOURCE_USAGE_RESOLVE_ATTACHMENT:
+                        resolves[k].push_back(reference);
+                        break;
+                    case RESOURCE_USAGE_INPUT_ATTACHMENT:
+                        inputs[k].push_back(reference);
+                        break;
+                    case RESOURCE_USAGE_DEPTH_ATTACHMENT:
+                    case RESOURCE_USAGE_DEPTH_READ_ONLY:
+                        depths[k] = reference;
+                        break;
+                    default:
+                        break;
+                }
+            }
+            // Resolve attachments pair up with color attachments in declaration order.
+            if (!resolves[k].empty()) {
+                resolves[k].resize(colors[k].size(), { VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+            }
+            subpass.colorAttachmentCount    = static_cast<uint32_t>(colors[k].size());
+            subpass.pColorAttachments       = colors[k].data();
+            subpass.pResolveAttachments     = resolves[k].empty() ? nullptr : resolves[k].data();
+            subpass.inputAttachmentCount    = static_cast<uint32_t>(inputs[k].size());
+            subpass.pInputAttachments       = inputs[k].data();
+            subpass.pDepthStencilAttachment = depths[k].attachment != VK_ATTACHMENT_UNUSED ? &depths[k] : nullptr;
+
+            for (const auto& b : compiled.barriers) {
+                if (!b.subpassDependency) {
+                    continue;
+                }
+                auto it = std::find_if(dependencies.begin(), dependencies.end(), [&b, k](const VkSubpassDependency& d) {
+                    return d.srcSubpass == b.srcSubpass && d.dstSubpass == k;
+                });
+                if (it == dependencies.end()) {
+                    VkSubpassDependency dependency = {};
+                    dependency.srcSubpass      = b.srcSubpass;
+                    dependency.dstSubpass      = k;
+                    dependency.dependencyFlags = b.srcSubpass == VK_SUBPASS_EXTERNAL ? 0 : VK_DEPENDENCY_BY_REGION_BIT;
+                    dependencies.push_back(dependency);
+                    it = dependencies.end() - 1;
+                }
+                it->srcStageMask  |= b.srcStageMask;
+                it->dstStageMask  |= b.dstStageMask;
+                it->srcAccessMask |= b.srcAccessMask;
+                it->dstAccessMask |= b.dstAccessMask;
+            }
+        }
+
+        VkRenderPassCreateInfo renderPassInfo = {};
+        renderPassInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(descriptions.size());
+        renderPassInfo.pAttachments    = descriptions.data();
+        renderPassInfo.subpassCount    = static_cast<uint32_t>(subpasses.size());
+        renderPassInfo.pSubpasses      = subpasses.data();
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies   = dependencies.data();
+        VkRenderPass renderPass;
+        VK_CHECK_RESULT(vkCreateRenderPass(device.LogicalDevice(), &renderPassInfo, nullptr, &renderPass));
+        return renderPass;
+    }
+
+    void RenderGraph::RecordBarrierList(VkCommandBuffer commandBuffer, const vector<Barrier>& barriers, const function<VkImage(uint32_t)>& image) const
+    {
+        vector<VkImageMemoryBarrier> imageBarriers;
+        PipelineBarrierParameters parameters = PipelineBarrierParameters();
+        parameters.commandBuffer = commandBuffer;
+        parameters.srcStageMask  = 0;
+        parameters.dstStageMask  = 0;
+        for (const auto& b : barriers) {
+            if (b.subpassDependency) {
+                continue;
+            }
+            const ImageInfo& info = _resources[b.resource].info;
+            imageBarriers.push_back(ImageMemoryBarrier(b.srcAccessMask, b.dstAccessMask, b.oldLayout, b.newLayout,
+                                                       image(b.resource), { info.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, info.arrayLayers }));
+            parameters.srcStageMask |= b.srcStageMask;
+            parameters.dstStageMask |= b.dstStageMask;
+        }
+        if (imageBarriers.empty()) {
+            return;
+        }
+        // All barriers in front of a pass go into one call.
+        parameters.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+        parameters.pImageMemoryBarriers    = imageBarriers.data();
+        PipelineBarrier(&parameters);
+    }
+
+    void RenderGraph::RecordBarriers(VkCommandBuffer commandBuffer, uint32_t compiledPass, const function<VkImage(uint32_t)>& image) const
+    {
+        RecordBarrierList(commandBuffer, _plan.passes[compiledPass].barriers, image);
+    }
+
+    void RenderGraph::RecordFinalBarriers(VkCommandBuffer commandBuffer, const function<VkImage(uint32_t)>& image) const
+    {
+        RecordBarrierList(commandBuffer, _plan.finalBarriers, image);
+    }
+
+    void RenderGraph::Execute(VkCommandBuffer commandBuffer, const function<VkImage(uint32_t)>& image) const
+    {
+        for (uint32_t i = 0; i < _plan.passes.size(); i++) {
+            RecordBarriers(commandBuffer, i, image);
+            const Pass& pass = _passes[_plan.passes[i].pass];
+            if (pass.record) {
+                pass.record(commandBuffer);
+            }
+        }
+        RecordFinalBarriers(commandBuffer, image);
+    }
+
+#ifdef ENABLE_BENCHMARKS
+    static bool SameBarrier(const RenderGraph::Barrier& a, const RenderGraph::Barrier& b)
+    {
+        return a.resource == b.resource && a.srcStageMask == b.srcStageMask && a.dstStageMask == b.dstStageMask &&
+               a.srcAccessMask == b.srcAccessMask && a.dstAccessMask == b.dstAccessMask && a.oldLayout == b.oldLayout &&
+               a.newLayout == b.newLayout && a.subpassDependency == b.subpassDependency && a.srcSubpass == b.srcSubpass &&
+               a.alias == b.alias;
+    }
+
+    static bool SameAttachment(const RenderGraph::GroupAttachment& a, const RenderGraph::GroupAttachment& b)
+    {
+        return a.resource == b.resource && a.loadOp == b.loadOp && a.storeOp == b.storeOp &&
+               a.initialLayout == b.initialLayout && a.finalLayout == b.finalLayout;
+    }
+
+    void RunRenderGraphCheck()
+    {
+        const VkPipelineStageFlags colorStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        const VkPipelineStageFlags depthStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        const VkAccessFlags        colorAccess = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        const VkAttachmentLoadOp   clear       = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        const VkAttachmentLoadOp   noLoad      = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        const VkAttachmentStoreOp  store       = VK_ATTACHMENT_STORE_OP_STORE;
+        const VkAttachmentStoreOp  noStore     = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        const VkImageLayout        undefined   = VK_IMAGE_LAYOUT_UNDEFINED;
+        const VkImageLayout        colorLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        const VkImageLayout        depthLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        const VkImageLayout        depthRead   = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        const VkImageLayout        sampled     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        RenderGraph::ImageInfo output = {};
+        output.format      = VK_FORMAT_R8G8B8A8_UNORM;
+        output.extent      = { 1280, 720 };
+        output.usage       = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        output.samples     = VK_SAMPLE_COUNT_1_BIT;
+        output.aspect      = VK_IMAGE_ASPECT_COLOR_BIT;
+        output.arrayLayers = 1;
+        RenderGraph::ImageInfo resolved = output;
+        resolved.extent = { 640, 720 };
+        resolved.usage  = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        RenderGraph::ImageInfo color = resolved;
+        color.usage   = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        color.samples = VK_SAMPLE_COUNT_4_BIT;
+        RenderGraph::ImageInfo depth = color;
+        depth.format = VK_FORMAT_D32_SFLOAT;
+        depth.usage  = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        depth.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+        RenderGraph graph;
+        uint32_t swapchain = graph.Import("swapchain", output, undefined, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, colorStages);
+        uint32_t eyeColor[2], eyeDepth[2], eyeResolved[2], eyePasses[2][2];
+        for (int eye = 0; eye < 2; eye++) {
+            string name = eye == 0 ? "left" : "right";
+            eyeColor[eye]    = graph.CreateTransient(name + " color", color);
+            eyeDepth[eye]    = graph.CreateTransient(name + " depth", depth);
+            eyeResolved[eye] = graph.CreateTransient(name + " resolved", resolved);
+            uint32_t opaque = graph.AddPass(name + " opaque");
+            graph.Write(opaque, eyeColor[eye], RESOURCE_USAGE_COLOR_ATTACHMENT);
+            graph.Write(opaque, eyeDepth[eye], RESOURCE_USAGE_DEPTH_ATTACHMENT);
+            uint32_t transparent = graph.AddPass(name + " transparent");
+            graph.Write(transparent, eyeColor[eye], RESOURCE_USAGE_COLOR_ATTACHMENT, true);
+            graph.Read(transparent, eyeDepth[eye], RESOURCE_USAGE_DEPTH_READ_ONLY);
+            graph.Write(transparent, eyeResolved[eye], RESOURCE_USAGE_RESOLVE_ATTACHMENT);
+            eyePasses[eye][0] = opaque;
+            eyePasses[eye][1] = transparent;
+        }
+        uint32_t debugView = graph.CreateTransient("debug view", resolved);
+        uint32_t debug = graph.AddPass("debug");
+        graph.Write(debug, debugView, RESOURCE_USAGE_COLOR_ATTACHMENT);
+        uint32_t distortion = graph.AddPass("distortion");
+        graph.Read(distortion, eyeResolved[0], RESOURCE_USAGE_SAMPLED);
+        graph.Read(distortion, eyeResolved[1], RESOURCE_USAGE_SAMPLED);
+        graph.Write(distortion, swapchain, RESOURCE_USAGE_COLOR_ATTACHMENT);
+        graph.Compile();
+        const RenderGraph::Plan& plan = graph.CompiledPlan();
+
+        // Each eye is one render pass of two subpasses; the distortion pass samples the resolved eyes, so it starts a
+        // render pass of its own. The right eye's color and depth take over the slots of the left eye's.
+        const uint32_t external = VK_SUBPASS_EXTERNAL;
+        vector<uint32_t> passes = { eyePasses[0][0], eyePasses[0][1], eyePasses[1][0], eyePasses[1][1], distortion };
+        vector<vector<RenderGraph::GroupAttachment>> attachments(3);
+        vector<vector<RenderGraph::Barrier>> barriers(passes.size());
+        for (int eye = 0; eye < 2; eye++) {
+            attachments[eye] = {
+                { eyeColor[eye],    clear,  noStore, undefined, colorLayout },
+                { eyeDepth[eye],    clear,  noStore, undefined, depthRead },
+                { eyeResolved[eye], noLoad, store,   undefined, colorLayout }
+            };
+            barriers[2 * eye + 1] = {
+                { eyeColor[eye], colorStages, colorStages, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, colorAccess,
+                  colorLayout, colorLayout, true, 0, false },
+                { eyeDepth[eye], depthStages, depthStages, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, depthLayout, depthRead, true, 0, false }
+            };
+        }
+        attachments[2] = { { swapchain, clear, store, undefined, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR } };
+        barriers[2] = {
+            { eyeColor[1], colorStages, colorStages, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, colorAccess,
+              undefined, colorLayout, true, external, true },
+            { eyeDepth[1], depthStages, depthStages, 0,
+              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+              undefined, depthLayout, true, external, true }
+        };
+        barriers[4] = {
+            { eyeResolved[0], colorStages, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+              VK_ACCESS_SHADER_READ_BIT, colorLayout, sampled, false, external, false },
+            { eyeResolved[1], colorStages, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+              VK_ACCESS_SHADER_READ_BIT, colorLayout, sampled, false, external, false },
+            { swapchain, colorStages, colorStages, 0, colorAccess, undefined, colorLayout, true, external, false }
+        };
+        const uint32_t none = RenderTargetPool::NO_ALIAS;
+        vector<uint32_t> aliasSlots = { none, 0, 1, 2, 0, 1, 3, none };
+
+        string mismatch;
+        if (plan.culledPasses != vector<uint32_t>{ debug }) {
+            mismatch = "culled passes";
+        } else if (plan.passes.size() != passes.size() || plan.groups.size() != attachments.size()) {
+            mismatch = "pass or group count";
+        } else if (plan.aliasSlots != aliasSlots || plan.aliasSlotCount != 4) {
+            mismatch = "alias slots";
+        } else if (!plan.finalBarriers.empty()) {
+            mismatch = "final barriers";
+        }
+        for (uint32_t i = 0; mismatch.empty() && i < passes.size(); i++) {
+            const RenderGraph::CompiledPass& compiled = plan.passes[i];
+            bool same = compiled.pass == passes[i] && compiled.group == i / 2 && compiled.subpass == i % 2 &&
+                        compiled.barriers.size() == barriers[i].size();
+            for (uint32_t b = 0; same && b < barriers[i].size(); b++) {
+                same = SameBarrier(compiled.barriers[b], barriers[i][b]);
+            }
+            if (!same) {
+                mismatch = "pass " + graph.PassName(passes[i]);
+            }
+        }
+        for (uint32_t g = 0; mismatch.empty() && g < attachments.size(); g++) {
+            const RenderGraph::Group& group = plan.groups[g];
+            bool same = group.firstPass == 2 * g && group.passCount == (g < 2 ? 2u : 1u) &&
+                        group.attachments.size() == attachments[g].size();
+            for (uint32_t a = 0; same && a < attachments[g].size(); a++) {
+                same = SameAttachment(group.attachments[a], attachments[g][a]);
+            }
+            if (!same) {
+                mismatch = "render pass " + std::to_string(g);
+            }
+        }
+        if (!mismatch.empty()) {
+            graph.LogPlan();
+            Log::Error("Render graph: compiled plan differs from the expected one in its %s.", mismatch.c_str());
+            throw runtime_error("compiled render graph plan differs from the expected one");
+        }
+        Log::Info("Render graph: compiled plan of %d passes in %d render passes matches the expected one.",
+                  (int)plan.passes.size(), (int)plan.groups.size());
+    }
+#endif
+}
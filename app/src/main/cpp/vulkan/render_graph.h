@@ -0,0 +1,186 @@
+﻿#ifndef VULKAN_RENDER_GRAPH_H
+#define VULKAN_RENDER_GRAPH_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include "device.h"
+#include "render_target_pool.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+using std::function;
+using std::string;
+using std::vector;
+
+namespace Vulkan
+{
+    typedef enum ResourceUsage {
+        RESOURCE_USAGE_COLOR_ATTACHMENT,
+        RESOURCE_USAGE_DEPTH_ATTACHMENT,
+        RESOURCE_USAGE_DEPTH_READ_ONLY,
+        RESOURCE_USAGE_RESOLVE_ATTACHMENT,
+        RESOURCE_USAGE_INPUT_ATTACHMENT,
+        RESOURCE_USAGE_SAMPLED,
+        RESOURCE_USAGE_TRANSFER_SRC,
+        RESOURCE_USAGE_TRANSFER_DST
+    } ResourceUsage;
+
+    // A frame declared as passes that read and write images. Compile() works on the CPU only: it culls passes whose
+    // results are never consumed, merges consecutive attachment-only passes into subpasses of one render pass, gives
+    // transient images with disjoint lifetimes the same alias slot, and plans the barriers between passes. The plan
+    // can be inspected, logged, and then used to declare the transients in a RenderTargetPool, create the render
+    // passes and record the barriers.
+    //
+    // Passes run in declaration order; a pass may only read what an earlier pass wrote or what was imported.
+    class RenderGraph {
+    public:
+        typedef RenderTargetPool::AttachmentInfo ImageInfo;
+        typedef function<void(VkCommandBuffer commandBuffer)> RecordPass;
+
+        static const uint32_t NOT_FOUND = UINT32_MAX;
+
+        typedef struct Barrier {
+            uint32_t             resource;
+            VkPipelineStageFlags srcStageMask;
+            VkPipelineStageFlags dstStageMask;
+            VkAccessFlags        srcAccessMask;
+            VkAccessFlags        dstAccessMask;
+            VkImageLayout        oldLayout;
+            VkImageLayout        newLayout;
+            // Between two subpasses of one render pass; becomes a subpass dependency from srcSubpass.
+            bool                 subpassDependency;
+            uint32_t             srcSubpass;
+            // First use of an aliased transient; waits for the previous user of the alias slot.
+            bool                 alias;
+        } Barrier;
+
+        typedef struct GroupAttachment {
+            uint32_t            resource;
+            VkAttachmentLoadOp  loadOp;
+            VkAttachmentStoreOp storeOp;
+            VkImageLayout       initialLayout;
+            VkImageLayout       finalLayout;
+        } GroupAttachment;
+
+        typedef struct CompiledPass {
+            uint32_t        pass;
+            uint32_t        group;
+            uint32_t        subpass;
+            vector<Barrier> barriers;
+        } CompiledPass;
+
+        // Passes sharing a render pass. A group of passes without attachments has no attachments and is recorded
+        // outside of any render pass.
+        typedef struct Group {
+            uint32_t                firstPass;
+            uint32_t                passCount;
+            vector<GroupAttachment> attachments;
+        } Group;
+
+        // Bytes a tiler moves between tile memory and main memory in one frame.
+        typedef struct Traffic {
+            uint64_t storedBytes;
+            uint64_t loadedBytes;
+        } Traffic;
+
+        typedef struct Plan {
+            vector<CompiledPass> passes;
+            vector<Group>        groups;
+            vector<uint32_t>     culledPasses;
+            vector<Barrier>      finalBarriers;
+            vector<uint32_t>     aliasSlots;
+            uint32_t             aliasSlotCount;
+        } Plan;
+
+        uint32_t CreateTransient(const string& name, const ImageInfo& info);
+        // finalLayout is the layout the image must be left in; anything other than UNDEFINED makes it an output of the
+        // frame. initialStageMask is where earlier work on the image, e.g. a semaphore wait, finishes.
+        uint32_t Import(const string& name,
+                        const ImageInfo& info,
+                        VkImageLayout initialLayout,
+                        VkImageLayout finalLayout,
+                        VkPipelineStageFlags initialStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+        uint32_t AddPass(const string& name, RecordPass record = nullptr);
+        void Read(uint32_t pass, uint32_t resource, ResourceUsage usage);
+        // Unless preserveContents is set the previous contents are discarded.
+        void Write(uint32_t pass, uint32_t resource, ResourceUsage usage, bool preserveContents = false);
+        // Keeps the pass even if nothing reads what it writes.
+        void SetSideEffects(uint32_t pass);
+
+        void Compile();
+        const Plan& CompiledPlan() const { return _plan; }
+        string Describe() const;
+        void LogPlan() const;
+        // Estimated from the compiled plan: attachments the render passes load or store, and images read or written
+        // outside of them, once each. Cleared and discarded attachments never leave the tile.
+        Traffic EstimateTraffic() const;
+
+        uint32_t FindResource(const string& name) const;
+        uint32_t FindPass(const string& name) const;
+        const string& ResourceName(uint32_t resource) const { return _resources[resource].name; }
+        const string& PassName(uint32_t pass) const { return _passes[pass].name; }
+        bool IsCulled(uint32_t pass) const;
+        uint32_t AliasSlot(uint32_t resource) const { return _plan.aliasSlots[resource]; }
+
+        // Declares every transient used by the plan, aliasing by slot. The pool's other attachments must not use alias
+        // groups below AliasSlotCount().
+        void DeclareTransients(RenderTargetPool& pool);
+        uint32_t Attachment(uint32_t resource) const { return _attachments[resource]; }
+
+        // The caller owns the returned render pass.
+        VkRenderPass CreateRenderPass(const Device& device, uint32_t group) const;
+        // Records the compiled pass' barriers that are not subpass dependencies. image maps resources to images.
+        void RecordBarriers(VkCommandBuffer commandBuffer, uint32_t compiledPass, const function<VkImage(uint32_t)>& image) const;
+        void RecordFinalBarriers(VkCommandBuffer commandBuffer, const function<VkImage(uint32_t)>& image) const;
+        // Records barriers and passes in order. Beginning and ending render passes is up to the passes.
+        void Execute(VkCommandBuffer commandBuffer, const function<VkImage(uint32_t)>& image) const;
+
+    private:
+        typedef struct Resource {
+            string               name;
+            ImageInfo            info;
+            bool                 imported;
+            VkImageLayout        initialLayout;
+            VkImageLayout        finalLayout;
+            VkPipelineStageFlags initialStageMask;
+        } Resource;
+
+        typedef struct Access {
+            uint32_t      resource;
+            ResourceUsage usage;
+            bool          write;
+            bool          preserveContents;
+        } Access;
+
+        typedef struct Pass {
+            string         name;
+            RecordPass     record;
+            vector<Access> accesses;
+            bool           sideEffects;
+        } Pass;
+
+        bool HasAttachments(const Pass& pass) const;
+        bool CanMerge(const vector<uint32_t>& group, uint32_t pass) const;
+        void Cull(vector<bool>& alive);
+        void BuildGroups(const vector<uint32_t>& order);
+        void AssignAliasSlots(const vector<uint32_t>& order);
+        void PlanBarriers();
+        void RecordBarrierList(VkCommandBuffer commandBuffer, const vector<Barrier>& barriers, const function<VkImage(uint32_t)>& image) const;
+
+        vector<Resource> _resources;
+        vector<Pass>     _passes;
+        vector<uint32_t> _attachments;
+        Plan             _plan = {};
+    };
+
+#ifdef ENABLE_BENCHMARKS
+    // Compiles a small stereo frame, two eyes of two subpasses each, an unused debug pass and a distortion pass, and
+    // checks the plan's culled passes, groups, attachments, barriers and alias slots against the expected ones.
+    void RunRenderGraphCheck();
+#endif
+}
+
+#endif // VULKAN_RENDER_GRAPH_H
@@ -0,0 +1,214 @@
+﻿#include "render_target_pool.h"
+#include "vulkan_utility.h"
+#include <algorithm>
+#include <unordered_map>
+
+using std::unordered_map;
+
+namespace Vulkan
+{
+    const uint32_t RenderTargetPool::NO_ALIAS;
+
+    RenderTargetPool::~RenderTargetPool()
+    {
+        DebugLog("~RenderTargetPool()");
+        Release();
+    }
+
+    uint32_t RenderTargetPool::DeclareAttachment(const AttachmentInfo& info, uint32_t aliasGroup)
+    {
+        assert(info.arrayLayers > 0);
+        Attachment attachment = {};
+        attachment.info       = info;
+        attachment.aliasGroup = aliasGroup;
+        attachment.block      = UINT32_MAX;
+        attachment.image      = VK_NULL_HANDLE;
+        attachment.view       = VK_NULL_HANDLE;
+        _attachments.push_back(attachment);
+        return static_cast<uint32_t>(_attachments.size() - 1);
+    }
+
+    void RenderTargetPool::Build()
+    {
+        VkDevice d = _device.LogicalDevice();
+
+        // Create images and gather their requirements.
+        for (auto& a : _attachments) {
+            assert(a.image == VK_NULL_HANDLE);
+            VkImageCreateInfo imageInfo = ImageCreateInfo(a.info.format,
+                                                          { a.info.extent.width, a.info.extent.height, 1 },
+                                                          1,
+                                                          a.info.usage,
+                                                          VK_IMAGE_TILING_OPTIMAL,
+                                                          VK_IMAGE_LAYOUT_UNDEFINED,
+                                                          a.info.samples,
+                                                          a.info.arrayLayers);
+            VK_CHECK_RESULT(vkCreateImage(d, &imageInfo, nullptr, &a.image));
+            vkGetImageMemoryRequirements(d, a.image, &a.memoryRequirements);
+        }
+
+        // Assign attachments to memory blocks. Every member of an alias group is bound at offset 0 of the group's
+        // block, so the block only has to be as large as its largest member. A member whose memory types don't
+        // intersect with the rest of its group falls back to a block of its own.
+        unordered_map<uint32_t, uint32_t> groupToBlock;
+        for (auto& a : _attachments) {
+            bool transient = (a.info.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+            auto it = groupToBlock.find(a.aliasGroup);
+            if (a.aliasGroup != NO_ALIAS && it != groupToBlock.end() &&
+                (_blocks[it->second].memoryTypeBits & a.memoryRequirements.memoryTypeBits))
+            {
+                MemoryBlock& block   = _blocks[it->second];
+                block.size           = std::max(block.size, a.memoryRequirements.size);
+                block.memoryTypeBits &= a.memoryRequirements.memoryTypeBits;
+                block.transient      = block.transient && transient;
+                a.block              = it->second;
+                continue;
+            }
+            MemoryBlock block     = {};
+            block.memory          = VK_NULL_HANDLE;
+            block.size            = a.memoryRequirements.size;
+            block.memoryTypeBits  = a.memoryRequirements.memoryTypeBits;
+            block.transient       = transient;
+            block.lazilyAllocated = false;
+            _blocks.push_back(block);
+            a.block = static_cast<uint32_t>(_blocks.size() - 1);
+            if (a.aliasGroup != NO_ALIAS && it == groupToBlock.end()) {
+                groupToBlock[a.aliasGroup] = a.block;
+            }
+        }
+
+        // Allocate, preferring lazily allocated memory for blocks that only back transient attachments.
+        _lazilyAllocated = false;
+        for (auto& b : _blocks) {
+            if (b.transient && FindMemoryTypeIndex(_device, b.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, b.memoryTypeIndex)) {
+                b.lazilyAllocated = true;
+                _lazilyAllocated = true;
+            } else if (!FindMemoryTypeIndex(_device, b.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, b.memoryTypeIndex)) {
+                throw runtime_error("Cannot find a device local memory type for render targets.");
+            }
+            VkMemoryAllocateInfo allocInfo = {};
+            allocInfo.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize       = b.size;
+            allocInfo.memoryTypeIndex      = b.memoryTypeIndex;
+            VK_CHECK_RESULT(_device.Memory().Allocate(allocInfo, MEMORY_CATEGORY_RENDER_TARGET, "render target pool", &b.memory));
+        }
+
+        for (auto& a : _attachments) {
+            VK_CHECK_RESULT(vkBindImageMemory(d, a.image, _blocks[a.block].memory, 0));
+            VkImageViewCreateInfo viewInfo = ImageViewCreateInfo(a.image,
+                                                                 a.info.format,
+                                                                 { a.info.aspect, 0, 1, 0, a.info.arrayLayers },
+                                                                 a.info.arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D);
+            VK_CHECK_RESULT(vkCreateImageView(d, &viewInfo, nullptr, &a.view));
+        }
+
+        LogStatistics();
+    }
+
+    void RenderTargetPool::Release()
+    {
+        VkDevice d = _device.LogicalDevice();
+        for (auto& a : _attachments) {
+            if (a.view != VK_NULL_HANDLE) {
+                vkDestroyImageView(d, a.view, nullptr), a.view = VK_NULL_HANDLE;
+            }
+            if (a.image != VK_NULL_HANDLE) {
+                vkDestroyImage(d, a.image, nullptr), a.image = VK_NULL_HANDLE;
+            }
+        }
+        _attachments.clear();
+        for (auto& b : _blocks) {
+            if (b.memory != VK_NULL_HANDLE) {
+                _device.Memory().Free(b.memory), b.memory = VK_NULL_HANDLE;
+            }
+        }
+        _blocks.clear();
+        _lazilyAllocated = false;
+    }
+
+    void RenderTargetPool::AliasBarrier(VkCommandBuffer commandBuffer, const vector<uint32_t>& attachments) const
+    {
+        vector<VkImageMemoryBarrier> barriers;
+        for (uint32_t i : attachments) {
+            const Attachment& a = _attachments[i];
+            if (a.aliasGroup == NO_ALIAS) {
+                continue;
+            }
+            bool depthStencil = (a.info.aspect & (VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT)) != 0;
+            // The old contents are never read again, so the transition starts from UNDEFINED; what matters is that
+            // writes through the previous alias are finished before the next render pass starts writing.
+            barriers.push_back(ImageMemoryBarrier(VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                                                  depthStencil ? (VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
+                                                               : (VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT),
+                                                  VK_IMAGE_LAYOUT_UNDEFINED,
+                                                  depthStencil ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                                                  a.image,
+                                                  { a.info.aspect, 0, 1, 0, a.info.arrayLayers }));
+        }
+        if (barriers.empty()) {
+            return;
+        }
+
+        VkPipelineStageFlags attachmentStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        PipelineBarrierParameters parameters = PipelineBarrierParameters();
+        parameters.commandBuffer             = commandBuffer;
+        parameters.srcStageMask              = attachmentStages;
+        parameters.dstStageMask              = attachmentStages;
+        parameters.dependencyFlags           = VK_DEPENDENCY_BY_REGION_BIT;
+        parameters.imageMemoryBarrierCount   = static_cast<uint32_t>(barriers.size());
+        parameters.pImageMemoryBarriers      = barriers.data();
+        PipelineBarrier(&parameters);
+    }
+
+    VkDeviceSize RenderTargetPool::RequestedBytes() const
+    {
+        VkDeviceSize bytes = 0;
+        for (const auto& a : _attachments) {
+            bytes += a.memoryRequirements.size;
+        }
+        return bytes;
+    }
+
+    VkDeviceSize RenderTargetPool::AllocatedBytes() const
+    {
+        VkDeviceSize bytes = 0;
+        for (const auto& b : _blocks) {
+            bytes += b.size;
+        }
+        return bytes;
+    }
+
+    VkDeviceSize RenderTargetPool::CommittedBytes() const
+    {
+        VkDevice d = _device.LogicalDevice();
+        VkDeviceSize bytes = 0;
+        for (const auto& b : _blocks) {
+            if (b.lazilyAllocated) {
+                VkDeviceSize committed = 0;
+                vkGetDeviceMemoryCommitment(d, b.memory, &committed);
+                bytes += committed;
+            } else {
+                bytes += b.size;
+            }
+        }
+        return bytes;
+    }
+
+    void RenderTargetPool::LogStatistics() const
+    {
+        if (_attachments.empty()) {
+            return;
+        }
+        const float MiB = 1024.0f * 1024.0f;
+        VkDeviceSize requested = RequestedBytes();
+        VkDeviceSize allocated = AllocatedBytes();
+        const VkExtent2D& extent = _attachments[0].info.extent;
+        Log::Info("Render targets at %dx%d: %d attachments in %d allocations, %.2f MiB requested, %.2f MiB allocated, %.2f MiB saved by aliasing.",
+                  extent.width, extent.height,
+                  (int)_attachments.size(), (int)_blocks.size(),
+                  requested / MiB, allocated / MiB, (requested - allocated) / MiB);
+        Log::Info("Render targets lazily allocated: %s, %.2f MiB committed.", _lazilyAllocated ? "yes" : "no", CommittedBytes() / MiB);
+    }
+}
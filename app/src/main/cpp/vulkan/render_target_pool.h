@@ -0,0 +1,81 @@
+﻿#ifndef VULKAN_RENDER_TARGET_POOL_H
+#define VULKAN_RENDER_TARGET_POOL_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include "device.h"
+#include <vector>
+
+using std::vector;
+
+namespace Vulkan
+{
+    // Owns the transient attachments of a frame (MSAA color, depth, ...). Attachments are declared first, then built
+    // together so that attachments sharing an alias group are bound to the same VkDeviceMemory. Attachments with
+    // TRANSIENT_ATTACHMENT usage are placed in LAZILY_ALLOCATED memory when the device offers it, so tilers never have
+    // to back them with physical pages.
+    class RenderTargetPool {
+    public:
+        typedef struct AttachmentInfo {
+            VkFormat              format;
+            VkExtent2D            extent;
+            VkImageUsageFlags     usage;
+            VkSampleCountFlagBits samples;
+            VkImageAspectFlags    aspect;
+            uint32_t              arrayLayers;
+        } AttachmentInfo;
+
+        // Attachments in the same alias group must never be in use at the same time. The caller records
+        // AliasBarrier() before switching from one member of a group to another.
+        static const uint32_t NO_ALIAS = UINT32_MAX;
+
+        RenderTargetPool(const Device& device) : _device(device) {}
+        ~RenderTargetPool();
+
+        uint32_t DeclareAttachment(const AttachmentInfo& info, uint32_t aliasGroup = NO_ALIAS);
+        void Build();
+        void Release();
+
+        VkImage Image(uint32_t attachment) const { return _attachments[attachment].image; }
+        VkImageView View(uint32_t attachment) const { return _attachments[attachment].view; }
+        const AttachmentInfo& Info(uint32_t attachment) const { return _attachments[attachment].info; }
+
+        // Makes the previous contents of the given attachments available for overwrite by the next render pass. Must
+        // be recorded outside of a render pass.
+        void AliasBarrier(VkCommandBuffer commandBuffer, const vector<uint32_t>& attachments) const;
+
+        bool LazilyAllocated() const { return _lazilyAllocated; }
+        VkDeviceSize RequestedBytes() const;
+        VkDeviceSize AllocatedBytes() const;
+        VkDeviceSize CommittedBytes() const;
+        void LogStatistics() const;
+
+    private:
+        typedef struct Attachment {
+            AttachmentInfo       info;
+            uint32_t             aliasGroup;
+            uint32_t             block;
+            VkImage              image;
+            VkImageView          view;
+            VkMemoryRequirements memoryRequirements;
+        } Attachment;
+
+        typedef struct MemoryBlock {
+            VkDeviceMemory memory;
+            VkDeviceSize   size;
+            uint32_t       memoryTypeBits;
+            uint32_t       memoryTypeIndex;
+            bool           transient;
+            bool           lazilyAllocated;
+        } MemoryBlock;
+
+        vector<Attachment>  _attachments;
+        vector<MemoryBlock> _blocks;
+        bool                _lazilyAllocated = false;
+
+        const Device& _device;
+    };
+}
+
+#endif // VULKAN_RENDER_TARGET_POOL_H
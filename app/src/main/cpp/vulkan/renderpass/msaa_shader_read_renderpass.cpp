@@ -71,6 +71,17 @@ namespace Vulkan
         renderPassInfo.subpassCount = 1;
         renderPassInfo.pSubpasses = &subpassDescription;
 
+        // The views are rendered from nearly the same position, so the implementation may process them together.
+        VkRenderPassMultiviewCreateInfoKHR multiviewInfo = {};
+        multiviewInfo.sType                = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO_KHR;
+        multiviewInfo.subpassCount         = 1;
+        multiviewInfo.pViewMasks           = &viewMask;
+        multiviewInfo.correlationMaskCount = 1;
+        multiviewInfo.pCorrelationMasks    = &viewMask;
+        if (viewMask) {
+            renderPassInfo.pNext = &multiviewInfo;
+        }
+
         VkSubpassDependency dependencies[] = { {}, {} };
         if (device.FamilyQueues().graphics.index == device.FamilyQueues().present.index) {
             dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
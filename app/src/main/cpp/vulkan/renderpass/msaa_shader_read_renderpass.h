@@ -19,6 +19,10 @@ namespace Vulkan
 
         VkFormat DepthFormat() const { return _depthFormat; }
 
+        // Non-zero renders every view in the mask in one pass into layered attachments (VK_KHR_multiview). Set before
+        // CreateRenderPass().
+        uint32_t viewMask = 0;
+
     private:
         virtual void CreateRenderPassImpl() override;
 
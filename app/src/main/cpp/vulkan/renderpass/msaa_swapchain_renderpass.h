@@ -0,0 +1,30 @@
+﻿#ifndef MSAA_SWAPCHAIN_RENDER_PASS_H
+#define MSAA_SWAPCHAIN_RENDER_PASS_H
+
+#include "renderpass.h"
+#include "../vulkan_utility.h"
+
+namespace Vulkan
+{
+    // MSAA color and depth that never leave tile memory, resolved straight into the swapchain image for presenting.
+    class MSAASwapchainRenderPass : public RenderPass
+    {
+    public:
+        MSAASwapchainRenderPass(const Device& device) : RenderPass(device) {}
+        ~MSAASwapchainRenderPass() override
+        {
+            DebugLog("MSAASwapchainRenderPass");
+            vkDestroyRenderPass(_device.LogicalDevice(), _renderPass, nullptr);
+            _renderPass = VK_NULL_HANDLE;
+        }
+
+        VkFormat DepthFormat() const { return _depthFormat; }
+
+    private:
+        virtual void CreateRenderPassImpl() override;
+
+        VkFormat _depthFormat;
+    };
+}
+
+#endif // MSAA_SWAPCHAIN_RENDER_PASS_H
\ No newline at end of file
@@ -11,9 +11,27 @@ using Vulkan::Swapchain;
 using std::min;
 using std::max;
 
+Swapchain::Swapchain(const Device& device, uint32_t concurrentFramesCount, VkFormat format, bool readback) : _swapchain(VK_NULL_HANDLE),
+                                                                                                           _surface(nullptr),
+                                                                                                           _device(device),
+                                                                                                           _concurrentFramesCount(concurrentFramesCount),
+                                                                                                           _readback(readback)
+{
+    _surfaceFormat = { format, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+    orientationChanged = false;
+    // The readback copies texels as they are, four bytes each.
+    if (readback && format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_B8G8R8A8_UNORM &&
+                    format != VK_FORMAT_R8G8B8A8_SRGB  && format != VK_FORMAT_B8G8R8A8_SRGB) {
+        throw runtime_error("Offscreen readback needs an 8 bit RGBA or BGRA format.");
+    }
+}
+
 Swapchain::~Swapchain()
 {
-    if (_swapchain != VK_NULL_HANDLE) {
+    if (Offscreen()) {
+        DebugLog("~Swapchain() offscreen");
+        DestroyOffscreenImages();
+    } else if (_swapchain != VK_NULL_HANDLE) {
         DebugLog("~Swapchain() vkDestroySwapchainKHR()");
         VkDevice device = _device.LogicalDevice();
         for (uint32_t i = 0; i < _imageViews.size(); i++) {
@@ -30,7 +48,12 @@ Swapchain::~Swapchain()
 
 void Swapchain::CreateSwapChain()
 {
-    const Surface& surface = _surface;
+    if (Offscreen()) {
+        CreateOffscreenImages();
+        return;
+    }
+
+    const Surface& surface = *_surface;
     const Device& device = _device;
     Vulkan::Surface::SurfaceSupportInfo supportInfo = surface.QuerySurfaceSupport(device.PhysicalDevice());
     _surfaceFormat = ChooseSurfaceFormat(supportInfo.formats);
@@ -130,10 +153,12 @@ void Swapchain::CreateSwapChain()
 void Swapchain::CreateImageViews(uint32_t baseArrayLayer, uint32_t layerCount)
 {
     const Device& device = _device;
-    uint32_t swapChainImagesCount = 0;
-    VK_CHECK_RESULT(vkGetSwapchainImagesKHR(device.LogicalDevice(), _swapchain, &swapChainImagesCount, nullptr));
-    _images.resize(swapChainImagesCount);
-    VK_CHECK_RESULT(vkGetSwapchainImagesKHR(device.LogicalDevice(), _swapchain, &swapChainImagesCount, _images.data()));
+    uint32_t swapChainImagesCount = static_cast<uint32_t>(_images.size());
+    if (!Offscreen()) {
+        VK_CHECK_RESULT(vkGetSwapchainImagesKHR(device.LogicalDevice(), _swapchain, &swapChainImagesCount, nullptr));
+        _images.resize(swapChainImagesCount);
+        VK_CHECK_RESULT(vkGetSwapchainImagesKHR(device.LogicalDevice(), _swapchain, &swapChainImagesCount, _images.data()));
+    }
 
     _imageViews.resize(swapChainImagesCount);
     for (uint32_t i = 0; i < swapChainImagesCount; i++) {
@@ -147,4 +172,230 @@ void Swapchain::CreateImageViews(uint32_t baseArrayLayer, uint32_t layerCount)
                                          layerCount,
                                          device.LogicalDevice());
     }
+}
+
+VkResult Swapchain::AcquireNextImage(VkSemaphore semaphore, uint32_t* imageIndex)
+{
+    if (!Offscreen()) {
+        return vkAcquireNextImageKHR(_device.LogicalDevice(), _swapchain, UINT64_MAX, semaphore, VK_NULL_HANDLE, imageIndex);
+    }
+
+    // The ring goes round in order; the renderer's frame fences keep at most ConcurrentFramesCount() frames in flight,
+    // as they do with a real swapchain.
+    *imageIndex = _nextImage;
+    _nextImage  = (_nextImage + 1) % _concurrentFramesCount;
+    if (_readback) {
+        CollectReadback(*imageIndex);
+    }
+
+    // Nothing is holding the image on the GPU but earlier submits, which an empty submit's signal already waits for.
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores    = &semaphore;
+    return vkQueueSubmit(_graphics.queue, 1, &submitInfo, VK_NULL_HANDLE);
+}
+
+VkResult Swapchain::Present(uint32_t imageIndex, VkSemaphore waitSemaphore)
+{
+    if (!Offscreen()) {
+        return QueuePresent(&_swapchain, &imageIndex, _device, 1, &waitSemaphore);
+    }
+
+    // Waiting is all presenting does offscreen; the readback copy, if any, follows the frame.
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores    = &waitSemaphore;
+    submitInfo.pWaitDstStageMask  = &waitStage;
+    submitInfo.commandBufferCount = _readback ? 1 : 0;
+    submitInfo.pCommandBuffers    = _readback ? &_readbackCommandBuffers[imageIndex] : nullptr;
+    VkResult result = vkQueueSubmit(_present.queue, 1, &submitInfo, _readback ? _readbackFences[imageIndex] : VK_NULL_HANDLE);
+    if (_readback && result == VK_SUCCESS) {
+        _readbackPending[imageIndex] = true;
+    }
+    return result;
+}
+
+void Swapchain::CreateOffscreenImages()
+{
+    DestroyOffscreenImages();
+
+    const Device& device = _device;
+    VkDevice d = device.LogicalDevice();
+    assert(getScreenExtent);
+    Extent2D viewportSize = getScreenExtent();
+    _extent2D = { viewportSize.width, viewportSize.height };
+    _graphics = _present = device.FamilyQueues().graphics;
+    _nextImage = 0;
+    DebugLog("Offscreen Swapchain Size: (%d, %d), %d images", _extent2D.width, _extent2D.height, _concurrentFramesCount);
+
+    // The images are alike, so a single allocation holds them all at the same stride.
+    _images.resize(_concurrentFramesCount);
+    for (auto& image : _images) {
+        VkImageCreateInfo imageInfo = ImageCreateInfo(_surfaceFormat.format,
+                                                      { _extent2D.width, _extent2D.height, 1 },
+                                                      1,
+                                                      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+        VK_CHECK_RESULT(vkCreateImage(d, &imageInfo, nullptr, &image));
+    }
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(d, _images[0], &memoryRequirements);
+    VkDeviceSize imageStride = (memoryRequirements.size + memoryRequirements.alignment - 1) / memoryRequirements.alignment * memoryRequirements.alignment;
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize       = imageStride * _images.size();
+    if (!FindMemoryTypeIndex(device, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, allocInfo.memoryTypeIndex)) {
+        throw runtime_error("Cannot find a device local memory type for offscreen swapchain images.");
+    }
+    VK_CHECK_RESULT(device.Memory().Allocate(allocInfo, Vulkan::MEMORY_CATEGORY_RENDER_TARGET, "offscreen swapchain", &_imageMemory));
+    for (uint32_t i = 0; i < _images.size(); i++) {
+        VK_CHECK_RESULT(vkBindImageMemory(d, _images[i], _imageMemory, i * imageStride));
+    }
+
+    if (!_readback) {
+        return;
+    }
+
+    // One slice of the readback buffer per image, each flushable on its own.
+    VkDeviceSize atom = max<VkDeviceSize>(device.PhysicalDeviceProperties().limits.nonCoherentAtomSize, 4);
+    _readbackStride = (static_cast<VkDeviceSize>(_extent2D.width) * _extent2D.height * 4 + atom - 1) / atom * atom;
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size        = _readbackStride * _images.size();
+    bufferInfo.usage       = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK_RESULT(vkCreateBuffer(d, &bufferInfo, nullptr, &_readbackBuffer));
+    vkGetBufferMemoryRequirements(d, _readbackBuffer, &memoryRequirements);
+    allocInfo.allocationSize = memoryRequirements.size;
+    // Cached memory reads back much faster on the CPU, at the price of invalidating it.
+    _readbackCoherent = false;
+    if (!FindMemoryTypeIndex(device, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, allocInfo.memoryTypeIndex)) {
+        _readbackCoherent = true;
+        if (!FindMemoryTypeIndex(device, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, allocInfo.memoryTypeIndex)) {
+            throw runtime_error("Cannot find a host visible memory type for offscreen readback.");
+        }
+    } else {
+        _readbackCoherent = (device.MemoryProperties().memoryTypes[allocInfo.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    }
+    VK_CHECK_RESULT(device.Memory().Allocate(allocInfo, Vulkan::MEMORY_CATEGORY_STAGING, "offscreen readback", &_readbackMemory));
+    VK_CHECK_RESULT(vkBindBufferMemory(d, _readbackBuffer, _readbackMemory, 0));
+    VK_CHECK_RESULT(vkMapMemory(d, _readbackMemory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&_readbackMapped)));
+
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = static_cast<uint32_t>(_present.index);
+    VK_CHECK_RESULT(vkCreateCommandPool(d, &poolInfo, nullptr, &_readbackPool));
+    _readbackCommandBuffers = Command::CreateCommandBuffers(_readbackPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, _concurrentFramesCount, d);
+    _readbackFences.resize(_concurrentFramesCount);
+    for (auto& fence : _readbackFences) {
+        fence = device.Sync().AcquireFence();
+    }
+    _readbackPending.assign(_concurrentFramesCount, false);
+    RecordReadbacks();
+}
+
+void Swapchain::DestroyOffscreenImages()
+{
+    VkDevice d = _device.LogicalDevice();
+    // Frames still being read back are dropped rather than handed to onFrameRead.
+    for (uint32_t i = 0; i < _readbackFences.size(); i++) {
+        if (_readbackPending[i]) {
+            vkWaitForFences(d, 1, &_readbackFences[i], VK_TRUE, UINT64_MAX);
+        }
+        _device.Sync().ReleaseFence(_readbackFences[i]);
+    }
+    _readbackFences.clear();
+    _readbackPending.clear();
+    _readbackCommandBuffers.clear();
+    if (_readbackPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(d, _readbackPool, nullptr), _readbackPool = VK_NULL_HANDLE;
+    }
+    if (_readbackBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(d, _readbackBuffer, nullptr), _readbackBuffer = VK_NULL_HANDLE;
+    }
+    if (_readbackMemory != VK_NULL_HANDLE) {
+        vkUnmapMemory(d, _readbackMemory), _readbackMapped = nullptr;
+        _device.Memory().Free(_readbackMemory), _readbackMemory = VK_NULL_HANDLE;
+    }
+
+    for (auto& imageView : _imageViews) {
+        vkDestroyImageView(d, imageView, nullptr);
+    }
+    _imageViews.clear();
+    for (auto& image : _images) {
+        vkDestroyImage(d, image, nullptr);
+    }
+    _images.clear();
+    if (_imageMemory != VK_NULL_HANDLE) {
+        _device.Memory().Free(_imageMemory), _imageMemory = VK_NULL_HANDLE;
+    }
+}
+
+void Swapchain::RecordReadbacks()
+{
+    for (uint32_t i = 0; i < _images.size(); i++) {
+        VkCommandBuffer commandBuffer = _readbackCommandBuffers[i];
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+        // Frames leave the image ready to present. Present() waits for the frame at the transfer stage, which makes
+        // its writes visible; the next frame's render pass starts from an undefined layout again.
+        VkImageMemoryBarrier toTransfer = ImageMemoryBarrier(0,
+                                                             VK_ACCESS_TRANSFER_READ_BIT,
+                                                             VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                                             VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                                             _images[i]);
+        PipelineBarrierParameters toTransferParameters;
+        toTransferParameters.commandBuffer           = commandBuffer;
+        toTransferParameters.srcStageMask            = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        toTransferParameters.dstStageMask            = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        toTransferParameters.imageMemoryBarrierCount = 1;
+        toTransferParameters.pImageMemoryBarriers    = &toTransfer;
+        PipelineBarrier(&toTransferParameters);
+
+        VkBufferImageCopy region = BufferImageCopy({ _extent2D.width, _extent2D.height, 1 },
+                                                   { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+                                                   i * _readbackStride);
+        vkCmdCopyImageToBuffer(commandBuffer, _images[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _readbackBuffer, 1, &region);
+
+        VkBufferMemoryBarrier toHost = BufferMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                           VK_ACCESS_HOST_READ_BIT,
+                                                           _readbackBuffer,
+                                                           i * _readbackStride,
+                                                           _readbackStride);
+        PipelineBarrierParameters toHostParameters;
+        toHostParameters.commandBuffer            = commandBuffer;
+        toHostParameters.srcStageMask             = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        toHostParameters.dstStageMask             = VK_PIPELINE_STAGE_HOST_BIT;
+        toHostParameters.bufferMemoryBarrierCount = 1;
+        toHostParameters.pBufferMemoryBarriers    = &toHost;
+        PipelineBarrier(&toHostParameters);
+
+        VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+    }
+}
+
+void Swapchain::CollectReadback(uint32_t imageIndex)
+{
+    if (!_readbackPending[imageIndex]) {
+        return;
+    }
+    VkDevice d = _device.LogicalDevice();
+    VK_CHECK_RESULT(vkWaitForFences(d, 1, &_readbackFences[imageIndex], VK_TRUE, UINT64_MAX));
+    VK_CHECK_RESULT(vkResetFences(d, 1, &_readbackFences[imageIndex]));
+    _readbackPending[imageIndex] = false;
+    if (!_readbackCoherent) {
+        VkMappedMemoryRange range = {};
+        range.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = _readbackMemory;
+        range.offset = imageIndex * _readbackStride;
+        range.size   = _readbackStride;
+        VK_CHECK_RESULT(vkInvalidateMappedMemoryRanges(d, 1, &range));
+    }
+    if (onFrameRead) {
+        onFrameRead(imageIndex, _readbackMapped + imageIndex * _readbackStride);
+    }
 }
\ No newline at end of file
@@ -24,16 +24,31 @@ using std::vector;
 
 namespace Vulkan
 {
+    // The images frames are rendered into and presented from. Built on a surface it wraps a VkSwapchainKHR; built
+    // without one it is an offscreen ring of images for rendering with no window, e.g. on a software implementation,
+    // which goes through the same AcquireNextImage() and Present() with the same frames in flight.
     class Swapchain {
     public:
-        Swapchain(const Surface& surface, const Device& device) : _swapchain(VK_NULL_HANDLE), _surface(surface), _device(device) {}
+        Swapchain(const Surface& surface, const Device& device) : _swapchain(VK_NULL_HANDLE), _surface(&surface), _device(device) {}
+        // Offscreen: concurrentFramesCount images sized by getScreenExtent. With readback every presented image is
+        // copied to host memory and handed to onFrameRead when its turn in the ring comes round again.
+        Swapchain(const Device& device, uint32_t concurrentFramesCount, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, bool readback = false);
         ~Swapchain();
         void CreateSwapChain();
         void CreateImageViews(uint32_t baseArrayLayer = 0, uint32_t layerCount = 1);
 
+        // Signals semaphore once imageIndex may be rendered into, like vkAcquireNextImageKHR().
+        VkResult AcquireNextImage(VkSemaphore semaphore, uint32_t* imageIndex);
+        // Presents imageIndex after waitSemaphore; offscreen the image goes back to the ring, read back first if asked.
+        VkResult Present(uint32_t imageIndex, VkSemaphore waitSemaphore);
+
         std::function<Extent2D(void)> getScreenExtent;
         std::function<void(void)>     onSwapchainDestroy;
+        // Offscreen readback of imageIndex: Extent().height rows of Extent().width texels, tightly packed, in Format().
+        // The pixels are only valid during the call.
+        std::function<void(uint32_t, const uint8_t*)> onFrameRead;
 
+        bool Offscreen() const { return _surface == nullptr; }
         const VkSwapchainKHR& GetSwapchain() const { return _swapchain; }
         const VkExtent2D& Extent() const { return _extent2D; }
         VkFormat Format() const { return _surfaceFormat.format; }
@@ -42,10 +57,17 @@ namespace Vulkan
 
         bool orientationChanged;
     private:
+        void CreateOffscreenImages();
+        void DestroyOffscreenImages();
+        // Copies of every image into its slice of the readback buffer, recorded once.
+        void RecordReadbacks();
+        // Hands the image's previous frame to onFrameRead once its copy completes.
+        void CollectReadback(uint32_t imageIndex);
+
         // Base Variables
         VkSwapchainKHR _swapchain;
 
-        const Vulkan::Surface& _surface;
+        const Vulkan::Surface* _surface;
         const Vulkan::Device&  _device;
         Device::QueuePair      _graphics;
         Device::QueuePair      _present;
@@ -57,6 +79,20 @@ namespace Vulkan
         uint32_t            _concurrentFramesCount;
         vector<VkImage>     _images;
         vector<VkImageView> _imageViews;
+
+        // Offscreen
+        VkDeviceMemory          _imageMemory      = VK_NULL_HANDLE;
+        uint32_t                _nextImage        = 0;
+        bool                    _readback         = false;
+        VkCommandPool           _readbackPool     = VK_NULL_HANDLE;
+        VkBuffer                _readbackBuffer   = VK_NULL_HANDLE;
+        VkDeviceMemory          _readbackMemory   = VK_NULL_HANDLE;
+        VkDeviceSize            _readbackStride   = 0;
+        uint8_t*                _readbackMapped   = nullptr;
+        bool                    _readbackCoherent = true;
+        vector<VkCommandBuffer> _readbackCommandBuffers;
+        vector<VkFence>         _readbackFences;
+        vector<bool>            _readbackPending;
     };
 }
 
@@ -0,0 +1,183 @@
+﻿#include "sync_pool.h"
+#include "vulkan_utility.h"
+
+using std::lock_guard;
+using std::mutex;
+
+namespace Vulkan
+{
+    SyncPool::SyncPool(VkDevice device, bool timelineSemaphores) : _device(device)
+    {
+        if (timelineSemaphores) {
+            _getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+            _waitSemaphores           = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+            if (!_getSemaphoreCounterValue || !_waitSemaphores) {
+                Log::Warn("VK_KHR_timeline_semaphore entry points are unavailable, falling back to fences.");
+                _getSemaphoreCounterValue = nullptr;
+                _waitSemaphores           = nullptr;
+            }
+        }
+    }
+
+    SyncPool::~SyncPool()
+    {
+        DebugLog("~SyncPool()");
+        LogStatistics();
+        for (auto& f : _signaledFences) {
+            vkDestroyFence(_device, f, nullptr), f = VK_NULL_HANDLE;
+        }
+        for (auto& f : _unsignaledFences) {
+            vkDestroyFence(_device, f, nullptr), f = VK_NULL_HANDLE;
+        }
+        for (auto& s : _semaphores) {
+            vkDestroySemaphore(_device, s, nullptr), s = VK_NULL_HANDLE;
+        }
+        for (auto& it : _timelines) {
+            vkDestroySemaphore(_device, it.second.semaphore, nullptr), it.second.semaphore = VK_NULL_HANDLE;
+        }
+    }
+
+    VkFence SyncPool::AcquireFence(VkFenceCreateFlags flags)
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            bool signaled = (flags & VK_FENCE_CREATE_SIGNALED_BIT) != 0;
+            vector<VkFence>& fences = signaled ? _signaledFences : _unsignaledFences;
+            if (!fences.empty()) {
+                VkFence fence = fences.back();
+                fences.pop_back();
+                _statistics.fencesRecycled++;
+                return fence;
+            }
+            // A signaled fence can be reset on the host, but not the other way around.
+            if (!signaled && !_signaledFences.empty()) {
+                VkFence fence = _signaledFences.back();
+                _signaledFences.pop_back();
+                VK_CHECK_RESULT(vkResetFences(_device, 1, &fence));
+                _statistics.fencesRecycled++;
+                return fence;
+            }
+            _statistics.fencesCreated++;
+        }
+        return CreateFence(_device, flags);
+    }
+
+    void SyncPool::ReleaseFence(VkFence fence)
+    {
+        if (fence == VK_NULL_HANDLE) {
+            return;
+        }
+        // Waited-on fences come back signaled and are the common case for per-frame fences, so they are kept as they
+        // are rather than reset.
+        bool signaled = vkGetFenceStatus(_device, fence) == VK_SUCCESS;
+        lock_guard<mutex> lock(_mutex);
+        (signaled ? _signaledFences : _unsignaledFences).push_back(fence);
+    }
+
+    VkSemaphore SyncPool::AcquireSemaphore()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            if (!_semaphores.empty()) {
+                VkSemaphore semaphore = _semaphores.back();
+                _semaphores.pop_back();
+                _statistics.semaphoresRecycled++;
+                return semaphore;
+            }
+            _statistics.semaphoresCreated++;
+        }
+        return CreateSemaphore(_device);
+    }
+
+    void SyncPool::ReleaseSemaphore(VkSemaphore semaphore)
+    {
+        if (semaphore == VK_NULL_HANDLE) {
+            return;
+        }
+        lock_guard<mutex> lock(_mutex);
+        _semaphores.push_back(semaphore);
+    }
+
+    SyncPool::Timeline& SyncPool::QueueTimeline(VkQueue queue)
+    {
+        auto it = _timelines.find(queue);
+        if (it != _timelines.end()) {
+            return it->second;
+        }
+        VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+        typeInfo.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        typeInfo.initialValue  = 0;
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        Timeline timeline = { VK_NULL_HANDLE, 0 };
+        VK_CHECK_RESULT(vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &timeline.semaphore));
+        return _timelines[queue] = timeline;
+    }
+
+    uint64_t SyncPool::SignalTimeline(VkQueue queue, VkSubmitInfo& submitInfo, SyncPool::TimelineSignal& signal)
+    {
+        assert(TimelineSemaphoresEnabled());
+        assert(submitInfo.signalSemaphoreCount == 0);
+        {
+            lock_guard<mutex> lock(_mutex);
+            Timeline& timeline = QueueTimeline(queue);
+            signal.semaphore = timeline.semaphore;
+            signal.value     = ++timeline.value;
+        }
+
+        signal.submitInfo = {};
+        signal.submitInfo.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        signal.submitInfo.pNext                     = submitInfo.pNext;
+        signal.submitInfo.signalSemaphoreValueCount = 1;
+        signal.submitInfo.pSignalSemaphoreValues    = &signal.value;
+        submitInfo.pNext                = &signal.submitInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores    = &signal.semaphore;
+        return signal.value;
+    }
+
+    uint64_t SyncPool::CompletedTimelineValue(VkQueue queue)
+    {
+        assert(TimelineSemaphoresEnabled());
+        VkSemaphore semaphore;
+        {
+            lock_guard<mutex> lock(_mutex);
+            semaphore = QueueTimeline(queue).semaphore;
+        }
+        uint64_t value = 0;
+        VK_CHECK_RESULT(_getSemaphoreCounterValue(_device, semaphore, &value));
+        return value;
+    }
+
+    void SyncPool::WaitTimeline(VkQueue queue, uint64_t value, uint64_t timeout)
+    {
+        assert(TimelineSemaphoresEnabled());
+        VkSemaphore semaphore;
+        {
+            lock_guard<mutex> lock(_mutex);
+            semaphore = QueueTimeline(queue).semaphore;
+        }
+        VkSemaphoreWaitInfoKHR waitInfo = {};
+        waitInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores    = &semaphore;
+        waitInfo.pValues        = &value;
+        VK_CHECK_RESULT(_waitSemaphores(_device, &waitInfo, timeout));
+    }
+
+    SyncPool::Statistics SyncPool::Stats()
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _statistics;
+    }
+
+    void SyncPool::LogStatistics()
+    {
+        Statistics s = Stats();
+        Log::Info("Sync pool: %d fences created, %d recycled; %d semaphores created, %d recycled; timeline semaphores %s.",
+                  s.fencesCreated, s.fencesRecycled, s.semaphoresCreated, s.semaphoresRecycled,
+                  TimelineSemaphoresEnabled() ? "enabled" : "unavailable");
+    }
+}
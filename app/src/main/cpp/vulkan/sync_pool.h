@@ -0,0 +1,127 @@
+﻿#ifndef VULKAN_SYNC_POOL_H
+#define VULKAN_SYNC_POOL_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifndef VK_KHR_timeline_semaphore
+#define VK_KHR_timeline_semaphore 1
+#define VK_KHR_TIMELINE_SEMAPHORE_SPEC_VERSION 2
+#define VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME "VK_KHR_timeline_semaphore"
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR ((VkStructureType)1000207000)
+#define VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR ((VkStructureType)1000207002)
+#define VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR ((VkStructureType)1000207003)
+#define VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR ((VkStructureType)1000207004)
+typedef enum VkSemaphoreTypeKHR {
+    VK_SEMAPHORE_TYPE_BINARY_KHR   = 0,
+    VK_SEMAPHORE_TYPE_TIMELINE_KHR = 1,
+    VK_SEMAPHORE_TYPE_MAX_ENUM_KHR = 0x7FFFFFFF
+} VkSemaphoreTypeKHR;
+typedef VkFlags VkSemaphoreWaitFlagsKHR;
+typedef struct VkPhysicalDeviceTimelineSemaphoreFeaturesKHR {
+    VkStructureType sType;
+    void*           pNext;
+    VkBool32        timelineSemaphore;
+} VkPhysicalDeviceTimelineSemaphoreFeaturesKHR;
+typedef struct VkSemaphoreTypeCreateInfoKHR {
+    VkStructureType    sType;
+    const void*        pNext;
+    VkSemaphoreTypeKHR semaphoreType;
+    uint64_t           initialValue;
+} VkSemaphoreTypeCreateInfoKHR;
+typedef struct VkTimelineSemaphoreSubmitInfoKHR {
+    VkStructureType sType;
+    const void*     pNext;
+    uint32_t        waitSemaphoreValueCount;
+    const uint64_t* pWaitSemaphoreValues;
+    uint32_t        signalSemaphoreValueCount;
+    const uint64_t* pSignalSemaphoreValues;
+} VkTimelineSemaphoreSubmitInfoKHR;
+typedef struct VkSemaphoreWaitInfoKHR {
+    VkStructureType         sType;
+    const void*             pNext;
+    VkSemaphoreWaitFlagsKHR flags;
+    uint32_t                semaphoreCount;
+    const VkSemaphore*      pSemaphores;
+    const uint64_t*         pValues;
+} VkSemaphoreWaitInfoKHR;
+typedef VkResult (VKAPI_PTR *PFN_vkGetSemaphoreCounterValueKHR)(VkDevice device, VkSemaphore semaphore, uint64_t* pValue);
+typedef VkResult (VKAPI_PTR *PFN_vkWaitSemaphoresKHR)(VkDevice device, const VkSemaphoreWaitInfoKHR* pWaitInfo, uint64_t timeout);
+#endif
+
+using std::unordered_map;
+using std::vector;
+
+namespace Vulkan
+{
+    // Recycles fences and binary semaphores instead of creating and destroying them around every submission, and,
+    // with VK_KHR_timeline_semaphore, keeps one timeline semaphore per queue whose value counts that queue's
+    // submissions.
+    //
+    // Objects handed back must not be in use by pending work: a released fence's submission must have completed and a
+    // released semaphore must be unsignaled with no pending wait. Thread safe.
+    class SyncPool {
+    public:
+        typedef struct Statistics {
+            uint32_t fencesCreated;
+            uint32_t fencesRecycled;
+            uint32_t semaphoresCreated;
+            uint32_t semaphoresRecycled;
+        } Statistics;
+
+        SyncPool(VkDevice device, bool timelineSemaphores);
+        ~SyncPool();
+
+        // Recycled fences keep the state they were released in. An unsignaled request may be served by resetting a
+        // signaled fence, but a signaled request that finds no signaled fence creates a new one.
+        VkFence AcquireFence(VkFenceCreateFlags flags = 0);
+        void ReleaseFence(VkFence fence);
+        VkSemaphore AcquireSemaphore();
+        void ReleaseSemaphore(VkSemaphore semaphore);
+
+        // ==== Timeline ==== //
+        // Storage for the structures chained into a VkSubmitInfo; it has to outlive the vkQueueSubmit call.
+        typedef struct TimelineSignal {
+            VkTimelineSemaphoreSubmitInfoKHR submitInfo;
+            VkSemaphore                      semaphore;
+            uint64_t                         value;
+        } TimelineSignal;
+
+        bool TimelineSemaphoresEnabled() const { return _getSemaphoreCounterValue != nullptr; }
+        // Adds a signal of the queue's timeline to submitInfo, which must not signal anything else, and returns the
+        // value it will reach. Values are handed out in call order, so the call and its vkQueueSubmit must happen under
+        // the same external synchronization of the queue.
+        uint64_t SignalTimeline(VkQueue queue, VkSubmitInfo& submitInfo, TimelineSignal& signal);
+        uint64_t CompletedTimelineValue(VkQueue queue);
+        void WaitTimeline(VkQueue queue, uint64_t value, uint64_t timeout = UINT64_MAX);
+
+        Statistics Stats();
+        void LogStatistics();
+
+    private:
+        typedef struct Timeline {
+            VkSemaphore semaphore;
+            uint64_t    value;
+        } Timeline;
+
+        Timeline& QueueTimeline(VkQueue queue);
+
+        VkDevice _device;
+
+        std::mutex          _mutex;
+        vector<VkFence>     _signaledFences;
+        vector<VkFence>     _unsignaledFences;
+        vector<VkSemaphore> _semaphores;
+        Statistics          _statistics = {};
+
+        unordered_map<VkQueue, Timeline>  _timelines;
+        PFN_vkGetSemaphoreCounterValueKHR _getSemaphoreCounterValue = nullptr;
+        PFN_vkWaitSemaphoresKHR           _waitSemaphores           = nullptr;
+    };
+}
+
+#endif // VULKAN_SYNC_POOL_H
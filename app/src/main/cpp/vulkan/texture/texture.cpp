@@ -15,7 +15,7 @@ namespace Vulkan
 
         uint32_t memoryTypeIndex;
         VkMemoryAllocateInfo allocInfo = MemoryAllocateInfo(image, preferredProperties, device, memoryRequirements, memoryTypeIndex);
-        VK_CHECK_RESULT(vkAllocateMemory(d, &allocInfo, nullptr, &memory));
+        VK_CHECK_RESULT(device.Memory().Allocate(allocInfo, MEMORY_CATEGORY_TEXTURE, name, &memory));
     }
 
     void Texture::CreateImageView(const TextureAttribs& textureAttribs)
@@ -24,7 +24,7 @@ namespace Vulkan
         VK_CHECK_RESULT(vkCreateImageView(device.LogicalDevice(), &imageViewInfo, nullptr, &view));
     }
 
-    void Texture::GenerateMipmaps(TextureAttribs& textureAttribs, Command& command, VkCommandBuffer commandBuffer)
+    void Texture::GenerateMipmaps(TextureAttribs& textureAttribs, VkCommandBuffer commandBuffer)
     {
         VkFormatProperties formatProperties;
         vkGetPhysicalDeviceFormatProperties(device.PhysicalDevice(), textureAttribs.format, &formatProperties);
@@ -8,6 +8,7 @@
 #include "../device.h"
 #include "../command.h"
 #include "../vulkan_utility.h"
+#include "../upload_context.h"
 
 #include "stb_image.h"
 
@@ -36,6 +37,9 @@ namespace Vulkan
 
         const VkImageView& ImageView() const { return view; }
 
+        // Debug name reported by the memory tracker, e.g. the image file the texture was loaded from.
+        string name = "texture";
+
     protected:
         Texture(const Device& device) : device(device) { DebugLog("Texture()"); }
         ~Texture()
@@ -54,7 +58,7 @@ namespace Vulkan
             }
             if (memory != VK_NULL_HANDLE) {
                 DebugLog("~Texture() vkFreeMemory()");
-                vkFreeMemory(d, memory, nullptr);
+                device.Memory().Free(memory);
                 memory = VK_NULL_HANDLE;
             }
         }
@@ -66,7 +70,9 @@ namespace Vulkan
         }
         void CreateImageView(const TextureAttribs& textureAttribs);
 
-        void GenerateMipmaps(TextureAttribs& textureAttribs, Command& command, VkCommandBuffer commandBuffer);
+        // Expects every level in TRANSFER_DST_OPTIMAL with level 0 filled, leaves them in SHADER_READ_ONLY_OPTIMAL.
+        // Blits require a graphics queue.
+        void GenerateMipmaps(TextureAttribs& textureAttribs, VkCommandBuffer commandBuffer);
 
         VkImage        image        = VK_NULL_HANDLE;
         VkDeviceMemory memory       = VK_NULL_HANDLE;
@@ -87,6 +93,7 @@ namespace Vulkan
             view   = other.view  , other.view   = VK_NULL_HANDLE;
             image  = other.image , other.image  = VK_NULL_HANDLE;
             memory = other.memory, other.memory = VK_NULL_HANDLE;
+            name   = std::move(other.name);
         }
         ~Texture2D()
         {
@@ -94,7 +101,7 @@ namespace Vulkan
             Texture::~Texture();
         }
 
-        void BuildTexture2D(TextureAttribs& textureAttribs, uint8_t* data, VkMemoryPropertyFlags preferredProperties, Command& command);
+        void BuildTexture2D(TextureAttribs& textureAttribs, uint8_t* data, VkMemoryPropertyFlags preferredProperties, UploadContext& uploadContext);
     private:
         void CreateTexure2D(TextureAttribs& textureAttribs);
         uint32_t ArrayLayersImpl() override { return 1; }
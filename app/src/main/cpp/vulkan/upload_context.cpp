@@ -0,0 +1,306 @@
+﻿#include "upload_context.h"
+#include "command.h"
+#include "vulkan_utility.h"
+
+namespace Vulkan
+{
+    const UploadContext::Ticket UploadContext::NO_TICKET;
+
+    UploadContext::UploadContext(const Device& device) : _device(device)
+    {
+        const Device::QueueGroup& familyQueues = device.FamilyQueues();
+        _graphicsFamily    = familyQueues.graphics.index;
+        _graphicsQueue     = familyQueues.graphics.queue;
+        _dedicatedTransfer = device.DedicatedTransferQueueFamily() && familyQueues.transfer.queue != VK_NULL_HANDLE;
+        _transferFamily    = _dedicatedTransfer ? familyQueues.transfer.index : _graphicsFamily;
+        _transferQueue     = _dedicatedTransfer ? familyQueues.transfer.queue : _graphicsQueue;
+
+        VkDevice d = device.LogicalDevice();
+        VkCommandPoolCreateInfo createInfo = {};
+        createInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        createInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        createInfo.queueFamilyIndex = _graphicsFamily;
+        VK_CHECK_RESULT(vkCreateCommandPool(d, &createInfo, nullptr, &_graphicsPool));
+        if (_dedicatedTransfer) {
+            createInfo.queueFamilyIndex = _transferFamily;
+            VK_CHECK_RESULT(vkCreateCommandPool(d, &createInfo, nullptr, &_transferPool));
+        }
+        Log::Info("Uploads use %s.", _dedicatedTransfer ? "the dedicated transfer queue" : "the graphics queue");
+    }
+
+    UploadContext::~UploadContext()
+    {
+        DebugLog("~UploadContext()");
+        if (_recording) {
+            Flush();
+        }
+        // Also covers the submissions waiting on taken semaphores.
+        VK_CHECK_RESULT(vkQueueWaitIdle(_graphicsQueue));
+        for (auto& b : _submitted) {
+            ReleaseBatch(b);
+        }
+        _submitted.clear();
+        VkDevice d = _device.LogicalDevice();
+        if (_transferPool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(d, _transferPool, nullptr), _transferPool = VK_NULL_HANDLE;
+        }
+        vkDestroyCommandPool(d, _graphicsPool, nullptr), _graphicsPool = VK_NULL_HANDLE;
+    }
+
+    UploadContext::Batch& UploadContext::OpenBatch()
+    {
+        if (_recording) {
+            return *_recording;
+        }
+        VkDevice d = _device.LogicalDevice();
+        Batch batch = {};
+        batch.ticket                = _nextTicket++;
+        batch.graphicsCommandBuffer = Command::CreateAndBeginCommandBuffers(_graphicsPool,
+                                                                            VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                                                            1,
+                                                                            VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                                                                            d)[0];
+        batch.transferCommandBuffer = batch.graphicsCommandBuffer;
+        if (_dedicatedTransfer) {
+            batch.transferCommandBuffer = Command::CreateAndBeginCommandBuffers(_transferPool,
+                                                                                VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                                                                1,
+                                                                                VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                                                                                d)[0];
+            batch.transferComplete = _device.Sync().AcquireSemaphore();
+        }
+        batch.graphicsComplete = _device.Sync().AcquireSemaphore();
+        batch.fence            = _device.Sync().AcquireFence();
+        _submitted.push_back(std::move(batch));
+        _recording = &_submitted.back();
+        return *_recording;
+    }
+
+    Buffer& UploadContext::CreateStagingBuffer(const void* data, VkDeviceSize size)
+    {
+        Batch& batch = OpenBatch();
+        batch.stagingBuffers.emplace_back(_device);
+        Buffer& staging = batch.stagingBuffers.back();
+        staging.name = "upload staging";
+        staging.BuildDefaultBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        staging.Map();
+        memcpy(staging.mapped, data, size);
+        staging.Unmap();
+        return staging;
+    }
+
+    void UploadContext::UploadBuffer(const Buffer&        dst,
+                                     const void*          data,
+                                     VkDeviceSize         size,
+                                     VkPipelineStageFlags dstStageMask,
+                                     VkAccessFlags        dstAccessMask)
+    {
+        Buffer& staging = CreateStagingBuffer(data, size);
+        Batch& batch = *_recording;
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.size = size;
+        vkCmdCopyBuffer(batch.transferCommandBuffer, staging.GetBuffer(), dst.GetBuffer(), 1, &copyRegion);
+
+        PipelineBarrierParameters parameters = PipelineBarrierParameters();
+        parameters.bufferMemoryBarrierCount  = 1;
+        if (_dedicatedTransfer) {
+            // Release on the transfer family. The access mask of the other family is ignored by the driver.
+            VkBufferMemoryBarrier release = BufferMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, 0, dst.GetBuffer(), 0, VK_WHOLE_SIZE, _transferFamily, _graphicsFamily);
+            parameters.commandBuffer         = batch.transferCommandBuffer;
+            parameters.srcStageMask          = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            parameters.dstStageMask          = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+            parameters.pBufferMemoryBarriers = &release;
+            PipelineBarrier(&parameters);
+
+            // Acquire on the graphics family; the wait on transferComplete makes the copy visible.
+            VkBufferMemoryBarrier acquire = BufferMemoryBarrier(0, dstAccessMask, dst.GetBuffer(), 0, VK_WHOLE_SIZE, _transferFamily, _graphicsFamily);
+            parameters.commandBuffer         = batch.graphicsCommandBuffer;
+            parameters.srcStageMask          = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            parameters.dstStageMask          = dstStageMask;
+            parameters.pBufferMemoryBarriers = &acquire;
+            PipelineBarrier(&parameters);
+        } else {
+            VkBufferMemoryBarrier barrier = BufferMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, dstAccessMask, dst.GetBuffer());
+            parameters.commandBuffer         = batch.graphicsCommandBuffer;
+            parameters.srcStageMask          = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            parameters.dstStageMask          = dstStageMask;
+            parameters.pBufferMemoryBarriers = &barrier;
+            PipelineBarrier(&parameters);
+        }
+    }
+
+    void UploadContext::UploadImage(VkImage               image,
+                                    const void*           data,
+                                    VkDeviceSize          size,
+                                    VkExtent2D            extent,
+                                    uint32_t              mipLevels,
+                                    const RecordGraphics& recordMipmaps)
+    {
+        assert(recordMipmaps || mipLevels == 1);
+        Buffer& staging = CreateStagingBuffer(data, size);
+        Batch& batch = *_recording;
+        VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+
+        PipelineBarrierParameters parameters = PipelineBarrierParameters();
+        parameters.commandBuffer             = batch.transferCommandBuffer;
+        parameters.imageMemoryBarrierCount   = 1;
+        parameters.srcStageMask              = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        parameters.dstStageMask              = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        VkImageMemoryBarrier barrier = ImageMemoryBarrier(0,
+                                                          VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                          VK_IMAGE_LAYOUT_UNDEFINED,
+                                                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                                          image,
+                                                          range);
+        parameters.pImageMemoryBarriers = &barrier;
+        PipelineBarrier(&parameters);
+
+        VkBufferImageCopy region = BufferImageCopy({ extent.width, extent.height, 1 }, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 });
+        vkCmdCopyBufferToImage(batch.transferCommandBuffer, staging.GetBuffer(), image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        // Mipmaps are blitted on the graphics queue, so the image stays in TRANSFER_DST_OPTIMAL for them. Otherwise the
+        // ownership transfer doubles as the transition to SHADER_READ_ONLY_OPTIMAL; both halves must agree on it.
+        VkImageLayout finalLayout = recordMipmaps ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        VkAccessFlags dstAccess   = recordMipmaps ? (VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT) : VK_ACCESS_SHADER_READ_BIT;
+        VkPipelineStageFlags dstStage = recordMipmaps ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        if (_dedicatedTransfer) {
+            barrier = ImageMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout,
+                                         image, range, _transferFamily, _graphicsFamily);
+            parameters.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            parameters.dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+            PipelineBarrier(&parameters);
+
+            barrier = ImageMemoryBarrier(0, dstAccess,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout,
+                                         image, range, _transferFamily, _graphicsFamily);
+            parameters.commandBuffer = batch.graphicsCommandBuffer;
+            parameters.srcStageMask  = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            parameters.dstStageMask  = dstStage;
+            PipelineBarrier(&parameters);
+        } else if (!recordMipmaps) {
+            barrier = ImageMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, dstAccess,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout,
+                                         image, range);
+            parameters.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            parameters.dstStageMask = dstStage;
+            PipelineBarrier(&parameters);
+        }
+        // Without a dedicated family the blits follow the copy in the same command buffer, and the mipmap recorder's
+        // first barrier orders them after the copy.
+        if (recordMipmaps) {
+            recordMipmaps(batch.graphicsCommandBuffer);
+        }
+    }
+
+    UploadContext::Ticket UploadContext::Flush()
+    {
+        if (!_recording) {
+            return NO_TICKET;
+        }
+        Batch& batch = *_recording;
+        _recording = nullptr;
+
+        if (_dedicatedTransfer) {
+            VK_CHECK_RESULT(vkEndCommandBuffer(batch.transferCommandBuffer));
+            VkSubmitInfo submitInfo = {};
+            submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount   = 1;
+            submitInfo.pCommandBuffers      = &batch.transferCommandBuffer;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores    = &batch.transferComplete;
+            VK_CHECK_RESULT(vkQueueSubmit(_transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+        }
+
+        VK_CHECK_RESULT(vkEndCommandBuffer(batch.graphicsCommandBuffer));
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount   = _dedicatedTransfer ? 1 : 0;
+        submitInfo.pWaitSemaphores      = &batch.transferComplete;
+        submitInfo.pWaitDstStageMask    = &waitStage;
+        submitInfo.commandBufferCount   = 1;
+        submitInfo.pCommandBuffers      = &batch.graphicsCommandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores    = &batch.graphicsComplete;
+        VK_CHECK_RESULT(vkQueueSubmit(_graphicsQueue, 1, &submitInfo, batch.fence));
+
+        DebugLog("Upload batch %llu submitted with %d staging buffers.", (unsigned long long)batch.ticket, (int)batch.stagingBuffers.size());
+        return batch.ticket;
+    }
+
+    const UploadContext::Batch* UploadContext::FindBatch(Ticket ticket) const
+    {
+        for (const auto& b : _submitted) {
+            if (b.ticket == ticket && &b != _recording) {
+                return &b;
+            }
+        }
+        return nullptr;
+    }
+
+    VkSemaphore UploadContext::TakeSemaphore(Ticket ticket, VkFence consumerFence)
+    {
+        Batch* batch = const_cast<Batch*>(FindBatch(ticket));
+        if (!batch || batch->semaphoreTaken) {
+            return VK_NULL_HANDLE;
+        }
+        batch->semaphoreTaken = true;
+        batch->consumerFence  = consumerFence;
+        return batch->graphicsComplete;
+    }
+
+    bool UploadContext::IsComplete(Ticket ticket) const
+    {
+        const Batch* batch = FindBatch(ticket);
+        if (!batch) {
+            // Already collected, or never issued.
+            return ticket != NO_TICKET && ticket < _nextTicket && !(_recording && _recording->ticket == ticket);
+        }
+        return vkGetFenceStatus(_device.LogicalDevice(), batch->fence) == VK_SUCCESS;
+    }
+
+    void UploadContext::Wait(Ticket ticket)
+    {
+        const Batch* batch = FindBatch(ticket);
+        if (batch) {
+            VK_CHECK_RESULT(vkWaitForFences(_device.LogicalDevice(), 1, &batch->fence, VK_TRUE, UINT64_MAX));
+        }
+    }
+
+    void UploadContext::Collect()
+    {
+        VkDevice d = _device.LogicalDevice();
+        while (!_submitted.empty()) {
+            Batch& b = _submitted.front();
+            if (&b == _recording || vkGetFenceStatus(d, b.fence) != VK_SUCCESS) {
+                break;
+            }
+            // The semaphore may not be destroyed while the submission waiting on it is pending.
+            if (b.semaphoreTaken && vkGetFenceStatus(d, b.consumerFence) != VK_SUCCESS) {
+                break;
+            }
+            ReleaseBatch(b);
+            _submitted.pop_front();
+        }
+    }
+
+    void UploadContext::ReleaseBatch(Batch& batch)
+    {
+        VkDevice d = _device.LogicalDevice();
+        batch.stagingBuffers.clear();
+        vkFreeCommandBuffers(d, _graphicsPool, 1, &batch.graphicsCommandBuffer);
+        if (_dedicatedTransfer) {
+            vkFreeCommandBuffers(d, _transferPool, 1, &batch.transferCommandBuffer);
+            _device.Sync().ReleaseSemaphore(batch.transferComplete), batch.transferComplete = VK_NULL_HANDLE;
+        }
+        // Nobody waited on a semaphore that was never taken, so it is still signaled and can't go back to the pool.
+        if (batch.semaphoreTaken) {
+            _device.Sync().ReleaseSemaphore(batch.graphicsComplete), batch.graphicsComplete = VK_NULL_HANDLE;
+        } else {
+            vkDestroySemaphore(d, batch.graphicsComplete, nullptr), batch.graphicsComplete = VK_NULL_HANDLE;
+        }
+        _device.Sync().ReleaseFence(batch.fence), batch.fence = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,105 @@
+﻿#ifndef VULKAN_UPLOAD_CONTEXT_H
+#define VULKAN_UPLOAD_CONTEXT_H
+
+#ifdef __ANDROID__
+#include "vulkan_wrapper.h"
+#endif
+#include "device.h"
+#include "buffer.h"
+#include <deque>
+#include <functional>
+#include <vector>
+
+using std::deque;
+using std::function;
+using std::vector;
+
+namespace Vulkan
+{
+    // Streams data to device local buffers and images without blocking the CPU. Copies are recorded on the dedicated
+    // transfer queue family when the device has one, and ownership is then released to the graphics family; the
+    // acquire half, and anything that needs the graphics queue (mipmap blits), is recorded into a graphics command
+    // buffer that waits on the transfer submission. Without a dedicated family everything goes into the graphics
+    // command buffer.
+    //
+    // Uploads are batched until Flush(), which submits and returns a ticket. The caller either waits on the semaphore
+    // taken with TakeSemaphore() in the submission that first uses the data, or polls/waits on the ticket. Staging
+    // memory is released by Collect() once a batch has completed. Not thread safe.
+    class UploadContext {
+    public:
+        typedef uint64_t Ticket;
+        static const Ticket NO_TICKET = 0;
+
+        typedef function<void(VkCommandBuffer graphicsCommandBuffer)> RecordGraphics;
+
+        UploadContext(const Device& device);
+        ~UploadContext();
+
+        // dst must have TRANSFER_DST usage. dstStageMask and dstAccessMask describe the first use of dst.
+        void UploadBuffer(const Buffer&        dst,
+                          const void*          data,
+                          VkDeviceSize         size,
+                          VkPipelineStageFlags dstStageMask,
+                          VkAccessFlags        dstAccessMask);
+
+        // Copies data into mip 0 of a 2D color image. All mip levels are left in TRANSFER_DST_OPTIMAL and handed to
+        // recordMipmaps on the graphics queue, which must move them to their final layout. Without recordMipmaps the
+        // image must have one mip level and ends up in SHADER_READ_ONLY_OPTIMAL.
+        void UploadImage(VkImage               image,
+                         const void*           data,
+                         VkDeviceSize          size,
+                         VkExtent2D            extent,
+                         uint32_t              mipLevels,
+                         const RecordGraphics& recordMipmaps = nullptr);
+
+        // Submits everything recorded since the last Flush(). Returns NO_TICKET when nothing was recorded.
+        Ticket Flush();
+
+        // Semaphore signaled when the ticket's batch is complete on the graphics queue. Each semaphore can be taken
+        // once, to be waited on by exactly one graphics queue submission; later calls return VK_NULL_HANDLE. The batch
+        // is not collected before consumerFence, signaled by that submission or a later one, has been seen signaled.
+        VkSemaphore TakeSemaphore(Ticket ticket, VkFence consumerFence);
+        bool IsComplete(Ticket ticket) const;
+        void Wait(Ticket ticket);
+
+        // Frees staging buffers and command buffers of completed batches. Batches are released in order, so with consumer
+        // fences that are reset and reused, call it after waiting on such a fence and before resetting it.
+        void Collect();
+
+        bool UsesDedicatedTransferQueue() const { return _dedicatedTransfer; }
+
+    private:
+        typedef struct Batch {
+            Ticket          ticket;
+            VkCommandBuffer transferCommandBuffer;
+            VkCommandBuffer graphicsCommandBuffer;
+            VkSemaphore     transferComplete;
+            VkSemaphore     graphicsComplete;
+            bool            semaphoreTaken;
+            VkFence         consumerFence;
+            VkFence         fence;
+            vector<Buffer>  stagingBuffers;
+        } Batch;
+
+        Batch& OpenBatch();
+        Buffer& CreateStagingBuffer(const void* data, VkDeviceSize size);
+        const Batch* FindBatch(Ticket ticket) const;
+        void ReleaseBatch(Batch& batch);
+
+        const Device& _device;
+        bool          _dedicatedTransfer;
+        uint32_t      _transferFamily;
+        uint32_t      _graphicsFamily;
+        VkQueue       _transferQueue;
+        VkQueue       _graphicsQueue;
+        VkCommandPool _transferPool = VK_NULL_HANDLE;
+        VkCommandPool _graphicsPool = VK_NULL_HANDLE;
+
+        // Submitted batches, oldest first; the batch being recorded, if any, is _recording.
+        deque<Batch> _submitted;
+        Batch*       _recording  = nullptr;
+        Ticket       _nextTicket = 1;
+    };
+}
+
+#endif // VULKAN_UPLOAD_CONTEXT_H
@@ -1,5 +1,7 @@
 ﻿#include "vulkan_utility.h"
 #include "device.h"
+#include <algorithm>
+#include <cstring>
 #include <string>
 
 using Vulkan::Device;
@@ -8,7 +10,12 @@ using std::vector;
 // ==== Instance ==== //
 bool BuildInstance(Instance& instance, LayerAndExtension& layerAndExtension, vector<const char*> requestedInstanceExtensionNames, vector<const char*> requestedInstanceLayerNames)
 {
-    AppendInstanceExtension(requestedInstanceExtensionNames);
+    // The platform's surface extension comes with VK_KHR_surface; offscreen renderers request neither.
+    auto surface = std::find_if(requestedInstanceExtensionNames.begin(), requestedInstanceExtensionNames.end(),
+                                [](const char* name) { return !strcmp(name, VK_KHR_SURFACE_EXTENSION_NAME); });
+    if (surface != requestedInstanceExtensionNames.end()) {
+        AppendInstanceExtension(requestedInstanceExtensionNames);
+    }
 
     if (layerAndExtension.enableValidationLayers) {
         requestedInstanceExtensionNames.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
@@ -32,7 +39,7 @@ bool BuildInstance(Instance& instance, LayerAndExtension& layerAndExtension, vec
 // ==== Device ==== //
 static bool DeviceFeaturesCompare(const VkPhysicalDeviceFeatures& requested, const VkPhysicalDeviceFeatures& supported);
 
-Device SelectPhysicalDevice(const Instance& instance, Surface& surface, vector<const char*> extensionNamesRequested, VkQueueFlags queuesRequested, VkPhysicalDeviceFeatures requestedFeatures)
+static Device FindPhysicalDevice(const Instance& instance, Surface* surface, const vector<const char*>& extensionNamesRequested, VkQueueFlags queuesRequested, const VkPhysicalDeviceFeatures& requestedFeatures)
 {
     // Find one GPU to use:
     // On Android, every GPU device is equal -- supporting
@@ -55,18 +62,28 @@ Device SelectPhysicalDevice(const Instance& instance, Surface& surface, vector<c
     throw runtime_error("Could not find suitable physical device.");
 }
 
+Device SelectPhysicalDevice(const Instance& instance, Surface& surface, vector<const char*> extensionNamesRequested, VkQueueFlags queuesRequested, VkPhysicalDeviceFeatures requestedFeatures)
+{
+    return FindPhysicalDevice(instance, &surface, extensionNamesRequested, queuesRequested, requestedFeatures);
+}
+
+Device SelectOffscreenPhysicalDevice(const Instance& instance, vector<const char*> extensionNamesRequested, VkQueueFlags queuesRequested, VkPhysicalDeviceFeatures requestedFeatures)
+{
+    return FindPhysicalDevice(instance, nullptr, extensionNamesRequested, queuesRequested, requestedFeatures);
+}
+
 bool IsPhysicalDeviceSuitable(Device&                         device,
                               VkQueueFlags                    queuesRequested,
                               const vector<const char*>&      deviceExtensionNamesRequested,
                               const VkPhysicalDeviceFeatures& featuresRequested,
-                              Surface&                        surface,
+                              Surface*                        surface,
                               bool                            needPresent)
 {
     // Check Requested Queues
     VkPhysicalDevice physicalDevice = device.PhysicalDevice();
     VkQueueFlags queueFound = 0;
     if (queuesRequested & VK_QUEUE_GRAPHICS_BIT) {
-        if (device.GetQueueFamilyIndex(VK_QUEUE_GRAPHICS_BIT, surface.GetSurface()) != -1) {
+        if (device.GetQueueFamilyIndex(VK_QUEUE_GRAPHICS_BIT, surface ? surface->GetSurface() : VK_NULL_HANDLE) != -1) {
             queueFound = (queueFound | VK_QUEUE_GRAPHICS_BIT);
         }
     }
@@ -98,9 +115,11 @@ bool IsPhysicalDeviceSuitable(Device&                         device,
     }
 
     // Check Surface Capabilities
-    Surface::SurfaceSupportInfo supportInfo = surface.QuerySurfaceSupport(physicalDevice);
-    if (supportInfo.formats.empty() || supportInfo.presentModes.empty()) {
-        return false;
+    if (surface) {
+        Surface::SurfaceSupportInfo supportInfo = surface->QuerySurfaceSupport(physicalDevice);
+        if (supportInfo.formats.empty() || supportInfo.presentModes.empty()) {
+            return false;
+        }
     }
 
     // Check Physical Device Features
@@ -186,6 +205,18 @@ uint32_t MapMemoryTypeToIndex(VkPhysicalDevice physicalDevice, uint32_t memoryTy
     throw runtime_error(string("Cannot find requested properties: " + std::to_string(requestedProperties)).data());
 }
 
+bool FindMemoryTypeIndex(const Device& device, uint32_t memoryTypeBits, VkMemoryPropertyFlags requestedProperties, uint32_t& memoryTypeIndex)
+{
+    const VkPhysicalDeviceMemoryProperties& memoryProperties = device.MemoryProperties();
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & requestedProperties) == requestedProperties) {
+            memoryTypeIndex = i;
+            return true;
+        }
+    }
+    return false;
+}
+
 VkFormat FindDeviceSupportedFormat(const vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features, const VkPhysicalDevice physicalDevice)
 {
     for (VkFormat format : candidates) {
@@ -458,6 +489,29 @@ VkSemaphore CreateSemaphore(VkDevice device, VkSemaphoreCreateFlags flags, const
 //    return deviceMemory;
 //}
 
+VkBufferMemoryBarrier BufferMemoryBarrier(VkAccessFlags srcAccessMask,
+                                          VkAccessFlags dstAccessMask,
+                                          VkBuffer      buffer,
+
+                                          VkDeviceSize  offset,
+                                          VkDeviceSize  size,
+                                          uint32_t      srcQueueFamilyIndex,
+                                          uint32_t      dstQueueFamilyIndex,
+                                          const void*   pNext)
+{
+    VkBufferMemoryBarrier bufferMemoryBarrier = {};
+    bufferMemoryBarrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferMemoryBarrier.pNext               = pNext;
+    bufferMemoryBarrier.srcAccessMask       = srcAccessMask;
+    bufferMemoryBarrier.dstAccessMask       = dstAccessMask;
+    bufferMemoryBarrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+    bufferMemoryBarrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+    bufferMemoryBarrier.buffer              = buffer;
+    bufferMemoryBarrier.offset              = offset;
+    bufferMemoryBarrier.size                = size;
+    return bufferMemoryBarrier;
+}
+
 //void CreateDepthBuffer(SwapchainInfo &swapchainInfo, const DeviceInfo &deviceInfo, CommandInfo &commandInfo)
 //{
 //    VkFormat depthFormat = FindSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
@@ -51,13 +51,19 @@ bool BuildInstance(Instance& instance,
 
 // ==== Device ==== //
 Device SelectPhysicalDevice(const Instance& instance, Surface& surface, vector<const char*> extensionNamesRequested = { VK_KHR_SWAPCHAIN_EXTENSION_NAME }, VkQueueFlags queuesRequested = (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT), VkPhysicalDeviceFeatures requestedFeatures = {});
+// For an offscreen swapchain: no surface to present to, the graphics queue family stands in for the present one.
+Device SelectOffscreenPhysicalDevice(const Instance& instance, vector<const char*> extensionNamesRequested = { VK_KHR_SWAPCHAIN_EXTENSION_NAME }, VkQueueFlags queuesRequested = (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT), VkPhysicalDeviceFeatures requestedFeatures = {});
+// Without a surface the surface's support is not checked.
 bool IsPhysicalDeviceSuitable(Device&                         device,
                               VkQueueFlags                    queuesRequested,
                               const vector<const char*>&      deviceExtensionNamesRequested,
                               const VkPhysicalDeviceFeatures& featuresRequested,
-                              Surface&                        surface,
+                              Surface*                        surface,
                               bool                            needPresent = true);
 uint32_t MapMemoryTypeToIndex(VkPhysicalDevice physicalDevice, uint32_t memoryTypeBits, VkMemoryPropertyFlags requestedProperties);
+// Like MapMemoryTypeToIndex(), from the device's cached memory properties, for callers with a fallback: returns false
+// instead of throwing when no memory type has the requested properties.
+bool FindMemoryTypeIndex(const Device& device, uint32_t memoryTypeBits, VkMemoryPropertyFlags requestedProperties, uint32_t& memoryTypeIndex);
 VkFormat FindDeviceSupportedFormat(const vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features, const VkPhysicalDevice physicalDevice);
 
 
@@ -169,6 +175,15 @@ VkSemaphore CreateSemaphore(VkDevice device, VkSemaphoreCreateFlags flags = 0, c
 //
 //                                     const void*           pNext,
 //                                     VkMemoryRequirements* memoryRequirements);
+VkBufferMemoryBarrier BufferMemoryBarrier(VkAccessFlags srcAccessMask,
+                                          VkAccessFlags dstAccessMask,
+                                          VkBuffer      buffer,
+
+                                          VkDeviceSize  offset              = 0,
+                                          VkDeviceSize  size                = VK_WHOLE_SIZE,
+                                          uint32_t      srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                          uint32_t      dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                          const void*   pNext               = nullptr);
 
 
 // ==== Image ==== //
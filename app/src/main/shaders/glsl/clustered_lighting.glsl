@@ -0,0 +1,74 @@
+// Clustered point and spot lights shared by the eye fragment shaders. Define LIGHTING_SET as the descriptor set of
+// the lights before including; the includer declares worldPosition and eye.
+#ifndef LIGHTING_SET
+#error LIGHTING_SET must be defined before including clustered_lighting.glsl
+#endif
+
+struct Light {
+    vec4 positionRange;
+    vec4 directionCosine;
+    vec4 color;
+};
+
+struct Eye {
+    mat4 view;
+    mat4 projection;
+    mat4 inverseProjection;
+    vec4 camera;
+};
+
+// Clustered lights: the fragment's cluster lists the lights that may reach it.
+layout(set = LIGHTING_SET, binding = 0) uniform Lighting {
+    Eye   eyes[2];
+    vec4  depth;
+    uvec4 grid;
+    vec4  ambient;
+    vec4  specular;
+} lighting;
+
+layout(std430, set = LIGHTING_SET, binding = 1) readonly buffer Lights {
+    Light lights[];
+};
+
+layout(std430, set = LIGHTING_SET, binding = 2) readonly buffer Clusters {
+    uvec2 ranges[];
+};
+
+layout(std430, set = LIGHTING_SET, binding = 3) readonly buffer LightIndices {
+    uint indexCount;
+    uint indices[];
+};
+
+vec3 Shade(vec3 albedo)
+{
+    // The cluster as Culling::LightClusters numbers them: the screen tile, then the slice of log view depth.
+    vec4 viewPosition = lighting.eyes[eye].view * vec4(worldPosition, 1.0);
+    vec4 clip = lighting.eyes[eye].projection * viewPosition;
+    vec2 tile = clamp(floor((clip.xy / clip.w * 0.5 + 0.5) * vec2(lighting.grid.xy)), vec2(0.0), vec2(lighting.grid.xy) - 1.0);
+    float slice = clamp(floor(log(-viewPosition.z / lighting.depth.x) * lighting.depth.y), 0.0, float(lighting.grid.z) - 1.0);
+    uint clusters = lighting.grid.x * lighting.grid.y * lighting.grid.z;
+    uvec2 range = ranges[eye * clusters + (uint(slice) * lighting.grid.y + uint(tile.y)) * lighting.grid.x + uint(tile.x)];
+
+    // Flat shaded from the surface's slope, facing the camera.
+    vec3 toCamera = normalize(lighting.eyes[eye].camera.xyz - worldPosition);
+    vec3 normal = normalize(cross(dFdx(worldPosition), dFdy(worldPosition)));
+    normal = dot(normal, toCamera) < 0.0 ? -normal : normal;
+
+    vec3 diffuse = vec3(0.0), specular = vec3(0.0);
+    for (uint i = range.x; i < range.x + range.y; i++) {
+        Light light = lights[indices[i]];
+        vec3 toLight = light.positionRange.xyz - worldPosition;
+        float d = length(toLight);
+        vec3 l = toLight / max(d, 1e-4);
+        // Inverse square, windowed to reach zero at the range; spot lights fade out over the cone's edge.
+        float window = clamp(1.0 - d * d / (light.positionRange.w * light.positionRange.w), 0.0, 1.0);
+        float attenuation = window * window / (1.0 + d * d);
+        attenuation *= smoothstep(light.directionCosine.w, light.directionCosine.w + 0.05, dot(-l, light.directionCosine.xyz));
+        float lambert = max(dot(normal, l), 0.0);
+        diffuse += light.color.rgb * attenuation * lambert;
+        if (lambert > 0.0) {
+            specular += light.color.rgb * attenuation * pow(max(dot(normal, normalize(l + toCamera)), 0.0), lighting.specular.w);
+        }
+    }
+    return albedo * (lighting.ambient.rgb + diffuse) + specular * lighting.specular.rgb;
+}
\ No newline at end of file
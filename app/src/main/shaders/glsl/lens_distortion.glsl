@@ -0,0 +1,16 @@
+// The distortion pass' lens distortion, p * (1 + k1 * |p|^2) in normalized device coordinates, for eyes rendered
+// straight into the swapchain image; k1 is zero when the distortion pass applies it. |p|^2 stops growing at the screen
+// corners, which keeps vertices beyond them outside.
+//
+// Per vertex this only approximates the distortion pass, which resamples the resolved eye: edges between vertices stay
+// straight instead of bending, texture coordinates and lighting are interpolated undistorted, and vertices at or behind
+// the eye (w <= 0) are left undistorted. The error grows with the triangles' screen size and towards the edges.
+vec4 Distort(vec4 position, float k1)
+{
+    if (k1 == 0.0 || position.w <= 0.0) {
+        return position;
+    }
+    vec2 p = position.xy / position.w;
+    float r2 = min(dot(p, p), 2.0);
+    return vec4(position.xy * (1.0 + k1 * r2), position.zw);
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 440
+#extension GL_GOOGLE_include_directive : require
+
+layout(binding = 0) uniform ModelTransform {
+    mat4 model;
+} modelTransform;
+
+layout(binding = 1) uniform ViewProjectionTransform {
+    mat4 view;
+    mat4 projection;
+} dynamicVP;
+
+layout(location = 0) in vec3 inPosition;
+// Per instance, relative to the model transform: the rows of a 3x4 matrix. Locations 11 to 13 hold the normal matrix.
+layout(location = 8) in vec4 instanceRows[3];
+
+layout(push_constant) uniform Draw {
+    layout(offset = 8) float lensDistortion;
+} draw;
+
+#include "../glsl/lens_distortion.glsl"
+
+// The shading pass tests for equal depth, so both passes must compute positions bit for bit alike.
+invariant gl_Position;
+
+void main()
+{
+    vec4 vertex = vec4(inPosition, 1.0);
+    vec4 position = vec4(dot(instanceRows[0], vertex), dot(instanceRows[1], vertex), dot(instanceRows[2], vertex), 1.0);
+    gl_Position = Distort(dynamicVP.projection * dynamicVP.view * modelTransform.model * position, draw.lensDistortion);
+}
\ No newline at end of file
@@ -2,11 +2,33 @@
 
 layout (binding = 0) uniform sampler2D resolvedView;
 
+// Per axis, where the full density center of the eye buffer ends in eye space and the share of the buffer each
+// reduced density band around it takes. A center of 1 means the buffer has a single region. Only the top left part of
+// the buffer given by scale is rendered to.
+layout(push_constant) uniform Distortion {
+    vec4 remap;
+    float k1;
+    float scale;
+} distortion;
+
 layout (location = 0) in vec2 inUV;
 layout (location = 0) out vec4 outColor;
 
+float Remap(float p, float center, float band)
+{
+    if (p < -center) {
+        return (p + 1.0) / (1.0 - center) * band;
+    }
+    if (p > center) {
+        return 1.0 - (1.0 - p) / (1.0 - center) * band;
+    }
+    return band + (p + center) / (2.0 * center) * (1.0 - 2.0 * band);
+}
+
 void main()
 {
-    vec2 uv = (inUV.xy + vec2(1.0, 1.0)) / 2.0;
+    vec2 uv = vec2(Remap(inUV.x, distortion.remap.x, distortion.remap.y), Remap(inUV.y, distortion.remap.z, distortion.remap.w));
+    // Keep the filter from reaching past the rendered part.
+    uv = min(uv * distortion.scale, vec2(distortion.scale) - 0.5 / vec2(textureSize(resolvedView, 0)));
 	outColor = vec4((texture(resolvedView, uv)).rgb, 1.0);
 }
\ No newline at end of file
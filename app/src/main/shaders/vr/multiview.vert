@@ -4,6 +4,12 @@ layout(location = 0) in vec3 inPosition;
 
 layout (location = 0) out vec2 outUV;
 
+layout(push_constant) uniform Distortion {
+    vec4 remap;
+    float k1;
+    float scale;
+} distortion;
+
 out gl_PerVertex
 {
 	vec4 gl_Position;
@@ -12,7 +18,7 @@ out gl_PerVertex
 void main()
 {
     outUV = inPosition.xy;
-	float K1 = -0.046875;
+	float K1 = distortion.k1;
 	//float K2 = 0;
 	float r2 = dot(inPosition.xy, inPosition.xy);
 	//float r4 = r2 * r2;
@@ -1,4 +1,5 @@
 #version 440
+#extension GL_GOOGLE_include_directive : require
 
 layout(location = 0) in VS_OUT {
     vec2 texCoords;
@@ -6,9 +7,15 @@ layout(location = 0) in VS_OUT {
 
 layout(binding = 2) uniform sampler2D texSampler;
 
+layout(location = 2) in vec3 worldPosition;
+layout(location = 3) flat in uint eye;
+
+#define LIGHTING_SET 1
+#include "../glsl/clustered_lighting.glsl"
+
 layout(location = 0) out vec4 outColor;
 
 void main()
 {
-    outColor = vec4(texture(texSampler, fs_in.texCoords).rgb, 1.0);
+    outColor = vec4(Shade(texture(texSampler, fs_in.texCoords).rgb), 1.0);
 }
\ No newline at end of file
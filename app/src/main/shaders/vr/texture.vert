@@ -1,4 +1,5 @@
 #version 440
+#extension GL_GOOGLE_include_directive : require
 
 layout(binding = 0) uniform ModelTransform {
     mat4 model;
@@ -11,15 +12,38 @@ layout(binding = 1) uniform ViewProjectionTransform {
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inTexCoord;
+// Per instance, relative to the model transform: the rows of a 3x4 matrix. Locations 11 to 13 hold the normal matrix.
+layout(location = 8) in vec4 instanceRows[3];
 
 layout(location = 0) out VS_OUT {
     vec2 texCoords;
 } vs_out;
 
+// Set by indirect draws, which put the texture index in the first instance.
+layout(location = 1) flat out uint textureIndex;
+
+// For the clustered lights, which are looked up per eye.
+layout(location = 2) out vec3 worldPosition;
+layout(location = 3) flat out uint eye;
+
+layout(push_constant) uniform Draw {
+    layout(offset = 4) uint eye;
+    float lensDistortion;
+} draw;
+
+#include "../glsl/lens_distortion.glsl"
+
+// Matches the depth pre-pass exactly, which the shading pass tests for equal depth against.
+invariant gl_Position;
+
 void main()
 {
-    vec4 position = vec4(inPosition, 1.0);
-    gl_Position = dynamicVP.projection * dynamicVP.view * modelTransform.model * position;
+    vec4 vertex = vec4(inPosition, 1.0);
+    vec4 position = vec4(dot(instanceRows[0], vertex), dot(instanceRows[1], vertex), dot(instanceRows[2], vertex), 1.0);
+    gl_Position = Distort(dynamicVP.projection * dynamicVP.view * modelTransform.model * position, draw.lensDistortion);
 
     vs_out.texCoords = inTexCoord;
+    textureIndex = gl_InstanceIndex;
+    worldPosition = (modelTransform.model * position).xyz;
+    eye = draw.eye;
 }
\ No newline at end of file
@@ -0,0 +1,26 @@
+#version 440
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in VS_OUT {
+    vec2 texCoords;
+} fs_in;
+
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(push_constant) uniform Material {
+    uint textureIndex;
+} material;
+
+layout(location = 2) in vec3 worldPosition;
+layout(location = 3) flat in uint eye;
+
+#define LIGHTING_SET 2
+#include "../glsl/clustered_lighting.glsl"
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    outColor = vec4(Shade(texture(textures[material.textureIndex], fs_in.texCoords).rgb), 1.0);
+}
\ No newline at end of file